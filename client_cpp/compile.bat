@@ -10,19 +10,31 @@ echo.
 
 if not exist "out" mkdir out
 
+REM Sources shared by every executable
+set COMMON=src\protocol.cpp src\endian.cpp src\metrics.cpp src\net.cpp src\rto.cpp src\ring.cpp src\flow.cpp src\impair.cpp src\trace.cpp src\compact.cpp src\lz.cpp src\pipeline.cpp src\batcher.cpp src\runtime.cpp
+
+REM Coroutine session driver (coro.hpp needs C++20)
+set COROUTINE=src\protocol.cpp src\endian.cpp src\metrics.cpp src\net.cpp src\rto.cpp src\ring.cpp src\flow.cpp src\impair.cpp src\trace.cpp src\compact.cpp src\lz.cpp src\pipeline.cpp src\coro.cpp src\sessions.cpp
+
+REM Byte-swap kernels default to SSE2 on x64; add -mssse3 (g++) or /arch:AVX (cl)
+REM for the faster SSSE3 shuffle, or -DBANK_NO_SIMD for the scalar loop
+
 REM Try g++ first (MinGW)
 echo Checking for g++ compiler...
 g++ --version >nul 2>&1
 if %errorlevel% equ 0 (
     echo Found g++ compiler
     echo Compiling with g++...
-    g++ -std=c++17 -O2 -o out\client.exe src\protocol.cpp src\client.cpp src\main.cpp -lws2_32
-    if %errorlevel% neq 0 (
-        echo.
-        echo ERROR: Compilation failed!
-        echo Please check the error messages above.
-        exit /b 1
-    )
+    g++ -std=c++17 -O2 -pthread -o out\client.exe %COMMON% src\snapshot.cpp src\balance_cache.cpp src\callback_bus.cpp src\token_cache.cpp src\client.cpp src\script.cpp src\main.cpp -lws2_32
+    if errorlevel 1 goto failed
+    g++ -std=c++17 -O2 -pthread -o out\loadgen.exe %COMMON% src\snapshot.cpp src\loadgen.cpp -lws2_32
+    if errorlevel 1 goto failed
+    g++ -std=c++17 -O2 -pthread -o out\replay.exe %COMMON% src\replay.cpp -lws2_32
+    if errorlevel 1 goto failed
+    g++ -std=c++17 -O2 -o out\bench_codec.exe src\protocol.cpp src\endian.cpp src\compact.cpp src\lz.cpp src\bench_codec.cpp
+    if errorlevel 1 goto failed
+    g++ -std=c++20 -O2 -pthread -o out\sessions.exe %COROUTINE% -lws2_32
+    if errorlevel 1 goto failed
     goto success
 )
 
@@ -32,13 +44,16 @@ cl >nul 2>&1
 if %errorlevel% equ 0 (
     echo Found cl.exe compiler
     echo Compiling with cl.exe...
-    cl /EHsc /O2 /Fe:out\client.exe src\protocol.cpp src\client.cpp src\main.cpp ws2_32.lib
-    if %errorlevel% neq 0 (
-        echo.
-        echo ERROR: Compilation failed!
-        echo Please check the error messages above.
-        exit /b 1
-    )
+    cl /EHsc /O2 /std:c++17 /Fe:out\client.exe %COMMON% src\snapshot.cpp src\balance_cache.cpp src\callback_bus.cpp src\token_cache.cpp src\client.cpp src\script.cpp src\main.cpp ws2_32.lib
+    if errorlevel 1 goto failed
+    cl /EHsc /O2 /std:c++17 /Fe:out\loadgen.exe %COMMON% src\snapshot.cpp src\loadgen.cpp ws2_32.lib
+    if errorlevel 1 goto failed
+    cl /EHsc /O2 /std:c++17 /Fe:out\replay.exe %COMMON% src\replay.cpp ws2_32.lib
+    if errorlevel 1 goto failed
+    cl /EHsc /O2 /std:c++17 /Fe:out\bench_codec.exe src\protocol.cpp src\endian.cpp src\compact.cpp src\lz.cpp src\bench_codec.cpp
+    if errorlevel 1 goto failed
+    cl /EHsc /O2 /std:c++20 /Fe:out\sessions.exe %COROUTINE% ws2_32.lib
+    if errorlevel 1 goto failed
     goto success
 )
 
@@ -54,6 +69,12 @@ echo To check if cl.exe is available, run: cl
 echo.
 exit /b 1
 
+:failed
+echo.
+echo ERROR: Compilation failed!
+echo Please check the error messages above.
+exit /b 1
+
 :success
 echo.
 echo ========================================
@@ -61,6 +82,10 @@ echo   Compilation successful!
 echo ========================================
 echo.
 echo Executable created: out\client.exe
+echo Executable created: out\loadgen.exe
+echo Executable created: out\replay.exe
+echo Executable created: out\bench_codec.exe
+echo Executable created: out\sessions.exe
 echo.
 echo To run the client:
 echo   run.bat --server 127.0.0.1 --port 9000
@@ -71,4 +96,34 @@ echo   --port ^<port^>      Server port (default: 9000)
 echo   --sem ^<semantic^>   atmost or atleast (default: atmost)
 echo   --timeout ^<ms^>     Timeout in milliseconds (default: 500)
 echo   --retry ^<count^>    Retry count (default: 5)
+echo   --servers ^<list^>   Several servers ip:port,ip:port,... routed by account holder
+echo   --rate-limit ^<n^>   Datagrams per second, retransmissions included
+echo   --max-inflight ^<n^> Adaptive cap on requests in flight
+echo   --breaker ^<n^>      Fail fast after n timeouts in a row
+echo   --trace ^<file^>     Capture all traffic to a binary trace
+echo   --compact          Compact bodies: varints, amounts in cents (C++ server only)
+echo   --lz               LZ4-compress batches and snapshots (C++ server only)
+echo   --tokens           Log in once per account, then send session tokens (C++ server, one server)
+echo   --drop-send ^<p^>    Drop outgoing datagrams with probability p (testing)
+echo   --drop-recv ^<p^>    Drop incoming datagrams with probability p (testing)
+echo   --delay ^<ms^>       Hold back incoming datagrams (testing)
+echo   --jitter ^<ms^>      Uniform spread around --delay (testing)
+echo.
+echo To replay an operation file without the menu:
+echo   out\client.exe --script ops.txt --out results.txt --concurrency 64
+echo.
+echo To run the load generator:
+echo   out\loadgen.exe --server 127.0.0.1 --port 9000 --mix deposit=4,query=4 --concurrency 64 --duration 10
+echo.
+echo To check a SNAPSHOT of every balance after a load run (server started with --allow-scan):
+echo   out\loadgen.exe --server 127.0.0.1 --port 9000 --accounts 100000 --snapshot
+echo.
+echo To replay a captured trace and diff the statuses:
+echo   out\replay.exe --trace run.trace --server 127.0.0.1 --port 9000 --speed 1
+echo.
+echo To run thousands of coroutine sessions on one thread:
+echo   out\sessions.exe --server 127.0.0.1 --port 9000 --sessions 5000 --duration 10
+echo.
+echo To benchmark the protocol codec:
+echo   out\bench_codec.exe --filter deposit
 echo.
@@ -0,0 +1,87 @@
+#include "balance_cache.hpp"
+#include <algorithm>
+
+BalanceCache::BalanceCache(std::chrono::milliseconds ttl, std::chrono::milliseconds monitoredTtl)
+    : ttl_(ttl), monitoredTtl_(monitoredTtl < ttl ? ttl : monitoredTtl) {}
+
+uint64_t BalanceCache::hashCredentials(const std::string& name, const std::string& password) {
+    // FNV-1a over "name\0password"; only ever compared, never sent
+    uint64_t h = 0xcbf29ce484222325ULL;
+    auto mix = [&h](unsigned char c) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    };
+    for (unsigned char c : name) mix(c);
+    mix(0);
+    for (unsigned char c : password) mix(c);
+    return h;
+}
+
+bool BalanceCache::lookup(int32_t accNo, const std::string& name, const std::string& password,
+                          uint16_t& currency, double& balance, Clock::duration* age) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(accNo);
+    if (it == entries_.end() || it->second.credentials != hashCredentials(name, password)) {
+        stats_.misses++;
+        return false;
+    }
+
+    Clock::time_point now = Clock::now();
+    // Only a watched account gets every update
+    const bool watched = now < monitorUntil_ &&
+                         (watched_.empty() || std::binary_search(watched_.begin(), watched_.end(), accNo));
+    Clock::duration limit = watched ? Clock::duration(monitoredTtl_) : Clock::duration(ttl_);
+    if (now - it->second.refreshed > limit) {
+        entries_.erase(it);
+        stats_.misses++;
+        return false;
+    }
+
+    currency = it->second.currency;
+    balance = it->second.balance;
+    if (age) *age = now - it->second.refreshed;
+    stats_.hits++;
+    return true;
+}
+
+void BalanceCache::put(int32_t accNo, const std::string& name, const std::string& password,
+                       uint16_t currency, double balance) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry& e = entries_[accNo];
+    e.credentials = hashCredentials(name, password);
+    e.currency = currency;
+    e.balance = balance;
+    e.refreshed = Clock::now();
+}
+
+void BalanceCache::update(int32_t accNo, uint16_t currency, double balance) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(accNo);
+    if (it == entries_.end()) return;
+    it->second.currency = currency;
+    it->second.balance = balance;
+    it->second.refreshed = Clock::now();
+    stats_.updates++;
+}
+
+void BalanceCache::erase(int32_t accNo) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.erase(accNo);
+}
+
+void BalanceCache::setMonitorUntil(Clock::time_point t, std::vector<int32_t> accounts) {
+    std::sort(accounts.begin(), accounts.end());
+    std::lock_guard<std::mutex> lock(mutex_);
+    monitorUntil_ = t;
+    watched_ = std::move(accounts);
+}
+
+bool BalanceCache::monitorLive() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return Clock::now() < monitorUntil_;
+}
+
+BalanceCache::Stats BalanceCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
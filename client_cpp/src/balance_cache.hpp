@@ -0,0 +1,93 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Client-side QUERY_BALANCE cache keyed by account number
+ *
+ * Entries are created only from replies the server has authenticated
+ * (OPEN, DEPOSIT, WITHDRAW, QUERY_BALANCE, TRANSFER source account), and
+ * remember a hash of the name/password pair that was accepted; a lookup
+ * is served only for the same credentials, so the cache never answers a
+ * query the server would have rejected for a different caller.
+ *
+ * CALLBACK_UPDATE notifications refresh the balance of existing entries.
+ * While a monitor registration is live every update to the accounts it
+ * watches reaches the client, so such an entry stays usable for
+ * monitoredTtl since its last refresh; any other entry expires after ttl
+ * (bounded staleness either way, since a callback datagram can be lost).
+ *
+ * Thread-safe: callbacks are applied on the dispatch thread while the
+ * menu thread looks balances up.
+ */
+class BalanceCache {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t updates = 0;  // refreshes from callbacks and TRANSFER targets
+    };
+
+    /**
+     * Constructor
+     * @param ttl Lifetime of an entry when no monitor is live
+     * @param monitoredTtl Lifetime of an entry while a monitor is live
+     */
+    BalanceCache(std::chrono::milliseconds ttl, std::chrono::milliseconds monitoredTtl);
+
+    /**
+     * Look up a balance for the given credentials
+     * @param age Optional output: time since the entry was last refreshed
+     * @return true on a fresh hit
+     */
+    bool lookup(int32_t accNo, const std::string& name, const std::string& password,
+                uint16_t& currency, double& balance, Clock::duration* age = nullptr);
+
+    /**
+     * Store a balance the server returned for an authenticated request
+     */
+    void put(int32_t accNo, const std::string& name, const std::string& password,
+             uint16_t currency, double balance);
+
+    /**
+     * Refresh the balance of an existing entry (callbacks, TRANSFER target)
+     */
+    void update(int32_t accNo, uint16_t currency, double balance);
+
+    // Drop an entry (account closed)
+    void erase(int32_t accNo);
+
+    /**
+     * Monitor registration as granted by the server; replaces the previous one
+     * @param accounts Accounts it watches, empty = all
+     */
+    void setMonitorUntil(Clock::time_point t, std::vector<int32_t> accounts = {});
+    bool monitorLive() const;
+
+    Stats stats() const;
+
+private:
+    struct Entry {
+        uint64_t credentials;  // hash of name + password
+        uint16_t currency;
+        double balance;
+        Clock::time_point refreshed;
+    };
+
+    mutable std::mutex mutex_;
+    std::chrono::milliseconds ttl_;
+    std::chrono::milliseconds monitoredTtl_;
+    Clock::time_point monitorUntil_;
+    std::vector<int32_t> watched_;  // sorted; empty = all
+    std::unordered_map<int32_t, Entry> entries_;
+    Stats stats_;
+
+    static uint64_t hashCredentials(const std::string& name, const std::string& password);
+};
@@ -0,0 +1,160 @@
+#include "batcher.hpp"
+#include "compact.hpp"
+#include "schema.hpp"
+#include <algorithm>
+#include <cstring>
+
+Batcher::Batcher(Pipeline& pipe, int maxOps, std::chrono::microseconds window)
+    : pipe_(pipe), maxOps_(std::max(2, maxOps)), window_(window), open_(-1),
+      batchReplies_(0), subCompletions_(0), compact_(false) {}
+
+void Batcher::openBatch() {
+    if (freeBatches_.empty()) {
+        batches_.emplace_back();
+        batches_.back().subs.reserve(maxOps_);
+        open_ = (int)batches_.size() - 1;
+    } else {
+        open_ = freeBatches_.back();
+        freeBatches_.pop_back();
+    }
+    Batch& b = batches_[open_];
+    b.subs.clear();
+    b.len = 2;  // count field
+    b.packed = proto::schema::varintSize(uint64_t(maxOps_));
+    b.wide = false;
+    b.opened = Clock::now();
+}
+
+void Batcher::place(uint16_t opCode, uint16_t bodyLen) {
+    namespace schema = proto::schema;
+    Batch& b = batches_[open_];
+    const uint16_t subId = (uint16_t)b.subs.size();
+    const uint8_t* body = b.buf + b.len + proto::BATCH_ENTRY_HEADER;
+
+    uint8_t out[proto::MAX_DATAGRAM];
+    size_t packed = 0;
+    bool wide = compact::pack(opCode, false, proto::FLAG_COMPACT, body, bodyLen, out, sizeof(out), packed) == 0;
+    if (wide) packed = bodyLen;
+    const size_t entry = packed + schema::CompactBatchEntryHeader::size(opCode, subId, uint16_t(packed));
+    const size_t wideLen = b.len + proto::BATCH_ENTRY_HEADER + bodyLen;
+
+    if (wide || b.wide ? wideLen <= proto::BATCH_MTU_BODY : b.packed + entry <= proto::BATCH_MTU_BODY) {
+        b.packed += entry;
+        b.wide = b.wide || wide;
+        return;
+    }
+
+    // Send what fits; the entry starts the next batch as its first sub-operation
+    std::memcpy(out, body, bodyLen);
+    close();
+    openBatch();
+    Batch& n = batches_[open_];
+    proto::Writer w(n.buf + n.len, sizeof(n.buf) - n.len);
+    proto::writeBatchEntry(w, opCode, 0, bodyLen);
+    w.putBytes(out, bodyLen);
+    n.packed += packed + schema::CompactBatchEntryHeader::size(opCode, uint16_t(0), uint16_t(packed));
+    n.wide = wide;
+}
+
+void Batcher::close() {
+    if (open_ < 0) return;
+    int index = open_;
+    open_ = -1;
+    Batch& b = batches_[index];
+
+    if (b.subs.size() == 1) {
+        // Nothing to coalesce with: send the plain request
+        Sub& s = b.subs[0];
+        const uint8_t* body = b.buf + s.offset;
+        pipe_.submitWith(s.opCode, s.bodyLen, [&](proto::Writer& w) {
+            w.putBytes(body, s.bodyLen);
+        }, std::move(s.done));
+        stats_.singles++;
+        b.subs.clear();
+        freeBatches_.push_back(index);
+        return;
+    }
+
+    proto::Writer count(b.buf, 2);
+    count.putU16((uint16_t)b.subs.size());
+    stats_.batches++;
+    stats_.batchedOps += b.subs.size();
+
+    const uint16_t op = (uint16_t)proto::OpCode::BATCH;
+    pipe_.submitWith(op, b.len, [&](proto::Writer& w) {
+        w.putBytes(b.buf, b.len);
+    }, [this, index](const Pipeline::Completion& c) { onBatchDone(index, c); });
+}
+
+int Batcher::poll(int maxWaitMs) {
+    if (open_ >= 0) {
+        auto left = batches_[open_].opened + window_ - Clock::now();
+        if (left <= Clock::duration::zero()) {
+            close();
+        } else {
+            auto leftMs = (std::chrono::duration_cast<std::chrono::microseconds>(left).count() + 999) / 1000;
+            maxWaitMs = (int)std::min<long long>(maxWaitMs, leftMs);
+        }
+    }
+
+    uint64_t replies = batchReplies_;
+    uint64_t subs = subCompletions_;
+    int done = pipe_.poll(maxWaitMs);
+    return done - int(batchReplies_ - replies) + int(subCompletions_ - subs);
+}
+
+void Batcher::onBatchDone(int index, const Pipeline::Completion& c) {
+    Batch& b = batches_[index];
+    Clock::time_point now = Clock::now();
+    batchReplies_++;
+
+    auto finish = [&](Sub& s, const proto::MessageView* reply) {
+        Pipeline::Completion sc = c;
+        sc.opCode = s.opCode;
+        sc.ok = reply != nullptr;
+        sc.latency = std::chrono::duration_cast<std::chrono::microseconds>(now - s.submitted);
+        sc.reply = reply;
+        if (reply) pipe_.metrics().reply(s.opCode, reply->h.status, (uint64_t)sc.latency.count());
+        CompletionFn done = std::move(s.done);
+        s.done = nullptr;
+        s.pending = false;
+        subCompletions_++;
+        if (done) done(sc);
+    };
+
+    if (c.ok && c.reply->h.status == (uint16_t)proto::Status::OK) {
+        proto::Reader r(*c.reply);
+        uint16_t count = 0;
+        r.getU16(count);
+        proto::BatchReplyEntry e;
+        for (uint16_t i = 0; i < count && proto::readBatchReplyEntry(r, e); i++) {
+            if (e.subId >= b.subs.size() || !b.subs[e.subId].pending) continue;
+            proto::MessageView v;
+            v.h = c.reply->h;
+            v.h.opCode = e.opCode;
+            v.h.status = e.status;
+            v.h.bodyLen = (uint32_t)e.bodyLen;
+            v.body = e.body;
+            v.bodyLen = e.bodyLen;
+            finish(b.subs[e.subId], &v);
+        }
+    } else if (c.ok) {
+        // The server rejected the batch itself: every entry shares its status
+        for (Sub& s : b.subs) {
+            if (!s.pending) continue;
+            proto::MessageView v;
+            v.h = c.reply->h;
+            v.h.opCode = s.opCode;
+            v.h.bodyLen = 0;
+            finish(s, &v);
+        }
+    }
+
+    // Timed out, or missing from a truncated reply
+    for (Sub& s : b.subs) {
+        if (s.pending) finish(s, nullptr);
+    }
+
+    b.subs.clear();
+    freeBatches_.push_back(index);
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "pipeline.hpp"
+#include "protocol.hpp"
+#include <chrono>
+#include <deque>
+#include <vector>
+
+/**
+ * Client-side batching stage in front of a Pipeline
+ *
+ * Coalesces submitted operations into BATCH requests: entries are appended
+ * to an open batch, which is sent when it reaches maxOps entries, when the
+ * next entry would no longer fit a single MTU-sized datagram, or when its
+ * time window expires in poll(). A BATCH travels, retransmits and is
+ * deduplicated as one request; its reply is split back into one
+ * Pipeline::Completion per sub-operation, whose reply view carries the
+ * sub-operation's opCode, status and body, so callers handle it exactly
+ * like a reply to a plain request.
+ *
+ * A batch that closes with a single entry is sent as a plain request.
+ * MONITOR_REGISTER is never batched.
+ *
+ * With setCompact() the Pipeline sends batches in the compact encoding
+ * (compact.hpp), so the MTU limit applies to the compact size instead: a
+ * batch holds as many entries as fit 1500 bytes once packed, up to a wide
+ * body of MAX_DATAGRAM. An entry without a compact form makes the whole
+ * batch go out wide, so from then on it is held to the wide limit.
+ *
+ * Not thread-safe: owned and driven by the thread that drives the Pipeline.
+ */
+class Batcher {
+public:
+    using Clock = Pipeline::Clock;
+    using CompletionFn = Pipeline::CompletionFn;
+
+    struct Stats {
+        uint64_t batches = 0;     // BATCH requests sent
+        uint64_t batchedOps = 0;  // operations carried inside them
+        uint64_t singles = 0;     // operations sent as plain requests
+    };
+
+    /**
+     * Constructor
+     * @param pipe Pipeline the batches are submitted to
+     * @param maxOps Largest number of operations per batch (>= 2)
+     * @param window How long an open batch waits for more entries;
+     *               zero closes it at the next poll()
+     */
+    Batcher(Pipeline& pipe, int maxOps, std::chrono::microseconds window);
+
+    /**
+     * Queue an operation into the open batch
+     * @param opCode Operation code
+     * @param bodyLen Exact body size (see proto::requestBodySize)
+     * @param writeBody Callable taking proto::Writer&, must write bodyLen bytes
+     * @param done Completion callback (required: batched results are never kept for await())
+     * @return false if the body did not fit
+     */
+    template <class BodyFn>
+    bool submitWith(uint16_t opCode, size_t bodyLen, BodyFn&& writeBody, CompletionFn done) {
+        if (opCode == (uint16_t)proto::OpCode::MONITOR_REGISTER ||
+            2 + proto::BATCH_ENTRY_HEADER + bodyLen > proto::BATCH_MTU_BODY) {
+            stats_.singles++;
+            return pipe_.submitWith(opCode, bodyLen, std::forward<BodyFn>(writeBody), std::move(done)) != 0;
+        }
+
+        if (open_ >= 0) {
+            Batch& b = batches_[open_];
+            if (b.len + proto::BATCH_ENTRY_HEADER + bodyLen > wideLimit(b)) close();
+        }
+        if (open_ < 0) openBatch();
+
+        Batch& cur = batches_[open_];
+        proto::Writer w(cur.buf + cur.len, wideLimit(cur) - cur.len);
+        proto::writeBatchEntry(w, opCode, (uint16_t)cur.subs.size(), (uint16_t)bodyLen);
+        writeBody(w);
+        if (!w.ok() || w.size() != proto::BATCH_ENTRY_HEADER + bodyLen) return false;
+        if (compact_) place(opCode, (uint16_t)bodyLen);  // may move the entry to a new batch
+
+        Batch& b = batches_[open_];
+
+        Sub sub;
+        sub.opCode = opCode;
+        sub.bodyLen = (uint16_t)bodyLen;
+        sub.offset = (uint16_t)(b.len + proto::BATCH_ENTRY_HEADER);
+        sub.pending = true;
+        sub.submitted = Clock::now();
+        sub.done = std::move(done);
+        b.subs.push_back(std::move(sub));
+        b.len += w.size();
+
+        if ((int)b.subs.size() >= maxOps_) close();
+        return true;
+    }
+
+    /**
+     * Send batches whose window expired, then drive the Pipeline
+     * @param maxWaitMs Longest time to block (also bounded by the open window)
+     * @return number of operations completed, counting each sub-operation
+     */
+    int poll(int maxWaitMs);
+
+    /**
+     * Send the open batch now
+     */
+    void close();
+
+    /**
+     * Size batches for the compact encoding (with Pipeline::setEncoding)
+     */
+    void setCompact(bool on) { compact_ = on; }
+
+    // Operations waiting in the open batch
+    size_t pending() const { return open_ < 0 ? 0 : batches_[open_].subs.size(); }
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    struct Sub {
+        uint16_t opCode;
+        uint16_t bodyLen;
+        uint16_t offset;  // body position inside Batch::buf
+        bool pending;     // not completed yet
+        Clock::time_point submitted;
+        CompletionFn done;
+    };
+
+    struct Batch {
+        std::vector<Sub> subs;
+        size_t len;  // bytes used in buf, including the leading count field
+        size_t packed;  // the same in the compact encoding (setCompact())
+        bool wide;      // an entry has no compact form
+        Clock::time_point opened;
+        uint8_t buf[proto::MAX_DATAGRAM - proto::HEADER_SIZE];
+    };
+
+    Pipeline& pipe_;
+    int maxOps_;
+    std::chrono::microseconds window_;
+    std::deque<Batch> batches_;  // pooled, stable addresses
+    std::vector<int> freeBatches_;
+    int open_;                   // batch currently accepting entries, -1 if none
+    Stats stats_;
+    uint64_t batchReplies_;      // BATCH completions seen by the pipeline
+    uint64_t subCompletions_;    // sub-operation completions they produced
+    bool compact_;
+
+    // Most wide bytes the batch may hold
+    size_t wideLimit(const Batch& b) const {
+        return compact_ && !b.wide ? sizeof(b.buf) : proto::BATCH_MTU_BODY;
+    }
+
+    /**
+     * Count the entry just written past Batch::len in its compact size, or
+     * close the batch without it and start the next one with it
+     */
+    void place(uint16_t opCode, uint16_t bodyLen);
+
+    void openBatch();
+    void onBatchDone(int index, const Pipeline::Completion& c);
+};
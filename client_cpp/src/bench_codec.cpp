@@ -0,0 +1,1057 @@
+#include "compact.hpp"
+#include "endian.hpp"
+#include "protocol.hpp"
+#include "schema.hpp"
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Micro-benchmarks for the protocol codec
+ *
+ * Usage:
+ *   bench_codec.exe [--ms 200] [--filter deposit] [--csv]
+ *
+ * Every case is measured once per codec path:
+ *   vector  std::vector based putXxx/getXxx helpers, proto::encode / proto::decode
+ *   writer  proto::Writer / proto::Reader over caller buffers, one put/get per field
+ *   schema  the same buffers, bodies encoded/decoded by proto::schema layouts
+ * Bodies with a compact form are also packed and unpacked (compact.hpp) as
+ * "compact" and "cmp+lz" (LZ on top, where it shrinks the body), with the
+ * packed size as wire bytes.
+ * Field arrays compare the one-at-a-time loop ("scalar") with the byte-swap
+ * kernel compiled into endian.cpp (named after its instruction set).
+ * and reported as ns/op, wire MB/s, heap bytes/op and allocations/op, with
+ * the speed relative to the first path of the case. New codec paths are
+ * added as further variants of the same cases.
+ *
+ * Arguments:
+ *   --ms      Measuring time per variant in milliseconds (default: 200)
+ *   --filter  Only run cases whose name contains this text
+ *   --csv     Print case,path,ns_per_op,wire_bytes,alloc_bytes_per_op,allocs_per_op
+ */
+
+// ==================== Allocation counting ====================
+
+namespace {
+uint64_t gAllocs = 0;
+uint64_t gAllocBytes = 0;
+} // namespace
+
+void* operator new(size_t n) {
+    gAllocs++;
+    gAllocBytes += n;
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t n) { return operator new(n); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Keep a value alive so the measured work is not optimised away
+template <class T>
+inline void keep(const T& v) {
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(v) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &v;
+#endif
+}
+
+// Make the memory behind p observable (buffers written through a Writer)
+inline void escape(const void* p) {
+#if defined(__GNUC__)
+    asm volatile("" : : "g"(p) : "memory");
+#else
+    keep(p);
+#endif
+}
+
+struct Options {
+    int ms = 200;
+    std::string filter;
+    bool csv = false;
+};
+
+class Runner {
+public:
+    explicit Runner(const Options& opt) : opt_(opt) {
+        if (opt_.csv) {
+            std::printf("case,path,ns_per_op,wire_bytes,alloc_bytes_per_op,allocs_per_op\n");
+        } else {
+            std::printf("%-26s %-7s %10s %10s %10s %10s %8s\n",
+                        "case", "path", "ns/op", "MB/s", "B/op", "allocs/op", "speedup");
+        }
+    }
+
+    /**
+     * Measure one variant of a case
+     * @param name Case name (variants of a case must be run back to back)
+     * @param path Codec path being measured
+     * @param wireBytes Bytes encoded or decoded per operation
+     * @param fn Operation to measure
+     */
+    template <class F>
+    void run(const std::string& name, const char* path, size_t wireBytes, F&& fn) {
+        if (!opt_.filter.empty() && name.find(opt_.filter) == std::string::npos) return;
+
+        // Calibrate: grow the batch until it takes ~1/10 of the measuring time
+        const auto target = std::chrono::milliseconds(opt_.ms);
+        uint64_t iters = 64;
+        while (true) {
+            auto t0 = Clock::now();
+            for (uint64_t i = 0; i < iters; i++) fn();
+            auto took = Clock::now() - t0;
+            if (took * 10 >= target || iters >= (uint64_t(1) << 34)) {
+                double perOp = std::chrono::duration<double>(took).count() / iters;
+                iters = perOp > 0 ? (uint64_t)(std::chrono::duration<double>(target).count() / perOp) : iters;
+                if (iters < 1) iters = 1;
+                break;
+            }
+            iters *= 4;
+        }
+
+        uint64_t allocs = gAllocs;
+        uint64_t allocBytes = gAllocBytes;
+        auto t0 = Clock::now();
+        for (uint64_t i = 0; i < iters; i++) fn();
+        double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+        double ns = secs * 1e9 / iters;
+        double perAllocs = double(gAllocs - allocs) / iters;
+        double perBytes = double(gAllocBytes - allocBytes) / iters;
+
+        if (name != caseName_) {
+            caseName_ = name;
+            baselineNs_ = ns;
+        }
+        if (opt_.csv) {
+            std::printf("%s,%s,%.2f,%zu,%.1f,%.2f\n", name.c_str(), path, ns, wireBytes, perBytes, perAllocs);
+        } else {
+            std::printf("%-26s %-7s %10.2f %10.1f %10.1f %10.2f %7.2fx\n", name.c_str(), path, ns,
+                        wireBytes / ns * 1e3, perBytes, perAllocs, baselineNs_ / ns);
+        }
+    }
+
+private:
+    Options opt_;
+    std::string caseName_;
+    double baselineNs_ = 0;
+};
+
+// ==================== Sample operation ====================
+
+const std::string kName = "alice";
+const std::string kPassword = "secret123";
+const int32_t kAcc = 10001;
+const int32_t kToAcc = 10002;
+const uint16_t kCurrency = uint16_t(proto::Currency::SGD);
+const double kAmount = 123.45;
+const double kBalance = 1000.5;
+const std::string kMessage = "Account closed";
+const int kBatchEntries = 8;
+
+const uint16_t kOps[] = {
+    uint16_t(proto::OpCode::OPEN), uint16_t(proto::OpCode::CLOSE), uint16_t(proto::OpCode::DEPOSIT),
+    uint16_t(proto::OpCode::WITHDRAW), uint16_t(proto::OpCode::MONITOR_REGISTER),
+    uint16_t(proto::OpCode::QUERY_BALANCE), uint16_t(proto::OpCode::TRANSFER),
+    uint16_t(proto::OpCode::BATCH)};
+
+std::string lower(std::string s) {
+    for (char& c : s) c = (char)std::tolower((unsigned char)c);
+    return s;
+}
+
+// ---------- Requests, vector path ----------
+
+void vecRequest(uint16_t op, std::vector<uint8_t>& b) {
+    switch (op) {
+        case uint16_t(proto::OpCode::OPEN):
+            proto::putString(b, kName);
+            proto::putPassword16(b, kPassword);
+            proto::putU16(b, kCurrency);
+            proto::putDouble(b, kAmount);
+            break;
+        case uint16_t(proto::OpCode::CLOSE):
+        case uint16_t(proto::OpCode::QUERY_BALANCE):
+            proto::putString(b, kName);
+            proto::putI32(b, kAcc);
+            proto::putPassword16(b, kPassword);
+            break;
+        case uint16_t(proto::OpCode::DEPOSIT):
+        case uint16_t(proto::OpCode::WITHDRAW):
+            proto::putString(b, kName);
+            proto::putI32(b, kAcc);
+            proto::putPassword16(b, kPassword);
+            proto::putU16(b, kCurrency);
+            proto::putDouble(b, kAmount);
+            break;
+        case uint16_t(proto::OpCode::MONITOR_REGISTER):
+            proto::putU16(b, 60);
+            break;
+        case uint16_t(proto::OpCode::TRANSFER):
+            proto::putString(b, kName);
+            proto::putI32(b, kAcc);
+            proto::putPassword16(b, kPassword);
+            proto::putI32(b, kToAcc);
+            proto::putU16(b, kCurrency);
+            proto::putDouble(b, kAmount);
+            break;
+        case uint16_t(proto::OpCode::BATCH): {
+            const uint16_t sub = uint16_t(proto::OpCode::DEPOSIT);
+            proto::putU16(b, kBatchEntries);
+            for (int i = 0; i < kBatchEntries; i++) {
+                proto::putU16(b, sub);
+                proto::putU16(b, (uint16_t)i);
+                proto::putU16(b, (uint16_t)proto::requestBodySize(sub, kName.size()));
+                vecRequest(sub, b);
+            }
+            break;
+        }
+    }
+}
+
+bool vecParseRequest(uint16_t op, const std::vector<uint8_t>& b) {
+    size_t off = 0;
+    std::string name, password;
+    int32_t acc = 0, to = 0;
+    uint16_t cur = 0, u = 0;
+    double amount = 0;
+    bool ok = true;
+    switch (op) {
+        case uint16_t(proto::OpCode::OPEN):
+            ok = proto::getString(b, off, name) && proto::getPassword16(b, off, password) &&
+                 proto::getU16(b, off, cur) && proto::getDouble(b, off, amount);
+            break;
+        case uint16_t(proto::OpCode::CLOSE):
+        case uint16_t(proto::OpCode::QUERY_BALANCE):
+            ok = proto::getString(b, off, name) && proto::getI32(b, off, acc) &&
+                 proto::getPassword16(b, off, password);
+            break;
+        case uint16_t(proto::OpCode::DEPOSIT):
+        case uint16_t(proto::OpCode::WITHDRAW):
+            ok = proto::getString(b, off, name) && proto::getI32(b, off, acc) &&
+                 proto::getPassword16(b, off, password) && proto::getU16(b, off, cur) &&
+                 proto::getDouble(b, off, amount);
+            break;
+        case uint16_t(proto::OpCode::MONITOR_REGISTER):
+            ok = proto::getU16(b, off, u);
+            break;
+        case uint16_t(proto::OpCode::TRANSFER):
+            ok = proto::getString(b, off, name) && proto::getI32(b, off, acc) &&
+                 proto::getPassword16(b, off, password) && proto::getI32(b, off, to) &&
+                 proto::getU16(b, off, cur) && proto::getDouble(b, off, amount);
+            break;
+        case uint16_t(proto::OpCode::BATCH): {
+            // What a server does: slice each entry into its own body and parse it
+            uint16_t count = 0, sub = 0, id = 0, len = 0;
+            ok = proto::getU16(b, off, count);
+            for (uint16_t i = 0; ok && i < count; i++) {
+                ok = proto::getU16(b, off, sub) && proto::getU16(b, off, id) &&
+                     proto::getU16(b, off, len) && off + len <= b.size();
+                if (!ok) break;
+                std::vector<uint8_t> body(b.begin() + off, b.begin() + off + len);
+                off += len;
+                ok = vecParseRequest(sub, body);
+            }
+            break;
+        }
+    }
+    keep(acc);
+    keep(amount);
+    keep(name);
+    return ok;
+}
+
+// ---------- Requests, writer path ----------
+
+size_t writerRequestSize(uint16_t op) {
+    if (op == uint16_t(proto::OpCode::BATCH)) {
+        const uint16_t sub = uint16_t(proto::OpCode::DEPOSIT);
+        return 2 + kBatchEntries * (proto::BATCH_ENTRY_HEADER + proto::requestBodySize(sub, kName.size()));
+    }
+    return proto::requestBodySize(op, kName.size());
+}
+
+void writerRequest(uint16_t op, proto::Writer& w) {
+    switch (op) {
+        case uint16_t(proto::OpCode::OPEN):
+            w.putString(kName);
+            w.putPassword16(kPassword);
+            w.putU16(kCurrency);
+            w.putDouble(kAmount);
+            break;
+        case uint16_t(proto::OpCode::CLOSE):
+        case uint16_t(proto::OpCode::QUERY_BALANCE):
+            w.putString(kName);
+            w.putI32(kAcc);
+            w.putPassword16(kPassword);
+            break;
+        case uint16_t(proto::OpCode::DEPOSIT):
+        case uint16_t(proto::OpCode::WITHDRAW):
+            w.putString(kName);
+            w.putI32(kAcc);
+            w.putPassword16(kPassword);
+            w.putU16(kCurrency);
+            w.putDouble(kAmount);
+            break;
+        case uint16_t(proto::OpCode::MONITOR_REGISTER):
+            w.putU16(60);
+            break;
+        case uint16_t(proto::OpCode::TRANSFER):
+            w.putString(kName);
+            w.putI32(kAcc);
+            w.putPassword16(kPassword);
+            w.putI32(kToAcc);
+            w.putU16(kCurrency);
+            w.putDouble(kAmount);
+            break;
+        case uint16_t(proto::OpCode::BATCH): {
+            const uint16_t sub = uint16_t(proto::OpCode::DEPOSIT);
+            w.putU16(kBatchEntries);
+            for (int i = 0; i < kBatchEntries; i++) {
+                w.putU16(sub);
+                w.putU16((uint16_t)i);
+                w.putU16((uint16_t)proto::requestBodySize(sub, kName.size()));
+                writerRequest(sub, w);
+            }
+            break;
+        }
+    }
+}
+
+bool writerParseRequest(uint16_t op, const uint8_t* p, size_t n) {
+    proto::Reader r(p, n);
+    std::string_view name, password;
+    int32_t acc = 0, to = 0;
+    uint16_t cur = 0, u = 0;
+    double amount = 0;
+    bool ok = true;
+    switch (op) {
+        case uint16_t(proto::OpCode::OPEN):
+            ok = r.getString(name) && r.getPassword16(password) && r.getU16(cur) && r.getDouble(amount);
+            break;
+        case uint16_t(proto::OpCode::CLOSE):
+        case uint16_t(proto::OpCode::QUERY_BALANCE):
+            ok = r.getString(name) && r.getI32(acc) && r.getPassword16(password);
+            break;
+        case uint16_t(proto::OpCode::DEPOSIT):
+        case uint16_t(proto::OpCode::WITHDRAW):
+            ok = r.getString(name) && r.getI32(acc) && r.getPassword16(password) && r.getU16(cur) &&
+                 r.getDouble(amount);
+            break;
+        case uint16_t(proto::OpCode::MONITOR_REGISTER):
+            ok = r.getU16(u);
+            break;
+        case uint16_t(proto::OpCode::TRANSFER):
+            ok = r.getString(name) && r.getI32(acc) && r.getPassword16(password) && r.getI32(to) &&
+                 r.getU16(cur) && r.getDouble(amount);
+            break;
+        case uint16_t(proto::OpCode::BATCH): {
+            uint16_t count = 0, sub = 0, id = 0, len = 0;
+            const uint8_t* body = nullptr;
+            ok = r.getU16(count);
+            for (uint16_t i = 0; ok && i < count; i++) {
+                ok = r.getU16(sub) && r.getU16(id) && r.getU16(len) && r.getBytes(body, len) &&
+                     writerParseRequest(sub, body, len);
+            }
+            break;
+        }
+    }
+    keep(acc);
+    keep(amount);
+    keep(name);
+    return ok;
+}
+
+// ---------- Requests, schema path ----------
+
+namespace sc = proto::schema;
+
+void schemaRequest(uint16_t op, proto::Writer& w) {
+    switch (op) {
+        case uint16_t(proto::OpCode::OPEN):
+            proto::writeOpenRequest(w, kName, kPassword, kCurrency, kAmount);
+            break;
+        case uint16_t(proto::OpCode::CLOSE):
+        case uint16_t(proto::OpCode::QUERY_BALANCE):
+            proto::writeAuthRequest(w, kName, kAcc, kPassword);
+            break;
+        case uint16_t(proto::OpCode::DEPOSIT):
+        case uint16_t(proto::OpCode::WITHDRAW):
+            proto::writeAmountRequest(w, kName, kAcc, kPassword, kCurrency, kAmount);
+            break;
+        case uint16_t(proto::OpCode::MONITOR_REGISTER):
+            proto::writeMonitorRequest(w, 60);
+            break;
+        case uint16_t(proto::OpCode::TRANSFER):
+            proto::writeTransferRequest(w, kName, kAcc, kPassword, kToAcc, kCurrency, kAmount);
+            break;
+        case uint16_t(proto::OpCode::BATCH): {
+            const uint16_t sub = uint16_t(proto::OpCode::DEPOSIT);
+            w.putU16(kBatchEntries);
+            for (int i = 0; i < kBatchEntries; i++) {
+                proto::writeBatchEntry(w, sub, (uint16_t)i, (uint16_t)proto::requestBodySize(sub, kName.size()));
+                schemaRequest(sub, w);
+            }
+            break;
+        }
+    }
+}
+
+bool schemaParseRequest(uint16_t op, const uint8_t* p, size_t n) {
+    std::string_view name, password;
+    int32_t acc = 0, to = 0;
+    uint16_t cur = 0, u = 0;
+    double amount = 0;
+    bool ok = true;
+    switch (op) {
+        case uint16_t(proto::OpCode::OPEN):
+            ok = sc::OpenRequest::read(p, n, name, password, cur, amount);
+            break;
+        case uint16_t(proto::OpCode::CLOSE):
+        case uint16_t(proto::OpCode::QUERY_BALANCE):
+            ok = sc::AuthRequest::read(p, n, name, acc, password);
+            break;
+        case uint16_t(proto::OpCode::DEPOSIT):
+        case uint16_t(proto::OpCode::WITHDRAW):
+            ok = sc::AmountRequest::read(p, n, name, acc, password, cur, amount);
+            break;
+        case uint16_t(proto::OpCode::MONITOR_REGISTER):
+            ok = sc::MonitorRequest::read(p, n, u);
+            break;
+        case uint16_t(proto::OpCode::TRANSFER):
+            ok = sc::TransferRequest::read(p, n, name, acc, password, to, cur, amount);
+            break;
+        case uint16_t(proto::OpCode::BATCH): {
+            proto::Reader r(p, n);
+            uint16_t count = 0, sub = 0, id = 0, len = 0;
+            const uint8_t* hdr = nullptr;
+            const uint8_t* body = nullptr;
+            ok = r.getU16(count);
+            for (uint16_t i = 0; ok && i < count; i++) {
+                ok = r.getBytes(hdr, proto::BATCH_ENTRY_HEADER) &&
+                     sc::BatchEntryHeader::read(hdr, proto::BATCH_ENTRY_HEADER, sub, id, len) &&
+                     r.getBytes(body, len) && schemaParseRequest(sub, body, len);
+            }
+            break;
+        }
+    }
+    keep(acc);
+    keep(amount);
+    keep(name);
+    return ok;
+}
+
+// ---------- Replies, vector path ----------
+
+void vecReply(uint16_t op, std::vector<uint8_t>& b) {
+    switch (op) {
+        case uint16_t(proto::OpCode::OPEN):
+            proto::putI32(b, kAcc);
+            proto::putDouble(b, kBalance);
+            break;
+        case uint16_t(proto::OpCode::CLOSE):
+        case uint16_t(proto::OpCode::MONITOR_REGISTER):
+            proto::putString(b, kMessage);
+            break;
+        case uint16_t(proto::OpCode::DEPOSIT):
+        case uint16_t(proto::OpCode::WITHDRAW):
+            proto::putDouble(b, kBalance);
+            break;
+        case uint16_t(proto::OpCode::QUERY_BALANCE):
+            proto::putU16(b, kCurrency);
+            proto::putDouble(b, kBalance);
+            break;
+        case uint16_t(proto::OpCode::TRANSFER):
+            proto::putDouble(b, kBalance);
+            proto::putDouble(b, kAmount);
+            break;
+        case uint16_t(proto::OpCode::BATCH):
+            proto::putU16(b, kBatchEntries);
+            for (int i = 0; i < kBatchEntries; i++) {
+                proto::putU16(b, uint16_t(proto::OpCode::DEPOSIT));
+                proto::putU16(b, (uint16_t)i);
+                proto::putU16(b, uint16_t(proto::Status::OK));
+                proto::putU16(b, 8);
+                proto::putDouble(b, kBalance);
+            }
+            break;
+    }
+}
+
+bool vecParseReply(uint16_t op, const std::vector<uint8_t>& b) {
+    size_t off = 0;
+    int32_t acc = 0;
+    uint16_t cur = 0;
+    double bal = 0, bal2 = 0;
+    std::string msg;
+    bool ok = true;
+    switch (op) {
+        case uint16_t(proto::OpCode::OPEN):
+            ok = proto::getI32(b, off, acc) && proto::getDouble(b, off, bal);
+            break;
+        case uint16_t(proto::OpCode::CLOSE):
+        case uint16_t(proto::OpCode::MONITOR_REGISTER):
+            ok = proto::getString(b, off, msg);
+            break;
+        case uint16_t(proto::OpCode::DEPOSIT):
+        case uint16_t(proto::OpCode::WITHDRAW):
+            ok = proto::getDouble(b, off, bal);
+            break;
+        case uint16_t(proto::OpCode::QUERY_BALANCE):
+            ok = proto::getU16(b, off, cur) && proto::getDouble(b, off, bal);
+            break;
+        case uint16_t(proto::OpCode::TRANSFER):
+            ok = proto::getDouble(b, off, bal) && proto::getDouble(b, off, bal2);
+            break;
+        case uint16_t(proto::OpCode::BATCH): {
+            uint16_t count = 0, sub = 0, id = 0, status = 0, len = 0;
+            ok = proto::getU16(b, off, count);
+            for (uint16_t i = 0; ok && i < count; i++) {
+                ok = proto::getU16(b, off, sub) && proto::getU16(b, off, id) &&
+                     proto::getU16(b, off, status) && proto::getU16(b, off, len) &&
+                     off + len <= b.size();
+                if (!ok) break;
+                std::vector<uint8_t> body(b.begin() + off, b.begin() + off + len);
+                off += len;
+                ok = vecParseReply(sub, body);
+            }
+            break;
+        }
+    }
+    keep(acc);
+    keep(bal);
+    keep(msg);
+    return ok;
+}
+
+// ---------- Replies, writer path ----------
+
+size_t writerReplySize(uint16_t op) {
+    std::vector<uint8_t> b;
+    vecReply(op, b);
+    return b.size();
+}
+
+void writerReply(uint16_t op, proto::Writer& w) {
+    switch (op) {
+        case uint16_t(proto::OpCode::OPEN):
+            w.putI32(kAcc);
+            w.putDouble(kBalance);
+            break;
+        case uint16_t(proto::OpCode::CLOSE):
+        case uint16_t(proto::OpCode::MONITOR_REGISTER):
+            w.putString(kMessage);
+            break;
+        case uint16_t(proto::OpCode::DEPOSIT):
+        case uint16_t(proto::OpCode::WITHDRAW):
+            w.putDouble(kBalance);
+            break;
+        case uint16_t(proto::OpCode::QUERY_BALANCE):
+            w.putU16(kCurrency);
+            w.putDouble(kBalance);
+            break;
+        case uint16_t(proto::OpCode::TRANSFER):
+            w.putDouble(kBalance);
+            w.putDouble(kAmount);
+            break;
+        case uint16_t(proto::OpCode::BATCH):
+            w.putU16(kBatchEntries);
+            for (int i = 0; i < kBatchEntries; i++) {
+                w.putU16(uint16_t(proto::OpCode::DEPOSIT));
+                w.putU16((uint16_t)i);
+                w.putU16(uint16_t(proto::Status::OK));
+                w.putU16(8);
+                w.putDouble(kBalance);
+            }
+            break;
+    }
+}
+
+bool writerParseReply(uint16_t op, const uint8_t* p, size_t n) {
+    proto::Reader r(p, n);
+    int32_t acc = 0;
+    uint16_t cur = 0;
+    double bal = 0, bal2 = 0;
+    std::string_view msg;
+    bool ok = true;
+    switch (op) {
+        case uint16_t(proto::OpCode::OPEN):
+            ok = r.getI32(acc) && r.getDouble(bal);
+            break;
+        case uint16_t(proto::OpCode::CLOSE):
+        case uint16_t(proto::OpCode::MONITOR_REGISTER):
+            ok = r.getString(msg);
+            break;
+        case uint16_t(proto::OpCode::DEPOSIT):
+        case uint16_t(proto::OpCode::WITHDRAW):
+            ok = r.getDouble(bal);
+            break;
+        case uint16_t(proto::OpCode::QUERY_BALANCE):
+            ok = r.getU16(cur) && r.getDouble(bal);
+            break;
+        case uint16_t(proto::OpCode::TRANSFER):
+            ok = r.getDouble(bal) && r.getDouble(bal2);
+            break;
+        case uint16_t(proto::OpCode::BATCH): {
+            uint16_t count = 0;
+            ok = r.getU16(count);
+            proto::BatchReplyEntry e;
+            for (uint16_t i = 0; ok && i < count; i++) {
+                ok = proto::readBatchReplyEntry(r, e) && writerParseReply(e.opCode, e.body, e.bodyLen);
+            }
+            break;
+        }
+    }
+    keep(acc);
+    keep(bal);
+    keep(msg);
+    return ok;
+}
+
+// ---------- Replies, schema path ----------
+
+void schemaReply(uint16_t op, proto::Writer& w) {
+    switch (op) {
+        case uint16_t(proto::OpCode::OPEN):
+            sc::OpenReply::write(w, kAcc, kBalance);
+            break;
+        case uint16_t(proto::OpCode::CLOSE):
+        case uint16_t(proto::OpCode::MONITOR_REGISTER):
+            sc::TextReply::write(w, kMessage);
+            break;
+        case uint16_t(proto::OpCode::DEPOSIT):
+        case uint16_t(proto::OpCode::WITHDRAW):
+            sc::BalanceReply::write(w, kBalance);
+            break;
+        case uint16_t(proto::OpCode::QUERY_BALANCE):
+            sc::QueryReply::write(w, kCurrency, kBalance);
+            break;
+        case uint16_t(proto::OpCode::TRANSFER):
+            sc::TransferReply::write(w, kBalance, kAmount);
+            break;
+        case uint16_t(proto::OpCode::BATCH):
+            w.putU16(kBatchEntries);
+            for (int i = 0; i < kBatchEntries; i++) {
+                sc::BatchReplyEntryHeader::write(w, uint16_t(proto::OpCode::DEPOSIT), uint16_t(i),
+                                                 uint16_t(proto::Status::OK), uint16_t(8));
+                sc::BalanceReply::write(w, kBalance);
+            }
+            break;
+    }
+}
+
+bool schemaParseReply(uint16_t op, const uint8_t* p, size_t n) {
+    int32_t acc = 0;
+    uint16_t cur = 0;
+    double bal = 0, bal2 = 0;
+    std::string_view msg;
+    bool ok = true;
+    switch (op) {
+        case uint16_t(proto::OpCode::OPEN):
+            ok = sc::OpenReply::read(p, n, acc, bal);
+            break;
+        case uint16_t(proto::OpCode::CLOSE):
+        case uint16_t(proto::OpCode::MONITOR_REGISTER):
+            ok = sc::TextReply::read(p, n, msg);
+            break;
+        case uint16_t(proto::OpCode::DEPOSIT):
+        case uint16_t(proto::OpCode::WITHDRAW):
+            ok = sc::BalanceReply::read(p, n, bal);
+            break;
+        case uint16_t(proto::OpCode::QUERY_BALANCE):
+            ok = sc::QueryReply::read(p, n, cur, bal);
+            break;
+        case uint16_t(proto::OpCode::TRANSFER):
+            ok = sc::TransferReply::read(p, n, bal, bal2);
+            break;
+        case uint16_t(proto::OpCode::BATCH): {
+            proto::Reader r(p, n);
+            uint16_t count = 0;
+            ok = r.getU16(count);
+            proto::BatchReplyEntry e;
+            for (uint16_t i = 0; ok && i < count; i++) {
+                ok = proto::readBatchReplyEntry(r, e) && schemaParseReply(e.opCode, e.body, e.bodyLen);
+            }
+            break;
+        }
+    }
+    keep(acc);
+    keep(bal);
+    keep(msg);
+    return ok;
+}
+
+// ==================== Cases ====================
+
+void benchFields(Runner& run) {
+    uint8_t buf[proto::MAX_DATAGRAM];
+    const size_t strLen = 2 + kName.size();
+
+    run.run("string.put", "vector", strLen, [&] {
+        std::vector<uint8_t> b;
+        proto::putString(b, kName);
+        keep(b);
+    });
+    run.run("string.put", "writer", strLen, [&] {
+        proto::Writer w(buf, sizeof(buf));
+        w.putString(kName);
+        escape(buf);
+    });
+
+    std::vector<uint8_t> str;
+    proto::putString(str, kName);
+    run.run("string.get", "vector", strLen, [&] {
+        size_t off = 0;
+        std::string s;
+        proto::getString(str, off, s);
+        keep(s);
+    });
+    run.run("string.get", "writer", strLen, [&] {
+        proto::Reader r(str.data(), str.size());
+        std::string_view s;
+        r.getString(s);
+        keep(s);
+    });
+
+    run.run("password16.put", "vector", 16, [&] {
+        std::vector<uint8_t> b;
+        proto::putPassword16(b, kPassword);
+        keep(b);
+    });
+    run.run("password16.put", "writer", 16, [&] {
+        proto::Writer w(buf, sizeof(buf));
+        w.putPassword16(kPassword);
+        escape(buf);
+    });
+
+    std::vector<uint8_t> pw;
+    proto::putPassword16(pw, kPassword);
+    run.run("password16.get", "vector", 16, [&] {
+        size_t off = 0;
+        std::string s;
+        proto::getPassword16(pw, off, s);
+        keep(s);
+    });
+    run.run("password16.get", "writer", 16, [&] {
+        proto::Reader r(pw.data(), pw.size());
+        std::string_view s;
+        r.getPassword16(s);
+        keep(s);
+    });
+}
+
+// ---------- Scalar fields and field arrays ----------
+
+// The byte-at-a-time decoder the codec used before the bswap fast path
+uint64_t loadBE64Shifts(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v = (v << 8) | uint64_t(p[i]);
+    return v;
+}
+
+// The vector kernels must agree with the scalar loops, tails included
+void checkKernels() {
+    const size_t n = 131;
+    std::vector<uint32_t> u32(n), u32Back(n);
+    std::vector<double> f64(n), f64Back(n);
+    for (size_t i = 0; i < n; i++) {
+        u32[i] = uint32_t(0x01020304u * (i + 1));
+        f64[i] = kBalance * double(i) - kAmount;
+    }
+    std::vector<uint8_t> a(8 * n), b(8 * n);
+    proto::storeBE32s(a.data(), u32.data(), n);
+    proto::storeBE32sScalar(b.data(), u32.data(), n);
+    proto::loadBE32s(u32Back.data(), a.data(), n);
+    bool ok = std::memcmp(a.data(), b.data(), 4 * n) == 0 && u32Back == u32;
+    proto::storeBE64s(a.data(), f64.data(), n);
+    for (size_t i = 0; i < n; i++) {
+        uint64_t bits;
+        std::memcpy(&bits, &f64[i], 8);
+        proto::putBE64(b.data() + 8 * i, bits);
+    }
+    proto::loadBE64s(f64Back.data(), a.data(), n);
+    ok = ok && std::memcmp(a.data(), b.data(), 8 * n) == 0 && f64Back == f64;
+    if (!ok) {
+        std::fprintf(stderr, "byte-swap kernel %s disagrees with the scalar loop\n", proto::byteSwapKernel());
+        std::exit(1);
+    }
+}
+
+void benchArrays(Runner& run) {
+    checkKernels();
+    const char* kernel = proto::byteSwapKernel();
+
+    uint8_t one[8];
+    proto::putBE64(one, 0x0123456789ABCDEFULL);
+    run.run("u64.load", "shifts", 8, [&] {
+        escape(one);
+        keep(loadBE64Shifts(one));
+    });
+    run.run("u64.load", "bswap", 8, [&] {
+        escape(one);
+        keep(proto::loadBE64(one));
+    });
+
+    // One snapshot-sized page: 128 account numbers and 128 balances
+    const size_t n = 128;
+    std::vector<uint32_t> accs(n);
+    std::vector<double> bals(n);
+    for (size_t i = 0; i < n; i++) {
+        accs[i] = uint32_t(kAcc + i);
+        bals[i] = kBalance + double(i);
+    }
+    std::vector<uint8_t> wire(8 * n);
+    uint64_t* bits = reinterpret_cast<uint64_t*>(static_cast<void*>(bals.data()));
+
+    run.run("array.u32.store", "scalar", 4 * n, [&] {
+        proto::storeBE32sScalar(wire.data(), accs.data(), n);
+        escape(wire.data());
+    });
+    run.run("array.u32.store", kernel, 4 * n, [&] {
+        proto::storeBE32s(wire.data(), accs.data(), n);
+        escape(wire.data());
+    });
+    run.run("array.u32.load", "scalar", 4 * n, [&] {
+        proto::loadBE32sScalar(accs.data(), wire.data(), n);
+        escape(accs.data());
+    });
+    run.run("array.u32.load", kernel, 4 * n, [&] {
+        proto::loadBE32s(accs.data(), wire.data(), n);
+        escape(accs.data());
+    });
+    run.run("array.f64.store", "scalar", 8 * n, [&] {
+        proto::storeBE64sScalar(wire.data(), bits, n);
+        escape(wire.data());
+    });
+    run.run("array.f64.store", kernel, 8 * n, [&] {
+        proto::storeBE64s(wire.data(), bals.data(), n);
+        escape(wire.data());
+    });
+    run.run("array.f64.load", "scalar", 8 * n, [&] {
+        proto::loadBE64sScalar(bits, wire.data(), n);
+        escape(bals.data());
+    });
+    run.run("array.f64.load", kernel, 8 * n, [&] {
+        proto::loadBE64s(bals.data(), wire.data(), n);
+        escape(bals.data());
+    });
+}
+
+void benchMessage(Runner& run) {
+    const uint16_t op = uint16_t(proto::OpCode::DEPOSIT);
+    proto::Message m;
+    m.h.magic = proto::MAGIC;
+    m.h.version = proto::VERSION;
+    m.h.msgType = (uint8_t)proto::MsgType::Request;
+    m.h.opCode = op;
+    m.h.flags = proto::FLAG_AT_MOST_ONCE;
+    m.h.requestId = 0x0123456789ABCDEFULL;
+    vecRequest(op, m.body);
+    m.h.bodyLen = (uint32_t)m.body.size();
+    const size_t total = proto::HEADER_SIZE + m.body.size();
+
+    uint8_t buf[proto::MAX_DATAGRAM];
+    run.run("message.encode", "vector", total, [&] {
+        std::vector<uint8_t> raw = proto::encode(m);
+        keep(raw);
+    });
+    run.run("message.encode", "writer", total, [&] {
+        proto::writeHeader(buf, m.h);
+        std::memcpy(buf + proto::HEADER_SIZE, m.body.data(), m.body.size());
+        escape(buf);
+    });
+
+    std::vector<uint8_t> raw = proto::encode(m);
+    run.run("message.decode", "vector", total, [&] {
+        proto::Message out;
+        bool ok = proto::decode(raw, out);
+        keep(ok);
+        keep(out);
+    });
+    run.run("message.decode", "writer", total, [&] {
+        proto::MessageView v;
+        bool ok = proto::parse(raw.data(), raw.size(), v);
+        keep(ok);
+        keep(v);
+    });
+}
+
+// Every path must produce the bytes of the vector path
+template <class Fn>
+void checkSame(const std::string& name, const std::vector<uint8_t>& expect, Fn&& build) {
+    uint8_t buf[proto::MAX_DATAGRAM];
+    proto::Writer w(buf, sizeof(buf));
+    build(w);
+    if (!w.ok() || w.size() != expect.size() || std::memcmp(buf, expect.data(), expect.size()) != 0) {
+        std::fprintf(stderr, "encoding mismatch for %s\n", name.c_str());
+        std::exit(1);
+    }
+}
+
+// Both encodings of one wide body; each must unpack to the same bytes
+void benchPacked(Runner& run, const std::string& name, uint16_t op, bool reply, const std::vector<uint8_t>& wide) {
+    const uint16_t encodings[] = {proto::FLAG_COMPACT, proto::FLAG_COMPACT | proto::FLAG_LZ};
+    const char* paths[] = {"compact", "cmp+lz"};
+    uint8_t packed[2][proto::MAX_DATAGRAM];
+    size_t packedLen[2] = {0, 0};
+    uint8_t out[proto::MAX_DATAGRAM];
+    bool applies[2] = {false, false};
+    for (int k = 0; k < 2; k++) {
+        uint16_t flags = compact::pack(op, reply, encodings[k], wide.data(), wide.size(), packed[k],
+                                       sizeof(packed[k]), packedLen[k]);
+        if (flags != encodings[k]) continue;
+        size_t back = 0;
+        if (!compact::unpack(op, reply, flags, packed[k], packedLen[k], out, sizeof(out), back) ||
+            back != wide.size() || std::memcmp(out, wide.data(), back) != 0) {
+            std::fprintf(stderr, "%s mismatch for %s\n", paths[k], name.c_str());
+            std::exit(1);
+        }
+        applies[k] = true;
+    }
+
+    for (int k = 0; k < 2; k++) {
+        if (!applies[k]) continue;
+        run.run(name + ".pack", paths[k], packedLen[k], [&] {
+            size_t n = 0;
+            uint16_t flags = compact::pack(op, reply, encodings[k], wide.data(), wide.size(), out, sizeof(out), n);
+            keep(flags);
+            escape(out);
+        });
+    }
+    for (int k = 0; k < 2; k++) {
+        if (!applies[k]) continue;
+        run.run(name + ".unpack", paths[k], packedLen[k], [&] {
+            size_t n = 0;
+            bool ok = compact::unpack(op, reply, encodings[k], packed[k], packedLen[k], out, sizeof(out), n);
+            keep(ok);
+            escape(out);
+        });
+    }
+}
+
+void benchBodies(Runner& run) {
+    uint8_t buf[proto::MAX_DATAGRAM];
+    for (uint16_t op : kOps) {
+        const std::string name = lower(proto::opCodeToString(op));
+
+        // Full request datagram, built the way a client sends it
+        std::vector<uint8_t> req;
+        vecRequest(op, req);
+        const size_t reqLen = writerRequestSize(op);
+        if (reqLen != req.size()) {
+            std::fprintf(stderr, "size mismatch for %s: %zu vs %zu\n", name.c_str(), reqLen, req.size());
+            std::exit(1);
+        }
+        checkSame("req." + name, req, [&](proto::Writer& w) { writerRequest(op, w); });
+        checkSame("req." + name, req, [&](proto::Writer& w) { schemaRequest(op, w); });
+        run.run("req." + name + ".build", "vector", req.size(), [&] {
+            std::vector<uint8_t> b;
+            vecRequest(op, b);
+            keep(b);
+        });
+        run.run("req." + name + ".build", "writer", reqLen, [&] {
+            proto::Writer w(buf, reqLen);
+            writerRequest(op, w);
+            escape(buf);
+        });
+        run.run("req." + name + ".build", "schema", reqLen, [&] {
+            proto::Writer w(buf, reqLen);
+            schemaRequest(op, w);
+            escape(buf);
+        });
+
+        run.run("req." + name + ".parse", "vector", req.size(), [&] {
+            bool ok = vecParseRequest(op, req);
+            keep(ok);
+        });
+        run.run("req." + name + ".parse", "writer", req.size(), [&] {
+            bool ok = writerParseRequest(op, req.data(), req.size());
+            keep(ok);
+        });
+        run.run("req." + name + ".parse", "schema", req.size(), [&] {
+            bool ok = schemaParseRequest(op, req.data(), req.size());
+            keep(ok);
+        });
+        benchPacked(run, "req." + name, op, false, req);
+
+        std::vector<uint8_t> rep;
+        vecReply(op, rep);
+        const size_t repLen = writerReplySize(op);
+        checkSame("rep." + name, rep, [&](proto::Writer& w) { writerReply(op, w); });
+        checkSame("rep." + name, rep, [&](proto::Writer& w) { schemaReply(op, w); });
+        run.run("rep." + name + ".build", "vector", rep.size(), [&] {
+            std::vector<uint8_t> b;
+            vecReply(op, b);
+            keep(b);
+        });
+        run.run("rep." + name + ".build", "writer", repLen, [&] {
+            proto::Writer w(buf, repLen);
+            writerReply(op, w);
+            escape(buf);
+        });
+        run.run("rep." + name + ".build", "schema", repLen, [&] {
+            proto::Writer w(buf, repLen);
+            schemaReply(op, w);
+            escape(buf);
+        });
+
+        run.run("rep." + name + ".parse", "vector", rep.size(), [&] {
+            bool ok = vecParseReply(op, rep);
+            keep(ok);
+        });
+        run.run("rep." + name + ".parse", "writer", rep.size(), [&] {
+            bool ok = writerParseReply(op, rep.data(), rep.size());
+            keep(ok);
+        });
+        run.run("rep." + name + ".parse", "schema", rep.size(), [&] {
+            bool ok = schemaParseReply(op, rep.data(), rep.size());
+            keep(ok);
+        });
+        benchPacked(run, "rep." + name, op, true, rep);
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--ms") == 0 && i + 1 < argc) {
+            opt.ms = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            opt.filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--csv") == 0) {
+            opt.csv = true;
+        } else if (std::strcmp(argv[i], "--help") == 0 || std::strcmp(argv[i], "-h") == 0) {
+            std::cout << "Usage: " << argv[0] << " [options]\n";
+            std::cout << "Options:\n";
+            std::cout << "  --ms <ms>         Measuring time per variant (default: 200)\n";
+            std::cout << "  --filter <text>   Only cases whose name contains text\n";
+            std::cout << "  --csv             Machine-readable output\n";
+            return 0;
+        }
+    }
+    if (opt.ms < 1) opt.ms = 1;
+
+    Runner run(opt);
+    benchFields(run);
+    benchArrays(run);
+    benchMessage(run);
+    benchBodies(run);
+    return 0;
+}
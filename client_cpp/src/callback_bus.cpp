@@ -0,0 +1,89 @@
+#include "callback_bus.hpp"
+#include <chrono>
+#include <cstring>
+
+CallbackBus::CallbackBus()
+    : queue_(QUEUE_DEPTH), nextId_(1), running_(false), waiting_(false), dropped_(0) {}
+
+CallbackBus::~CallbackBus() {
+    stop();
+}
+
+void CallbackBus::start() {
+    if (running_.exchange(true)) return;
+    thread_ = std::thread(&CallbackBus::run, this);
+}
+
+void CallbackBus::stop() {
+    if (!running_.exchange(false)) return;
+    {
+        std::lock_guard<std::mutex> lock(waitMutex_);
+        cv_.notify_one();
+    }
+    thread_.join();
+    drain();
+}
+
+int CallbackBus::subscribe(Handler fn) {
+    std::lock_guard<std::mutex> lock(subsMutex_);
+    int id = nextId_++;
+    subs_.push_back({id, std::move(fn)});
+    return id;
+}
+
+void CallbackBus::unsubscribe(int id) {
+    std::lock_guard<std::mutex> lock(subsMutex_);
+    for (size_t i = 0; i < subs_.size(); i++) {
+        if (subs_[i].first == id) {
+            subs_.erase(subs_.begin() + i);
+            return;
+        }
+    }
+}
+
+bool CallbackBus::publish(const proto::MessageView& msg) {
+    bool queued = queue_.tryPush([&](Event& e) {
+        e.h = msg.h;
+        e.len = msg.bodyLen < sizeof(e.body) ? msg.bodyLen : sizeof(e.body);
+        if (e.len) std::memcpy(e.body, msg.body, e.len);
+    });
+    if (!queued) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Pairs with the flag/re-check in run(): only a sleeping dispatcher is signalled
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting_.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(waitMutex_);
+        cv_.notify_one();
+    }
+    return true;
+}
+
+void CallbackBus::drain() {
+    auto deliver = [this](Event& e) {
+        proto::MessageView v;
+        v.h = e.h;
+        v.body = e.body;
+        v.bodyLen = e.len;
+        std::lock_guard<std::mutex> lock(subsMutex_);
+        for (auto& s : subs_) s.second(v);
+    };
+    while (queue_.tryPop(deliver)) {
+    }
+}
+
+void CallbackBus::run() {
+    while (running_.load(std::memory_order_acquire)) {
+        drain();
+
+        std::unique_lock<std::mutex> lock(waitMutex_);
+        waiting_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (queue_.empty() && running_.load(std::memory_order_acquire)) {
+            cv_.wait_for(lock, std::chrono::milliseconds(100));
+        }
+        waiting_.store(false, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "bounded_queue.hpp"
+#include "protocol.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * Fan-out of server-pushed messages (CALLBACK_UPDATE, ...) to subscribers
+ *
+ * The receive thread publish()es each non-reply datagram into a bounded
+ * lock-free queue (copied into the queue cell, no allocation) and goes
+ * straight back to the socket; a dispatch thread drains the queue and calls
+ * every subscriber in registration order. A slow subscriber therefore never
+ * delays reply matching or retransmissions. When the queue is full the
+ * message is dropped and counted, like any other lost datagram.
+ */
+class CallbackBus {
+public:
+    using Handler = std::function<void(const proto::MessageView&)>;
+
+    // Messages buffered between the receive and dispatch threads
+    static constexpr size_t QUEUE_DEPTH = 256;
+
+    CallbackBus();
+    ~CallbackBus();
+
+    CallbackBus(const CallbackBus&) = delete;
+    CallbackBus& operator=(const CallbackBus&) = delete;
+
+    // Start / stop the dispatch thread (stop() delivers what is queued first)
+    void start();
+    void stop();
+
+    /**
+     * Register a handler, invoked on the dispatch thread
+     * (handlers must not subscribe/unsubscribe themselves)
+     * @return id for unsubscribe()
+     */
+    int subscribe(Handler fn);
+    void unsubscribe(int id);
+
+    /**
+     * Queue a message for the subscribers; safe from any thread, never blocks
+     * @return false if the queue was full and the message was dropped
+     */
+    bool publish(const proto::MessageView& msg);
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    struct Event {
+        proto::Header h;
+        size_t len;
+        uint8_t body[proto::MAX_DATAGRAM];
+    };
+
+    BoundedQueue<Event> queue_;
+    std::mutex subsMutex_;
+    std::vector<std::pair<int, Handler>> subs_;
+    int nextId_;
+
+    std::thread thread_;
+    std::mutex waitMutex_;
+    std::condition_variable cv_;
+    std::atomic<bool> running_;
+    std::atomic<bool> waiting_;
+    std::atomic<uint64_t> dropped_;
+
+    void run();
+    void drain();
+};
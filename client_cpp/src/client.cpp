@@ -1,170 +1,181 @@
 #include "client.hpp"
+#include "log.hpp"
+#include "schema.hpp"
+#include "snapshot.hpp"
 #include <iostream>
+#include <sstream>
 #include <chrono>
-#include <random>
 #include <thread>
 #include <cstring>
+#include <algorithm>
 
-#ifdef _WIN32
-#pragma comment(lib, "ws2_32.lib")
-#endif
-
-Client::Client(const std::string& serverIp, int serverPort, bool atMostOnce, int timeoutMs, int retryCount)
+Client::Client(const std::string& serverIp, int serverPort, bool atMostOnce, int timeoutMs, int retryCount,
+               RetransmitPolicy::Mode rtoMode, int cacheTtlMs, int cacheStaleMs)
     : serverIp_(serverIp), serverPort_(serverPort), atMostOnce_(atMostOnce),
-      timeoutMs_(timeoutMs), retryCount_(retryCount), nextRequestId_(1) {
-#ifdef _WIN32
-    sock_ = INVALID_SOCKET;
-#else
-    sock_ = -1;
-#endif
+      timeoutMs_(timeoutMs), retryCount_(retryCount), rtoMode_(rtoMode),
+      cacheTtlMs_(cacheTtlMs), cacheStaleMs_(cacheStaleMs), printUntil_(0) {
 }
 
 Client::~Client() {
-#ifdef _WIN32
-    if (sock_ != INVALID_SOCKET) {
-        closesocket(sock_);
-    }
-    WSACleanup();
-#else
-    if (sock_ >= 0) {
-        close(sock_);
-    }
-#endif
+    if (runtime_) runtime_->stop();
+    bus_.stop();
+    net::cleanup();
 }
 
 bool Client::init() {
-#ifdef _WIN32
-    WSADATA wsa;
-    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+    if (!net::startup()) {
         std::cerr << "[client] WSAStartup failed\n";
         return false;
     }
-#endif
 
-    sock_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-#ifdef _WIN32
-    if (sock_ == INVALID_SOCKET) {
-#else
-    if (sock_ < 0) {
-#endif
-        std::cerr << "[client] socket() failed\n";
+    if (cacheTtlMs_ > 0) {
+        cache_.reset(new BalanceCache(std::chrono::milliseconds(cacheTtlMs_),
+                                      std::chrono::milliseconds(cacheStaleMs_)));
+    }
+    // A token is only valid on the server that issued it, and only LOGIN is
+    // routed by name
+    if (tokensOn_ && servers_.empty()) tokens_.reset(new TokenCache());
+
+    bus_.subscribe([this](const proto::MessageView& cb) { onCallback(cb); });
+    bus_.start();
+
+    Runtime::Config cfg;
+    cfg.serverIp = serverIp_;
+    cfg.serverPort = serverPort_;
+    cfg.atMostOnce = atMostOnce_;
+    cfg.timeoutMs = timeoutMs_;
+    cfg.retryCount = retryCount_;
+    cfg.rtoMode = rtoMode_;
+    cfg.workers = 1;  // one socket: the server keys monitors by client address
+    cfg.servers = servers_;
+    cfg.flow = flow_;
+    cfg.impair = impair_;
+    cfg.trace = trace_;
+    cfg.compact = compact_;
+    cfg.lz = lz_;
+    runtime_.reset(new Runtime(cfg));
+    runtime_->setVerbose(true);
+    runtime_->setCallbackHandler([this](const proto::MessageView& cb) { bus_.publish(cb); });
+    if (!runtime_->start()) return false;
+
+    std::cout << "[client] server=" << (servers_.empty() ? serverIp_ + ":" + std::to_string(serverPort_) : servers_)
+              << " sem=" << (atMostOnce_ ? "at-most-once" : "at-least-once")
+              << " timeout=" << timeoutMs_ << "ms retry=" << retryCount_
+              << " rto=" << RetransmitPolicy::modeName(rtoMode_);
+    if (cache_) std::cout << " cache=" << cacheTtlMs_ << "ms/" << cacheStaleMs_ << "ms";
+    if (flow_.rate > 0) std::cout << " rate-limit=" << flow_.rate << "/s";
+    if (flow_.window > 0) std::cout << " max-inflight=" << flow_.window;
+    if (!trace_.empty()) std::cout << " trace=" << trace_;
+    if (compact_) std::cout << " compact=on";
+    if (lz_) std::cout << " lz=on";
+    if (tokens_) std::cout << " tokens=on";
+    if (flow_.breakerThreshold > 0) std::cout << " breaker=" << flow_.breakerThreshold << "/" << flow_.breakerCooldownMs << "ms";
+    if (impair_.enabled()) {
+        std::cout << " impair=drop " << impair_.dropSend << "/" << impair_.dropRecv << " delay "
+                  << impair_.delayUs << "+-" << impair_.jitterUs << "us";
+    }
+    std::cout << "\n";
+
+    return true;
+}
+
+bool Client::tokenFor(int32_t accNo, const std::string& name, const std::string& password, uint64_t& token) {
+    if (!tokens_ || !tokens_->supported()) return false;
+    if (tokens_->lookup(accNo, name, password, token)) return true;
+
+    const uint16_t op = (uint16_t)proto::OpCode::LOGIN;
+    proto::Message reply;
+    // Before the first LOGIN: does the server have session tokens at all
+    if (!tokensProbed_) {
+        if (!runtime_->callWith(op, TokenCache::probeSize(), [](proto::Writer& w) { TokenCache::writeProbe(w); },
+                                reply)) {
+            return false;
+        }
+        tokensProbed_ = true;
+        tokens_->probed(reply.h.status);
+        if (!tokens_->supported()) {
+            BANK_LOG(logging::Info, true, "server has no session tokens, sending name and password");
+            return false;
+        }
+    }
+    const auto sent = TokenCache::Clock::now();
+    if (!call(op, proto::requestBodySize(op, name.size()), [&](proto::Writer& w) {
+            proto::writeAuthRequest(w, name, accNo, password);
+        }, reply)) {
         return false;
     }
+    return tokens_->login(accNo, name, password, reply.h.status, reply.body.data(), reply.body.size(), sent, token);
+}
+
+void Client::dropToken(int32_t accNo) {
+    tokens_->erase(accNo);
+    BANK_LOG(logging::Info, true, "session token refused, sending name and password");
+}
+
+void Client::logSend(uint16_t opCode, size_t bodyLen) {
+    BANK_LOG(logging::Info, true, "sending op=" << proto::opCodeToString(opCode)
+             << " bodyLen=" << bodyLen << " totalLen=" << (proto::HEADER_SIZE + bodyLen));
+}
 
-    memset(&serverAddr_, 0, sizeof(serverAddr_));
-    serverAddr_.sin_family = AF_INET;
-    serverAddr_.sin_port = htons((uint16_t)serverPort_);
-    
-#ifdef _WIN32
-    serverAddr_.sin_addr.s_addr = inet_addr(serverIp_.c_str());
-    if (serverAddr_.sin_addr.s_addr == INADDR_NONE) {
-#else
-    if (inet_pton(AF_INET, serverIp_.c_str(), &serverAddr_.sin_addr) <= 0) {
-#endif
-        std::cerr << "[client] Invalid server IP: " << serverIp_ << "\n";
+bool Client::checkReply(bool ok, const proto::Message& reply) {
+    if (!ok) {
+        BANK_LOG(logging::Warn, true, "request failed after " << retryCount_ << " retries");
         return false;
     }
 
-    std::cout << "[client] server=" << serverIp_ << ":" << serverPort_
-              << " sem=" << (atMostOnce_ ? "at-most-once" : "at-least-once")
-              << " timeout=" << timeoutMs_ << "ms retry=" << retryCount_ << "\n";
-
+    BANK_LOG(logging::Info, true, "got reply ok: op=" << proto::opCodeToString(reply.h.opCode)
+             << " status=" << proto::statusToString(reply.h.status)
+             << " reqId=" << reply.h.requestId);
     return true;
 }
 
-bool Client::call(uint16_t opCode, const std::vector<uint8_t>& body, proto::Message& reply) {
-    // Generate random request ID
-    static std::mt19937_64 rng(std::chrono::high_resolution_clock::now().time_since_epoch().count());
-    uint64_t reqId = rng();
-
-    // Build request message
-    proto::Message req;
-    req.h.magic = proto::MAGIC;
-    req.h.version = proto::VERSION;
-    req.h.msgType = (uint8_t)proto::MsgType::Request;
-    req.h.opCode = opCode;
-    req.h.flags = atMostOnce_ ? proto::FLAG_AT_MOST_ONCE : 0;
-    req.h.status = 0;
-    req.h.requestId = reqId;
-    req.h.bodyLen = (uint32_t)body.size();
-    req.body = body;
-
-    auto reqBytes = proto::encode(req);
-
-    std::cout << "[client] sending op=" << proto::opCodeToString(opCode) 
-              << " bodyLen=" << body.size() << " totalLen=" << reqBytes.size() << "\n";
-
-    // Set socket timeout
-#ifdef _WIN32
-    DWORD tv = timeoutMs_;
-    setsockopt(sock_, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
-#else
-    struct timeval tv;
-    tv.tv_sec = timeoutMs_ / 1000;
-    tv.tv_usec = (timeoutMs_ % 1000) * 1000;
-    setsockopt(sock_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-#endif
-
-    for (int attempt = 1; attempt <= retryCount_; attempt++) {
-        // Send request
-        int sent = sendto(sock_, (const char*)reqBytes.data(), (int)reqBytes.size(), 0,
-                         (sockaddr*)&serverAddr_, sizeof(serverAddr_));
-        if (sent < 0) {
-            std::cerr << "[client] sendto() failed\n";
-            continue;
-        }
+void Client::onCallback(const proto::MessageView& cb) {
+    if (cb.h.msgType != (uint8_t)proto::MsgType::Callback) return;
 
-        // Receive reply
-        std::vector<uint8_t> buf(2048);
-        sockaddr_in fromAddr;
-#ifdef _WIN32
-        int fromLen = sizeof(fromAddr);
-#else
-        socklen_t fromLen = sizeof(fromAddr);
-#endif
-
-        int n = recvfrom(sock_, (char*)buf.data(), (int)buf.size(), 0,
-                        (sockaddr*)&fromAddr, &fromLen);
-
-        if (n < 0) {
-#ifdef _WIN32
-            int err = WSAGetLastError();
-            if (err == WSAETIMEDOUT) {
-#else
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-#endif
-                std::cout << "[client] timeout, retry " << attempt << "/" << retryCount_ << "\n";
-                continue;
-            }
-            std::cerr << "[client] recvfrom() failed\n";
-            continue;
-        }
+    uint16_t updateType;
+    int32_t accNo;
+    uint16_t cur;
+    double newBal;
+    std::string_view info;
 
-        buf.resize(n);
-        if (!proto::decode(buf, reply)) {
-            std::cout << "[client] decode() failed, retry " << attempt << "/" << retryCount_ << "\n";
-            continue;
+    if (cb.h.opCode == (uint16_t)proto::OpCode::CALLBACK_UPDATE) {
+        if (proto::schema::CallbackUpdate::read(cb, updateType, accNo, cur, newBal, info)) {
+            onUpdate(updateType, accNo, cur, newBal, info);
         }
+        return;
+    }
+    if (cb.h.opCode != (uint16_t)proto::OpCode::CALLBACK_BATCH) return;
 
-        if (reply.h.msgType != (uint8_t)proto::MsgType::Reply) {
-            std::cout << "[client] ignore non-reply msgType=" << (int)reply.h.msgType << "\n";
-            continue;
-        }
+    // count:u16, then count CALLBACK_UPDATE bodies back to back
+    proto::Reader r(cb.body, cb.bodyLen);
+    uint16_t count;
+    if (!r.getU16(count)) return;
+    size_t off = 2;
+    for (uint16_t i = 0; i < count; i++) {
+        const uint8_t* p = cb.body + off;
+        const size_t left = cb.bodyLen - off;
+        if (!proto::schema::CallbackUpdate::read(p, left, updateType, accNo, cur, newBal, info)) return;
+        onUpdate(updateType, accNo, cur, newBal, info);
+        off += proto::schema::CallbackUpdate::size(updateType, accNo, cur, newBal, info);
+    }
+}
 
-        if (reply.h.requestId != reqId) {
-            std::cout << "[client] ignore reply for other reqId=" << reply.h.requestId 
-                      << " (expect " << reqId << ")\n";
-            continue;
+void Client::onUpdate(uint16_t updateType, int32_t accNo, uint16_t cur, double newBal, std::string_view info) {
+    if (cache_) {
+        if (updateType == (uint16_t)proto::OpCode::CLOSE) {
+            cache_->erase(accNo);
+        } else {
+            cache_->update(accNo, cur, newBal);
         }
-
-        std::cout << "[client] got reply ok: op=" << proto::opCodeToString(reply.h.opCode)
-                  << " status=" << proto::statusToString(reply.h.status)
-                  << " reqId=" << reply.h.requestId << "\n";
-        return true;
     }
 
-    std::cerr << "[client] request failed after " << retryCount_ << " retries\n";
-    return false;
+    if (Clock::now().time_since_epoch().count() < printUntil_.load(std::memory_order_relaxed)) {
+        std::cout << "[CALLBACK] type=" << proto::opCodeToString(updateType)
+                  << " acc=" << accNo
+                  << " cur=" << proto::currencyToString(cur)
+                  << " newBal=" << newBal
+                  << " info=" << info << "\n";
+    }
 }
 
 void Client::clearScreen() {
@@ -227,7 +238,15 @@ void Client::run() {
         std::cout << "4) WITHDRAW (non-idempotent)\n";
         std::cout << "5) QUERY balance (idempotent)\n";
         std::cout << "6) TRANSFER (non-idempotent)\n";
-        std::cout << "7) MONITOR register (callback)\n";
+        auto monitorLeft = std::chrono::duration_cast<std::chrono::seconds>(
+            Clock::duration(printUntil_.load(std::memory_order_relaxed)) - Clock::now().time_since_epoch()).count();
+        if (monitorLeft > 0) {
+            std::cout << "7) MONITOR register (callback) [active, " << monitorLeft << "s left]\n";
+        } else {
+            std::cout << "7) MONITOR register (callback)\n";
+        }
+        std::cout << "8) METRICS (latency / retries)\n";
+        std::cout << "9) SNAPSHOT all balances of a holder (idempotent)\n";
         std::cout << "0) EXIT\n";
         std::cout << "Choose: ";
 
@@ -251,6 +270,10 @@ void Client::run() {
             handleTransfer();
         } else if (choice == "7") {
             handleMonitor();
+        } else if (choice == "8") {
+            handleMetrics();
+        } else if (choice == "9") {
+            handleSnapshot();
         } else {
             std::cout << "Unknown option\n";
         }
@@ -291,15 +314,12 @@ void Client::handleOpen() {
         return;
     }
 
-    // Build request body
-    std::vector<uint8_t> body;
-    proto::putString(body, name);
-    proto::putPassword16(body, password);
-    proto::putU16(body, currency);
-    proto::putDouble(body, initialBalance);
-
+    // Request body is written straight into the pipeline's send buffer
+    const uint16_t op = (uint16_t)proto::OpCode::OPEN;
     proto::Message reply;
-    if (!call((uint16_t)proto::OpCode::OPEN, body, reply)) {
+    if (!call(op, proto::requestBodySize(op, name.size()), [&](proto::Writer& w) {
+            proto::writeOpenRequest(w, name, password, currency, initialBalance);
+        }, reply)) {
         std::cout << "Network error: No reply from server (UDP packet loss/wrong port/server not running/firewall). Returned to menu.\n";
         readLine("Press Enter to continue...");
         return;
@@ -311,11 +331,11 @@ void Client::handleOpen() {
         return;
     }
 
-    size_t off = 0;
     int32_t accNo;
     double bal;
-    if (proto::getI32(reply.body, off, accNo) && proto::getDouble(reply.body, off, bal)) {
+    if (proto::schema::OpenReply::read(reply.body, accNo, bal)) {
         std::cout << "OPEN OK. accountNo=" << accNo << " balance=" << bal << "\n";
+        if (cache_) cache_->put(accNo, name, password, currency, bal);
     }
     readLine("Press Enter to continue...");
 }
@@ -337,13 +357,11 @@ void Client::handleClose() {
     std::string password = readPassword("password (or 'q' to cancel): ");
     if (password == "q" || password == "Q") return;
 
-    std::vector<uint8_t> body;
-    proto::putString(body, name);
-    proto::putI32(body, accNo);
-    proto::putPassword16(body, password);
-
+    const uint16_t op = (uint16_t)proto::OpCode::CLOSE;
     proto::Message reply;
-    if (!call((uint16_t)proto::OpCode::CLOSE, body, reply)) {
+    if (!call(op, proto::requestBodySize(op, name.size()), [&](proto::Writer& w) {
+            proto::writeAuthRequest(w, name, accNo, password);
+        }, reply)) {
         std::cout << "CLOSE failed: communication error\n";
         readLine("Press Enter to continue...");
         return;
@@ -355,11 +373,12 @@ void Client::handleClose() {
         return;
     }
 
-    size_t off = 0;
-    std::string msg;
-    if (proto::getString(reply.body, off, msg)) {
+    std::string_view msg;
+    if (proto::schema::TextReply::read(reply.body, msg)) {
         std::cout << "CLOSE OK: " << msg << "\n";
     }
+    if (cache_) cache_->erase(accNo);
+    if (tokens_) tokens_->erase(accNo);
     readLine("Press Enter to continue...");
 }
 
@@ -390,15 +409,13 @@ void Client::handleDeposit() {
         return;
     }
 
-    std::vector<uint8_t> body;
-    proto::putString(body, name);
-    proto::putI32(body, accNo);
-    proto::putPassword16(body, password);
-    proto::putU16(body, currency);
-    proto::putDouble(body, amount);
-
+    const uint16_t op = (uint16_t)proto::OpCode::DEPOSIT;
     proto::Message reply;
-    if (!call((uint16_t)proto::OpCode::DEPOSIT, body, reply)) {
+    if (!callAs(op, accNo, name, password, [&](proto::Writer& w) {
+            proto::writeAmountRequest(w, name, accNo, password, currency, amount);
+        }, [&](proto::Writer& w, uint64_t token) {
+            proto::writeTokenAmountRequest(w, token, accNo, currency, amount);
+        }, reply)) {
         std::cout << "DEPOSIT failed: communication error\n";
         readLine("Press Enter to continue...");
         return;
@@ -410,11 +427,11 @@ void Client::handleDeposit() {
         return;
     }
 
-    size_t off = 0;
     double newBal;
-    if (proto::getDouble(reply.body, off, newBal)) {
+    if (proto::schema::BalanceReply::read(reply.body, newBal)) {
         std::cout << "Password & account verified. Hello, " << name << "!\n";
         std::cout << "DEPOSIT OK. new balance=" << newBal << "\n";
+        if (cache_) cache_->put(accNo, name, password, currency, newBal);
     }
     readLine("Press Enter to continue...");
 }
@@ -446,15 +463,13 @@ void Client::handleWithdraw() {
         return;
     }
 
-    std::vector<uint8_t> body;
-    proto::putString(body, name);
-    proto::putI32(body, accNo);
-    proto::putPassword16(body, password);
-    proto::putU16(body, currency);
-    proto::putDouble(body, amount);
-
+    const uint16_t op = (uint16_t)proto::OpCode::WITHDRAW;
     proto::Message reply;
-    if (!call((uint16_t)proto::OpCode::WITHDRAW, body, reply)) {
+    if (!callAs(op, accNo, name, password, [&](proto::Writer& w) {
+            proto::writeAmountRequest(w, name, accNo, password, currency, amount);
+        }, [&](proto::Writer& w, uint64_t token) {
+            proto::writeTokenAmountRequest(w, token, accNo, currency, amount);
+        }, reply)) {
         std::cout << "WITHDRAW failed: communication error\n";
         readLine("Press Enter to continue...");
         return;
@@ -466,11 +481,11 @@ void Client::handleWithdraw() {
         return;
     }
 
-    size_t off = 0;
     double newBal;
-    if (proto::getDouble(reply.body, off, newBal)) {
+    if (proto::schema::BalanceReply::read(reply.body, newBal)) {
         std::cout << "Password & account verified. Hello, " << name << "!\n";
         std::cout << "WITHDRAW OK. new balance=" << newBal << "\n";
+        if (cache_) cache_->put(accNo, name, password, currency, newBal);
     }
     readLine("Press Enter to continue...");
 }
@@ -492,13 +507,27 @@ void Client::handleQueryBalance() {
     std::string password = readPassword("password (or 'q' to cancel): ");
     if (password == "q" || password == "Q") return;
 
-    std::vector<uint8_t> body;
-    proto::putString(body, name);
-    proto::putI32(body, accNo);
-    proto::putPassword16(body, password);
+    if (cache_) {
+        uint16_t cur;
+        double bal;
+        BalanceCache::Clock::duration age;
+        if (cache_->lookup(accNo, name, password, cur, bal, &age)) {
+            auto ageMs = std::chrono::duration_cast<std::chrono::milliseconds>(age).count();
+            std::cout << "[client] QUERY served from local cache (age=" << ageMs << "ms"
+                      << (cache_->monitorLive() ? ", monitor live" : "") << ")\n";
+            std::cout << "BALANCE: " << bal << " " << proto::currencyToString(cur) << "\n";
+            readLine("Press Enter to continue...");
+            return;
+        }
+    }
 
+    const uint16_t op = (uint16_t)proto::OpCode::QUERY_BALANCE;
     proto::Message reply;
-    if (!call((uint16_t)proto::OpCode::QUERY_BALANCE, body, reply)) {
+    if (!callAs(op, accNo, name, password, [&](proto::Writer& w) {
+            proto::writeAuthRequest(w, name, accNo, password);
+        }, [&](proto::Writer& w, uint64_t token) {
+            proto::writeTokenRequest(w, token, accNo);
+        }, reply)) {
         std::cout << "QUERY failed: communication error\n";
         readLine("Press Enter to continue...");
         return;
@@ -510,12 +539,12 @@ void Client::handleQueryBalance() {
         return;
     }
 
-    size_t off = 0;
     uint16_t cur;
     double bal;
-    if (proto::getU16(reply.body, off, cur) && proto::getDouble(reply.body, off, bal)) {
+    if (proto::schema::QueryReply::read(reply.body, cur, bal)) {
         std::cout << "Password & account verified. Hello, " << name << "!\n";
         std::cout << "BALANCE: " << bal << " " << proto::currencyToString(cur) << "\n";
+        if (cache_) cache_->put(accNo, name, password, cur, bal);
     }
     readLine("Press Enter to continue...");
 }
@@ -558,16 +587,13 @@ void Client::handleTransfer() {
         return;
     }
 
-    std::vector<uint8_t> body;
-    proto::putString(body, name);
-    proto::putI32(body, fromAccNo);
-    proto::putPassword16(body, password);
-    proto::putI32(body, toAccNo);
-    proto::putU16(body, currency);
-    proto::putDouble(body, amount);
-
+    const uint16_t op = (uint16_t)proto::OpCode::TRANSFER;
     proto::Message reply;
-    if (!call((uint16_t)proto::OpCode::TRANSFER, body, reply)) {
+    if (!callAs(op, fromAccNo, name, password, [&](proto::Writer& w) {
+            proto::writeTransferRequest(w, name, fromAccNo, password, toAccNo, currency, amount);
+        }, [&](proto::Writer& w, uint64_t token) {
+            proto::writeTokenTransferRequest(w, token, fromAccNo, toAccNo, currency, amount);
+        }, reply)) {
         std::cout << "TRANSFER failed: communication error\n";
         readLine("Press Enter to continue...");
         return;
@@ -579,11 +605,14 @@ void Client::handleTransfer() {
         return;
     }
 
-    size_t off = 0;
     double fromBal, toBal;
-    if (proto::getDouble(reply.body, off, fromBal) && proto::getDouble(reply.body, off, toBal)) {
+    if (proto::schema::TransferReply::read(reply.body, fromBal, toBal)) {
         std::cout << "Password & account verified. Hello, " << name << "!\n";
         std::cout << "TRANSFER OK. fromNewBal=" << fromBal << " toNewBal=" << toBal << "\n";
+        if (cache_) {
+            cache_->put(fromAccNo, name, password, currency, fromBal);
+            cache_->update(toAccNo, currency, toBal);
+        }
     }
     readLine("Press Enter to continue...");
 }
@@ -599,11 +628,24 @@ void Client::handleMonitor() {
         return;
     }
 
-    std::vector<uint8_t> body;
-    proto::putU16(body, (uint16_t)seconds);
+    // Optional filter; this client also takes updates batched per datagram
+    std::vector<int32_t> accounts;
+    {
+        std::istringstream in(readLine("accounts to watch, separated by spaces (Enter = all): "));
+        int32_t acc;
+        while (in >> acc) accounts.push_back(acc);
+    }
+    if (accounts.size() > proto::MONITOR_MAX_FILTER) {
+        std::cout << "At most " << proto::MONITOR_MAX_FILTER << " accounts.\n";
+        return;
+    }
 
+    const uint16_t op = (uint16_t)proto::OpCode::MONITOR_REGISTER;
     proto::Message reply;
-    if (!call((uint16_t)proto::OpCode::MONITOR_REGISTER, body, reply)) {
+    if (!call(op, proto::monitorRequestSize(accounts.size()), [&](proto::Writer& w) {
+            proto::writeMonitorRequest(w, (uint16_t)seconds, proto::MONITOR_BATCH, accounts.data(),
+                                       accounts.size());
+        }, reply)) {
         std::cout << "MONITOR failed: communication error\n";
         readLine("Press Enter to continue...");
         return;
@@ -615,71 +657,57 @@ void Client::handleMonitor() {
         return;
     }
 
-    size_t off = 0;
-    std::string msg;
-    if (proto::getString(reply.body, off, msg)) {
+    std::string_view msg;
+    if (proto::schema::TextReply::read(reply.body, msg)) {
         std::cout << "MONITOR OK: " << msg << "\n";
     }
 
-    std::cout << "== Waiting callbacks for " << seconds << " seconds (client blocked) ==\n";
-
-    // Set shorter timeout for polling
-#ifdef _WIN32
-    DWORD tv = 1000;
-    setsockopt(sock_, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
-#else
-    struct timeval tv;
-    tv.tv_sec = 1;
-    tv.tv_usec = 0;
-    setsockopt(sock_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-#endif
-
-    auto endTime = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
-
-    while (std::chrono::steady_clock::now() < endTime) {
-        std::vector<uint8_t> buf(2048);
-        sockaddr_in fromAddr;
-#ifdef _WIN32
-        int fromLen = sizeof(fromAddr);
-#else
-        socklen_t fromLen = sizeof(fromAddr);
-#endif
+    // Callbacks keep arriving on the background threads; the menu stays usable
+    auto endTime = Clock::now() + std::chrono::seconds(seconds);
+    if (cache_) cache_->setMonitorUntil(endTime, accounts);
+    printUntil_.store(endTime.time_since_epoch().count(), std::memory_order_relaxed);
 
-        int n = recvfrom(sock_, (char*)buf.data(), (int)buf.size(), 0,
-                        (sockaddr*)&fromAddr, &fromLen);
-
-        if (n < 0) {
-            // Timeout, continue waiting
-            continue;
-        }
+    std::cout << "== Printing callbacks for the next " << seconds << " seconds (client not blocked) ==\n";
+    readLine("Press Enter to continue...");
+}
 
-        buf.resize(n);
-        proto::Message cb;
-        if (!proto::decode(buf, cb)) continue;
-        if (cb.h.msgType != (uint8_t)proto::MsgType::Callback) continue;
-        if (cb.h.opCode != (uint16_t)proto::OpCode::CALLBACK_UPDATE) continue;
+void Client::handleMetrics() {
+    clearScreen();
+    std::cout << "=== METRICS ===\n";
+    metrics::writeText(std::cout, runtime_->metrics());
+    readLine("Press Enter to continue...");
+}
 
-        size_t cbOff = 0;
-        uint16_t updateType;
-        int32_t accNo;
-        uint16_t cur;
-        double newBal;
-        std::string info;
-
-        if (proto::getU16(cb.body, cbOff, updateType) &&
-            proto::getI32(cb.body, cbOff, accNo) &&
-            proto::getU16(cb.body, cbOff, cur) &&
-            proto::getDouble(cb.body, cbOff, newBal) &&
-            proto::getString(cb.body, cbOff, info)) {
-            
-            std::cout << "[CALLBACK] type=" << proto::opCodeToString(updateType)
-                      << " acc=" << accNo
-                      << " cur=" << proto::currencyToString(cur)
-                      << " newBal=" << newBal
-                      << " info=" << info << "\n";
-        }
+void Client::handleSnapshot() {
+    clearScreen();
+    std::cout << "=== SNAPSHOT (enter 'q' at any prompt to cancel) ===\n";
+
+    SnapshotReader::Options opt;
+    opt.name = readLine("name (or 'q' to cancel): ");
+    if (opt.name.empty() || opt.name == "q" || opt.name == "Q") return;
+    opt.password = readPassword("password (or 'q' to cancel): ");
+    if (opt.password == "q" || opt.password == "Q") return;
+    opt.attempts = retryCount_;
+
+    // Entries are printed as their chunks arrive, and refresh the cache
+    BANK_LOG(logging::Info, true, "sending op=SNAPSHOT name=" << opt.name);
+    double total[2] = {0, 0};
+    SnapshotReader reader(*runtime_, opt, [&](const SnapshotReader::Entry& e) {
+        std::cout << "  accountNo=" << e.accNo << " currency=" << proto::currencyToString(e.currency)
+                  << " balance=" << e.balance << "\n";
+        if (e.currency < 2) total[e.currency] += e.balance;
+        if (cache_) cache_->put(e.accNo, opt.name, opt.password, e.currency, e.balance);
+    });
+    SnapshotReader::Result r = reader.run();
+
+    if (r.status != (uint16_t)proto::Status::OK) {
+        std::cout << "SNAPSHOT failed, status=" << proto::statusToString(r.status) << "\n";
+    } else if (!r.ok) {
+        std::cout << "SNAPSHOT incomplete: no reply from server, stopped at accountNo " << r.next << "\n";
+    } else {
+        std::cout << "SNAPSHOT OK. " << r.entries << " account(s), CNY total=" << total[0]
+                  << " SGD total=" << total[1] << " (" << r.chunks << " chunk(s) in " << r.requests
+                  << " request(s), " << r.resumes << " resumed)\n";
     }
-
-    std::cout << "== Monitor finished ==\n";
     readLine("Press Enter to continue...");
 }
@@ -1,45 +1,95 @@
 #pragma once
 
+#include "balance_cache.hpp"
+#include "callback_bus.hpp"
+#include "net.hpp"
 #include "protocol.hpp"
+#include "runtime.hpp"
+#include "token_cache.hpp"
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <string>
 
-#ifdef _WIN32
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#else
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-#include <unistd.h>
-#endif
-
 /**
  * UDP Client for the Distributed Banking System
  * 
  * Features:
  * - At-least-once and At-most-once invocation semantics
- * - Configurable timeout and retry
+ * - Configurable timeout and retry, fixed or RTT-adaptive retransmission
  * - Full banking operations support
+ * - Optional local QUERY_BALANCE cache refreshed by replies and callbacks
+ * - Background receive thread: monitoring runs alongside normal requests
+ * - Optionally several servers, routed by account
+ * - Optional rate limit, adaptive in-flight cap and circuit breaker
+ * - Optional capture of all traffic to a binary trace (see trace.hpp)
+ * - Optional compact and LZ body encodings (see compact.hpp)
+ * - SNAPSHOT of all balances of a holder, streamed in chunks (see snapshot.hpp)
+ * - Optional session tokens: one LOGIN per account, then deposits,
+ *   withdrawals, queries and transfers without name and password (see
+ *   token_cache.hpp; one server only)
  */
 class Client {
 public:
+    using Clock = std::chrono::steady_clock;
+
     /**
      * Constructor
      * @param serverIp Server IP address
      * @param serverPort Server port number
      * @param atMostOnce Use at-most-once semantics if true, at-least-once if false
-     * @param timeoutMs Timeout in milliseconds
+     * @param timeoutMs Timeout in milliseconds (initial RTO in adaptive mode)
      * @param retryCount Number of retries on timeout
+     * @param rtoMode Fixed timeout or RTT-adaptive retransmission timer
+     * @param cacheTtlMs Balance cache lifetime without a live monitor (0 = no cache)
+     * @param cacheStaleMs Balance cache lifetime while a monitor is live
      */
-    Client(const std::string& serverIp, int serverPort, bool atMostOnce, int timeoutMs, int retryCount);
+    Client(const std::string& serverIp, int serverPort, bool atMostOnce, int timeoutMs, int retryCount,
+           RetransmitPolicy::Mode rtoMode = RetransmitPolicy::Mode::Fixed,
+           int cacheTtlMs = 0, int cacheStaleMs = 30000);
     
     /**
-     * Destructor - cleanup socket
+     * Destructor - stop the background threads
      */
     ~Client();
 
     /**
-     * Initialize the client (create socket, etc.)
+     * Use several servers instead of serverIp:serverPort (call before init())
+     * @param list "ip:port,ip:port,..." requests go to the owner of their account
+     */
+    void setServers(const std::string& list) { servers_ = list; }
+
+    /**
+     * Rate limit, congestion window and circuit breaker (call before init())
+     */
+    void setFlowControl(const FlowControl::Config& flow) { flow_ = flow; }
+
+    /**
+     * Lose and delay datagrams in the transport, for testing (call before init())
+     */
+    void setImpairment(const Impairment::Config& impair) { impair_ = impair; }
+
+    /**
+     * Capture every datagram to this trace file (call before init())
+     */
+    void setTrace(const std::string& path) { trace_ = path; }
+
+    /**
+     * Body encodings to ask the server for (call before init())
+     */
+    void setEncoding(bool compact, bool lz) {
+        compact_ = compact;
+        lz_ = lz;
+    }
+
+    /**
+     * Log in once per account and use its session token (call before init();
+     * ignored with several servers)
+     */
+    void setTokens(bool on) { tokensOn_ = on; }
+
+    /**
+     * Initialize the client (create socket, start receive/dispatch threads)
      * @return true on success
      */
     bool init();
@@ -49,6 +99,11 @@ public:
      */
     void run();
 
+    /**
+     * Request metrics collected so far (after init())
+     */
+    metrics::Snapshot metrics() const { return runtime_->metrics(); }
+
 private:
     // Network configuration
     std::string serverIp_;
@@ -56,25 +111,82 @@ private:
     bool atMostOnce_;
     int timeoutMs_;
     int retryCount_;
+    RetransmitPolicy::Mode rtoMode_;
+    std::string servers_;  // empty = serverIp_:serverPort_
+    FlowControl::Config flow_;
+    Impairment::Config impair_;
+    std::string trace_;    // empty = no capture
+    bool compact_ = false;
+    bool lz_ = false;
+    bool tokensOn_ = false;
+
+    // One worker thread owns the socket: it sends, matches replies and
+    // publishes callbacks to bus_ (created by init())
+    std::unique_ptr<Runtime> runtime_;
+    CallbackBus bus_;
+
+    // Balance cache, null unless enabled with cacheTtlMs > 0
+    int cacheTtlMs_;
+    int cacheStaleMs_;
+    std::unique_ptr<BalanceCache> cache_;
 
-#ifdef _WIN32
-    SOCKET sock_;
-#else
-    int sock_;
-#endif
-    sockaddr_in serverAddr_;
+    // Session tokens, null unless enabled with setTokens()
+    std::unique_ptr<TokenCache> tokens_;
+    bool tokensProbed_ = false;  // the server answered the probe LOGIN
 
-    // Request ID counter
-    uint64_t nextRequestId_;
+    // Print CALLBACK_UPDATE notifications until this steady_clock tick count
+    std::atomic<int64_t> printUntil_;
 
     /**
      * Send a request and wait for reply
      * @param opCode Operation code
-     * @param body Request body
+     * @param bodyLen Exact request body size
+     * @param writeBody Callable taking proto::Writer&, writes the body in place
      * @param reply Output reply message
      * @return true on success
      */
-    bool call(uint16_t opCode, const std::vector<uint8_t>& body, proto::Message& reply);
+    template <class BodyFn>
+    bool call(uint16_t opCode, size_t bodyLen, BodyFn&& writeBody, proto::Message& reply) {
+        logSend(opCode, bodyLen);
+        return checkReply(runtime_->callWith(opCode, bodyLen, writeBody, reply), reply);
+    }
+
+    /**
+     * call() with the account's session token where one can be had, else
+     * with name and password; a token the server refuses is dropped and the
+     * call made again with name and password (the refused request changed
+     * nothing, so this is safe for non-idempotent operations too)
+     * @param opCode Operation with name and password (DEPOSIT, ...)
+     * @param writeBody Writes that operation's body
+     * @param writeToken Callable taking (proto::Writer&, uint64_t token), writes the token variant's body
+     */
+    template <class BodyFn, class TokenFn>
+    bool callAs(uint16_t opCode, int32_t accNo, const std::string& name, const std::string& password,
+                BodyFn&& writeBody, TokenFn&& writeToken, proto::Message& reply) {
+        uint64_t token;
+        if (tokenFor(accNo, name, password, token)) {
+            const uint16_t op = proto::tokenOpCode(opCode);
+            bool ok = call(op, proto::requestBodySize(op, 0), [&](proto::Writer& w) { writeToken(w, token); }, reply);
+            if (!ok || reply.h.status != (uint16_t)proto::Status::ERR_AUTH) return ok;
+            dropToken(accNo);
+        }
+        return call(opCode, proto::requestBodySize(opCode, name.size()), writeBody, reply);
+    }
+
+    /**
+     * Session token for an account: cached, or from a LOGIN now
+     * @return false if tokens are off or the LOGIN did not succeed
+     */
+    bool tokenFor(int32_t accNo, const std::string& name, const std::string& password, uint64_t& token);
+    void dropToken(int32_t accNo);
+
+    void logSend(uint16_t opCode, size_t bodyLen);
+    bool checkReply(bool ok, const proto::Message& reply);
+
+    // Subscribed for the whole session (dispatch thread): feeds the cache,
+    // prints while a monitor registration is live
+    void onCallback(const proto::MessageView& cb);
+    void onUpdate(uint16_t updateType, int32_t accNo, uint16_t cur, double newBal, std::string_view info);
 
     // Operation handlers
     void handleOpen();
@@ -84,6 +196,8 @@ private:
     void handleQueryBalance();
     void handleTransfer();
     void handleMonitor();
+    void handleMetrics();
+    void handleSnapshot();
 
     // Utility functions
     void clearScreen();
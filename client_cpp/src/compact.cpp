@@ -0,0 +1,238 @@
+#include "compact.hpp"
+#include "endian.hpp"
+#include "lz.hpp"
+#include "schema.hpp"
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+
+namespace compact {
+
+namespace {
+
+namespace schema = proto::schema;
+using proto::OpCode;
+
+// Read a body with one layout and write the same values with the other
+template <class From, class To> struct Recode;
+
+template <class... F, class... T>
+struct Recode<schema::Layout<F...>, schema::Layout<T...>> {
+    static bool run(const uint8_t* p, size_t n, proto::Writer& w) {
+        std::tuple<typename F::Value...> v;
+        if (!std::apply([&](auto&... x) { return schema::Layout<F...>::read(p, n, x...); }, v)) return false;
+        std::apply([&](const auto&... x) { schema::Layout<T...>::write(w, x...); }, v);
+        return w.ok();
+    }
+};
+
+template <class Wide, class Compact>
+bool recode(bool encode, const uint8_t* p, size_t n, proto::Writer& w) {
+    return encode ? Recode<Wide, Compact>::run(p, n, w) : Recode<Compact, Wide>::run(p, n, w);
+}
+
+bool request(uint16_t op, bool encode, const uint8_t* p, size_t n, proto::Writer& w) {
+    switch (OpCode(op)) {
+        case OpCode::OPEN:
+            return recode<schema::OpenRequest, schema::CompactOpenRequest>(encode, p, n, w);
+        case OpCode::CLOSE:
+        case OpCode::QUERY_BALANCE:
+            return recode<schema::AuthRequest, schema::CompactAuthRequest>(encode, p, n, w);
+        case OpCode::DEPOSIT:
+        case OpCode::WITHDRAW:
+            return recode<schema::AmountRequest, schema::CompactAmountRequest>(encode, p, n, w);
+        case OpCode::TRANSFER:
+            return recode<schema::TransferRequest, schema::CompactTransferRequest>(encode, p, n, w);
+        case OpCode::SNAPSHOT:
+            return recode<schema::SnapshotRequest, schema::CompactSnapshotRequest>(encode, p, n, w);
+        case OpCode::LOGIN:
+            return recode<schema::AuthRequest, schema::CompactAuthRequest>(encode, p, n, w);
+        case OpCode::DEPOSIT_TOKEN:
+        case OpCode::WITHDRAW_TOKEN:
+            return recode<schema::TokenAmountRequest, schema::CompactTokenAmountRequest>(encode, p, n, w);
+        case OpCode::QUERY_BALANCE_TOKEN:
+            return recode<schema::TokenRequest, schema::CompactTokenRequest>(encode, p, n, w);
+        case OpCode::TRANSFER_TOKEN:
+            return recode<schema::TokenTransferRequest, schema::CompactTokenTransferRequest>(encode, p, n, w);
+        default:
+            return false;  // MONITOR_REGISTER, nested BATCH
+    }
+}
+
+bool reply(uint16_t op, bool encode, const uint8_t* p, size_t n, proto::Writer& w) {
+    switch (OpCode(op)) {
+        case OpCode::OPEN:
+            return recode<schema::OpenReply, schema::CompactOpenReply>(encode, p, n, w);
+        case OpCode::CLOSE:
+            return recode<schema::TextReply, schema::CompactTextReply>(encode, p, n, w);
+        case OpCode::DEPOSIT:
+        case OpCode::WITHDRAW:
+        case OpCode::DEPOSIT_TOKEN:
+        case OpCode::WITHDRAW_TOKEN:
+            return recode<schema::BalanceReply, schema::CompactBalanceReply>(encode, p, n, w);
+        case OpCode::QUERY_BALANCE:
+        case OpCode::QUERY_BALANCE_TOKEN:
+            return recode<schema::QueryReply, schema::CompactQueryReply>(encode, p, n, w);
+        case OpCode::TRANSFER:
+        case OpCode::TRANSFER_TOKEN:
+            return recode<schema::TransferReply, schema::CompactTransferReply>(encode, p, n, w);
+        case OpCode::LOGIN:
+            return recode<schema::LoginReply, schema::CompactLoginReply>(encode, p, n, w);
+        default:
+            return false;
+    }
+}
+
+// count, then per entry a header and the sub-body, each sub-body recoded on its own
+template <bool Encode>
+bool batch(bool isReply, const uint8_t* p, size_t n, proto::Writer& w) {
+    using InCount = std::conditional_t<Encode, schema::BatchCount, schema::CompactBatchCount>;
+    using OutCount = std::conditional_t<Encode, schema::CompactBatchCount, schema::BatchCount>;
+    using InEntry = std::conditional_t<Encode, schema::BatchEntryHeader, schema::CompactBatchEntryHeader>;
+    using OutEntry = std::conditional_t<Encode, schema::CompactBatchEntryHeader, schema::BatchEntryHeader>;
+    using InReplyEntry =
+        std::conditional_t<Encode, schema::BatchReplyEntryHeader, schema::CompactBatchReplyEntryHeader>;
+    using OutReplyEntry =
+        std::conditional_t<Encode, schema::CompactBatchReplyEntryHeader, schema::BatchReplyEntryHeader>;
+
+    size_t off = 0;
+    uint16_t count;
+    if (!InCount::readAt(p, n, off, count)) return false;
+    OutCount::write(w, count);
+
+    uint8_t sub[proto::MAX_DATAGRAM];
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t op, id, status = uint16_t(proto::Status::OK), len;
+        bool ok = isReply ? InReplyEntry::readAt(p, n, off, op, id, status, len)
+                          : InEntry::readAt(p, n, off, op, id, len);
+        if (!ok || len > n - off) return false;
+
+        proto::Writer sw(sub, sizeof(sub));
+        if (isReply && status != uint16_t(proto::Status::OK)) {
+            sw.putBytes(p + off, len);  // failed sub-operations have no body to recode
+        } else if (!(isReply ? reply(op, Encode, p + off, len, sw) : request(op, Encode, p + off, len, sw))) {
+            return false;
+        }
+        off += len;
+
+        if (isReply) {
+            OutReplyEntry::write(w, op, id, status, uint16_t(sw.size()));
+        } else {
+            OutEntry::write(w, op, id, uint16_t(sw.size()));
+        }
+        w.putBytes(sub, sw.size());
+    }
+    return off == n && w.ok();
+}
+
+// Chunk header, then its entries; compact ones carry the step from the previous account number
+template <bool Encode>
+bool snapshotChunk(const uint8_t* p, size_t n, proto::Writer& w) {
+    using InChunk = std::conditional_t<Encode, schema::SnapshotChunk, schema::CompactSnapshotChunk>;
+    using OutChunk = std::conditional_t<Encode, schema::CompactSnapshotChunk, schema::SnapshotChunk>;
+    using InEntry = std::conditional_t<Encode, schema::SnapshotEntry, schema::CompactSnapshotEntry>;
+    using OutEntry = std::conditional_t<Encode, schema::CompactSnapshotEntry, schema::SnapshotEntry>;
+
+    size_t off = 0;
+    uint16_t chunk, flags, count;
+    int32_t next;
+    if (!InChunk::readAt(p, n, off, chunk, flags, next, count)) return false;
+    OutChunk::write(w, chunk, flags, next, count);
+
+    uint32_t prev = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        int32_t acc;
+        uint16_t currency;
+        double balance;
+        if (!InEntry::readAt(p, n, off, acc, currency, balance)) return false;
+        if constexpr (Encode) {
+            OutEntry::write(w, int32_t(uint32_t(acc) - prev), currency, balance);
+            prev = uint32_t(acc);
+        } else {
+            prev += uint32_t(acc);
+            OutEntry::write(w, int32_t(prev), currency, balance);
+        }
+    }
+    return off == n && w.ok();
+}
+
+bool transcode(uint16_t op, bool isReply, bool encode, const uint8_t* p, size_t n, proto::Writer& w) {
+    if (op == uint16_t(OpCode::BATCH)) {
+        return encode ? batch<true>(isReply, p, n, w) : batch<false>(isReply, p, n, w);
+    }
+    if (isReply && op == uint16_t(OpCode::SNAPSHOT)) {
+        return encode ? snapshotChunk<true>(p, n, w) : snapshotChunk<false>(p, n, w);
+    }
+    return isReply ? reply(op, encode, p, n, w) : request(op, encode, p, n, w);
+}
+
+} // namespace
+
+uint16_t pack(uint16_t opCode, bool reply, uint16_t flags, const uint8_t* body, size_t len, uint8_t* out,
+              size_t cap, size_t& outLen) {
+    if (len > proto::MAX_DATAGRAM) return 0;
+    uint8_t tmp[proto::MAX_DATAGRAM];
+    const uint8_t* cur = body;
+    size_t curLen = len;
+    uint16_t applied = 0;
+
+    if (flags & proto::FLAG_COMPACT) {
+        proto::Writer w(tmp, sizeof(tmp));
+        if (transcode(opCode, reply, true, body, len, w) && w.size() < len) {
+            cur = tmp;
+            curLen = w.size();
+            applied |= proto::FLAG_COMPACT;
+        }
+    }
+    if ((flags & proto::FLAG_LZ) && curLen >= LZ_MIN_BODY && cap > 2) {
+        // Kept only if the block and its rawLen come out smaller
+        size_t z = lz::compress(cur, curLen, out + 2, std::min(cap - 2, curLen - 3));
+        if (z > 0) {
+            proto::putBE16(out, uint16_t(curLen));
+            outLen = 2 + z;
+            return applied | proto::FLAG_LZ;
+        }
+    }
+    if (applied == 0 || curLen > cap) return 0;
+    std::memcpy(out, cur, curLen);
+    outLen = curLen;
+    return applied;
+}
+
+bool unpack(uint16_t opCode, bool reply, uint16_t flags, const uint8_t* body, size_t len, uint8_t* out,
+            size_t cap, size_t& outLen) {
+    const bool compact = (flags & proto::FLAG_COMPACT) != 0;
+    uint8_t tmp[proto::MAX_DATAGRAM];
+    const uint8_t* cur = body;
+    size_t curLen = len;
+
+    if (flags & proto::FLAG_LZ) {
+        if (len < 2) return false;
+        const size_t raw = proto::loadBE16(body);
+        uint8_t* dst = compact ? tmp : out;
+        size_t got = 0;
+        if (raw > (compact ? sizeof(tmp) : cap) || !lz::decompress(body + 2, len - 2, dst, raw, got) ||
+            got != raw) {
+            return false;
+        }
+        if (!compact) {
+            outLen = raw;
+            return true;
+        }
+        cur = tmp;
+        curLen = raw;
+    }
+    if (compact) {
+        proto::Writer w(out, cap);
+        if (!transcode(opCode, reply, false, cur, curLen, w)) return false;
+        outLen = w.size();
+        return true;
+    }
+    if (len > cap) return false;
+    std::memcpy(out, body, len);
+    outLen = len;
+    return true;
+}
+
+} // namespace compact
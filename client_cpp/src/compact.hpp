@@ -0,0 +1,56 @@
+#pragma once
+
+#include "protocol.hpp"
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Optional body encodings, selected per datagram by header flags
+ *
+ * FLAG_COMPACT: every field of the wide layout in schema.hpp, in the same
+ * order, as its compact counterpart (schema::CompactXxx): integers as
+ * varints, names and passwords as varint-length strings, and money as the
+ * whole number of minor units (cents), which turns a typical amount from
+ * 8 bytes into 2 or 3. Only values that many cents reproduce exactly are
+ * encoded this way; a body holding any other goes out wide, so neither
+ * side ever rounds. BATCH entries are compact headers around compact
+ * sub-bodies, and SNAPSHOT entries give each account number as the step
+ * from the one before, 1 byte for consecutive accounts.
+ * MONITOR_REGISTER and callbacks have no compact form.
+ *
+ * FLAG_LZ: rawLen:u16, then the body (after FLAG_COMPACT, if both are set)
+ * as one LZ4 block (lz.hpp). Only tried on bodies of LZ_MIN_BODY bytes or
+ * more, BATCH and SNAPSHOT chunks in practice, and kept only if smaller.
+ *
+ * Both are a matter of the transport: callers build and read wide bodies
+ * as always, the Pipeline packs requests as they are launched and unpacks
+ * replies before handing them out, and server_cpp does the same the other
+ * way round. A reply uses an encoding only if its request did, so a client
+ * that does not ask never sees one.
+ */
+namespace compact {
+
+// Smallest body LZ is tried on
+static constexpr size_t LZ_MIN_BODY = 64;
+
+/**
+ * Encode a wide body for sending
+ * @param reply Reply body (status OK) rather than request body
+ * @param flags Encodings wanted: FLAG_COMPACT and/or FLAG_LZ
+ * @param out Encoded body, up to cap bytes
+ * @param outLen Output: its size
+ * @return the flags actually applied, 0 (nothing in out) if none was
+ */
+uint16_t pack(uint16_t opCode, bool reply, uint16_t flags, const uint8_t* body, size_t len, uint8_t* out,
+              size_t cap, size_t& outLen);
+
+/**
+ * Turn a received body back into the wide layout
+ * @param flags Header flags of the datagram (only FLAG_COMPACT and FLAG_LZ matter)
+ * @param out Wide body, up to cap bytes
+ * @return false if the body is malformed or does not fit
+ */
+bool unpack(uint16_t opCode, bool reply, uint16_t flags, const uint8_t* body, size_t len, uint8_t* out,
+            size_t cap, size_t& outLen);
+
+} // namespace compact
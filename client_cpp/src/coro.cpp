@@ -0,0 +1,136 @@
+#include "coro.hpp"
+#include "schema.hpp"
+#include <iostream>
+
+namespace coro {
+
+// ==================== Results ====================
+
+bool OpenResult::decode(const proto::MessageView& m) {
+    return proto::schema::OpenReply::read(m, accNo, balance);
+}
+
+bool CloseResult::decode(const proto::MessageView& m) {
+    std::string_view msg;
+    if (!proto::schema::TextReply::read(m, msg)) return false;
+    message.assign(msg);
+    return true;
+}
+
+bool AmountResult::decode(const proto::MessageView& m) {
+    return proto::schema::BalanceReply::read(m, balance);
+}
+
+bool QueryResult::decode(const proto::MessageView& m) {
+    return proto::schema::QueryReply::read(m, currency, balance);
+}
+
+bool TransferResult::decode(const proto::MessageView& m) {
+    return proto::schema::TransferReply::read(m, fromBalance, toBalance);
+}
+
+// ==================== Event loop ====================
+
+/**
+ * Eagerly started owner of a spawned task; its frame frees itself at the end
+ */
+struct EventLoop::Detached {
+    struct promise_type {
+        Detached get_return_object() const noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+};
+
+EventLoop::EventLoop(const Config& cfg) : cfg_(cfg), sock_(net::INVALID_SOCK), live_(0) {}
+
+EventLoop::~EventLoop() {
+    pipeline_.reset();
+    net::closeSocket(sock_);
+}
+
+bool EventLoop::open() {
+    sockaddr_in server;
+    if (!net::resolve(cfg_.serverIp, cfg_.serverPort, server)) {
+        std::cerr << "[client] invalid server ip: " << cfg_.serverIp << "\n";
+        return false;
+    }
+    sock_ = net::openUdp();
+    if (!net::isValid(sock_)) {
+        std::cerr << "[client] socket() failed\n";
+        return false;
+    }
+    pipeline_.reset(new Pipeline(sock_, server, cfg_.atMostOnce, RetransmitPolicy(cfg_.rtoMode, cfg_.timeoutMs),
+                                 cfg_.retryCount));
+    return true;
+}
+
+EventLoop::Detached EventLoop::own(EventLoop& loop, Task<void> task) {
+    co_await task;
+    loop.live_--;
+}
+
+void EventLoop::spawn(Task<void> task) {
+    live_++;
+    own(*this, std::move(task));
+}
+
+void EventLoop::run() {
+    // Every live task waits on a request, so polling is all there is to do:
+    // poll() flushes what the tasks queued, then resumes them from the
+    // completion callbacks
+    while (live_ > 0) pipeline_->poll(100);
+    pipeline_->flush();
+}
+
+// ==================== Operations ====================
+
+Call<OpenResult> Bank::open(const std::string& name, const std::string& password, uint16_t currency,
+                            double initialBalance) {
+    const uint16_t op = (uint16_t)proto::OpCode::OPEN;
+    return Call<OpenResult>(p_, op, proto::requestBodySize(op, name.size()), [&](proto::Writer& w) {
+        proto::writeOpenRequest(w, name, password, currency, initialBalance);
+    });
+}
+
+Call<CloseResult> Bank::close(const std::string& name, int32_t accNo, const std::string& password) {
+    const uint16_t op = (uint16_t)proto::OpCode::CLOSE;
+    return Call<CloseResult>(p_, op, proto::requestBodySize(op, name.size()), [&](proto::Writer& w) {
+        proto::writeAuthRequest(w, name, accNo, password);
+    });
+}
+
+Call<AmountResult> Bank::deposit(const std::string& name, int32_t accNo, const std::string& password,
+                                 uint16_t currency, double amount) {
+    const uint16_t op = (uint16_t)proto::OpCode::DEPOSIT;
+    return Call<AmountResult>(p_, op, proto::requestBodySize(op, name.size()), [&](proto::Writer& w) {
+        proto::writeAmountRequest(w, name, accNo, password, currency, amount);
+    });
+}
+
+Call<AmountResult> Bank::withdraw(const std::string& name, int32_t accNo, const std::string& password,
+                                  uint16_t currency, double amount) {
+    const uint16_t op = (uint16_t)proto::OpCode::WITHDRAW;
+    return Call<AmountResult>(p_, op, proto::requestBodySize(op, name.size()), [&](proto::Writer& w) {
+        proto::writeAmountRequest(w, name, accNo, password, currency, amount);
+    });
+}
+
+Call<QueryResult> Bank::queryBalance(const std::string& name, int32_t accNo, const std::string& password) {
+    const uint16_t op = (uint16_t)proto::OpCode::QUERY_BALANCE;
+    return Call<QueryResult>(p_, op, proto::requestBodySize(op, name.size()), [&](proto::Writer& w) {
+        proto::writeAuthRequest(w, name, accNo, password);
+    });
+}
+
+Call<TransferResult> Bank::transfer(const std::string& name, int32_t fromAccNo, const std::string& password,
+                                    int32_t toAccNo, uint16_t currency, double amount) {
+    const uint16_t op = (uint16_t)proto::OpCode::TRANSFER;
+    return Call<TransferResult>(p_, op, proto::requestBodySize(op, name.size()), [&](proto::Writer& w) {
+        proto::writeTransferRequest(w, name, fromAccNo, password, toAccNo, currency, amount);
+    });
+}
+
+} // namespace coro
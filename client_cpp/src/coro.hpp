@@ -0,0 +1,299 @@
+#pragma once
+
+#include "net.hpp"
+#include "pipeline.hpp"
+#include "protocol.hpp"
+#include "rto.hpp"
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+#include <utility>
+
+/**
+ * Coroutine facade over the client transport (C++20)
+ *
+ * Bank operations are awaitables on an EventLoop, one thread driving one
+ * socket and its Pipeline:
+ *
+ *   coro::Task<void> session(coro::Bank& bank, int32_t accNo) {
+ *       coro::AmountResult d = co_await bank.deposit("alice", accNo, "pw", cny, 10.0);
+ *       if (!d.ok()) co_return;
+ *       coro::QueryResult q = co_await bank.queryBalance("alice", accNo, "pw");
+ *   }
+ *   loop.spawn(session(bank, 10001));
+ *   loop.run();
+ *
+ * - An operation encodes its body straight into the Pipeline's send buffer
+ *   (the same bodies as the interactive client) and suspends; the reply is
+ *   decoded in the completion callback, which resumes the coroutine
+ * - Await types live in the coroutine frame, so an operation allocates
+ *   nothing; a logical session costs its frame (a few hundred bytes) plus
+ *   one pooled Pipeline slot per request it has in flight
+ * - Task<T> is lazy and resumes its awaiter by symmetric transfer, so
+ *   nested tasks do not grow the stack
+ * - Failures are reported in the result (ok(), delivered, status), never
+ *   thrown
+ *
+ * Not thread-safe: an EventLoop, its Bank and its tasks belong to the
+ * thread that calls run().
+ */
+namespace coro {
+
+template <class T = void>
+class Task;
+
+namespace detail {
+
+// Bytes held by this thread's Task frames
+inline thread_local size_t frameBytes = 0;
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;  // awaiting coroutine, resumed when this one ends
+
+    static void* operator new(size_t n) {
+        frameBytes += n;
+        return ::operator new(n);
+    }
+    static void operator delete(void* p, size_t n) {
+        frameBytes -= n;
+        ::operator delete(p);
+    }
+
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+        template <class P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+            std::coroutine_handle<> next = h.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() const noexcept { std::terminate(); }
+};
+
+template <class T>
+struct Promise : PromiseBase {
+    T value{};
+    void return_value(T v) { value = std::move(v); }
+    T take() { return std::move(value); }
+};
+
+template <>
+struct Promise<void> : PromiseBase {
+    void return_void() const noexcept {}
+    void take() const noexcept {}
+};
+
+} // namespace detail
+
+// Bytes held by the calling thread's Task frames
+inline size_t liveFrameBytes() { return detail::frameBytes; }
+
+/**
+ * Lazily started coroutine returning T; runs when awaited (or spawned)
+ */
+template <class T>
+class Task {
+public:
+    struct promise_type : detail::Promise<T> {
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    };
+
+    Task(Task&& o) noexcept : h_(std::exchange(o.h_, {})) {}
+    Task& operator=(Task&& o) noexcept {
+        if (this != &o) {
+            if (h_) h_.destroy();
+            h_ = std::exchange(o.h_, {});
+        }
+        return *this;
+    }
+    ~Task() {
+        if (h_) h_.destroy();
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    bool await_ready() const noexcept { return !h_ || h_.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        h_.promise().continuation = awaiting;
+        return h_;
+    }
+    T await_resume() { return h_.promise().take(); }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> h) : h_(h) {}
+
+    std::coroutine_handle<promise_type> h_;
+};
+
+// ==================== Results ====================
+
+/**
+ * Common part of every operation result
+ */
+struct Result {
+    bool delivered = false;  // a reply arrived (false: all attempts timed out)
+    uint16_t status = 0;     // reply status (proto::Status)
+    int attempts = 0;        // datagrams sent
+    std::chrono::microseconds latency{0};
+
+    bool ok() const { return delivered && status == (uint16_t)proto::Status::OK; }
+};
+
+struct OpenResult : Result {
+    int32_t accNo = 0;
+    double balance = 0;
+    bool decode(const proto::MessageView& m);
+};
+
+struct CloseResult : Result {
+    std::string message;
+    bool decode(const proto::MessageView& m);
+};
+
+// DEPOSIT, WITHDRAW
+struct AmountResult : Result {
+    double balance = 0;
+    bool decode(const proto::MessageView& m);
+};
+
+struct QueryResult : Result {
+    uint16_t currency = 0;
+    double balance = 0;
+    bool decode(const proto::MessageView& m);
+};
+
+struct TransferResult : Result {
+    double fromBalance = 0;
+    double toBalance = 0;
+    bool decode(const proto::MessageView& m);
+};
+
+// ==================== Event loop ====================
+
+class EventLoop {
+public:
+    struct Config {
+        std::string serverIp = "127.0.0.1";
+        int serverPort = 9000;
+        bool atMostOnce = false;
+        int timeoutMs = 500;
+        int retryCount = 3;
+        RetransmitPolicy::Mode rtoMode = RetransmitPolicy::Mode::Fixed;
+    };
+
+    explicit EventLoop(const Config& cfg);
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    /**
+     * Open the socket
+     * @return false if the address is invalid or the socket could not be opened
+     */
+    bool open();
+
+    /**
+     * Start a task now; it runs up to its first suspension and the loop
+     * owns it from then on
+     */
+    void spawn(Task<void> task);
+
+    /**
+     * Drive the socket until every spawned task has finished
+     */
+    void run();
+
+    // Tasks spawned and not yet finished
+    size_t live() const { return live_; }
+
+    Pipeline& pipeline() { return *pipeline_; }
+    net::Socket socket() const { return sock_; }
+
+private:
+    struct Detached;
+
+    Config cfg_;
+    net::Socket sock_;
+    std::unique_ptr<Pipeline> pipeline_;
+    size_t live_;
+
+    static Detached own(EventLoop& loop, Task<void> task);
+};
+
+// ==================== Operations ====================
+
+/**
+ * One request in flight; awaited for its result R
+ *
+ * The request is sent when the Call is created. It completes only while
+ * the loop is polling, so a Call may be awaited later (several issued,
+ * then awaited in turn) as long as it outlives its reply.
+ */
+template <class R>
+class Call {
+public:
+    template <class BodyFn>
+    Call(Pipeline& p, uint16_t opCode, size_t bodyLen, BodyFn&& writeBody) : done_(false) {
+        uint64_t id = p.submitWith(opCode, bodyLen, std::forward<BodyFn>(writeBody),
+                                   [this](const Pipeline::Completion& c) { complete(c); });
+        if (id == 0) done_ = true;  // body did not fit: not delivered
+    }
+
+    Call(const Call&) = delete;
+    Call& operator=(const Call&) = delete;
+
+    bool await_ready() const noexcept { return done_; }
+    void await_suspend(std::coroutine_handle<> h) noexcept { waiter_ = h; }
+    R await_resume() { return std::move(result_); }
+
+private:
+    R result_;
+    bool done_;
+    std::coroutine_handle<> waiter_;
+
+    void complete(const Pipeline::Completion& c) {
+        result_.delivered = c.ok;
+        result_.attempts = c.attempts;
+        result_.latency = c.latency;
+        if (c.ok) {
+            result_.status = c.reply->h.status;
+            // A reply too short for its layout counts as a bad one
+            if (result_.ok() && !result_.decode(*c.reply)) result_.status = (uint16_t)proto::Status::ERR_BAD_REQUEST;
+        }
+        done_ = true;
+        if (waiter_) waiter_.resume();
+    }
+};
+
+/**
+ * Awaitable bank operations on one EventLoop
+ */
+class Bank {
+public:
+    explicit Bank(EventLoop& loop) : p_(loop.pipeline()) {}
+
+    Call<OpenResult> open(const std::string& name, const std::string& password, uint16_t currency,
+                          double initialBalance);
+    Call<CloseResult> close(const std::string& name, int32_t accNo, const std::string& password);
+    Call<AmountResult> deposit(const std::string& name, int32_t accNo, const std::string& password,
+                               uint16_t currency, double amount);
+    Call<AmountResult> withdraw(const std::string& name, int32_t accNo, const std::string& password,
+                                uint16_t currency, double amount);
+    Call<QueryResult> queryBalance(const std::string& name, int32_t accNo, const std::string& password);
+    Call<TransferResult> transfer(const std::string& name, int32_t fromAccNo, const std::string& password,
+                                  int32_t toAccNo, uint16_t currency, double amount);
+
+private:
+    Pipeline& p_;
+};
+
+} // namespace coro
@@ -0,0 +1,169 @@
+#include "endian.hpp"
+
+#if !defined(BANK_NO_SIMD) && !BANK_BIG_ENDIAN_HOST
+#if defined(__SSSE3__) || defined(__AVX__)
+#define BANK_SWAP_SSSE3 1
+#include <tmmintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BANK_SWAP_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define BANK_SWAP_NEON 1
+#include <arm_neon.h>
+#endif
+#endif
+
+namespace proto {
+
+// Both directions are the same operation: reverse the bytes of every
+// 4-byte (or 8-byte) lane. The kernels work on 16-byte blocks and return
+// how many bytes they handled; swap32 / swap64 finish the tail.
+
+namespace {
+
+#if defined(BANK_SWAP_SSSE3)
+
+size_t swapLanes32(uint8_t* dst, const uint8_t* src, size_t bytes) {
+    const __m128i mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    size_t i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_shuffle_epi8(v, mask));
+    }
+    return i;
+}
+
+size_t swapLanes64(uint8_t* dst, const uint8_t* src, size_t bytes) {
+    const __m128i mask = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    size_t i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_shuffle_epi8(v, mask));
+    }
+    return i;
+}
+
+#elif defined(BANK_SWAP_SSE2)
+
+// No byte shuffle before SSSE3: reorder the 16-bit words, then swap the
+// two bytes of every word with shifts
+inline __m128i swapBytesInWords(__m128i v) {
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+size_t swapLanes32(uint8_t* dst, const uint8_t* src, size_t bytes) {
+    size_t i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xB1), 0xB1);  // (1,0,3,2)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), swapBytesInWords(v));
+    }
+    return i;
+}
+
+size_t swapLanes64(uint8_t* dst, const uint8_t* src, size_t bytes) {
+    size_t i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0x1B), 0x1B);  // (3,2,1,0)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), swapBytesInWords(v));
+    }
+    return i;
+}
+
+#elif defined(BANK_SWAP_NEON)
+
+size_t swapLanes32(uint8_t* dst, const uint8_t* src, size_t bytes) {
+    size_t i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        vst1q_u8(dst + i, vrev32q_u8(vld1q_u8(src + i)));
+    }
+    return i;
+}
+
+size_t swapLanes64(uint8_t* dst, const uint8_t* src, size_t bytes) {
+    size_t i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        vst1q_u8(dst + i, vrev64q_u8(vld1q_u8(src + i)));
+    }
+    return i;
+}
+
+#elif BANK_BIG_ENDIAN_HOST
+
+// Host order is wire order
+size_t swapLanes32(uint8_t* dst, const uint8_t* src, size_t bytes) {
+    std::memcpy(dst, src, bytes);
+    return bytes;
+}
+
+size_t swapLanes64(uint8_t* dst, const uint8_t* src, size_t bytes) {
+    std::memcpy(dst, src, bytes);
+    return bytes;
+}
+
+#else
+
+size_t swapLanes32(uint8_t*, const uint8_t*, size_t) { return 0; }
+size_t swapLanes64(uint8_t*, const uint8_t*, size_t) { return 0; }
+
+#endif
+
+// Whole blocks through the kernel, the rest one lane at a time
+void swap32(uint8_t* dst, const uint8_t* src, size_t n) {
+    for (size_t i = swapLanes32(dst, src, 4 * n); i < 4 * n; i += 4) {
+        uint32_t v;
+        std::memcpy(&v, src + i, 4);
+        v = byteSwap32(v);
+        std::memcpy(dst + i, &v, 4);
+    }
+}
+
+void swap64(uint8_t* dst, const uint8_t* src, size_t n) {
+    for (size_t i = swapLanes64(dst, src, 8 * n); i < 8 * n; i += 8) {
+        uint64_t v;
+        std::memcpy(&v, src + i, 8);
+        v = byteSwap64(v);
+        std::memcpy(dst + i, &v, 8);
+    }
+}
+
+} // namespace
+
+void storeBE32s(uint8_t* dst, const uint32_t* src, size_t n) {
+    swap32(dst, reinterpret_cast<const uint8_t*>(src), n);
+}
+
+void loadBE32s(uint32_t* dst, const uint8_t* src, size_t n) {
+    swap32(reinterpret_cast<uint8_t*>(dst), src, n);
+}
+
+void storeBE64s(uint8_t* dst, const uint64_t* src, size_t n) {
+    swap64(dst, reinterpret_cast<const uint8_t*>(src), n);
+}
+
+void loadBE64s(uint64_t* dst, const uint8_t* src, size_t n) {
+    swap64(reinterpret_cast<uint8_t*>(dst), src, n);
+}
+
+void storeBE64s(uint8_t* dst, const double* src, size_t n) {
+    swap64(dst, reinterpret_cast<const uint8_t*>(src), n);
+}
+
+void loadBE64s(double* dst, const uint8_t* src, size_t n) {
+    swap64(reinterpret_cast<uint8_t*>(dst), src, n);
+}
+
+const char* byteSwapKernel() {
+#if defined(BANK_SWAP_SSSE3)
+    return "ssse3";
+#elif defined(BANK_SWAP_SSE2)
+    return "sse2";
+#elif defined(BANK_SWAP_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+} // namespace proto
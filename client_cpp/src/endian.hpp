@@ -0,0 +1,134 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <stdlib.h>
+#endif
+
+/**
+ * Big-endian loads and stores on raw bytes (no alignment requirement)
+ *
+ * Scalar fields are moved with one unaligned memcpy, which compilers turn
+ * into a single load/store, plus one byte-swap instruction (bswap / rev)
+ * on little-endian hosts. Arrays of fields (account numbers and balances
+ * in BATCH / snapshot bodies) go through the vector kernels in endian.cpp,
+ * which swap 16 bytes per instruction with SSSE3 / SSE2 / NEON; the kernel
+ * is chosen at build time, -DBANK_NO_SIMD forces the scalar loop.
+ */
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define BANK_BIG_ENDIAN_HOST 1
+#else
+#define BANK_BIG_ENDIAN_HOST 0  // x86, x64, ARM (Windows, Linux, macOS)
+#endif
+
+namespace proto {
+
+// ==================== Byte swaps ====================
+
+inline uint16_t byteSwap16(uint16_t v) {
+#if defined(_MSC_VER)
+    return _byteswap_ushort(v);
+#elif defined(__GNUC__)
+    return __builtin_bswap16(v);
+#else
+    return uint16_t((v << 8) | (v >> 8));
+#endif
+}
+
+inline uint32_t byteSwap32(uint32_t v) {
+#if defined(_MSC_VER)
+    return _byteswap_ulong(v);
+#elif defined(__GNUC__)
+    return __builtin_bswap32(v);
+#else
+    return (v << 24) | ((v << 8) & 0x00FF0000u) | ((v >> 8) & 0x0000FF00u) | (v >> 24);
+#endif
+}
+
+inline uint64_t byteSwap64(uint64_t v) {
+#if defined(_MSC_VER)
+    return _byteswap_uint64(v);
+#elif defined(__GNUC__)
+    return __builtin_bswap64(v);
+#else
+    return (uint64_t(byteSwap32(uint32_t(v))) << 32) | byteSwap32(uint32_t(v >> 32));
+#endif
+}
+
+// Host order <-> network (big-endian) order
+inline uint16_t toBE16(uint16_t v) { return BANK_BIG_ENDIAN_HOST ? v : byteSwap16(v); }
+inline uint32_t toBE32(uint32_t v) { return BANK_BIG_ENDIAN_HOST ? v : byteSwap32(v); }
+inline uint64_t toBE64(uint64_t v) { return BANK_BIG_ENDIAN_HOST ? v : byteSwap64(v); }
+
+// ==================== Scalar fields ====================
+
+inline void putBE16(uint8_t* p, uint16_t v) {
+    v = toBE16(v);
+    std::memcpy(p, &v, 2);
+}
+
+inline void putBE32(uint8_t* p, uint32_t v) {
+    v = toBE32(v);
+    std::memcpy(p, &v, 4);
+}
+
+inline void putBE64(uint8_t* p, uint64_t v) {
+    v = toBE64(v);
+    std::memcpy(p, &v, 8);
+}
+
+inline uint16_t loadBE16(const uint8_t* p) {
+    uint16_t v;
+    std::memcpy(&v, p, 2);
+    return toBE16(v);
+}
+
+inline uint32_t loadBE32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return toBE32(v);
+}
+
+inline uint64_t loadBE64(const uint8_t* p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return toBE64(v);
+}
+
+// ==================== Arrays ====================
+//
+// n consecutive 4- or 8-byte fields between a wire buffer and a host array.
+// Wire and host ranges must not overlap; neither needs to be aligned.
+// double arrays use the 64-bit kernels (IEEE 754 bits, as putDouble).
+
+void storeBE32s(uint8_t* dst, const uint32_t* src, size_t n);
+void loadBE32s(uint32_t* dst, const uint8_t* src, size_t n);
+void storeBE64s(uint8_t* dst, const uint64_t* src, size_t n);
+void loadBE64s(uint64_t* dst, const uint8_t* src, size_t n);
+void storeBE64s(uint8_t* dst, const double* src, size_t n);
+void loadBE64s(double* dst, const uint8_t* src, size_t n);
+
+// Name of the kernel compiled in: "ssse3", "sse2", "neon" or "scalar"
+const char* byteSwapKernel();
+
+// Reference loops, one field at a time (bench_codec compares against them)
+inline void storeBE32sScalar(uint8_t* dst, const uint32_t* src, size_t n) {
+    for (size_t i = 0; i < n; i++) putBE32(dst + 4 * i, src[i]);
+}
+
+inline void loadBE32sScalar(uint32_t* dst, const uint8_t* src, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = loadBE32(src + 4 * i);
+}
+
+inline void storeBE64sScalar(uint8_t* dst, const uint64_t* src, size_t n) {
+    for (size_t i = 0; i < n; i++) putBE64(dst + 8 * i, src[i]);
+}
+
+inline void loadBE64sScalar(uint64_t* dst, const uint8_t* src, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = loadBE64(src + 8 * i);
+}
+
+} // namespace proto
@@ -0,0 +1,112 @@
+#include "flow.hpp"
+#include <algorithm>
+#include <cmath>
+
+FlowControl::FlowControl() : FlowControl(Config()) {}
+
+FlowControl::FlowControl(const Config& cfg)
+    : cfg_(cfg), tokens_(0), burst_(0), refilled_(Clock::now()), cwnd_(0), minRtt_(Micros::max()),
+      srtt_(0), lastCut_(), consecutive_(0), breaker_(Breaker::Closed),
+      openUntil_(Clock::time_point::min()), cooldownMs_(std::max(1, cfg.breakerCooldownMs)) {
+    if (cfg_.rate > 0) {
+        burst_ = cfg_.burst > 0 ? cfg_.burst : std::max(1.0, cfg_.rate / 10);
+        tokens_ = burst_;
+    }
+    // The window starts open and only shrinks when the server pushes back
+    if (cfg_.window > 0) cwnd_ = cfg_.window;
+}
+
+// ==================== Admission ====================
+
+void FlowControl::refill(Clock::time_point now) {
+    if (cfg_.rate <= 0 || now <= refilled_) return;
+    tokens_ = std::min(burst_, tokens_ + std::chrono::duration<double>(now - refilled_).count() * cfg_.rate);
+    refilled_ = now;
+}
+
+bool FlowControl::admit(Clock::time_point now, size_t inFlight) {
+    if (breaker_ == Breaker::HalfOpen && inFlight > 0) return false;  // one probe at a time
+    if (cfg_.window > 0 && double(inFlight) >= std::floor(cwnd_)) return false;
+    return takeToken(now);
+}
+
+bool FlowControl::takeToken(Clock::time_point now) {
+    if (cfg_.rate <= 0) return true;
+    refill(now);
+    if (tokens_ < 1) return false;
+    tokens_ -= 1;
+    return true;
+}
+
+FlowControl::Clock::time_point FlowControl::nextToken(Clock::time_point now) const {
+    if (cfg_.rate <= 0 || tokens_ >= 1) return now;
+    double wait = (1 - tokens_) / cfg_.rate;
+    auto at = refilled_ + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(wait));
+    return std::max(at, now);
+}
+
+FlowControl::Clock::time_point FlowControl::nextAdmit(Clock::time_point now, size_t inFlight) const {
+    if (breaker_ == Breaker::HalfOpen && inFlight > 0) return Clock::time_point::max();
+    if (cfg_.window > 0 && double(inFlight) >= std::floor(cwnd_)) return Clock::time_point::max();
+    return nextToken(now);
+}
+
+bool FlowControl::failFast(Clock::time_point now) {
+    if (breaker_ == Breaker::Open && now >= openUntil_) breaker_ = Breaker::HalfOpen;
+    return breaker_ == Breaker::Open;
+}
+
+// ==================== Feedback ====================
+
+bool FlowControl::cut(double factor, Clock::time_point now) {
+    // One cut per round trip: the slow replies of one burst are one signal
+    if (now - lastCut_ < std::max(srtt_, Micros(1000))) return false;
+    lastCut_ = now;
+    cwnd_ = std::max(1.0, cwnd_ * factor);
+    return true;
+}
+
+unsigned FlowControl::onReply(Micros rtt, int attempts, Clock::time_point now) {
+    unsigned ev = NONE;
+    consecutive_ = 0;
+    if (breaker_ == Breaker::HalfOpen) {
+        breaker_ = Breaker::Closed;
+        cooldownMs_ = std::max(1, cfg_.breakerCooldownMs);
+    }
+    if (cfg_.window <= 0) return ev;
+
+    if (attempts == 1) {
+        // Karn's rule, as for the retransmission timer
+        minRtt_ = std::min(minRtt_, rtt);
+        srtt_ = srtt_.count() == 0 ? rtt : Micros((7 * srtt_.count() + rtt.count()) / 8);
+        if (rtt > 4 * minRtt_ && rtt - minRtt_ > Micros(1000) && cut(0.875, now)) return WINDOW_CUT;
+    }
+    cwnd_ = std::min(double(cfg_.window), cwnd_ + 1.0 / cwnd_);
+    return ev;
+}
+
+unsigned FlowControl::onTimeout(Clock::time_point sentAt, Clock::time_point now) {
+    unsigned ev = NONE;
+    if (cfg_.window > 0 && sentAt > lastCut_ && cut(0.5, now)) ev |= WINDOW_CUT;
+
+    consecutive_++;
+    if (cfg_.breakerThreshold <= 0) return ev;
+    if (breaker_ == Breaker::HalfOpen) {
+        // The probe failed: stay away longer
+        cooldownMs_ = std::min(MAX_COOLDOWN_MS, cooldownMs_ * 2);
+    } else if (breaker_ != Breaker::Closed || consecutive_ < cfg_.breakerThreshold) {
+        return ev;
+    }
+    breaker_ = Breaker::Open;
+    openUntil_ = now + std::chrono::milliseconds(cooldownMs_);
+    return ev | BREAKER_TRIP;
+}
+
+const char* FlowControl::breakerName(Breaker b) {
+    switch (b) {
+        case Breaker::Closed: return "closed";
+        case Breaker::Open: return "open";
+        case Breaker::HalfOpen: return "half-open";
+    }
+    return "?";
+}
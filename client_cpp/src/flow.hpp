@@ -0,0 +1,110 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Client-side flow control for the request pipeline
+ *
+ * - Token bucket: at most Config::rate datagrams per second, in bursts of
+ *   up to Config::burst. Retransmissions pay as well, so a wave of
+ *   timeouts cannot multiply the load on a server that is already slow
+ * - Congestion window: requests in flight are capped by a window that
+ *   grows by about one request per window of replies (additive increase),
+ *   halves on a timeout and shrinks by 1/8 when round trips climb past
+ *   4x the smallest seen (requests queueing at the server); never below
+ *   one request or above Config::window. Only a timeout of an attempt
+ *   sent after the last cut cuts again, so the losses of one episode
+ *   (or a trickle of random ones) count once
+ * - Circuit breaker: Config::breakerThreshold timeouts in a row with no
+ *   reply in between open it. While open, requests fail locally without
+ *   being sent. After the cooldown one probe is let through (half-open):
+ *   a reply closes the breaker, a timeout opens it again for twice as
+ *   long (up to MAX_COOLDOWN_MS)
+ *
+ * Every part is off unless configured. Not thread-safe: owned and driven
+ * by one Pipeline.
+ */
+class FlowControl {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Micros = std::chrono::microseconds;
+
+    static constexpr int MAX_COOLDOWN_MS = 30000;
+
+    struct Config {
+        double rate = 0;             // datagrams per second, 0 = unlimited
+        double burst = 0;            // bucket size, 0 = a tenth of a second's worth (at least 1)
+        int window = 0;              // most requests in flight, 0 = no cap
+        int breakerThreshold = 0;    // timeouts in a row that open the breaker, 0 = no breaker
+        int breakerCooldownMs = 1000;
+
+        bool enabled() const { return rate > 0 || window > 0 || breakerThreshold > 0; }
+    };
+
+    enum class Breaker { Closed, Open, HalfOpen };
+
+    // What onReply()/onTimeout() changed, for the metrics
+    enum Event : unsigned { NONE = 0, WINDOW_CUT = 1, BREAKER_TRIP = 2 };
+
+    FlowControl();
+    explicit FlowControl(const Config& cfg);
+
+    /**
+     * May a new request be sent now? Takes a token if so
+     * @param inFlight Requests sent and not yet answered
+     */
+    bool admit(Clock::time_point now, size_t inFlight);
+
+    // Take a token for a retransmission
+    bool takeToken(Clock::time_point now);
+
+    // Earliest time a token is available (now if one is)
+    Clock::time_point nextToken(Clock::time_point now) const;
+
+    // Earliest time admit() can succeed, max() while only a reply can make room
+    Clock::time_point nextAdmit(Clock::time_point now, size_t inFlight) const;
+
+    /**
+     * Should requests fail without being sent? (moves an open breaker
+     * whose cooldown is over to half-open)
+     */
+    bool failFast(Clock::time_point now);
+
+    /**
+     * A reply arrived
+     * @param rtt Time from the last transmission
+     * @param attempts Transmissions the request needed (>1: no RTT sample)
+     */
+    unsigned onReply(Micros rtt, int attempts, Clock::time_point now);
+
+    /**
+     * An attempt timed out
+     * @param sentAt When the attempt was sent
+     */
+    unsigned onTimeout(Clock::time_point sentAt, Clock::time_point now);
+
+    const Config& config() const { return cfg_; }
+    int window() const { return cfg_.window > 0 ? int(cwnd_) : 0; }
+    Breaker breaker() const { return breaker_; }
+
+    static const char* breakerName(Breaker b);
+
+private:
+    Config cfg_;
+    double tokens_;
+    double burst_;
+    Clock::time_point refilled_;
+    double cwnd_;
+    Micros minRtt_;
+    Micros srtt_;
+    Clock::time_point lastCut_;
+    int consecutive_;  // timeouts since the last reply
+    Breaker breaker_;
+    Clock::time_point openUntil_;
+    int cooldownMs_;
+
+    void refill(Clock::time_point now);
+    bool cut(double factor, Clock::time_point now);  // false if already cut this round trip
+};
@@ -0,0 +1,27 @@
+#include "impair.hpp"
+
+Impairment::Impairment() : rng_(1) {}
+
+Impairment::Impairment(const Config& cfg) : cfg_(cfg) {
+    if (cfg_.delayUs < 0) cfg_.delayUs = 0;
+    if (cfg_.jitterUs < 0) cfg_.jitterUs = 0;
+    if (cfg_.seed != 0) {
+        rng_.seed(cfg_.seed);
+    } else {
+        std::random_device rd;
+        rng_.seed((uint64_t(rd()) << 32) ^ rd());
+    }
+}
+
+bool Impairment::coin(double p) {
+    // 53 random bits -> [0, 1)
+    return double(rng_() >> 11) * (1.0 / 9007199254740992.0) < p;
+}
+
+std::chrono::microseconds Impairment::delay() {
+    int64_t us = cfg_.delayUs;
+    if (cfg_.jitterUs > 0) {
+        us += int64_t(rng_() % uint64_t(2 * cfg_.jitterUs + 1)) - cfg_.jitterUs;
+    }
+    return std::chrono::microseconds(us > 0 ? us : 0);
+}
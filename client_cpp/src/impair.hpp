@@ -0,0 +1,59 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <random>
+
+/**
+ * Network impairment injected in the client transport, for testing
+ *
+ * - Send loss: a datagram the pipeline hands to the kernel is dropped with
+ *   probability Config::dropSend. It still counts as sent, so its request
+ *   times out and is retransmitted exactly as if the network had lost it
+ * - Receive loss: a datagram read from the socket (reply or callback) is
+ *   discarded with probability Config::dropRecv. For a request that was
+ *   executed this is a lost reply: at-least-once executes it again on the
+ *   retransmission, at-most-once is answered from the server's reply cache
+ * - Latency: every received datagram is held back Config::delayUs, plus a
+ *   uniform +-Config::jitterUs, before the pipeline sees it (the round trip
+ *   grows by that much; with jitter, replies can overtake each other)
+ *
+ * The server's --lossReq/--lossRep drop on the other end; this needs no
+ * server option and works against any server. Every part is off unless
+ * configured. Not thread-safe: owned and driven by one Pipeline.
+ */
+class Impairment {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Config {
+        double dropSend = 0;  // probability of losing an outgoing datagram
+        double dropRecv = 0;  // probability of losing an incoming datagram
+        int delayUs = 0;      // added to every incoming datagram
+        int jitterUs = 0;     // uniform spread around delayUs
+        uint64_t seed = 0;    // 0 = random
+
+        bool enabled() const { return dropSend > 0 || dropRecv > 0 || delayUs > 0 || jitterUs > 0; }
+        bool delays() const { return delayUs > 0 || jitterUs > 0; }
+    };
+
+    Impairment();
+    explicit Impairment(const Config& cfg);
+
+    const Config& config() const { return cfg_; }
+
+    // Lose this outgoing datagram?
+    bool dropSend() { return cfg_.dropSend > 0 && coin(cfg_.dropSend); }
+
+    // Lose this incoming datagram?
+    bool dropRecv() { return cfg_.dropRecv > 0 && coin(cfg_.dropRecv); }
+
+    // How long to hold back an incoming datagram
+    std::chrono::microseconds delay();
+
+private:
+    Config cfg_;
+    std::mt19937_64 rng_;
+
+    bool coin(double p);
+};
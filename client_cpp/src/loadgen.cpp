@@ -0,0 +1,749 @@
+#include "net.hpp"
+#include "protocol.hpp"
+#include "runtime.hpp"
+#include "schema.hpp"
+#include "snapshot.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Headless load generator for the Distributed Banking System
+ *
+ * Usage:
+ *   loadgen.exe --server 127.0.0.1 --port 9000 --mix deposit=4,query=4,withdraw=1,transfer=1
+ *               --concurrency 64 --duration 10
+ *
+ * Arguments:
+ *   --server       Server IP address (default: 127.0.0.1)
+ *   --port         Server port number (default: 9000)
+ *   --sem          Invocation semantics: "atmost" or "atleast" (default: atmost)
+ *   --timeout      Per-attempt timeout in milliseconds (default: 500)
+ *   --retry        Number of attempts (default: 5)
+ *   --rto          Retransmission timer: "fixed" or "adaptive" (default: fixed)
+ *   --mix          Workload ratios: open,deposit,withdraw,transfer,query (default: deposit=1,query=1)
+ *   --rate         Open-loop target rate in requests/s (overrides --concurrency)
+ *   --concurrency  Closed-loop number of requests kept in flight (default: 32)
+ *   --duration     Measurement duration in seconds (default: 10)
+ *   --accounts     Number of accounts opened before the run (default: 100)
+ *   --threads      Worker threads, each with its own socket (default: 1)
+ *   --batch        Coalesce up to N operations per BATCH datagram (default: off)
+ *   --batch-window Microseconds a worker holds an open batch (default: 0 = until idle)
+ *   --metrics      Write a JSON metrics snapshot (histograms, counters) after the run
+ *   --metrics-interval  Print a metrics snapshot to stderr every N seconds (default: off)
+ *   --servers      Several servers "ip:port,ip:port,...", routed by account (overrides --server/--port)
+ *   --rate-limit   Client-side cap in datagrams/s, retransmissions included (default: 0 = off)
+ *   --max-inflight Adaptive cap on requests in flight, AIMD on timeouts and RTT (default: 0 = off)
+ *   --breaker      Fail requests locally after N timeouts in a row (default: 0 = off)
+ *   --breaker-cooldown  Milliseconds the breaker stays open before a probe (default: 1000)
+ *   --drop-send    Lose this fraction of outgoing datagrams in the client transport (see impair.hpp)
+ *   --drop-recv    Lose this fraction of incoming datagrams (replies and callbacks)
+ *   --delay        Hold back every incoming datagram this many ms (fractions allowed)
+ *   --jitter       Spread the delay uniformly by +- this many ms
+ *   --trace        Capture every datagram to this binary trace (see trace.hpp, replay.cpp)
+ *   --compact      Compact bodies: varints, amounts in cents (see compact.hpp; server_cpp only)
+ *   --lz           LZ4-compress large bodies such as batches and snapshots (server_cpp only)
+ *   --tokens       LOGIN every account after setup and send the session-token variants of
+ *                  deposit, withdraw, query and transfer (server_cpp only, one server)
+ *   --snapshot     After the run, read every balance with SNAPSHOT and check it against
+ *                  a QUERY_BALANCE per account (server needs --allow-scan)
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Account {
+    std::string name;
+    std::string password;
+    int32_t accNo;
+    uint64_t token = 0;  // --tokens: session token from LOGIN
+};
+
+struct OpStats {
+    uint64_t ok = 0;          // replies with status OK
+    uint64_t rejected = 0;    // replies with an error status
+    uint64_t failed = 0;      // no reply after all attempts, or shed by the circuit breaker
+    uint64_t retried = 0;     // requests that needed more than one attempt
+    std::vector<uint32_t> latUs;
+};
+
+struct Options {
+    std::string server = "127.0.0.1";
+    int port = 9000;
+    bool atMostOnce = true;
+    int timeoutMs = 500;
+    int retry = 5;
+    RetransmitPolicy::Mode rto = RetransmitPolicy::Mode::Fixed;
+    std::vector<std::pair<uint16_t, int>> mix;
+    double rate = 0;
+    int concurrency = 32;
+    int durationSec = 10;
+    int accounts = 100;
+    int threads = 1;
+    int batch = 0;
+    int batchWindowUs = 0;
+    int metricsIntervalSec = 0;  // > 0: print a metrics snapshot to stderr this often
+    std::string metricsPath;     // JSON snapshot written after the run
+    std::string servers;         // several endpoints, routed by account
+    FlowControl::Config flow;    // client-side admission control
+    Impairment::Config impair;   // injected loss and delay
+    std::string trace;           // capture file
+    bool compact = false;        // FLAG_COMPACT bodies
+    bool lz = false;             // FLAG_LZ bodies
+    bool tokens = false;         // session-token variants of the account operations
+    bool snapshot = false;       // check a SNAPSHOT of every account after the run
+};
+
+bool parseMix(const std::string& spec, std::vector<std::pair<uint16_t, int>>& out) {
+    static const std::map<std::string, proto::OpCode> names = {
+        {"open", proto::OpCode::OPEN},
+        {"deposit", proto::OpCode::DEPOSIT},
+        {"withdraw", proto::OpCode::WITHDRAW},
+        {"transfer", proto::OpCode::TRANSFER},
+        {"query", proto::OpCode::QUERY_BALANCE},
+    };
+    out.clear();
+    size_t pos = 0;
+    while (pos < spec.size()) {
+        size_t comma = spec.find(',', pos);
+        std::string item = spec.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        pos = (comma == std::string::npos) ? spec.size() : comma + 1;
+
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) return false;
+        auto it = names.find(item.substr(0, eq));
+        if (it == names.end()) return false;
+        int w = std::atoi(item.c_str() + eq + 1);
+        if (w < 0) return false;
+        if (w > 0) out.push_back({(uint16_t)it->second, w});
+    }
+    return !out.empty();
+}
+
+/**
+ * Per-thread generator state; completions on different workers never
+ * share counters, the tables are merged by report()
+ */
+struct ThreadState {
+    std::mt19937_64 rng;
+    std::map<uint16_t, OpStats> stats;
+    uint64_t opened = 0;
+};
+
+class LoadGen {
+public:
+    LoadGen(const Options& opt, Runtime& rt) : opt_(opt), rt_(rt), measuring_(false) {
+        for (const auto& m : opt_.mix) totalWeight_ += m.second;
+        // One state per worker plus one for the main thread
+        threads_.resize(rt_.workerCount() + 1);
+        for (size_t i = 0; i < threads_.size(); i++) threads_[i].rng.seed(12345 + i);
+    }
+
+    bool setup();
+    bool login();
+    void run();
+    void report() const;
+    void reportProgress(Clock::time_point& next);
+    bool checkSnapshot();
+
+private:
+    const Options& opt_;
+    Runtime& rt_;
+    int totalWeight_ = 0;
+    std::vector<Account> accounts_;  // read-only once run() starts
+    std::vector<ThreadState> threads_;
+    std::atomic<bool> measuring_;
+    std::chrono::duration<double> elapsed_{0};
+
+    ThreadState& state();
+    uint16_t pickOp(ThreadState& t);
+    const Account& pickAccount(ThreadState& t);
+    void submitOp(uint16_t op, Runtime::CompletionFn done);
+    void submitOne();
+    void drain();
+};
+
+ThreadState& LoadGen::state() {
+    int w = Runtime::currentWorker();
+    return threads_[w < 0 ? threads_.size() - 1 : (size_t)w];
+}
+
+uint16_t LoadGen::pickOp(ThreadState& t) {
+    int r = int(t.rng() % (uint64_t)totalWeight_);
+    for (const auto& m : opt_.mix) {
+        if (r < m.second) return m.first;
+        r -= m.second;
+    }
+    return opt_.mix.back().first;
+}
+
+const Account& LoadGen::pickAccount(ThreadState& t) {
+    return accounts_[t.rng() % accounts_.size()];
+}
+
+void LoadGen::submitOp(uint16_t op, Runtime::CompletionFn done) {
+    const uint16_t cny = (uint16_t)proto::Currency::CNY;
+    ThreadState& t = state();
+    // Follow-up requests stay on the worker that completed the previous one
+    const int key = Runtime::currentWorker();
+    switch ((proto::OpCode)op) {
+        case proto::OpCode::OPEN: {
+            int owner = key < 0 ? (int)(threads_.size() - 1) : key;
+            std::string name = "lg-open-" + std::to_string(owner) + "-" + std::to_string(t.opened++);
+            rt_.submitWith(op, proto::requestBodySize(op, name.size()), [&](proto::Writer& w) {
+                proto::writeOpenRequest(w, name, "loadgen", cny, 1000.0);
+            }, std::move(done), key);
+            break;
+        }
+        case proto::OpCode::DEPOSIT:
+        case proto::OpCode::WITHDRAW: {
+            const Account& a = pickAccount(t);
+            if (opt_.tokens) {
+                const uint16_t tok = proto::tokenOpCode(op);
+                rt_.submitWith(tok, proto::requestBodySize(tok, 0), [&](proto::Writer& w) {
+                    proto::writeTokenAmountRequest(w, a.token, a.accNo, cny, 1.0);
+                }, std::move(done), key);
+                break;
+            }
+            rt_.submitWith(op, proto::requestBodySize(op, a.name.size()), [&](proto::Writer& w) {
+                proto::writeAmountRequest(w, a.name, a.accNo, a.password, cny, 1.0);
+            }, std::move(done), key);
+            break;
+        }
+        case proto::OpCode::QUERY_BALANCE: {
+            const Account& a = pickAccount(t);
+            if (opt_.tokens) {
+                const uint16_t tok = proto::tokenOpCode(op);
+                rt_.submitWith(tok, proto::requestBodySize(tok, 0), [&](proto::Writer& w) {
+                    proto::writeTokenRequest(w, a.token, a.accNo);
+                }, std::move(done), key);
+                break;
+            }
+            rt_.submitWith(op, proto::requestBodySize(op, a.name.size()), [&](proto::Writer& w) {
+                proto::writeAuthRequest(w, a.name, a.accNo, a.password);
+            }, std::move(done), key);
+            break;
+        }
+        case proto::OpCode::TRANSFER: {
+            const Account& from = pickAccount(t);
+            const Account* to = &pickAccount(t);
+            while (accounts_.size() > 1 && to->accNo == from.accNo) to = &pickAccount(t);
+            if (opt_.tokens) {
+                const uint16_t tok = proto::tokenOpCode(op);
+                rt_.submitWith(tok, proto::requestBodySize(tok, 0), [&](proto::Writer& w) {
+                    proto::writeTokenTransferRequest(w, from.token, from.accNo, to->accNo, cny, 1.0);
+                }, std::move(done), key);
+                break;
+            }
+            rt_.submitWith(op, proto::requestBodySize(op, from.name.size()), [&](proto::Writer& w) {
+                proto::writeTransferRequest(w, from.name, from.accNo, from.password, to->accNo, cny, 1.0);
+            }, std::move(done), key);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+bool LoadGen::setup() {
+    const int window = 64;
+    int next = 0;
+    std::atomic<int> failures(0);
+    std::mutex lock;  // completions arrive on any worker
+    accounts_.reserve(opt_.accounts);
+
+    while (next < opt_.accounts && failures == 0) {
+        while (next < opt_.accounts && (int)rt_.inFlight() < window) {
+            Account a;
+            a.name = "lg-" + std::to_string(next);
+            a.password = "pw" + std::to_string(next % 1000);
+            a.accNo = 0;
+            next++;
+
+            const uint16_t op = (uint16_t)proto::OpCode::OPEN;
+            rt_.submitWith(op, proto::requestBodySize(op, a.name.size()), [&](proto::Writer& w) {
+                proto::writeOpenRequest(w, a.name, a.password, (uint16_t)proto::Currency::CNY, 1000000.0);
+            }, [this, a, &failures, &lock](const Pipeline::Completion& c) mutable {
+                double bal;
+                if (!c.ok || c.reply->h.status != (uint16_t)proto::Status::OK) {
+                    failures++;
+                    return;
+                }
+                if (!proto::schema::OpenReply::read(*c.reply, a.accNo, bal)) {
+                    failures++;
+                    return;
+                }
+                std::lock_guard<std::mutex> g(lock);
+                accounts_.push_back(a);
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    drain();
+
+    if (failures > 0 || accounts_.empty()) {
+        std::cerr << "[loadgen] setup failed: could not open " << opt_.accounts << " accounts\n";
+        return false;
+    }
+    std::cout << "[loadgen] opened " << accounts_.size() << " accounts\n";
+    return true;
+}
+
+bool LoadGen::login() {
+    const int window = 64;
+    std::atomic<int> failures(0);
+    std::atomic<int> seconds(65535);  // shortest lifetime granted
+
+    for (Account& a : accounts_) {
+        while ((int)rt_.inFlight() >= window) std::this_thread::sleep_for(std::chrono::microseconds(100));
+        const uint16_t op = (uint16_t)proto::OpCode::LOGIN;
+        rt_.submitWith(op, proto::requestBodySize(op, a.name.size()), [&](proto::Writer& w) {
+            proto::writeAuthRequest(w, a.name, a.accNo, a.password);
+        }, [&a, &failures, &seconds](const Pipeline::Completion& c) {
+            uint16_t s;
+            if (!c.ok || c.reply->h.status != (uint16_t)proto::Status::OK ||
+                !proto::schema::LoginReply::read(*c.reply, a.token, s)) {
+                failures++;
+                return;
+            }
+            int cur = seconds.load();
+            while (s < cur && !seconds.compare_exchange_weak(cur, s)) {}
+        });
+    }
+    drain();
+
+    if (failures > 0) {
+        std::cerr << "[loadgen] LOGIN failed for " << failures.load() << " accounts"
+                  << " (server_java and server_cpp --token-ttl 0 issue no tokens)\n";
+        return false;
+    }
+    std::cout << "[loadgen] logged in " << accounts_.size() << " accounts, tokens valid " << seconds.load() << "s\n";
+    if (seconds.load() <= opt_.durationSec) {
+        std::cerr << "[loadgen] warning: tokens expire before the run ends (--duration " << opt_.durationSec
+                  << "s), later requests will be refused\n";
+    }
+    return true;
+}
+
+void LoadGen::submitOne() {
+    submitOp(pickOp(state()), [this](const Pipeline::Completion& c) {
+        if (!measuring_.load(std::memory_order_relaxed)) return;
+        if (opt_.rate <= 0) submitOne();  // closed loop: replace the finished request
+
+        OpStats& s = state().stats[c.opCode];
+        if (c.attempts > 1) s.retried++;
+        if (!c.ok) {
+            s.failed++;
+            return;
+        }
+        if (c.reply->h.status == (uint16_t)proto::Status::OK) {
+            s.ok++;
+        } else {
+            s.rejected++;
+        }
+        s.latUs.push_back((uint32_t)std::min<int64_t>(c.latency.count(), UINT32_MAX));
+    });
+}
+
+void LoadGen::drain() {
+    while (rt_.inFlight() > 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+void LoadGen::reportProgress(Clock::time_point& next) {
+    std::ostringstream os;
+    metrics::writeText(os, rt_.metrics());
+    std::cerr << "[loadgen] metrics\n" << os.str();
+    next += std::chrono::seconds(opt_.metricsIntervalSec);
+}
+
+void LoadGen::run() {
+    measuring_.store(true);
+    auto start = Clock::now();
+    auto end = start + std::chrono::seconds(opt_.durationSec);
+    auto nextReport = opt_.metricsIntervalSec > 0 ? start + std::chrono::seconds(opt_.metricsIntervalSec)
+                                                  : Clock::time_point::max();
+
+    if (opt_.rate > 0) {
+        // Open loop: send on a fixed schedule regardless of replies
+        auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / opt_.rate));
+        auto nextSend = start;
+        while (true) {
+            auto now = Clock::now();
+            if (now >= end) break;
+            while (nextSend <= now) {
+                submitOne();
+                nextSend += interval;
+            }
+            std::this_thread::sleep_until(std::min(nextSend, end));
+            if (Clock::now() >= nextReport) reportProgress(nextReport);
+        }
+    } else {
+        // Closed loop: keep `concurrency` requests in flight, each completion submits the next
+        // (initial requests are spread round-robin over the workers)
+        for (int i = 0; i < opt_.concurrency; i++) submitOne();
+        while (Clock::now() < end) {
+            std::this_thread::sleep_until(std::min(nextReport, end));
+            if (Clock::now() >= nextReport) reportProgress(nextReport);
+        }
+    }
+
+    elapsed_ = Clock::now() - start;
+    measuring_.store(false);
+    drain();
+}
+
+bool LoadGen::checkSnapshot() {
+    std::unordered_map<int32_t, size_t> index;
+    int32_t lo = accounts_.front().accNo, hi = lo;
+    for (size_t i = 0; i < accounts_.size(); i++) {
+        index[accounts_[i].accNo] = i;
+        lo = std::min(lo, accounts_[i].accNo);
+        hi = std::max(hi, accounts_[i].accNo);
+    }
+
+    // One pass over the range, entries handed out as the chunks arrive
+    std::vector<double> snap(accounts_.size(), -1.0);
+    uint64_t others = 0;
+    SnapshotReader::Options so;
+    so.from = lo;
+    so.to = hi + 1;
+    so.attempts = opt_.retry;
+    SnapshotReader reader(rt_, so, [&](const SnapshotReader::Entry& e) {
+        auto it = index.find(e.accNo);
+        if (it == index.end()) {
+            others++;  // opened by the run itself
+        } else {
+            snap[it->second] = e.balance;
+        }
+    });
+    auto t0 = Clock::now();
+    SnapshotReader::Result r = reader.run();
+    double snapMs = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+    if (!r.ok) {
+        std::cerr << "[loadgen] snapshot failed: status=" << proto::statusToString(r.status)
+                  << (r.status == (uint16_t)proto::Status::ERR_AUTH ? " (server needs --allow-scan)" : "")
+                  << ", stopped at " << r.next << "\n";
+        return false;
+    }
+
+    // The same balances one QUERY_BALANCE at a time, 64 in flight
+    std::vector<double> queried(accounts_.size(), -1.0);
+    std::atomic<int> failures(0);
+    t0 = Clock::now();
+    for (size_t i = 0; i < accounts_.size(); i++) {
+        while (rt_.inFlight() >= 64) std::this_thread::sleep_for(std::chrono::microseconds(100));
+        const Account& a = accounts_[i];
+        const uint16_t op = (uint16_t)proto::OpCode::QUERY_BALANCE;
+        rt_.submitWith(op, proto::requestBodySize(op, a.name.size()), [&](proto::Writer& w) {
+            proto::writeAuthRequest(w, a.name, a.accNo, a.password);
+        }, [&queried, &failures, i](const Pipeline::Completion& c) {
+            uint16_t cur;
+            if (!c.ok || !proto::schema::QueryReply::read(*c.reply, cur, queried[i])) failures++;
+        });
+    }
+    drain();
+    double queryMs = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < accounts_.size(); i++) {
+        if (snap[i] != queried[i]) mismatches++;
+    }
+    std::printf("snapshot: %llu accounts in %.1f ms (%llu chunks, %d requests, %d resumed, %llu duplicate chunks); "
+                "QUERY_BALANCE of each: %.1f ms; %zu mismatches, %d queries failed, %llu accounts opened by the run\n",
+                (unsigned long long)r.entries, snapMs, (unsigned long long)r.chunks, r.requests, r.resumes,
+                (unsigned long long)r.duplicates, queryMs, mismatches, failures.load(), (unsigned long long)others);
+    return mismatches == 0 && failures == 0;
+}
+
+double percentile(const std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t idx = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)] / 1000.0;
+}
+
+void LoadGen::report() const {
+    double secs = elapsed_.count();
+    uint64_t total = 0;
+
+    std::printf("\n%-19s %10s %10s %8s %8s %8s %10s %10s %10s\n",
+                "op", "ok", "rejected", "failed", "retried", "ops/s", "p50(ms)", "p99(ms)", "p99.9(ms)");
+    std::map<uint16_t, OpStats> merged;
+    for (const ThreadState& t : threads_) {
+        for (const auto& kv : t.stats) {
+            OpStats& m = merged[kv.first];
+            m.ok += kv.second.ok;
+            m.rejected += kv.second.rejected;
+            m.failed += kv.second.failed;
+            m.retried += kv.second.retried;
+            m.latUs.insert(m.latUs.end(), kv.second.latUs.begin(), kv.second.latUs.end());
+        }
+    }
+
+    for (auto& kv : merged) {
+        const OpStats& s = kv.second;
+        std::vector<uint32_t>& lat = kv.second.latUs;
+        std::sort(lat.begin(), lat.end());
+        uint64_t done = s.ok + s.rejected;
+        total += done;
+        std::printf("%-19s %10llu %10llu %8llu %8llu %8.0f %10.3f %10.3f %10.3f\n",
+                    proto::opCodeToString(kv.first).c_str(),
+                    (unsigned long long)s.ok, (unsigned long long)s.rejected,
+                    (unsigned long long)s.failed, (unsigned long long)s.retried,
+                    done / secs, percentile(lat, 50), percentile(lat, 99), percentile(lat, 99.9));
+    }
+    std::printf("\ntotal: %llu replies in %.2fs = %.0f ops/s\n",
+                (unsigned long long)total, secs, total / secs);
+
+    for (size_t i = 0; i < rt_.workerCount(); i++) {
+        const RetransmitPolicy& rto = rt_.rto(i);
+        if (rto.mode() != RetransmitPolicy::Mode::Adaptive) break;
+        std::printf("rto[%zu]: srtt=%.3fms rttvar=%.3fms rto=%.3fms (%llu samples)\n", i,
+                    rto.srtt().count() / 1000.0, rto.rttvar().count() / 1000.0,
+                    rto.rto().count() / 1000.0, (unsigned long long)rto.samples());
+    }
+
+    const Pipeline::BatchStats b = rt_.batchStats();
+    std::printf("batching (%s): send avg %.1f max %d, recv avg %.1f max %d datagrams/call\n",
+                net::hasBatchSyscalls() ? "sendmmsg/recvmmsg" : "per-packet",
+                b.sendCalls ? double(b.sendPackets) / b.sendCalls : 0.0, b.sendMax,
+                b.recvCalls ? double(b.recvPackets) / b.recvCalls : 0.0, b.recvMax);
+    std::printf("wire: sent %.1f, received %.1f bytes/datagram (headers included)\n",
+                b.sendPackets ? double(b.sendBytes) / b.sendPackets : 0.0,
+                b.recvPackets ? double(b.recvBytes) / b.recvPackets : 0.0);
+    if (opt_.batch > 1) {
+        Batcher::Stats bs = rt_.batcherStats();
+        std::printf("coalescing: %llu BATCH requests carrying %llu ops (avg %.1f), %llu sent alone\n",
+                    (unsigned long long)bs.batches, (unsigned long long)bs.batchedOps,
+                    bs.batches ? double(bs.batchedOps) / bs.batches : 0.0, (unsigned long long)bs.singles);
+    }
+    if (opt_.flow.enabled()) {
+        const metrics::Snapshot m = rt_.metrics();
+        std::printf("flow control: %llu requests throttled, %llu shed, %llu window cuts, %llu breaker trips\n",
+                    (unsigned long long)m.counters[metrics::THROTTLED],
+                    (unsigned long long)m.counters[metrics::SHED],
+                    (unsigned long long)m.counters[metrics::WINDOW_CUTS],
+                    (unsigned long long)m.counters[metrics::BREAKER_TRIPS]);
+    }
+    if (opt_.impair.enabled()) {
+        const metrics::Snapshot m = rt_.metrics();
+        std::printf("impairment: %llu datagrams dropped, %llu retransmits, %llu late replies\n",
+                    (unsigned long long)m.counters[metrics::INJECTED_DROPS],
+                    (unsigned long long)m.counters[metrics::RETRANSMITS],
+                    (unsigned long long)m.counters[metrics::UNKNOWN_REPLIES]);
+    }
+    std::printf("batch size histogram  1 | 2-3 | 4-7 | 8-15 | 16-31 | 32-63 | 64+\n");
+    std::printf("  send ");
+    for (int i = 0; i < 7; i++) std::printf(" %llu", (unsigned long long)(b.sendHist[i] + (i == 6 ? b.sendHist[7] : 0)));
+    std::printf("\n  recv ");
+    for (int i = 0; i < 7; i++) std::printf(" %llu", (unsigned long long)(b.recvHist[i] + (i == 6 ? b.recvHist[7] : 0)));
+    std::printf("\n");
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    std::string sem = "atmost";
+    std::string mix = "deposit=1,query=1";
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--server") == 0 && i + 1 < argc) {
+            opt.server = argv[++i];
+        } else if (std::strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            opt.port = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--sem") == 0 && i + 1 < argc) {
+            sem = argv[++i];
+        } else if (std::strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            opt.timeoutMs = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--retry") == 0 && i + 1 < argc) {
+            opt.retry = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--rto") == 0 && i + 1 < argc) {
+            if (!RetransmitPolicy::parseMode(argv[++i], opt.rto)) {
+                std::cerr << "Invalid --rto: " << argv[i] << "\n";
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--mix") == 0 && i + 1 < argc) {
+            mix = argv[++i];
+        } else if (std::strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            opt.rate = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--concurrency") == 0 && i + 1 < argc) {
+            opt.concurrency = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+            opt.durationSec = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--accounts") == 0 && i + 1 < argc) {
+            opt.accounts = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            opt.threads = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            opt.batch = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--batch-window") == 0 && i + 1 < argc) {
+            opt.batchWindowUs = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            opt.metricsPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--metrics-interval") == 0 && i + 1 < argc) {
+            opt.metricsIntervalSec = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--servers") == 0 && i + 1 < argc) {
+            opt.servers = argv[++i];
+        } else if (std::strcmp(argv[i], "--rate-limit") == 0 && i + 1 < argc) {
+            opt.flow.rate = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--max-inflight") == 0 && i + 1 < argc) {
+            opt.flow.window = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--breaker") == 0 && i + 1 < argc) {
+            opt.flow.breakerThreshold = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--breaker-cooldown") == 0 && i + 1 < argc) {
+            opt.flow.breakerCooldownMs = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--drop-send") == 0 && i + 1 < argc) {
+            opt.impair.dropSend = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--drop-recv") == 0 && i + 1 < argc) {
+            opt.impair.dropRecv = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--delay") == 0 && i + 1 < argc) {
+            opt.impair.delayUs = (int)(std::atof(argv[++i]) * 1000);
+        } else if (std::strcmp(argv[i], "--jitter") == 0 && i + 1 < argc) {
+            opt.impair.jitterUs = (int)(std::atof(argv[++i]) * 1000);
+        } else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            opt.trace = argv[++i];
+        } else if (std::strcmp(argv[i], "--compact") == 0) {
+            opt.compact = true;
+        } else if (std::strcmp(argv[i], "--lz") == 0) {
+            opt.lz = true;
+        } else if (std::strcmp(argv[i], "--tokens") == 0) {
+            opt.tokens = true;
+        } else if (std::strcmp(argv[i], "--snapshot") == 0) {
+            opt.snapshot = true;
+        } else if (std::strcmp(argv[i], "--help") == 0 || std::strcmp(argv[i], "-h") == 0) {
+            std::cout << "Usage: " << argv[0] << " [options]\n";
+            std::cout << "Options:\n";
+            std::cout << "  --server <ip>        Server IP address (default: 127.0.0.1)\n";
+            std::cout << "  --port <port>        Server port (default: 9000)\n";
+            std::cout << "  --sem <semantic>     atmost or atleast (default: atmost)\n";
+            std::cout << "  --timeout <ms>       Per-attempt timeout in milliseconds (default: 500)\n";
+            std::cout << "  --retry <count>      Attempts per request (default: 5)\n";
+            std::cout << "  --rto <mode>         fixed or adaptive (default: fixed)\n";
+            std::cout << "  --mix <spec>         e.g. open=1,deposit=4,withdraw=2,transfer=1,query=4\n";
+            std::cout << "  --rate <req/s>       Open-loop target rate (default: closed loop)\n";
+            std::cout << "  --concurrency <n>    Closed-loop requests in flight (default: 32)\n";
+            std::cout << "  --duration <s>       Measurement duration (default: 10)\n";
+            std::cout << "  --accounts <n>       Accounts opened before the run (default: 100)\n";
+            std::cout << "  --threads <n>        Worker threads / sockets (default: 1)\n";
+            std::cout << "  --batch <n>          Operations per BATCH datagram (default: off)\n";
+            std::cout << "  --batch-window <us>  How long an open batch waits (default: 0)\n";
+            std::cout << "  --metrics <file>     Write a JSON metrics snapshot after the run\n";
+            std::cout << "  --metrics-interval <s>  Print metrics to stderr every s seconds\n";
+            std::cout << "  --servers <list>     ip:port,ip:port,... routed by account\n";
+            std::cout << "  --rate-limit <n>     Datagrams per second, retransmissions included (default: off)\n";
+            std::cout << "  --max-inflight <n>   Adaptive cap on requests in flight (default: off)\n";
+            std::cout << "  --breaker <n>        Fail fast after n timeouts in a row (default: off)\n";
+            std::cout << "  --breaker-cooldown <ms>  Breaker open time before a probe (default: 1000)\n";
+            std::cout << "  --drop-send <p>      Lose this fraction of outgoing datagrams\n";
+            std::cout << "  --drop-recv <p>      Lose this fraction of incoming datagrams\n";
+            std::cout << "  --delay <ms>         Hold back incoming datagrams this long\n";
+            std::cout << "  --jitter <ms>        Spread the delay by +- this much\n";
+            std::cout << "  --trace <file>       Capture all traffic to a binary trace\n";
+            std::cout << "  --compact            Compact bodies: varints, amounts in cents (C++ server only)\n";
+            std::cout << "  --lz                 LZ4-compress batches and snapshots (C++ server only)\n";
+            std::cout << "  --tokens             LOGIN each account, then send session tokens (C++ server, one server)\n";
+            std::cout << "  --snapshot           Check a SNAPSHOT of every balance after the run (server: --allow-scan)\n";
+            return 0;
+        }
+    }
+
+    opt.atMostOnce = (sem == "atmost" || sem == "at-most-once");
+    if (!parseMix(mix, opt.mix)) {
+        std::cerr << "Invalid --mix: " << mix << "\n";
+        return 1;
+    }
+    if (opt.accounts < 2) opt.accounts = 2;
+    if (opt.concurrency < 1) opt.concurrency = 1;
+    if (opt.threads < 1) opt.threads = 1;
+    if (opt.snapshot && !opt.servers.empty()) {
+        std::cerr << "[loadgen] --snapshot reads one server, ignored with --servers\n";
+        opt.snapshot = false;
+    }
+    if (opt.tokens && !opt.servers.empty()) {
+        std::cerr << "[loadgen] --tokens needs a single server (a token is valid only where it was issued)\n";
+        return 1;
+    }
+
+    if (!net::startup()) {
+        std::cerr << "[loadgen] WSAStartup failed\n";
+        return 1;
+    }
+
+    std::cout << "[loadgen] server=" << (opt.servers.empty() ? opt.server + ":" + std::to_string(opt.port) : opt.servers)
+              << " sem=" << (opt.atMostOnce ? "at-most-once" : "at-least-once")
+              << " mix=" << mix << " "
+              << (opt.rate > 0 ? "rate=" + std::to_string((long long)opt.rate) + "/s"
+                               : "concurrency=" + std::to_string(opt.concurrency))
+              << " duration=" << opt.durationSec << "s rto=" << RetransmitPolicy::modeName(opt.rto)
+              << " threads=" << opt.threads;
+    if (opt.batch > 1) std::cout << " batch=" << opt.batch << "/" << opt.batchWindowUs << "us";
+    if (opt.flow.rate > 0) std::cout << " rate-limit=" << opt.flow.rate << "/s";
+    if (opt.flow.window > 0) std::cout << " max-inflight=" << opt.flow.window;
+    if (opt.flow.breakerThreshold > 0) std::cout << " breaker=" << opt.flow.breakerThreshold;
+    if (opt.compact) std::cout << " compact=on";
+    if (opt.lz) std::cout << " lz=on";
+    if (opt.tokens) std::cout << " tokens=on";
+    if (opt.impair.enabled()) {
+        std::cout << " impair=drop " << opt.impair.dropSend << "/" << opt.impair.dropRecv
+                  << " delay " << opt.impair.delayUs << "+-" << opt.impair.jitterUs << "us";
+    }
+    std::cout << "\n";
+
+    Runtime::Config cfg;
+    cfg.serverIp = opt.server;
+    cfg.serverPort = opt.port;
+    cfg.atMostOnce = opt.atMostOnce;
+    cfg.timeoutMs = opt.timeoutMs;
+    cfg.retryCount = opt.retry;
+    cfg.rtoMode = opt.rto;
+    cfg.workers = opt.threads;
+    cfg.batchMax = opt.batch;
+    cfg.batchWindowUs = opt.batchWindowUs;
+    cfg.servers = opt.servers;
+    cfg.flow = opt.flow;
+    cfg.impair = opt.impair;
+    cfg.trace = opt.trace;
+    cfg.compact = opt.compact;
+    cfg.lz = opt.lz;
+
+    int rc = 0;
+    {
+        Runtime rt(cfg);
+        if (!rt.start()) {
+            std::cerr << "[loadgen] cannot create sockets for " << opt.server << ":" << opt.port << "\n";
+            net::cleanup();
+            return 1;
+        }
+        LoadGen gen(opt, rt);
+        if (gen.setup() && (!opt.tokens || gen.login())) {
+            gen.run();
+            bool consistent = !opt.snapshot || gen.checkSnapshot();
+            rt.stop();
+            gen.report();
+            if (!consistent) rc = 1;
+            if (!opt.metricsPath.empty()) {
+                std::ofstream f(opt.metricsPath);
+                if (f) metrics::writeJson(f, rt.metrics());
+                else std::cerr << "[loadgen] cannot create " << opt.metricsPath << "\n";
+            }
+        } else {
+            rc = 1;
+        }
+    }
+
+    net::cleanup();
+    return rc;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+/**
+ * Leveled diagnostics, removable at compile time
+ *
+ * BANK_LOG(level, enabled, expr) formats `expr` (anything streamable) and
+ * writes it as one "[client] ..." line (the tag is logging::tag()), but
+ * only if `level` is at most BANK_LOG_LEVEL and `enabled` is true at run
+ * time. When the level is compiled out the whole statement folds away,
+ * including the formatting, so release builds can use -DBANK_LOG_LEVEL=1
+ * to keep only errors.
+ * Errors and warnings go to stderr, info and debug to stdout.
+ */
+#ifndef BANK_LOG_LEVEL
+#define BANK_LOG_LEVEL 3
+#endif
+
+namespace logging {
+
+enum Level : int {
+    Error = 1,
+    Warn = 2,
+    Info = 3,   // per-request lines of the interactive client
+    Debug = 4   // ignored datagrams and other per-packet events
+};
+
+// Program name in the line prefix; set once before starting threads
+inline const char*& tag() {
+    static const char* name = "client";
+    return name;
+}
+
+// Serialises lines from different worker threads
+inline void write(Level level, const std::string& line) {
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ostream& os = level <= Warn ? std::cerr : std::cout;
+    os << "[" << tag() << "] " << line << "\n";
+}
+
+} // namespace logging
+
+#define BANK_LOG(level, enabled, expr)                  \
+    do {                                                \
+        if ((level) <= BANK_LOG_LEVEL && (enabled)) {   \
+            std::ostringstream bankLogLine_;            \
+            bankLogLine_ << expr;                       \
+            ::logging::write((level), bankLogLine_.str()); \
+        }                                               \
+    } while (0)
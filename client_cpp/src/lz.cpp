@@ -0,0 +1,123 @@
+#include "lz.hpp"
+#include <cstring>
+
+namespace lz {
+
+namespace {
+
+constexpr size_t MIN_MATCH = 4;
+constexpr size_t LAST_LITERALS = 5;  // the block ends with at least this many literals
+constexpr size_t MF_LIMIT = 12;      // no match starts in the last 12 bytes
+constexpr int HASH_BITS = 12;
+
+uint32_t load32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+uint32_t hash(uint32_t v) { return (v * 2654435761u) >> (32 - HASH_BITS); }
+
+// Length beyond the 4-bit field: 255s, then the remainder
+bool putLength(uint8_t* out, size_t& op, size_t cap, size_t len) {
+    while (len >= 255) {
+        if (op == cap) return false;
+        out[op++] = 255;
+        len -= 255;
+    }
+    if (op == cap) return false;
+    out[op++] = uint8_t(len);
+    return true;
+}
+
+bool getLength(const uint8_t* in, size_t& ip, size_t n, size_t& len) {
+    uint8_t b;
+    do {
+        if (ip == n) return false;
+        b = in[ip++];
+        len += b;
+    } while (b == 255);
+    return true;
+}
+
+// One sequence: literals, then a match of matchLen at offset (matchLen 0 = last sequence)
+bool putSequence(uint8_t* out, size_t& op, size_t cap, const uint8_t* lit, size_t litLen, size_t offset,
+                 size_t matchLen) {
+    if (op == cap) return false;
+    const size_t ml = matchLen ? matchLen - MIN_MATCH : 0;
+    uint8_t& token = out[op++];
+    token = uint8_t((litLen < 15 ? litLen : 15) << 4 | (ml < 15 ? ml : 15));
+    if (litLen >= 15 && !putLength(out, op, cap, litLen - 15)) return false;
+    if (litLen > cap - op) return false;
+    std::memcpy(out + op, lit, litLen);
+    op += litLen;
+    if (matchLen == 0) return true;
+    if (cap - op < 2) return false;
+    out[op++] = uint8_t(offset);
+    out[op++] = uint8_t(offset >> 8);
+    return ml < 15 || putLength(out, op, cap, ml - 15);
+}
+
+} // namespace
+
+size_t compress(const uint8_t* in, size_t n, uint8_t* out, size_t cap) {
+    if (n > MAX_INPUT) return 0;
+    uint16_t table[1 << HASH_BITS] = {};  // position + 1 of the last 4 bytes with each hash
+    size_t op = 0;
+    size_t anchor = 0;
+    if (n > MF_LIMIT) {
+        const size_t limit = n - MF_LIMIT;
+        const size_t matchEnd = n - LAST_LITERALS;
+        size_t ip = 0;
+        while (ip < limit) {
+            const uint32_t seq = load32(in + ip);
+            uint16_t& slot = table[hash(seq)];
+            const size_t cand = slot;
+            slot = uint16_t(ip + 1);
+            if (cand == 0 || load32(in + cand - 1) != seq) {
+                ip++;
+                continue;
+            }
+            const size_t from = cand - 1;
+            size_t len = MIN_MATCH;
+            while (ip + len < matchEnd && in[from + len] == in[ip + len]) len++;
+            if (!putSequence(out, op, cap, in + anchor, ip - anchor, ip - from, len)) return 0;
+            ip += len;
+            anchor = ip;
+        }
+    }
+    if (!putSequence(out, op, cap, in + anchor, n - anchor, 0, 0)) return 0;
+    return op;
+}
+
+bool decompress(const uint8_t* in, size_t n, uint8_t* out, size_t cap, size_t& outLen) {
+    size_t ip = 0, op = 0;
+    while (true) {
+        if (ip == n) return false;
+        const uint8_t token = in[ip++];
+        size_t lit = token >> 4;
+        if (lit == 15 && !getLength(in, ip, n, lit)) return false;
+        if (lit > n - ip || lit > cap - op) return false;
+        std::memcpy(out + op, in + ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == n) break;  // last sequence: literals only
+
+        if (n - ip < 2) return false;
+        const size_t offset = size_t(in[ip]) | size_t(in[ip + 1]) << 8;
+        ip += 2;
+        if (offset == 0 || offset > op) return false;
+        size_t len = token & 15;
+        if (len == 15 && !getLength(in, ip, n, len)) return false;
+        len += MIN_MATCH;
+        if (len > cap - op) return false;
+        // Byte by byte: the match may overlap what it is copying
+        const uint8_t* src = out + op - offset;
+        for (size_t i = 0; i < len; i++) out[op + i] = src[i];
+        op += len;
+    }
+    outLen = op;
+    return true;
+}
+
+} // namespace lz
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * LZ4 block codec for datagram bodies (FLAG_LZ, see compact.hpp)
+ *
+ * The block format of the LZ4 specification, so any LZ4 block decoder can
+ * read what compress() writes: sequences of token, literals, offset:u16le
+ * and match length, with the last sequence literals only. The compressor
+ * is the single-pass greedy one, a 4-byte hash table over at most 64 KiB
+ * of input; datagrams are far smaller, so no window management is needed.
+ * The decoder checks every length and offset against both buffers and
+ * fails on anything out of bounds rather than trusting the sender.
+ */
+namespace lz {
+
+// Largest input compress() accepts
+static constexpr size_t MAX_INPUT = 0xFFFF;
+
+/**
+ * @return compressed size, 0 if the input is too large or the output did not fit cap
+ */
+size_t compress(const uint8_t* in, size_t n, uint8_t* out, size_t cap);
+
+/**
+ * @param outLen Output: decompressed size
+ * @return false if the block is malformed or decompresses to more than cap bytes
+ */
+bool decompress(const uint8_t* in, size_t n, uint8_t* out, size_t cap, size_t& outLen);
+
+} // namespace lz
@@ -1,7 +1,114 @@
 #include "client.hpp"
+#include "script.hpp"
 #include <iostream>
+#include <fstream>
 #include <cstring>
 
+/**
+ * Write a JSON metrics snapshot
+ * @param path File to create ("-" = stdout), nothing written if empty
+ */
+static void writeMetricsFile(const std::string& path, const metrics::Snapshot& snap) {
+    if (path.empty()) return;
+    if (path == "-") {
+        metrics::writeJson(std::cout, snap);
+        return;
+    }
+    std::ofstream f(path);
+    if (!f) {
+        std::cerr << "[client] cannot create " << path << "\n";
+        return;
+    }
+    metrics::writeJson(f, snap);
+}
+
+/**
+ * Non-interactive mode: replay an operation file, results to a file
+ * @return process exit code (1 if the run could not start or any operation failed)
+ */
+static int runScript(const std::string& script, const std::string& out, const std::string& server,
+                     int port, bool atMostOnce, int timeout, int retry, RetransmitPolicy::Mode rtoMode,
+                     int concurrency, int batch, const std::string& servers,
+                     const FlowControl::Config& flow, const Impairment::Config& impair,
+                     const std::string& tracePath, bool compact,
+                     bool lz, bool tokens, const std::string& metricsPath) {
+    std::ifstream inFile;
+    if (script != "-") {
+        inFile.open(script, std::ios::binary);
+        if (!inFile) {
+            std::cerr << "[client] cannot open script " << script << "\n";
+            return 1;
+        }
+    }
+    std::ofstream outFile;
+    if (out != "-") {
+        outFile.open(out);
+        if (!outFile) {
+            std::cerr << "[client] cannot create " << out << "\n";
+            return 1;
+        }
+    }
+    if (!net::startup()) {
+        std::cerr << "[client] network startup failed\n";
+        return 1;
+    }
+
+    Runtime::Config cfg;
+    cfg.serverIp = server;
+    cfg.serverPort = port;
+    cfg.atMostOnce = atMostOnce;
+    cfg.timeoutMs = timeout;
+    cfg.retryCount = retry;
+    cfg.rtoMode = rtoMode;
+    cfg.batchMax = batch;
+    cfg.servers = servers;
+    cfg.flow = flow;
+    cfg.impair = impair;
+    cfg.trace = tracePath;
+    cfg.compact = compact;
+    cfg.lz = lz;
+
+    int rc = 0;
+    {
+        Runtime rt(cfg);
+        if (!rt.start()) {
+            std::cerr << "[client] cannot create socket for " << server << ":" << port << "\n";
+            net::cleanup();
+            return 1;
+        }
+        std::istream& in = script == "-" ? std::cin : inFile;
+        std::ostream& os = out == "-" ? std::cout : outFile;
+        // A token is only valid on the server that issued it
+        std::unique_ptr<TokenCache> tokenCache;
+        if (tokens && servers.empty()) {
+            tokenCache.reset(new TokenCache());
+            // Without an answer LOGIN is still tried, each refusal falling back on its own
+            const uint16_t op = (uint16_t)proto::OpCode::LOGIN;
+            proto::Message reply;
+            if (rt.callWith(op, TokenCache::probeSize(), [](proto::Writer& w) { TokenCache::writeProbe(w); }, reply)) {
+                tokenCache->probed(reply.h.status);
+            }
+        }
+        ScriptRunner runner(rt, in, os, concurrency, tokenCache.get());
+        ScriptRunner::Summary sum = runner.run();
+        rt.stop();
+
+        std::cerr << "[client] script: " << sum.ops << " ops in " << sum.seconds << "s ("
+                  << (sum.seconds > 0 ? (uint64_t)(sum.ops / sum.seconds) : 0) << " ops/s), ok="
+                  << sum.ok << " rejected=" << sum.rejected << " failed=" << sum.failed << "\n";
+        if (tokenCache) {
+            TokenCache::Stats ts = tokenCache->stats();
+            std::cerr << "[client] tokens: logins=" << ts.logins << " hits=" << ts.hits
+                      << " refused=" << ts.dropped
+                      << (tokenCache->supported() ? "" : " (not supported by the server)") << "\n";
+        }
+        writeMetricsFile(metricsPath, rt.metrics());
+        if (sum.failed) rc = 1;
+    }
+    net::cleanup();
+    return rc;
+}
+
 /**
  * Main entry point for the C++ Banking Client
  * 
@@ -14,6 +121,27 @@
  *   --sem      Invocation semantics: "atmost" or "atleast" (default: atmost)
  *   --timeout  Timeout in milliseconds (default: 500)
  *   --retry    Number of retries (default: 5)
+ *   --rto      Retransmission timer: "fixed" or "adaptive" (default: fixed)
+ *   --cache-ttl    Serve repeated balance queries locally for this many ms (default: 0 = off)
+ *   --cache-stale  Entry lifetime while a monitor is live, in ms (default: 30000)
+ *   --script   Run the operations in a file ("-" = stdin) without the menu, see script.hpp
+ *   --out      Result file for --script ("-" = stdout, default)
+ *   --concurrency  Operations in flight in script mode (default: 64)
+ *   --batch    Coalesce up to this many script operations per BATCH (default: 0 = off)
+ *   --metrics  Write latency histograms and counters as JSON to this file on exit
+ *   --servers  Several servers "ip:port,ip:port,...", requests routed by account (overrides --server/--port)
+ *   --rate-limit   Send at most this many datagrams per second, retransmissions included (default: 0 = off)
+ *   --max-inflight Cap on requests in flight, shrunk on timeouts and rising RTT (default: 0 = off)
+ *   --breaker      Fail requests locally after this many timeouts in a row (default: 0 = off)
+ *   --breaker-cooldown  How long the breaker stays open before a probe, in ms (default: 1000)
+ *   --drop-send    Lose this fraction of outgoing datagrams in the client transport (testing, see impair.hpp)
+ *   --drop-recv    Lose this fraction of incoming datagrams (testing)
+ *   --delay        Hold back every incoming datagram this many ms (testing, fractions allowed)
+ *   --jitter       Spread the delay uniformly by +- this many ms (testing)
+ *   --trace    Capture every datagram sent and received to this binary trace (see trace.hpp, replay.cpp)
+ *   --compact  Compact bodies: varints, amounts in cents (see compact.hpp; server_cpp only)
+ *   --lz       LZ4-compress large bodies such as batches and snapshots (server_cpp only)
+ *   --tokens   Log in once per account and send session tokens instead of passwords (server_cpp only, one server)
  */
 int main(int argc, char* argv[]) {
     std::string server = "127.0.0.1";
@@ -21,6 +149,21 @@ int main(int argc, char* argv[]) {
     std::string sem = "atmost";
     int timeout = 500;
     int retry = 5;
+    std::string rto = "fixed";
+    int cacheTtl = 0;
+    int cacheStale = 30000;
+    std::string script;
+    std::string out = "-";
+    int concurrency = 64;
+    int batch = 0;
+    std::string metricsPath;
+    std::string servers;
+    FlowControl::Config flow;
+    Impairment::Config impair;
+    std::string tracePath;
+    bool compact = false;
+    bool lz = false;
+    bool tokens = false;
 
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -34,6 +177,48 @@ int main(int argc, char* argv[]) {
             timeout = std::atoi(argv[++i]);
         } else if (std::strcmp(argv[i], "--retry") == 0 && i + 1 < argc) {
             retry = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--rto") == 0 && i + 1 < argc) {
+            rto = argv[++i];
+        } else if (std::strcmp(argv[i], "--cache-ttl") == 0 && i + 1 < argc) {
+            cacheTtl = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--cache-stale") == 0 && i + 1 < argc) {
+            cacheStale = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--script") == 0 && i + 1 < argc) {
+            script = argv[++i];
+        } else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out = argv[++i];
+        } else if (std::strcmp(argv[i], "--concurrency") == 0 && i + 1 < argc) {
+            concurrency = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            metricsPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--servers") == 0 && i + 1 < argc) {
+            servers = argv[++i];
+        } else if (std::strcmp(argv[i], "--rate-limit") == 0 && i + 1 < argc) {
+            flow.rate = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--max-inflight") == 0 && i + 1 < argc) {
+            flow.window = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--breaker") == 0 && i + 1 < argc) {
+            flow.breakerThreshold = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--breaker-cooldown") == 0 && i + 1 < argc) {
+            flow.breakerCooldownMs = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--drop-send") == 0 && i + 1 < argc) {
+            impair.dropSend = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--drop-recv") == 0 && i + 1 < argc) {
+            impair.dropRecv = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--delay") == 0 && i + 1 < argc) {
+            impair.delayUs = (int)(std::atof(argv[++i]) * 1000);
+        } else if (std::strcmp(argv[i], "--jitter") == 0 && i + 1 < argc) {
+            impair.jitterUs = (int)(std::atof(argv[++i]) * 1000);
+        } else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (std::strcmp(argv[i], "--compact") == 0) {
+            compact = true;
+        } else if (std::strcmp(argv[i], "--lz") == 0) {
+            lz = true;
+        } else if (std::strcmp(argv[i], "--tokens") == 0) {
+            tokens = true;
         } else if (std::strcmp(argv[i], "--help") == 0 || std::strcmp(argv[i], "-h") == 0) {
             std::cout << "Usage: " << argv[0] << " [options]\n";
             std::cout << "Options:\n";
@@ -42,17 +227,54 @@ int main(int argc, char* argv[]) {
             std::cout << "  --sem <semantic>  atmost or atleast (default: atmost)\n";
             std::cout << "  --timeout <ms>    Timeout in milliseconds (default: 500)\n";
             std::cout << "  --retry <count>   Retry count (default: 5)\n";
+            std::cout << "  --rto <mode>      fixed or adaptive (RTT-based, --timeout is the initial RTO)\n";
+            std::cout << "  --cache-ttl <ms>  Serve repeated balance queries locally (default: 0 = off)\n";
+            std::cout << "  --cache-stale <ms> Cache lifetime while a monitor is live (default: 30000)\n";
+            std::cout << "  --script <file>   Run operations from a file (- = stdin) without the menu\n";
+            std::cout << "  --out <file>      Script result file (default: - = stdout)\n";
+            std::cout << "  --concurrency <n> Script operations in flight (default: 64)\n";
+            std::cout << "  --batch <n>       Coalesce up to n script operations per BATCH (default: 0 = off)\n";
+            std::cout << "  --metrics <file>  Write request metrics as JSON on exit (- = stdout)\n";
+            std::cout << "  --servers <list>  ip:port,ip:port,... routed by account (overrides --server/--port)\n";
+            std::cout << "  --rate-limit <n>  Datagrams per second, retransmissions included (default: 0 = off)\n";
+            std::cout << "  --max-inflight <n> Adaptive cap on requests in flight (default: 0 = off)\n";
+            std::cout << "  --breaker <n>     Fail fast after n timeouts in a row (default: 0 = off)\n";
+            std::cout << "  --breaker-cooldown <ms> Breaker open time before a probe (default: 1000)\n";
+            std::cout << "  --drop-send <p>   Lose this fraction of outgoing datagrams (testing)\n";
+            std::cout << "  --drop-recv <p>   Lose this fraction of incoming datagrams (testing)\n";
+            std::cout << "  --delay <ms>      Hold back incoming datagrams (testing)\n";
+            std::cout << "  --jitter <ms>     Spread the delay by +- this much (testing)\n";
+            std::cout << "  --trace <file>    Capture all traffic to a binary trace (replay with replay.exe)\n";
+            std::cout << "  --compact         Compact bodies: varints, amounts in cents (C++ server only)\n";
+            std::cout << "  --lz              LZ4-compress batches and snapshots (C++ server only)\n";
+            std::cout << "  --tokens          Log in once per account, then send tokens (C++ server, one server)\n";
             return 0;
         }
     }
 
     bool atMostOnce = (sem == "atmost" || sem == "at-most-once");
+    RetransmitPolicy::Mode rtoMode;
+    if (!RetransmitPolicy::parseMode(rto, rtoMode)) {
+        std::cerr << "Invalid --rto: " << rto << " (expected fixed or adaptive)\n";
+        return 1;
+    }
+
+    if (!script.empty()) {
+        return runScript(script, out, server, port, atMostOnce, timeout, retry, rtoMode,
+                         concurrency, batch, servers, flow, impair, tracePath, compact, lz, tokens, metricsPath);
+    }
 
     std::cout << "========================================\n";
     std::cout << "   Distributed Banking System - C++ Client\n";
     std::cout << "========================================\n\n";
 
-    Client client(server, port, atMostOnce, timeout, retry);
+    Client client(server, port, atMostOnce, timeout, retry, rtoMode, cacheTtl, cacheStale);
+    client.setServers(servers);
+    client.setFlowControl(flow);
+    client.setImpairment(impair);
+    client.setTrace(tracePath);
+    client.setEncoding(compact, lz);
+    client.setTokens(tokens);
 
     if (!client.init()) {
         std::cerr << "Failed to initialize client\n";
@@ -60,6 +282,7 @@ int main(int argc, char* argv[]) {
     }
 
     client.run();
+    writeMetricsFile(metricsPath, client.metrics());
 
     return 0;
 }
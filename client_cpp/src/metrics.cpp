@@ -0,0 +1,184 @@
+#include "metrics.hpp"
+#include "protocol.hpp"
+#include <algorithm>
+#include <ostream>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace metrics {
+
+namespace {
+
+int highestBit(uint64_t v) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanReverse64(&i, v);
+    return (int)i;
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+}
+
+// Single-writer increment: plain load + store, readers see a consistent value
+inline void bump(std::atomic<uint64_t>& a, uint64_t n = 1) {
+    a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+int opSlot(uint16_t opCode) {
+    return opCode >= 1 && opCode < OP_SLOTS ? opCode : 0;
+}
+
+std::string opSlotName(int slot) {
+    return slot == 0 ? "OTHER" : proto::opCodeToString((uint16_t)slot);
+}
+
+const char* statusSlotName(int slot) {
+    return slot == STATUS_SLOTS - 1 ? "OTHER" : proto::statusName((uint16_t)slot);
+}
+
+} // namespace
+
+// ==================== Histogram ====================
+
+Histogram::Histogram() : count_(0), sum_(0), max_(0) {
+    for (auto& b : buckets_) b.store(0, std::memory_order_relaxed);
+}
+
+size_t Histogram::bucketOf(uint64_t v) {
+    if (v > MAX_VALUE) v = MAX_VALUE;
+    if (v < 2 * SUB) return (size_t)v;
+    int msb = highestBit(v);
+    return size_t(msb - SUB_BITS + 1) * SUB + ((v >> (msb - SUB_BITS)) & (SUB - 1));
+}
+
+uint64_t Histogram::bucketUpper(size_t index) {
+    if (index < 2 * SUB) return index;
+    uint64_t magnitude = index / SUB;
+    uint64_t sub = index % SUB;
+    uint64_t width = uint64_t(1) << (magnitude - 1);
+    return ((SUB + sub) << (magnitude - 1)) + width - 1;
+}
+
+void Histogram::record(uint64_t us) {
+    bump(buckets_[bucketOf(us)]);
+    bump(count_);
+    bump(sum_, us);
+    if (us > max_.load(std::memory_order_relaxed)) max_.store(us, std::memory_order_relaxed);
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+    Snapshot s;
+    for (size_t i = 0; i < BUCKETS; i++) s.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    // Derive the count from the buckets so quantile() is self-consistent mid-update
+    for (uint64_t b : s.buckets) s.count += b;
+    s.sum = sum_.load(std::memory_order_relaxed);
+    s.max = max_.load(std::memory_order_relaxed);
+    return s;
+}
+
+uint64_t Histogram::Snapshot::quantile(double q) const {
+    if (count == 0) return 0;
+    uint64_t rank = (uint64_t)(q * (double)count + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank) return std::min(bucketUpper(i), max);
+    }
+    return max;
+}
+
+Histogram::Snapshot& Histogram::Snapshot::operator+=(const Snapshot& o) {
+    count += o.count;
+    sum += o.sum;
+    max = std::max(max, o.max);
+    for (size_t i = 0; i < BUCKETS; i++) buckets[i] += o.buckets[i];
+    return *this;
+}
+
+// ==================== Registry ====================
+
+const char* counterName(int c) {
+    static const char* names[COUNTER_COUNT] = {
+        "requests", "attempts", "retransmits", "timeouts", "decode_errors",
+        "unknown_replies", "callbacks", "send_errors", "recv_errors",
+        "throttled", "shed", "window_cuts", "breaker_trips",
+        "injected_drops"};
+    return c >= 0 && c < COUNTER_COUNT ? names[c] : "?";
+}
+
+Snapshot& Snapshot::operator+=(const Snapshot& o) {
+    for (int i = 0; i < COUNTER_COUNT; i++) counters[i] += o.counters[i];
+    for (int i = 0; i < STATUS_SLOTS; i++) status[i] += o.status[i];
+    for (int i = 0; i < OP_SLOTS; i++) latency[i] += o.latency[i];
+    return *this;
+}
+
+Registry::Registry() {
+    for (auto& c : counters_) c.store(0, std::memory_order_relaxed);
+    for (auto& s : status_) s.store(0, std::memory_order_relaxed);
+}
+
+void Registry::reply(uint16_t opCode, uint16_t status, uint64_t latencyUs) {
+    bump(status_[status < STATUS_SLOTS - 1 ? status : STATUS_SLOTS - 1]);
+    latency_[opSlot(opCode)].record(latencyUs);
+}
+
+Snapshot Registry::snapshot() const {
+    Snapshot s;
+    for (int i = 0; i < COUNTER_COUNT; i++) s.counters[i] = counters_[i].load(std::memory_order_relaxed);
+    for (int i = 0; i < STATUS_SLOTS; i++) s.status[i] = status_[i].load(std::memory_order_relaxed);
+    for (int i = 0; i < OP_SLOTS; i++) s.latency[i] = latency_[i].snapshot();
+    return s;
+}
+
+// ==================== Export ====================
+
+void writeText(std::ostream& os, const Snapshot& s) {
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        os << (i ? " " : "") << counterName(i) << "=" << s.counters[i];
+    }
+    os << "\nstatus";
+    for (int i = 0; i < STATUS_SLOTS; i++) {
+        if (s.status[i]) os << " " << statusSlotName(i) << "=" << s.status[i];
+    }
+    os << "\n";
+    for (int i = 0; i < OP_SLOTS; i++) {
+        const Histogram::Snapshot& h = s.latency[i];
+        if (h.count == 0) continue;
+        os << "latency op=" << opSlotName(i) << " count=" << h.count
+           << " mean=" << (uint64_t)h.mean() << "us p50=" << h.quantile(0.50)
+           << "us p90=" << h.quantile(0.90) << "us p99=" << h.quantile(0.99)
+           << "us p999=" << h.quantile(0.999) << "us max=" << h.max << "us\n";
+    }
+}
+
+void writeJson(std::ostream& os, const Snapshot& s) {
+    os << "{\"counters\":{";
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        os << (i ? "," : "") << "\"" << counterName(i) << "\":" << s.counters[i];
+    }
+    os << "},\"status\":{";
+    bool first = true;
+    for (int i = 0; i < STATUS_SLOTS; i++) {
+        if (!s.status[i]) continue;
+        os << (first ? "" : ",") << "\"" << statusSlotName(i) << "\":" << s.status[i];
+        first = false;
+    }
+    os << "},\"latency_us\":{";
+    first = true;
+    for (int i = 0; i < OP_SLOTS; i++) {
+        const Histogram::Snapshot& h = s.latency[i];
+        if (h.count == 0) continue;
+        os << (first ? "" : ",") << "\"" << opSlotName(i) << "\":{\"count\":" << h.count
+           << ",\"mean\":" << (uint64_t)h.mean() << ",\"p50\":" << h.quantile(0.50)
+           << ",\"p90\":" << h.quantile(0.90) << ",\"p99\":" << h.quantile(0.99)
+           << ",\"p999\":" << h.quantile(0.999) << ",\"max\":" << h.max << "}";
+        first = false;
+    }
+    os << "}}\n";
+}
+
+} // namespace metrics
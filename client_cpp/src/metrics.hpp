@@ -0,0 +1,130 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+
+/**
+ * Request metrics: per-opcode latency histograms and event counters
+ *
+ * A Registry is owned by one Pipeline and written only by the thread that
+ * drives it, so recording is a relaxed load + store per field (no locked
+ * read-modify-write, no shared cache lines between workers). Any thread may
+ * take a snapshot() at any time; snapshots of several registries are summed
+ * with operator+=.
+ */
+namespace metrics {
+
+/**
+ * Log-linear latency histogram (HDR-style): 16 sub-buckets per power of two,
+ * i.e. ~6% relative error, exact below 32us, values capped at 2^36 us
+ */
+class Histogram {
+public:
+    static constexpr int SUB_BITS = 4;
+    static constexpr uint64_t SUB = 1u << SUB_BITS;
+    static constexpr int MAGNITUDES = 33;
+    static constexpr size_t BUCKETS = MAGNITUDES * SUB;
+    static constexpr uint64_t MAX_VALUE = (uint64_t(1) << 36) - 1;
+
+    struct Snapshot {
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        uint64_t max = 0;
+        std::array<uint64_t, BUCKETS> buckets{};
+
+        /**
+         * Value at or below which the given fraction of samples fall
+         * @param q Quantile in [0, 1]
+         * @return bucket upper bound in microseconds, 0 when empty
+         */
+        uint64_t quantile(double q) const;
+        double mean() const { return count ? double(sum) / count : 0.0; }
+        Snapshot& operator+=(const Snapshot& o);
+    };
+
+    Histogram();
+
+    // Single writer
+    void record(uint64_t us);
+    Snapshot snapshot() const;
+
+    static size_t bucketOf(uint64_t v);
+    static uint64_t bucketUpper(size_t index);
+
+private:
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets_;
+};
+
+enum Counter : int {
+    REQUESTS = 0,      // requests handed to the pipeline (a BATCH counts once)
+    ATTEMPTS,          // datagrams sent, retransmissions included
+    RETRANSMITS,
+    TIMEOUTS,          // requests that ran out of attempts
+    DECODE_ERRORS,     // datagrams that did not parse
+    UNKNOWN_REPLIES,   // replies for no pending reqId (late duplicates)
+    CALLBACKS,         // non-reply messages received
+    SEND_ERRORS,
+    RECV_ERRORS,
+    THROTTLED,         // requests held back by the rate limit or the congestion window
+    SHED,              // requests failed locally while the circuit breaker was open
+    WINDOW_CUTS,       // congestion window decreases
+    BREAKER_TRIPS,     // circuit breaker openings
+    INJECTED_DROPS,    // datagrams lost on purpose by the transport's Impairment
+    COUNTER_COUNT
+};
+
+// Histogram slot per opcode: OPEN..TRANSFER_TOKEN by value, 0 = anything else
+static constexpr int OP_SLOTS = 15;
+// Status counts: OK..ERR_PASSWORD_FORMAT by value, last = anything else
+static constexpr int STATUS_SLOTS = 8;
+
+const char* counterName(int c);
+
+struct Snapshot {
+    std::array<uint64_t, COUNTER_COUNT> counters{};
+    std::array<uint64_t, STATUS_SLOTS> status{};
+    std::array<Histogram::Snapshot, OP_SLOTS> latency{};
+
+    Snapshot& operator+=(const Snapshot& o);
+};
+
+class Registry {
+public:
+    Registry();
+
+    void add(Counter c, uint64_t n = 1) {
+        counters_[c].store(counters_[c].load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    /**
+     * One reply (or BATCH sub-reply)
+     * @param opCode Operation the reply belongs to
+     * @param status Reply status
+     * @param latencyUs First submission to reply, in microseconds
+     */
+    void reply(uint16_t opCode, uint16_t status, uint64_t latencyUs);
+
+    Snapshot snapshot() const;
+
+private:
+    std::array<std::atomic<uint64_t>, COUNTER_COUNT> counters_;
+    std::array<std::atomic<uint64_t>, STATUS_SLOTS> status_;
+    std::array<Histogram, OP_SLOTS> latency_;
+};
+
+/**
+ * Human-readable dump: counters, status counts, one latency line per opcode
+ */
+void writeText(std::ostream& os, const Snapshot& s);
+
+/**
+ * Machine-readable dump: one JSON object
+ */
+void writeJson(std::ostream& os, const Snapshot& s);
+
+} // namespace metrics
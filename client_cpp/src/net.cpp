@@ -0,0 +1,297 @@
+#include "net.hpp"
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <fcntl.h>
+#include <poll.h>
+#endif
+
+namespace net {
+
+bool startup() {
+#ifdef _WIN32
+    WSADATA wsa;
+    return WSAStartup(MAKEWORD(2, 2), &wsa) == 0;
+#else
+    return true;
+#endif
+}
+
+void cleanup() {
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+Socket openUdp() {
+    return socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+}
+
+void closeSocket(Socket s) {
+    if (!isValid(s)) return;
+#ifdef _WIN32
+    closesocket(s);
+#else
+    close(s);
+#endif
+}
+
+bool isValid(Socket s) {
+#ifdef _WIN32
+    return s != INVALID_SOCKET;
+#else
+    return s >= 0;
+#endif
+}
+
+bool setNonBlocking(Socket s) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(s, FIONBIO, &mode) == 0;
+#else
+    int fl = fcntl(s, F_GETFL, 0);
+    if (fl < 0) return false;
+    return fcntl(s, F_SETFL, fl | O_NONBLOCK) == 0;
+#endif
+}
+
+bool hasReusePort() {
+#if defined(__linux__) && defined(SO_REUSEPORT)
+    return true;
+#else
+    return false;  // Windows has no equivalent; BSD reuseport does not balance
+#endif
+}
+
+Socket openBoundUdp(int port, bool reusePort) {
+    Socket s = openUdp();
+    if (!isValid(s)) return INVALID_SOCK;
+#if defined(__linux__) && defined(SO_REUSEPORT)
+    int one = 1;
+    if (reusePort && setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0) {
+        closeSocket(s);
+        return INVALID_SOCK;
+    }
+#else
+    if (reusePort) {
+        closeSocket(s);
+        return INVALID_SOCK;
+    }
+#endif
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)port);
+    if (bind(s, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+        closeSocket(s);
+        return INVALID_SOCK;
+    }
+    return s;
+}
+
+void setBufferSizes(Socket s, int bytes) {
+    setsockopt(s, SOL_SOCKET, SO_RCVBUF, (const char*)&bytes, sizeof(bytes));
+    setsockopt(s, SOL_SOCKET, SO_SNDBUF, (const char*)&bytes, sizeof(bytes));
+}
+
+bool resolve(const std::string& ip, int port, sockaddr_in& out) {
+    memset(&out, 0, sizeof(out));
+    out.sin_family = AF_INET;
+    out.sin_port = htons((uint16_t)port);
+#ifdef _WIN32
+    out.sin_addr.s_addr = inet_addr(ip.c_str());
+    return out.sin_addr.s_addr != INADDR_NONE;
+#else
+    return inet_pton(AF_INET, ip.c_str(), &out.sin_addr) > 0;
+#endif
+}
+
+int waitReadable(Socket s, int timeoutMs) {
+    if (timeoutMs < 0) timeoutMs = 0;
+#ifdef _WIN32
+    fd_set rd;
+    FD_ZERO(&rd);
+    FD_SET(s, &rd);
+    timeval tv;
+    tv.tv_sec = timeoutMs / 1000;
+    tv.tv_usec = (timeoutMs % 1000) * 1000;
+    int r = select(0, &rd, nullptr, nullptr, &tv);
+    if (r == SOCKET_ERROR) return -1;
+    return r > 0 ? 1 : 0;
+#else
+    pollfd p;
+    p.fd = s;
+    p.events = POLLIN;
+    p.revents = 0;
+    int r = ::poll(&p, 1, timeoutMs);
+    if (r < 0) return errno == EINTR ? 0 : -1;
+    return r > 0 ? 1 : 0;
+#endif
+}
+
+int waitEither(Socket a, Socket b, int timeoutMs) {
+    if (timeoutMs < 0) timeoutMs = 0;
+#ifdef _WIN32
+    fd_set rd;
+    FD_ZERO(&rd);
+    FD_SET(a, &rd);
+    FD_SET(b, &rd);
+    timeval tv;
+    tv.tv_sec = timeoutMs / 1000;
+    tv.tv_usec = (timeoutMs % 1000) * 1000;
+    int r = select(0, &rd, nullptr, nullptr, &tv);
+    if (r == SOCKET_ERROR) return -1;
+    if (r == 0) return 0;
+    return (FD_ISSET(a, &rd) ? 1 : 0) | (FD_ISSET(b, &rd) ? 2 : 0);
+#else
+    pollfd p[2];
+    p[0].fd = a;
+    p[0].events = POLLIN;
+    p[0].revents = 0;
+    p[1].fd = b;
+    p[1].events = POLLIN;
+    p[1].revents = 0;
+    int r = ::poll(p, 2, timeoutMs);
+    if (r < 0) return errno == EINTR ? 0 : -1;
+    if (r == 0) return 0;
+    return (p[0].revents ? 1 : 0) | (p[1].revents ? 2 : 0);
+#endif
+}
+
+bool wouldBlock() {
+#ifdef _WIN32
+    int err = WSAGetLastError();
+    return err == WSAEWOULDBLOCK || err == WSAETIMEDOUT;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+// ==================== Waker ====================
+
+Waker::Waker() : s_(INVALID_SOCK) {
+    memset(&self_, 0, sizeof(self_));
+}
+
+Waker::~Waker() {
+    close();
+}
+
+bool Waker::open() {
+    s_ = openUdp();
+    if (!isValid(s_)) return false;
+    resolve("127.0.0.1", 0, self_);
+    SockLen len = sizeof(self_);
+    if (bind(s_, (const sockaddr*)&self_, sizeof(self_)) != 0 ||
+        getsockname(s_, (sockaddr*)&self_, &len) != 0 || !setNonBlocking(s_)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void Waker::close() {
+    closeSocket(s_);
+    s_ = INVALID_SOCK;
+}
+
+void Waker::wake() {
+    char b = 0;
+    sendto(s_, &b, 1, 0, (const sockaddr*)&self_, sizeof(self_));
+}
+
+void Waker::drain() {
+    char buf[64];
+    while (recv(s_, buf, sizeof(buf), 0) > 0) {
+    }
+}
+
+// ==================== Batched datagram I/O ====================
+
+#if defined(__linux__)
+
+bool hasBatchSyscalls() {
+    return true;
+}
+
+int sendBatch(Socket s, Packet* pkts, int n) {
+    if (n > MAX_BATCH) n = MAX_BATCH;
+    mmsghdr msgs[MAX_BATCH];
+    iovec iov[MAX_BATCH];
+    for (int i = 0; i < n; i++) {
+        iov[i].iov_base = pkts[i].data;
+        iov[i].iov_len = pkts[i].len;
+        memset(&msgs[i].msg_hdr, 0, sizeof(msghdr));
+        msgs[i].msg_hdr.msg_name = &pkts[i].addr;
+        msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int r = sendmmsg(s, msgs, (unsigned)n, 0);
+    if (r < 0) return wouldBlock() ? 0 : -1;
+    return r;
+}
+
+int recvBatch(Socket s, Packet* pkts, int n) {
+    if (n > MAX_BATCH) n = MAX_BATCH;
+    mmsghdr msgs[MAX_BATCH];
+    iovec iov[MAX_BATCH];
+    for (int i = 0; i < n; i++) {
+        iov[i].iov_base = pkts[i].data;
+        iov[i].iov_len = pkts[i].len;
+        memset(&msgs[i].msg_hdr, 0, sizeof(msghdr));
+        msgs[i].msg_hdr.msg_name = &pkts[i].addr;
+        msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int r = recvmmsg(s, msgs, (unsigned)n, MSG_DONTWAIT, nullptr);
+    if (r < 0) return wouldBlock() ? 0 : -1;
+    for (int i = 0; i < r; i++) pkts[i].len = msgs[i].msg_len;
+    return r;
+}
+
+#else
+
+// Portable fallback (Windows, BSD, macOS): one sendto/recvfrom per datagram
+
+bool hasBatchSyscalls() {
+    return false;
+}
+
+int sendBatch(Socket s, Packet* pkts, int n) {
+    int sent = 0;
+    for (int i = 0; i < n; i++) {
+        int r = sendto(s, (const char*)pkts[i].data, (int)pkts[i].len, 0,
+                       (const sockaddr*)&pkts[i].addr, sizeof(sockaddr_in));
+        if (r < 0) {
+            if (sent == 0 && !wouldBlock()) return -1;
+            break;
+        }
+        sent++;
+    }
+    return sent;
+}
+
+int recvBatch(Socket s, Packet* pkts, int n) {
+    int got = 0;
+    for (int i = 0; i < n; i++) {
+        SockLen fromLen = sizeof(sockaddr_in);
+        int r = recvfrom(s, (char*)pkts[i].data, (int)pkts[i].len, 0,
+                         (sockaddr*)&pkts[i].addr, &fromLen);
+        if (r < 0) {
+            if (got == 0 && !wouldBlock()) return -1;
+            break;
+        }
+        pkts[i].len = (size_t)r;
+        got++;
+    }
+    return got;
+}
+
+#endif
+
+} // namespace net
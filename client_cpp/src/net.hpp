@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Thin portability layer over the BSD / Winsock UDP socket API.
+ * Keeps the _WIN32 branches in one place so the transport code stays readable.
+ */
+namespace net {
+
+#ifdef _WIN32
+using Socket = SOCKET;
+static const Socket INVALID_SOCK = INVALID_SOCKET;
+using SockLen = int;
+#else
+using Socket = int;
+static constexpr Socket INVALID_SOCK = -1;
+using SockLen = socklen_t;
+#endif
+
+// Winsock startup/cleanup (no-ops elsewhere)
+bool startup();
+void cleanup();
+
+// Create a UDP socket, INVALID_SOCK on failure
+Socket openUdp();
+void closeSocket(Socket s);
+bool isValid(Socket s);
+
+// Switch a socket to non-blocking mode
+bool setNonBlocking(Socket s);
+
+/**
+ * Create a UDP socket bound to INADDR_ANY:port (servers)
+ * @param reusePort Set SO_REUSEPORT first, so several sockets can bind the
+ *        same port and the kernel spreads clients across them
+ * @return the socket, INVALID_SOCK if it could not be created or bound
+ */
+Socket openBoundUdp(int port, bool reusePort = false);
+
+// True if SO_REUSEPORT load-balances datagrams on this platform (Linux)
+bool hasReusePort();
+
+// Ask for larger kernel send/receive buffers (best effort)
+void setBufferSizes(Socket s, int bytes);
+
+// Fill a sockaddr_in from dotted IPv4 address and port
+bool resolve(const std::string& ip, int port, sockaddr_in& out);
+
+/**
+ * Wait until the socket is readable
+ * @param s Socket
+ * @param timeoutMs Maximum wait in milliseconds (0 = poll)
+ * @return 1 if readable, 0 on timeout, -1 on error
+ */
+int waitReadable(Socket s, int timeoutMs);
+
+/**
+ * Wait until either of two sockets is readable
+ * @param a First socket
+ * @param b Second socket
+ * @param timeoutMs Maximum wait in milliseconds (0 = poll)
+ * @return bitmask (1 = a readable, 2 = b readable), 0 on timeout, -1 on error
+ */
+int waitEither(Socket a, Socket b, int timeoutMs);
+
+// True if the last socket call failed only because it would block
+bool wouldBlock();
+
+/**
+ * Self-addressed loopback UDP socket used to interrupt a thread blocked in
+ * waitEither() from another thread (portable stand-in for eventfd/pipes,
+ * which select() on Windows cannot wait on)
+ */
+class Waker {
+public:
+    Waker();
+    ~Waker();
+    Waker(const Waker&) = delete;
+    Waker& operator=(const Waker&) = delete;
+
+    // Bind to 127.0.0.1 on an ephemeral port
+    bool open();
+    void close();
+
+    // Make socket() readable; safe to call from any thread
+    void wake();
+
+    // Discard pending wake-ups (owner thread)
+    void drain();
+
+    Socket socket() const { return s_; }
+
+private:
+    Socket s_;
+    sockaddr_in self_;
+};
+
+// ==================== Batched datagram I/O ====================
+
+// Largest batch handed to a single sendBatch()/recvBatch() call
+static constexpr int MAX_BATCH = 64;
+
+/**
+ * One datagram in a batch
+ * For sends, len is the payload size and addr the destination.
+ * For receives, len is the buffer capacity on input and the datagram
+ * size on output; addr receives the source address.
+ */
+struct Packet {
+    uint8_t* data;
+    size_t len;
+    sockaddr_in addr;
+};
+
+/**
+ * Send up to n datagrams, using sendmmsg() where available
+ * @return number of datagrams handed to the kernel (stops early when the
+ *         socket would block), or -1 if the first one failed with a hard error
+ */
+int sendBatch(Socket s, Packet* pkts, int n);
+
+/**
+ * Receive up to n datagrams without blocking, using recvmmsg() where available
+ * (the per-packet fallback requires a non-blocking socket)
+ * @return number of datagrams received (0 if none pending), -1 on error
+ */
+int recvBatch(Socket s, Packet* pkts, int n);
+
+// True when sendBatch()/recvBatch() map to single sendmmsg/recvmmsg syscalls
+bool hasBatchSyscalls();
+
+} // namespace net
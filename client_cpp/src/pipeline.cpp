@@ -0,0 +1,639 @@
+#include "pipeline.hpp"
+#include "compact.hpp"
+#include "endian.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <cstring>
+
+// ==================== RequestIndex ====================
+
+Pipeline::RequestIndex::RequestIndex() : table_(256, {0, 0}), size_(0), mask_(255) {}
+
+size_t Pipeline::RequestIndex::home(uint64_t reqId) const {
+    // Fibonacci hashing spreads sequential and random ids alike
+    return size_t((reqId * 0x9E3779B97F4A7C15ULL) >> 32) & mask_;
+}
+
+void Pipeline::RequestIndex::insert(uint64_t reqId, uint32_t slot) {
+    if ((size_ + 1) * 2 > table_.size()) grow();
+    size_t i = home(reqId);
+    while (table_[i].first != 0) i = (i + 1) & mask_;
+    table_[i] = {reqId, slot};
+    size_++;
+}
+
+bool Pipeline::RequestIndex::find(uint64_t reqId, uint32_t& slot) const {
+    size_t i = home(reqId);
+    while (table_[i].first != 0) {
+        if (table_[i].first == reqId) {
+            slot = table_[i].second;
+            return true;
+        }
+        i = (i + 1) & mask_;
+    }
+    return false;
+}
+
+void Pipeline::RequestIndex::erase(uint64_t reqId) {
+    size_t i = home(reqId);
+    while (table_[i].first != reqId) {
+        if (table_[i].first == 0) return;
+        i = (i + 1) & mask_;
+    }
+
+    // Backward-shift the rest of the cluster so lookups never need tombstones
+    size_t j = i;
+    while (true) {
+        j = (j + 1) & mask_;
+        if (table_[j].first == 0) break;
+        size_t h = home(table_[j].first);
+        bool movable = (i <= j) ? (h <= i || h > j) : (h <= i && h > j);
+        if (movable) {
+            table_[i] = table_[j];
+            i = j;
+        }
+    }
+    table_[i] = {0, 0};
+    size_--;
+}
+
+void Pipeline::RequestIndex::grow() {
+    std::vector<std::pair<uint64_t, uint32_t>> old;
+    old.swap(table_);
+    table_.assign(old.size() * 2, {0, 0});
+    mask_ = table_.size() - 1;
+    size_ = 0;
+    for (const auto& e : old) {
+        if (e.first != 0) insert(e.first, e.second);
+    }
+}
+
+// ==================== Pipeline ====================
+
+Pipeline::Pipeline(net::Socket sock, const sockaddr_in& server, bool atMostOnce,
+                   const RetransmitPolicy& rto, int retryCount)
+    : sock_(sock), wake_(net::INVALID_SOCK), servers_(1, server), flowOn_(false), atMostOnce_(atMostOnce), rto_(rto),
+      retryCount_(retryCount < 1 ? 1 : retryCount), verbose_(false),
+      session_(newSession()), seq_(0),
+      sendHead_(0), recvRing_(RECV_RING * proto::MAX_DATAGRAM), trace_(nullptr),
+      impairOn_(false), delayedSeq_(0), encoding_(0),
+      packed_(proto::MAX_DATAGRAM), unpacked_(proto::MAX_DATAGRAM), completions_(0) {
+    net::setNonBlocking(sock_);
+}
+
+void Pipeline::setServers(const std::vector<sockaddr_in>& servers) {
+    if (servers.empty()) return;
+    servers_ = servers;
+    ring_.reset(servers_.size() > 1 ? new HashRing(servers_) : nullptr);
+}
+
+void Pipeline::setFlowControl(const FlowControl::Config& cfg) {
+    flow_ = FlowControl(cfg);
+    flowOn_ = cfg.enabled();
+}
+
+void Pipeline::setImpairment(const Impairment::Config& cfg) {
+    impair_ = Impairment(cfg);
+    impairOn_ = cfg.enabled();
+}
+
+uint32_t Pipeline::newSession() {
+    std::random_device rd;
+    uint64_t mix = (uint64_t(rd()) << 32 ^ rd()) ^ uint64_t(Clock::now().time_since_epoch().count());
+    mix = (mix ^ (mix >> 31)) * 0x9E3779B97F4A7C15ULL;
+    uint32_t session = uint32_t(mix >> 32);
+    return session != 0 ? session : 1;  // requestId 0 is never used
+}
+
+uint64_t Pipeline::newRequestId() {
+    if (++seq_ == 0) {
+        // 2^32 requests on one session: start another so ids stay unique
+        session_ = newSession();
+        seq_ = 1;
+    }
+    return uint64_t(session_) << 32 | seq_;
+}
+
+uint16_t Pipeline::behind(uint64_t reqId) {
+    // issued_ is in sequence order; answered ids at its front are done with
+    while (!issued_.empty() && !index_.contains(issued_.front())) issued_.pop_front();
+    const uint32_t seq = uint32_t(reqId);
+    uint64_t oldest = issued_.empty() ? reqId : issued_.front();
+    // After a session change treat everything below seq as possibly unanswered
+    uint32_t d = (oldest >> 32) == (reqId >> 32) ? seq - uint32_t(oldest) : seq - 1;
+    // Never understate it: the server would drop retransmissions of the oldest
+    return uint16_t(d < proto::SEQ_BEHIND_UNKNOWN ? d : proto::SEQ_BEHIND_UNKNOWN);
+}
+
+uint32_t Pipeline::acquireSlot() {
+    if (freeSlots_.empty()) {
+        slots_.emplace_back();
+        slots_.back().inUse = false;
+        slots_.back().queued = false;
+        slots_.back().parked = false;
+        slots_.back().shed = false;
+        return uint32_t(slots_.size() - 1);
+    }
+    uint32_t slot = freeSlots_.back();
+    freeSlots_.pop_back();
+    return slot;
+}
+
+void Pipeline::releaseSlot(uint32_t slot) {
+    slots_[slot].inUse = false;
+    slots_[slot].done = nullptr;
+    slots_[slot].onChunk = nullptr;
+    freeSlots_.push_back(slot);
+}
+
+static int bucketOf(int batch) {
+    int b = 0;
+    while (batch > 1 && b < 7) {
+        batch >>= 1;
+        b++;
+    }
+    return b;
+}
+
+void Pipeline::route(Slot& s, uint16_t opCode, size_t bodyLen) {
+    s.server = 0;
+    uint64_t key;
+    if (!ring_ || !HashRing::keyOf(opCode, s.bytes + proto::HEADER_SIZE, bodyLen, key)) return;
+    s.server = ring_->owner(key);
+}
+
+void Pipeline::enqueue(uint32_t slot) {
+    // A slot released and reused while still queued keeps its one queue entry
+    if (slots_[slot].queued) return;
+    slots_[slot].queued = true;
+    sendQueue_.push_back(slot);
+}
+
+size_t Pipeline::flush() {
+    net::Packet pkts[net::MAX_BATCH];
+    uint32_t owners[net::MAX_BATCH];
+    Clock::time_point now = Clock::now();
+
+    while (sendHead_ < sendQueue_.size()) {
+        int n = 0;
+        while (n < net::MAX_BATCH && sendHead_ < sendQueue_.size()) {
+            uint32_t slot = sendQueue_[sendHead_++];
+            Slot& s = slots_[slot];
+            s.queued = false;
+            // Completed before it was flushed; or the slot was reused by a request the
+            // flow control held back, which releaseParked() enqueues afresh when admitted
+            if (!s.inUse || s.parked || s.shed) continue;
+            pkts[n].addr = servers_[s.server];
+            pkts[n].data = s.bytes;
+            pkts[n].len = s.len;
+            owners[n] = slot;
+            n++;
+        }
+        if (n == 0) break;
+
+        int sent = impairOn_ ? transmit(pkts, n) : net::sendBatch(sock_, pkts, n);
+        if (sent < 0) {
+            // Hard error on the first datagram: drop it, its deadline retransmits
+            BANK_LOG(logging::Error, verbose_, "sendto() failed");
+            metrics_.add(metrics::SEND_ERRORS);
+            sent = 1;
+        }
+        for (int i = 0; i < sent; i++) {
+            if (trace_) trace_->record(trace::Dir::Sent, pkts[i].data, pkts[i].len);
+            batch_.sendBytes += pkts[i].len;
+            Slot& s = slots_[owners[i]];
+            s.sentAt = now;
+            s.deadline = now + rto_.timeoutFor(s.attempts);
+        }
+        if (sent > 0) {
+            metrics_.add(metrics::ATTEMPTS, (uint64_t)sent);
+            batch_.sendCalls++;
+            batch_.sendPackets += (uint64_t)sent;
+            batch_.sendMax = std::max(batch_.sendMax, sent);
+            batch_.sendHist[bucketOf(sent)]++;
+        }
+
+        if (sent < n) {
+            // Socket buffer full: put the unsent tail back in front of the queue
+            for (int i = n - 1; i >= sent; i--) {
+                slots_[owners[i]].queued = true;
+                sendQueue_[--sendHead_] = owners[i];
+            }
+            return sendQueue_.size() - sendHead_;
+        }
+    }
+
+    sendQueue_.clear();
+    sendHead_ = 0;
+    return 0;
+}
+
+uint64_t Pipeline::submit(uint16_t opCode, const std::vector<uint8_t>& body, CompletionFn done) {
+    return submitWith(opCode, body.size(), [&body](proto::Writer& w) {
+        w.putBytes(body.data(), body.size());
+    }, std::move(done));
+}
+
+uint64_t Pipeline::launch(uint32_t slot, uint16_t opCode, size_t bodyLen, CompletionFn done) {
+    Slot& s = slots_[slot];
+    s.requestId = newRequestId();
+    s.opCode = opCode;
+    s.attempts = 1;
+    s.inUse = true;
+    s.parked = false;
+    s.shed = false;
+    s.timedOut = false;
+    s.streaming = false;
+    s.len = proto::HEADER_SIZE + bodyLen;
+    s.submitted = Clock::now();
+    s.sentAt = s.submitted;
+    s.deadline = s.submitted + rto_.timeoutFor(1);  // re-armed when actually flushed
+    s.done = std::move(done);
+    metrics_.add(metrics::REQUESTS);
+    route(s, opCode, bodyLen);
+
+    // Packed in place once routed (route() reads the wide holder name)
+    uint16_t encoded = 0;
+    if (encoding_) {
+        uint8_t* body = s.bytes + proto::HEADER_SIZE;
+        size_t packed = 0;
+        encoded = compact::pack(opCode, false, encoding_, body, bodyLen, packed_.data(), packed_.size(), packed);
+        if (encoded) {
+            std::memcpy(body, packed_.data(), packed);
+            bodyLen = packed;
+            s.len = proto::HEADER_SIZE + bodyLen;
+        }
+    }
+
+    proto::Header h;
+    h.magic = proto::MAGIC;
+    h.version = proto::VERSION;
+    h.msgType = (uint8_t)proto::MsgType::Request;
+    h.opCode = opCode;
+    h.flags = (atMostOnce_ ? proto::FLAG_AT_MOST_ONCE | proto::FLAG_SEQ_ID : 0) | encoded;
+    h.status = 0;
+    h.requestId = s.requestId;
+    h.bodyLen = (uint32_t)bodyLen;
+
+    s.activePos = (uint32_t)active_.size();
+    active_.push_back(slot);
+    index_.insert(s.requestId, slot);
+    if (atMostOnce_) {
+        issued_.push_back(s.requestId);
+        h.status = behind(s.requestId);
+    }
+    proto::writeHeader(s.bytes, h);
+    if (flowOn_) {
+        admit(slot, s.submitted);
+    } else {
+        enqueue(slot);
+    }
+    return s.requestId;
+}
+
+void Pipeline::admit(uint32_t slot, Clock::time_point now) {
+    Slot& s = slots_[slot];
+    if (flow_.failFast(now)) {
+        // Completed by the next poll(): a callback submitting from inside
+        // submit() would recurse for as long as the breaker stays open
+        s.deadline = Clock::time_point::max();
+        s.shed = true;
+        shed_.push_back(slot);
+        return;
+    }
+    // Behind any parked request, in order; the new one is in active_ but not in flight yet
+    if (parked_.empty() && flow_.admit(now, unanswered() - 1)) {
+        enqueue(slot);
+        return;
+    }
+    s.parked = true;
+    parked_.push_back(slot);
+    metrics_.add(metrics::THROTTLED);
+}
+
+void Pipeline::releaseParked(Clock::time_point now) {
+    while (!parked_.empty()) {
+        const uint32_t slot = parked_.front();
+        Slot& s = slots_[slot];
+        if (flow_.failFast(now)) {
+            parked_.pop_front();
+            s.parked = false;
+            metrics_.add(metrics::SHED);
+            complete(slot, nullptr, true);
+            continue;
+        }
+        if (!flow_.admit(now, unanswered())) return;
+        parked_.pop_front();
+        s.parked = false;
+        s.deadline = now + rto_.timeoutFor(1);  // re-armed when flushed
+        enqueue(slot);
+    }
+}
+
+void Pipeline::flowEvent(unsigned ev) {
+    if (ev & FlowControl::WINDOW_CUT) metrics_.add(metrics::WINDOW_CUTS);
+    if (ev & FlowControl::BREAKER_TRIP) {
+        BANK_LOG(logging::Info, verbose_, "circuit breaker open, failing requests fast");
+        metrics_.add(metrics::BREAKER_TRIPS);
+    }
+}
+
+bool Pipeline::await(uint64_t reqId, proto::Message& reply, int* attempts) {
+    while (true) {
+        auto it = finished_.find(reqId);
+        if (it != finished_.end()) {
+            bool ok = it->second.ok;
+            if (ok) reply = std::move(it->second.reply);
+            if (attempts) *attempts = it->second.attempts;
+            finished_.erase(it);
+            return ok;
+        }
+        if (!index_.contains(reqId)) return false;  // unknown id or had a callback
+        poll(1000);
+    }
+}
+
+int Pipeline::poll(int maxWaitMs) {
+    uint64_t before = completions_;
+    auto now = Clock::now();
+    if (!delayed_.empty()) releaseDelayed(now);
+    if (flowOn_) {
+        if (!shed_.empty()) {
+            shedding_.swap(shed_);  // callbacks may shed more, for the next poll()
+            for (uint32_t slot : shedding_) {
+                metrics_.add(metrics::SHED);
+                complete(slot, nullptr, true);
+            }
+            shedding_.clear();
+        }
+        releaseParked(now);
+    }
+    expireDeadlines(now);
+    flush();
+
+    // Never sleep past the earliest deadline (rounded up to whole milliseconds)
+    int waitMs = maxWaitMs;
+    if (flowOn_ && !shed_.empty()) waitMs = 0;
+    if (flowOn_ && !parked_.empty()) {
+        // A full window waits for replies, an empty bucket for its next token
+        auto at = flow_.nextAdmit(now, unanswered());
+        if (at != Clock::time_point::max()) {
+            auto leftUs = std::chrono::duration_cast<std::chrono::microseconds>(at - now).count();
+            waitMs = (int)std::max<long long>(0, std::min<long long>(waitMs, (leftUs + 999) / 1000));
+        }
+    }
+    for (uint32_t slot : active_) {
+        const Slot& s = slots_[slot];
+        if (s.parked) continue;
+        auto leftUs = std::chrono::duration_cast<std::chrono::microseconds>(s.deadline - now).count();
+        long long left = (leftUs + 999) / 1000;
+        if (left < waitMs) waitMs = (int)std::max<long long>(0, left);
+    }
+    if (!delayed_.empty()) {
+        auto leftUs = std::chrono::duration_cast<std::chrono::microseconds>(delayed_.front().due - now).count();
+        waitMs = (int)std::max<long long>(0, std::min<long long>(waitMs, (leftUs + 999) / 1000));
+    }
+
+    int ready = net::isValid(wake_) ? net::waitEither(sock_, wake_, waitMs)
+                                     : net::waitReadable(sock_, waitMs);
+    if (ready > 0 && (ready & 1)) {
+        drainSocket();
+    }
+    if (ready > 0 && (ready & 2)) {
+        char buf[64];
+        while (recv(wake_, buf, sizeof(buf), 0) > 0) {
+        }
+    }
+
+    now = Clock::now();
+    if (!delayed_.empty()) releaseDelayed(now);
+    if (flowOn_) releaseParked(now);
+    expireDeadlines(now);
+    flush();  // requests submitted by completion callbacks
+    return int(completions_ - before);
+}
+
+void Pipeline::drainSocket() {
+    net::Packet pkts[RECV_RING];
+    while (true) {
+        for (size_t i = 0; i < RECV_RING; i++) {
+            pkts[i].data = recvRing_.data() + i * proto::MAX_DATAGRAM;
+            pkts[i].len = proto::MAX_DATAGRAM;
+        }
+        int n = net::recvBatch(sock_, pkts, (int)RECV_RING);
+        if (n <= 0) {
+            if (n < 0) {
+                BANK_LOG(logging::Error, verbose_, "recvfrom() failed");
+                metrics_.add(metrics::RECV_ERRORS);
+            }
+            return;
+        }
+
+        batch_.recvCalls++;
+        batch_.recvPackets += (uint64_t)n;
+        batch_.recvMax = std::max(batch_.recvMax, n);
+        batch_.recvHist[bucketOf(n)]++;
+
+        for (int i = 0; i < n; i++) {
+            batch_.recvBytes += pkts[i].len;
+            if (impairOn_) {
+                receive(pkts[i].data, pkts[i].len);
+            } else {
+                handleDatagram(pkts[i].data, pkts[i].len);
+            }
+        }
+        if (n < (int)RECV_RING) return;
+    }
+}
+
+int Pipeline::transmit(net::Packet* pkts, int n) {
+    net::Packet kept[net::MAX_BATCH];
+    int index[net::MAX_BATCH];
+    int k = 0;
+    for (int i = 0; i < n; i++) {
+        if (impair_.dropSend()) {
+            metrics_.add(metrics::INJECTED_DROPS);
+            continue;
+        }
+        kept[k] = pkts[i];
+        index[k++] = i;
+    }
+    if (k == 0) return n;
+
+    // Map the kernel's count back: everything before the first unsent datagram is gone
+    int sent = net::sendBatch(sock_, kept, k);
+    if (sent < 0) return index[0] > 0 ? index[0] : -1;
+    return sent == k ? n : index[sent];
+}
+
+void Pipeline::receive(const uint8_t* data, size_t len) {
+    if (impair_.dropRecv()) {
+        metrics_.add(metrics::INJECTED_DROPS);
+        return;
+    }
+    if (!impair_.config().delays()) {
+        handleDatagram(data, len);
+        return;
+    }
+    delayed_.push_back({Clock::now() + impair_.delay(), delayedSeq_++, std::vector<uint8_t>(data, data + len)});
+    std::push_heap(delayed_.begin(), delayed_.end(), std::greater<Delayed>());
+}
+
+void Pipeline::releaseDelayed(Clock::time_point now) {
+    while (!delayed_.empty() && delayed_.front().due <= now) {
+        std::pop_heap(delayed_.begin(), delayed_.end(), std::greater<Delayed>());
+        Delayed d = std::move(delayed_.back());
+        delayed_.pop_back();
+        handleDatagram(d.data.data(), d.data.size());
+    }
+}
+
+void Pipeline::handleDatagram(const uint8_t* data, size_t len) {
+    proto::MessageView msg;
+    if (!proto::parse(data, len, msg)) {
+        BANK_LOG(logging::Debug, verbose_, "decode() failed, ignore");
+        metrics_.add(metrics::DECODE_ERRORS);
+        return;
+    }
+    if (trace_) {
+        trace_->record(msg.h.msgType == (uint8_t)proto::MsgType::Reply ? trace::Dir::Reply : trace::Dir::Callback,
+                       data, len);
+    }
+
+    if (msg.h.msgType != (uint8_t)proto::MsgType::Reply) {
+        metrics_.add(metrics::CALLBACKS);
+        if (onCallback_) {
+            onCallback_(msg);
+        } else {
+            BANK_LOG(logging::Debug, verbose_, "ignore non-reply msgType=" << (int)msg.h.msgType);
+        }
+        return;
+    }
+
+    uint32_t slot;
+    if (!index_.find(msg.h.requestId, slot)) {
+        // Duplicate reply to a retransmission that already completed
+        BANK_LOG(logging::Debug, verbose_, "ignore reply for unknown reqId=" << msg.h.requestId);
+        metrics_.add(metrics::UNKNOWN_REPLIES);
+        return;
+    }
+    if ((msg.h.flags & (proto::FLAG_COMPACT | proto::FLAG_LZ)) && msg.bodyLen > 0) {
+        size_t wide = 0;
+        if (!compact::unpack(msg.h.opCode, true, msg.h.flags, msg.body, msg.bodyLen, unpacked_.data(),
+                             unpacked_.size(), wide)) {
+            BANK_LOG(logging::Debug, verbose_, "unpack() failed for reqId=" << msg.h.requestId << ", ignore");
+            metrics_.add(metrics::DECODE_ERRORS);
+            return;
+        }
+        msg.h.flags &= uint16_t(~(proto::FLAG_COMPACT | proto::FLAG_LZ));
+        msg.h.bodyLen = uint32_t(wide);
+        msg.body = unpacked_.data();
+        msg.bodyLen = wide;
+    }
+    Slot& s = slots_[slot];
+    if (s.onChunk) {
+        // The first chunk times the round trip; the others only keep the stream alive
+        Clock::time_point now = Clock::now();
+        if (!s.streaming) {
+            s.streaming = true;
+            sample(s, now);
+        }
+        bool last = s.onChunk(msg) || msg.h.status != (uint16_t)proto::Status::OK;
+        if (!last) {
+            s.deadline = now + rto_.timeoutFor(s.attempts);
+            return;
+        }
+    }
+    complete(slot, &msg);
+}
+
+void Pipeline::expireDeadlines(Clock::time_point now) {
+    expired_.clear();
+    for (uint32_t slot : active_) {
+        Slot& s = slots_[slot];
+        if (s.parked) continue;
+        if (s.deadline <= now) expired_.push_back(slot);
+    }
+
+    for (uint32_t slot : expired_) {
+        Slot& s = slots_[slot];
+        if (flowOn_ && !s.timedOut) {
+            // Once per attempt, however long its retransmission waits for a token
+            s.timedOut = true;
+            flowEvent(flow_.onTimeout(s.sentAt, now));
+        }
+
+        // A stream that has started is given up on, not restarted
+        const bool retry = s.attempts < retryCount_ && !s.streaming;
+        if (retry && flowOn_) {
+            if (flow_.failFast(now)) {
+                metrics_.add(metrics::SHED);
+                complete(slot, nullptr, true);
+                continue;
+            }
+            if (!flow_.takeToken(now)) {
+                s.deadline = flow_.nextToken(now);  // retransmitted once a token is there
+                continue;
+            }
+            s.timedOut = false;
+        }
+
+        BANK_LOG(logging::Info, verbose_, "timeout, retry " << s.attempts << "/" << retryCount_);
+        if (retry) {
+            metrics_.add(metrics::RETRANSMITS);
+            s.attempts++;
+            s.deadline = now + rto_.timeoutFor(s.attempts);  // re-armed when flushed
+            if (atMostOnce_) proto::putBE16(s.bytes + 10, behind(s.requestId));  // header status
+            enqueue(slot);
+            continue;
+        }
+
+        metrics_.add(metrics::TIMEOUTS);
+        complete(slot, nullptr);
+    }
+}
+
+void Pipeline::sample(const Slot& s, Clock::time_point now) {
+    auto rtt = std::chrono::duration_cast<RetransmitPolicy::Micros>(now - s.sentAt);
+    rto_.onReply(rtt, s.attempts);
+    if (flowOn_) flowEvent(flow_.onReply(rtt, s.attempts, now));
+}
+
+void Pipeline::complete(uint32_t slot, const proto::MessageView* reply, bool shed) {
+    Slot& s = slots_[slot];
+
+    Clock::time_point now = Clock::now();
+    if (reply && !s.streaming) sample(s, now);
+
+    Completion c;
+    c.requestId = s.requestId;
+    c.opCode = s.opCode;
+    c.ok = reply != nullptr;
+    c.shed = shed;
+    c.attempts = s.attempts;
+    c.latency = std::chrono::duration_cast<std::chrono::microseconds>(now - s.submitted);
+    c.reply = reply;
+    if (reply) metrics_.reply(s.opCode, reply->h.status, (uint64_t)c.latency.count());
+
+    completions_++;
+    CompletionFn done = std::move(s.done);
+
+    // Unlink before the callback, which may submit() into this very slot
+    uint32_t last = active_.back();
+    active_[s.activePos] = last;
+    slots_[last].activePos = s.activePos;
+    active_.pop_back();
+    index_.erase(s.requestId);
+    releaseSlot(slot);
+
+    if (done) {
+        done(c);
+        return;
+    }
+
+    Finished f;
+    f.ok = c.ok;
+    f.attempts = c.attempts;
+    if (reply) proto::copyTo(*reply, f.reply);
+    finished_.emplace(c.requestId, std::move(f));
+}
@@ -0,0 +1,386 @@
+#pragma once
+
+#include "flow.hpp"
+#include "impair.hpp"
+#include "metrics.hpp"
+#include "net.hpp"
+#include "protocol.hpp"
+#include "ring.hpp"
+#include "rto.hpp"
+#include "trace.hpp"
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Asynchronous request engine over one UDP socket
+ *
+ * Keeps many requests in flight at once:
+ * - Pending table keyed by requestId, replies are matched back to their entry
+ * - Per-request deadline from a RetransmitPolicy (fixed or RTT-adaptive),
+ *   retransmission up to retryCount attempts
+ * - Sequenced requestIds (proto::FLAG_SEQ_ID): a random 32-bit session
+ *   drawn when the pipeline is created, then a counter, so ids never
+ *   collide and the server can track them in a window per client; each
+ *   request also says how far back the oldest unanswered one is, so the
+ *   server knows which replies it no longer needs
+ * - Optionally several server endpoints (setServers()): each request goes
+ *   to the owner of its account holder on a HashRing, retransmissions
+ *   included
+ * - Optional flow control (setFlowControl()): a request the rate limit or
+ *   the congestion window has no room for is parked, encoded but unsent,
+ *   and leaves in order as room appears; retransmissions pay
+ *   tokens too, and while the circuit breaker is open requests complete
+ *   at once as failed (Completion::shed) without being sent
+ * - Optional capture (setTrace()): every datagram sent or received is
+ *   appended to a trace::Writer, for offline replay
+ * - Optional body encodings (setEncoding()): requests are packed into the
+ *   compact and/or LZ encoding (compact.hpp) as they are launched, after
+ *   routing, and replies in one are unpacked to the wide layout before
+ *   anyone sees them, so callers and the trace's readers deal in wide bodies
+ *   (the trace itself holds the datagrams as sent)
+ * - Optional impairment (setImpairment()): datagrams lost on the way out
+ *   or in, and received ones held back by a delay with jitter, to test
+ *   retransmission against a clean loopback (see impair.hpp)
+ * - Stream requests (submitStreamWith()), answered by several Reply
+ *   datagrams such as the chunks of a SNAPSHOT: each is handed to a chunk
+ *   callback as it arrives and re-arms the deadline; the request is only
+ *   retransmitted while nothing has come back, since the chunks already
+ *   seen would all be sent again
+ * - submit()/await() API, or completion callbacks driven by poll()
+ *
+ * Requests are encoded straight into a pooled send buffer that is reused
+ * for retransmissions, so a steady-state submitWith() does not allocate.
+ * Datagrams are received into a preallocated ring and handed out as
+ * proto::MessageView, so decoding a reply or callback does not copy either.
+ *
+ * Sends are queued and flushed in batches (sendmmsg/recvmmsg on Linux,
+ * one call per datagram elsewhere); flush() runs at the top and bottom of
+ * every poll(), so requests submitted between polls leave together.
+ *
+ * Not thread-safe: one Pipeline is owned and driven by a single thread.
+ */
+class Pipeline {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Number of receive buffers in the ring (= largest receive batch)
+    static constexpr size_t RECV_RING = 32;
+
+    /**
+     * Batch sizes actually achieved by the transport
+     */
+    struct BatchStats {
+        uint64_t sendCalls = 0;
+        uint64_t sendPackets = 0;
+        uint64_t recvCalls = 0;       // calls that returned at least one datagram
+        uint64_t recvPackets = 0;
+        uint64_t sendBytes = 0;       // datagram bytes, headers included
+        uint64_t recvBytes = 0;
+        int sendMax = 0;
+        int recvMax = 0;
+        uint64_t sendHist[8] = {};    // batch size buckets: 1, 2-3, 4-7, ..., 64+
+        uint64_t recvHist[8] = {};
+    };
+
+    /**
+     * Outcome of one request, handed to the completion callback
+     */
+    struct Completion {
+        uint64_t requestId;
+        uint16_t opCode;
+        bool ok;                            // false if all attempts timed out
+        bool shed;                          // failed locally by the open circuit breaker
+        int attempts;                       // datagrams sent for this request
+        std::chrono::microseconds latency;  // submit -> reply (or give up)
+        const proto::MessageView* reply;    // nullptr when !ok, valid during the callback only
+    };
+
+    using CompletionFn = std::function<void(const Completion&)>;
+    using CallbackFn = std::function<void(const proto::MessageView&)>;
+    // One reply datagram of a stream request; returns true if it was the last
+    using ChunkFn = std::function<bool(const proto::MessageView&)>;
+
+    /**
+     * Constructor
+     * @param sock Bound/unbound UDP socket (not owned, switched to non-blocking)
+     * @param server Server address
+     * @param atMostOnce Set FLAG_AT_MOST_ONCE on every request
+     * @param rto Retransmission timer policy
+     * @param retryCount Maximum number of attempts per request
+     */
+    Pipeline(net::Socket sock, const sockaddr_in& server, bool atMostOnce,
+             const RetransmitPolicy& rto, int retryCount);
+
+    /**
+     * Send a request without waiting for the reply
+     * @param opCode Operation code
+     * @param body Request body
+     * @param done Completion callback; if empty the result is kept for await()
+     * @return requestId of the new request, 0 if the body is too large
+     */
+    uint64_t submit(uint16_t opCode, const std::vector<uint8_t>& body, CompletionFn done = nullptr);
+
+    /**
+     * Send a request whose body is written in place into the send buffer
+     * @param opCode Operation code
+     * @param bodyLen Exact body size (see proto::requestBodySize)
+     * @param writeBody Callable taking proto::Writer&, must write bodyLen bytes
+     * @param done Completion callback; if empty the result is kept for await()
+     * @return requestId of the new request, 0 if the body did not fit
+     */
+    template <class BodyFn>
+    uint64_t submitWith(uint16_t opCode, size_t bodyLen, BodyFn&& writeBody, CompletionFn done = nullptr) {
+        uint32_t slot;
+        if (!encode(bodyLen, writeBody, slot)) return 0;
+        return launch(slot, opCode, bodyLen, std::move(done));
+    }
+
+    /**
+     * Send a request answered by several Reply datagrams (SNAPSHOT)
+     * @param onChunk Called with every reply datagram as it arrives (a
+     *                retransmission may bring some twice); returning true,
+     *                or a reply with an error status, completes the request
+     * @param done Completion callback, with the last datagram as reply; !ok
+     *             if the stream stalled for a whole retransmission timeout
+     * @return requestId of the new request, 0 if the body did not fit
+     */
+    template <class BodyFn>
+    uint64_t submitStreamWith(uint16_t opCode, size_t bodyLen, BodyFn&& writeBody, ChunkFn onChunk,
+                              CompletionFn done = nullptr) {
+        uint32_t slot;
+        if (!encode(bodyLen, writeBody, slot)) return 0;
+        slots_[slot].onChunk = std::move(onChunk);
+        return launch(slot, opCode, bodyLen, std::move(done));
+    }
+
+    /**
+     * Drive the engine until the given request completes
+     * @param reqId Id returned by submit() without a callback
+     * @param reply Output reply message
+     * @param attempts Optional output: datagrams sent
+     * @return true if a matching reply arrived
+     */
+    bool await(uint64_t reqId, proto::Message& reply, int* attempts = nullptr);
+
+    /**
+     * Receive replies/callbacks and handle expired deadlines
+     * @param maxWaitMs Longest time to block waiting for a datagram
+     * @return number of requests completed (successfully or not)
+     */
+    int poll(int maxWaitMs);
+
+    /**
+     * Hand all queued datagrams to the kernel
+     * @return number of datagrams still queued (socket buffer full)
+     */
+    size_t flush();
+
+    /**
+     * Spread requests over several endpoints (call before submitting)
+     * @param servers Endpoints; the constructor's server is replaced by this list
+     */
+    void setServers(const std::vector<sockaddr_in>& servers);
+
+    size_t serverCount() const { return servers_.size(); }
+
+    /**
+     * Rate limit, congestion window and circuit breaker (call before submitting)
+     */
+    void setFlowControl(const FlowControl::Config& cfg);
+
+    const FlowControl& flow() const { return flow_; }
+
+    /**
+     * Record every datagram sent and received (not owned; may be shared
+     * by several pipelines)
+     */
+    void setTrace(trace::Writer* t) { trace_ = t; }
+
+    /**
+     * Lose and delay datagrams in this pipeline (call before submitting)
+     */
+    void setImpairment(const Impairment::Config& cfg);
+
+    /**
+     * Encodings to ask for on every request that has them (server_cpp only)
+     * @param compact proto::FLAG_COMPACT: varints and minor-unit amounts
+     * @param lz proto::FLAG_LZ: LZ4 on bodies large enough, BATCH in practice
+     */
+    void setEncoding(bool compact, bool lz) {
+        encoding_ = (compact ? proto::FLAG_COMPACT : 0) | (lz ? proto::FLAG_LZ : 0);
+    }
+
+    /**
+     * Handler for non-reply messages (e.g. CALLBACK_UPDATE)
+     */
+    void setCallbackHandler(CallbackFn fn) { onCallback_ = std::move(fn); }
+
+    /**
+     * Extra socket whose readability interrupts the wait inside poll()
+     * (see net::Waker); poll() drains it and returns early
+     */
+    void setWakeSocket(net::Socket s) { wake_ = s; }
+
+    /**
+     * Print retry/timeout diagnostics to the console (see log.hpp)
+     */
+    void setVerbose(bool v) { verbose_ = v; }
+
+    size_t inFlight() const { return active_.size(); }
+    const BatchStats& batchStats() const { return batch_; }
+    const RetransmitPolicy& rto() const { return rto_; }
+
+    /**
+     * Latency histograms and counters; written by the owning thread only,
+     * snapshot() is safe from any thread
+     */
+    metrics::Registry& metrics() { return metrics_; }
+    const metrics::Registry& metrics() const { return metrics_; }
+
+private:
+    /**
+     * One in-flight request; slots are pooled and never freed
+     */
+    struct Slot {
+        uint64_t requestId;
+        uint16_t opCode;
+        int attempts;
+        uint32_t activePos;  // index in active_
+        bool inUse;          // a request currently owns this slot
+        bool queued;         // present in sendQueue_
+        bool parked;         // in parked_, waiting for FlowControl::admit()
+        bool shed;           // in shed_, failed fast by the breaker, never sent
+        bool timedOut;       // attempt expired, retransmission waiting for a token
+        bool streaming;      // stream request with its first chunk in
+        uint32_t server;     // endpoint (index into servers_) the request belongs to
+        size_t len;          // encoded datagram length
+        Clock::time_point submitted;
+        Clock::time_point sentAt;    // last transmission
+        Clock::time_point deadline;
+        CompletionFn done;
+        ChunkFn onChunk;     // set for a stream request
+        uint8_t bytes[proto::MAX_DATAGRAM];  // encoded request, resent verbatim
+    };
+
+    /**
+     * Open-addressing requestId -> slot index (linear probing, backward-shift delete)
+     */
+    class RequestIndex {
+    public:
+        RequestIndex();
+        void insert(uint64_t reqId, uint32_t slot);
+        bool find(uint64_t reqId, uint32_t& slot) const;
+        void erase(uint64_t reqId);
+        bool contains(uint64_t reqId) const { uint32_t s; return find(reqId, s); }
+
+    private:
+        std::vector<std::pair<uint64_t, uint32_t>> table_;  // key 0 = empty
+        size_t size_;
+        size_t mask_;
+
+        size_t home(uint64_t reqId) const;
+        void grow();
+    };
+
+    struct Finished {
+        bool ok;
+        int attempts;
+        proto::Message reply;
+    };
+
+    // A received datagram held back by the impairment
+    struct Delayed {
+        Clock::time_point due;
+        uint64_t seq;  // arrival order, among equal due times
+        std::vector<uint8_t> data;
+
+        bool operator>(const Delayed& o) const { return due != o.due ? due > o.due : seq > o.seq; }
+    };
+
+    net::Socket sock_;
+    net::Socket wake_;
+    std::vector<sockaddr_in> servers_;  // at least one
+    std::unique_ptr<HashRing> ring_;    // with more than one endpoint
+    FlowControl flow_;
+    bool flowOn_;
+    std::deque<uint32_t> parked_;      // admitted in order as the flow control allows
+    std::vector<uint32_t> shed_;       // refused by launch(), completed by the next poll()
+    std::vector<uint32_t> shedding_;   // scratch list reused by poll()
+    bool atMostOnce_;
+    RetransmitPolicy rto_;
+    int retryCount_;
+    bool verbose_;
+
+    uint32_t session_;  // requestId high half (drawn again if seq_ wraps)
+    uint32_t seq_;      // last sequence number handed out
+    std::deque<uint64_t> issued_;  // at-most-once ids in sequence order, answered ones trimmed lazily
+    std::deque<Slot> slots_;           // stable addresses as the pool grows
+    std::vector<uint32_t> freeSlots_;
+    std::vector<uint32_t> active_;     // slots with a request in flight
+    std::vector<uint32_t> expired_;    // scratch list reused by expireDeadlines()
+    std::vector<uint32_t> sendQueue_;  // slots waiting for flush()
+    size_t sendHead_;                  // first unsent entry of sendQueue_
+    BatchStats batch_;
+    metrics::Registry metrics_;
+    RequestIndex index_;
+    std::unordered_map<uint64_t, Finished> finished_;  // results waiting for await()
+    std::vector<uint8_t> recvRing_;    // RECV_RING buffers of MAX_DATAGRAM bytes
+    CallbackFn onCallback_;
+    trace::Writer* trace_;
+    Impairment impair_;
+    bool impairOn_;
+    std::vector<Delayed> delayed_;     // min-heap on due: received, held back by impair_
+    uint64_t delayedSeq_;
+    uint16_t encoding_;                // FLAG_COMPACT | FLAG_LZ wanted, 0 = wide
+    std::vector<uint8_t> packed_;      // request being packed
+    std::vector<uint8_t> unpacked_;    // reply being unpacked; apart from packed_, so a
+                                       // completion may submit while it reads its reply
+    uint64_t completions_;
+
+    uint64_t newRequestId();
+    static uint32_t newSession();
+    // Header status of a sequenced request: how far behind it the oldest unanswered one is
+    uint16_t behind(uint64_t reqId);
+    uint32_t acquireSlot();
+    void releaseSlot(uint32_t slot);
+
+    // Write a request body into a fresh slot; false (and no slot) if it did not fit
+    template <class BodyFn>
+    bool encode(size_t bodyLen, BodyFn& writeBody, uint32_t& slot) {
+        if (bodyLen > proto::MAX_DATAGRAM - proto::HEADER_SIZE) return false;
+        slot = acquireSlot();
+        proto::Writer w(slots_[slot].bytes + proto::HEADER_SIZE, bodyLen);
+        writeBody(w);
+        if (!w.ok() || w.size() != bodyLen) {
+            releaseSlot(slot);
+            return false;
+        }
+        return true;
+    }
+    uint64_t launch(uint32_t slot, uint16_t opCode, size_t bodyLen, CompletionFn done);
+    void enqueue(uint32_t slot);
+    void route(Slot& s, uint16_t opCode, size_t bodyLen);
+    // Requests sent and not answered: neither parked nor shed
+    size_t unanswered() const { return active_.size() - parked_.size() - shed_.size(); }
+    void admit(uint32_t slot, Clock::time_point now);
+    void releaseParked(Clock::time_point now);
+    void flowEvent(unsigned ev);
+    void drainSocket();
+    // sendBatch through the impairment: lost datagrams count as sent
+    int transmit(net::Packet* pkts, int n);
+    // A datagram off the socket: lost, held back, or handled now
+    void receive(const uint8_t* data, size_t len);
+    // Handle the held-back datagrams that are due
+    void releaseDelayed(Clock::time_point now);
+    void handleDatagram(const uint8_t* data, size_t len);
+    void expireDeadlines(Clock::time_point now);
+    // RTT sample for the retransmission timer and the flow control
+    void sample(const Slot& s, Clock::time_point now);
+    void complete(uint32_t slot, const proto::MessageView* reply, bool shed = false);
+};
@@ -1,51 +1,29 @@
 #include "protocol.hpp"
+#include "endian.hpp"
+#include "schema.hpp"
 #include <cstring>
 
 namespace proto {
 
-// ==================== Big-endian encoding helpers ====================
-
-static inline void putBE16(uint8_t* p, uint16_t v) {
-    p[0] = uint8_t((v >> 8) & 0xFF);
-    p[1] = uint8_t(v & 0xFF);
-}
-
-static inline void putBE32(uint8_t* p, uint32_t v) {
-    p[0] = uint8_t((v >> 24) & 0xFF);
-    p[1] = uint8_t((v >> 16) & 0xFF);
-    p[2] = uint8_t((v >> 8) & 0xFF);
-    p[3] = uint8_t(v & 0xFF);
-}
-
-static inline void putBE64(uint8_t* p, uint64_t v) {
-    for (int i = 0; i < 8; i++) {
-        p[i] = uint8_t((v >> (56 - 8 * i)) & 0xFF);
-    }
-}
-
 // ==================== Big-endian decoding helpers ====================
 
 static inline bool getBE16(const std::vector<uint8_t>& b, size_t& off, uint16_t& out) {
     if (off + 2 > b.size()) return false;
-    out = (uint16_t(b[off]) << 8) | uint16_t(b[off + 1]);
+    out = loadBE16(b.data() + off);
     off += 2;
     return true;
 }
 
 static inline bool getBE32(const std::vector<uint8_t>& b, size_t& off, uint32_t& out) {
     if (off + 4 > b.size()) return false;
-    out = (uint32_t(b[off]) << 24) | (uint32_t(b[off + 1]) << 16) | 
-          (uint32_t(b[off + 2]) << 8) | uint32_t(b[off + 3]);
+    out = loadBE32(b.data() + off);
     off += 4;
     return true;
 }
 
 static inline bool getBE64(const std::vector<uint8_t>& b, size_t& off, uint64_t& out) {
     if (off + 8 > b.size()) return false;
-    out = 0;
-    for (int i = 0; i < 8; i++) {
-        out = (out << 8) | uint64_t(b[off + i]);
-    }
+    out = loadBE64(b.data() + off);
     off += 8;
     return true;
 }
@@ -145,39 +123,324 @@ bool getPassword16(const std::vector<uint8_t>& b, size_t& off, std::string& out)
 // ==================== Message encoding/decoding ====================
 
 std::vector<uint8_t> encode(const Message& m) {
-    std::vector<uint8_t> out;
-    out.reserve(HEADER_SIZE + m.body.size());
-
-    putU32(out, m.h.magic);
-    out.push_back(m.h.version);
-    out.push_back(m.h.msgType);
-    putU16(out, m.h.opCode);
-    putU16(out, m.h.flags);
-    putU16(out, m.h.status);
-    putU64(out, m.h.requestId);
-    putU32(out, m.h.bodyLen);
-
-    out.insert(out.end(), m.body.begin(), m.body.end());
+    std::vector<uint8_t> out(HEADER_SIZE + m.body.size());
+    writeHeader(out.data(), m.h);
+    if (!m.body.empty()) std::memcpy(out.data() + HEADER_SIZE, m.body.data(), m.body.size());
     return out;
 }
 
 bool decode(const std::vector<uint8_t>& raw, Message& out) {
-    size_t off = 0;
-    if (!getU32(raw, off, out.h.magic)) return false;
+    MessageView v;
+    if (!parse(raw.data(), raw.size(), v)) return false;
+    copyTo(v, out);
+    return true;
+}
+
+// ==================== Fixed-buffer encoding ====================
+
+uint8_t* Writer::reserve(size_t n) {
+    if (!ok_ || n > cap_ - pos_) {
+        ok_ = false;
+        return nullptr;
+    }
+    uint8_t* p = buf_ + pos_;
+    pos_ += n;
+    return p;
+}
+
+void Writer::putU8(uint8_t v) {
+    if (uint8_t* p = reserve(1)) *p = v;
+}
+
+void Writer::putU16(uint16_t v) {
+    if (uint8_t* p = reserve(2)) putBE16(p, v);
+}
+
+void Writer::putU32(uint32_t v) {
+    if (uint8_t* p = reserve(4)) putBE32(p, v);
+}
+
+void Writer::putU64(uint64_t v) {
+    if (uint8_t* p = reserve(8)) putBE64(p, v);
+}
+
+void Writer::putDouble(double v) {
+    uint64_t bits = 0;
+    std::memcpy(&bits, &v, 8);
+    putU64(bits);
+}
+
+void Writer::putU32s(const uint32_t* v, size_t n) {
+    if (uint8_t* p = reserve(4 * n)) storeBE32s(p, v, n);
+}
+
+void Writer::putI32s(const int32_t* v, size_t n) {
+    putU32s(reinterpret_cast<const uint32_t*>(v), n);
+}
+
+void Writer::putU64s(const uint64_t* v, size_t n) {
+    if (uint8_t* p = reserve(8 * n)) storeBE64s(p, v, n);
+}
+
+void Writer::putDoubles(const double* v, size_t n) {
+    if (uint8_t* p = reserve(8 * n)) storeBE64s(p, v, n);
+}
+
+void Writer::putString(const std::string& s) {
+    if (s.size() > 65535) {
+        ok_ = false;
+        return;
+    }
+    putU16(uint16_t(s.size()));
+    putBytes(reinterpret_cast<const uint8_t*>(s.data()), s.size());
+}
+
+void Writer::putPassword16(const std::string& s) {
+    uint8_t* p = reserve(16);
+    if (!p) return;
+    size_t n = s.size() > 16 ? 16 : s.size();
+    std::memcpy(p, s.data(), n);
+    std::memset(p + n, 0, 16 - n);
+}
+
+void Writer::putBytes(const uint8_t* src, size_t n) {
+    if (n == 0) return;
+    if (uint8_t* p = reserve(n)) std::memcpy(p, src, n);
+}
+
+void writeHeader(uint8_t* p, const Header& h) {
+    putBE32(p, h.magic);
+    p[4] = h.version;
+    p[5] = h.msgType;
+    putBE16(p + 6, h.opCode);
+    putBE16(p + 8, h.flags);
+    putBE16(p + 10, h.status);
+    putBE64(p + 12, h.requestId);
+    putBE32(p + 20, h.bodyLen);
+}
+
+size_t requestBodySize(uint16_t opCode, size_t nameLen) {
+    switch (opCode) {
+        case uint16_t(OpCode::OPEN): return schema::OpenRequest::MIN_SIZE + nameLen;
+        case uint16_t(OpCode::CLOSE): return schema::AuthRequest::MIN_SIZE + nameLen;
+        case uint16_t(OpCode::DEPOSIT): return schema::AmountRequest::MIN_SIZE + nameLen;
+        case uint16_t(OpCode::WITHDRAW): return schema::AmountRequest::MIN_SIZE + nameLen;
+        case uint16_t(OpCode::MONITOR_REGISTER): return schema::MonitorRequest::fixedSize();
+        case uint16_t(OpCode::QUERY_BALANCE): return schema::AuthRequest::MIN_SIZE + nameLen;
+        case uint16_t(OpCode::TRANSFER): return schema::TransferRequest::MIN_SIZE + nameLen;
+        case uint16_t(OpCode::SNAPSHOT): return schema::SnapshotRequest::MIN_SIZE + nameLen;
+        case uint16_t(OpCode::LOGIN): return schema::AuthRequest::MIN_SIZE + nameLen;
+        case uint16_t(OpCode::DEPOSIT_TOKEN): return schema::TokenAmountRequest::fixedSize();
+        case uint16_t(OpCode::WITHDRAW_TOKEN): return schema::TokenAmountRequest::fixedSize();
+        case uint16_t(OpCode::QUERY_BALANCE_TOKEN): return schema::TokenRequest::fixedSize();
+        case uint16_t(OpCode::TRANSFER_TOKEN): return schema::TokenTransferRequest::fixedSize();
+        default: return 0;
+    }
+}
+
+void writeOpenRequest(Writer& w, const std::string& name, const std::string& password,
+                      uint16_t currency, double initialBalance) {
+    schema::OpenRequest::write(w, name, password, currency, initialBalance);
+}
+
+void writeSnapshotRequest(Writer& w, const std::string& name, const std::string& password,
+                          int32_t from, int32_t to, uint16_t maxChunks) {
+    schema::SnapshotRequest::write(w, name, password, from, to, maxChunks);
+}
+
+void writeAuthRequest(Writer& w, const std::string& name, int32_t accNo,
+                      const std::string& password) {
+    schema::AuthRequest::write(w, name, accNo, password);
+}
+
+void writeAmountRequest(Writer& w, const std::string& name, int32_t accNo,
+                        const std::string& password, uint16_t currency, double amount) {
+    schema::AmountRequest::write(w, name, accNo, password, currency, amount);
+}
+
+void writeTransferRequest(Writer& w, const std::string& name, int32_t fromAccNo,
+                          const std::string& password, int32_t toAccNo,
+                          uint16_t currency, double amount) {
+    schema::TransferRequest::write(w, name, fromAccNo, password, toAccNo, currency, amount);
+}
+
+uint16_t tokenOpCode(uint16_t opCode) {
+    switch (opCode) {
+        case uint16_t(OpCode::DEPOSIT): return uint16_t(OpCode::DEPOSIT_TOKEN);
+        case uint16_t(OpCode::WITHDRAW): return uint16_t(OpCode::WITHDRAW_TOKEN);
+        case uint16_t(OpCode::QUERY_BALANCE): return uint16_t(OpCode::QUERY_BALANCE_TOKEN);
+        case uint16_t(OpCode::TRANSFER): return uint16_t(OpCode::TRANSFER_TOKEN);
+        default: return 0;
+    }
+}
+
+void writeTokenRequest(Writer& w, uint64_t token, int32_t accNo) {
+    schema::TokenRequest::write(w, token, accNo);
+}
+
+void writeTokenAmountRequest(Writer& w, uint64_t token, int32_t accNo, uint16_t currency, double amount) {
+    schema::TokenAmountRequest::write(w, token, accNo, currency, amount);
+}
+
+void writeTokenTransferRequest(Writer& w, uint64_t token, int32_t fromAccNo, int32_t toAccNo,
+                               uint16_t currency, double amount) {
+    schema::TokenTransferRequest::write(w, token, fromAccNo, toAccNo, currency, amount);
+}
+
+void writeMonitorRequest(Writer& w, uint16_t seconds) {
+    schema::MonitorRequest::write(w, seconds);
+}
+
+size_t monitorRequestSize(size_t accounts) {
+    return schema::MonitorRequest::fixedSize() + schema::MonitorOptions::fixedSize() + 4 * accounts;
+}
+
+void writeMonitorRequest(Writer& w, uint16_t seconds, uint16_t options, const int32_t* accounts,
+                         size_t count) {
+    if (count > MONITOR_MAX_FILTER) {
+        w.fail();
+        return;
+    }
+    schema::MonitorRequest::write(w, seconds);
+    schema::MonitorOptions::write(w, options, uint16_t(count));
+    w.putI32s(accounts, count);
+}
+
+// ==================== Zero-copy decoding ====================
+
+bool parse(const uint8_t* data, size_t len, MessageView& out) {
+    if (len < HEADER_SIZE) return false;
+    out.h.magic = loadBE32(data);
     if (out.h.magic != MAGIC) return false;
-    if (off + 2 > raw.size()) return false;
-    out.h.version = raw[off++];
-    out.h.msgType = raw[off++];
-    if (!getU16(raw, off, out.h.opCode)) return false;
-    if (!getU16(raw, off, out.h.flags)) return false;
-    if (!getU16(raw, off, out.h.status)) return false;
-    if (!getU64(raw, off, out.h.requestId)) return false;
-    if (!getU32(raw, off, out.h.bodyLen)) return false;
-    if (off + out.h.bodyLen > raw.size()) return false;
-    out.body.assign(raw.begin() + off, raw.begin() + off + out.h.bodyLen);
+    out.h.version = data[4];
+    out.h.msgType = data[5];
+    out.h.opCode = loadBE16(data + 6);
+    out.h.flags = loadBE16(data + 8);
+    out.h.status = loadBE16(data + 10);
+    out.h.requestId = loadBE64(data + 12);
+    out.h.bodyLen = loadBE32(data + 20);
+    if (out.h.bodyLen > len - HEADER_SIZE) return false;
+    out.body = data + HEADER_SIZE;
+    out.bodyLen = out.h.bodyLen;
+    return true;
+}
+
+void copyTo(const MessageView& v, Message& out) {
+    out.h = v.h;
+    out.body.assign(v.body, v.body + v.bodyLen);
+}
+
+bool Reader::getU8(uint8_t& out) {
+    if (n_ - off_ < 1) return false;
+    out = p_[off_++];
+    return true;
+}
+
+bool Reader::getU16(uint16_t& out) {
+    if (n_ - off_ < 2) return false;
+    out = loadBE16(p_ + off_);
+    off_ += 2;
+    return true;
+}
+
+bool Reader::getU32(uint32_t& out) {
+    if (n_ - off_ < 4) return false;
+    out = loadBE32(p_ + off_);
+    off_ += 4;
+    return true;
+}
+
+bool Reader::getU64(uint64_t& out) {
+    if (n_ - off_ < 8) return false;
+    out = loadBE64(p_ + off_);
+    off_ += 8;
     return true;
 }
 
+bool Reader::getI32(int32_t& out) {
+    uint32_t u;
+    if (!getU32(u)) return false;
+    out = int32_t(u);
+    return true;
+}
+
+bool Reader::getDouble(double& out) {
+    uint64_t bits;
+    if (!getU64(bits)) return false;
+    std::memcpy(&out, &bits, 8);
+    return true;
+}
+
+bool Reader::getU32s(uint32_t* out, size_t n) {
+    if ((n_ - off_) / 4 < n) return false;
+    loadBE32s(out, p_ + off_, n);
+    off_ += 4 * n;
+    return true;
+}
+
+bool Reader::getI32s(int32_t* out, size_t n) {
+    return getU32s(reinterpret_cast<uint32_t*>(out), n);
+}
+
+bool Reader::getU64s(uint64_t* out, size_t n) {
+    if ((n_ - off_) / 8 < n) return false;
+    loadBE64s(out, p_ + off_, n);
+    off_ += 8 * n;
+    return true;
+}
+
+bool Reader::getDoubles(double* out, size_t n) {
+    if ((n_ - off_) / 8 < n) return false;
+    loadBE64s(out, p_ + off_, n);
+    off_ += 8 * n;
+    return true;
+}
+
+bool Reader::getString(std::string_view& out) {
+    uint16_t len;
+    if (!getU16(len)) return false;
+    if (n_ - off_ < len) {
+        off_ -= 2;
+        return false;
+    }
+    out = std::string_view(reinterpret_cast<const char*>(p_ + off_), len);
+    off_ += len;
+    return true;
+}
+
+bool Reader::getPassword16(std::string_view& out) {
+    if (n_ - off_ < 16) return false;
+    const uint8_t* p = p_ + off_;
+    size_t n = 16;
+    while (n > 0 && p[n - 1] == 0) n--;
+    out = std::string_view(reinterpret_cast<const char*>(p), n);
+    off_ += 16;
+    return true;
+}
+
+bool Reader::getBytes(const uint8_t*& out, size_t n) {
+    if (n_ - off_ < n) return false;
+    out = p_ + off_;
+    off_ += n;
+    return true;
+}
+
+void writeBatchEntry(Writer& w, uint16_t opCode, uint16_t subId, uint16_t bodyLen) {
+    schema::BatchEntryHeader::write(w, opCode, subId, bodyLen);
+}
+
+bool readBatchReplyEntry(Reader& r, BatchReplyEntry& out) {
+    const uint8_t* hdr;
+    uint16_t len;
+    if (!r.getBytes(hdr, BATCH_REPLY_ENTRY_HEADER) ||
+        !schema::BatchReplyEntryHeader::read(hdr, BATCH_REPLY_ENTRY_HEADER, out.opCode, out.subId,
+                                             out.status, len)) {
+        return false;
+    }
+    out.bodyLen = len;
+    return r.getBytes(out.body, len);
+}
+
 // ==================== Utility functions ====================
 
 std::string currencyToString(uint16_t c) {
@@ -199,6 +462,19 @@ std::string statusToString(uint16_t s) {
     }
 }
 
+const char* statusName(uint16_t s) {
+    switch (s) {
+        case uint16_t(Status::OK): return "OK";
+        case uint16_t(Status::ERR_BAD_REQUEST): return "BAD_REQUEST";
+        case uint16_t(Status::ERR_AUTH): return "AUTH";
+        case uint16_t(Status::ERR_NOT_FOUND): return "NOT_FOUND";
+        case uint16_t(Status::ERR_CURRENCY): return "CURRENCY";
+        case uint16_t(Status::ERR_INSUFFICIENT_FUNDS): return "INSUFFICIENT_FUNDS";
+        case uint16_t(Status::ERR_PASSWORD_FORMAT): return "PASSWORD_FORMAT";
+        default: return "ERROR";
+    }
+}
+
 std::string opCodeToString(uint16_t op) {
     switch (op) {
         case uint16_t(OpCode::OPEN): return "OPEN";
@@ -208,7 +484,15 @@ std::string opCodeToString(uint16_t op) {
         case uint16_t(OpCode::MONITOR_REGISTER): return "MONITOR_REGISTER";
         case uint16_t(OpCode::QUERY_BALANCE): return "QUERY_BALANCE";
         case uint16_t(OpCode::TRANSFER): return "TRANSFER";
+        case uint16_t(OpCode::BATCH): return "BATCH";
+        case uint16_t(OpCode::SNAPSHOT): return "SNAPSHOT";
+        case uint16_t(OpCode::LOGIN): return "LOGIN";
+        case uint16_t(OpCode::DEPOSIT_TOKEN): return "DEPOSIT_TOKEN";
+        case uint16_t(OpCode::WITHDRAW_TOKEN): return "WITHDRAW_TOKEN";
+        case uint16_t(OpCode::QUERY_BALANCE_TOKEN): return "QUERY_BALANCE_TOKEN";
+        case uint16_t(OpCode::TRANSFER_TOKEN): return "TRANSFER_TOKEN";
         case uint16_t(OpCode::CALLBACK_UPDATE): return "CALLBACK_UPDATE";
+        case uint16_t(OpCode::CALLBACK_BATCH): return "CALLBACK_BATCH";
         default: return "UNKNOWN_OP";
     }
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace proto {
@@ -25,7 +26,15 @@ enum class OpCode : uint16_t {
     MONITOR_REGISTER = 5,  // Monitor register
     QUERY_BALANCE = 6,     // Query balance (idempotent)
     TRANSFER = 7,          // Transfer (non-idempotent)
-    CALLBACK_UPDATE = 100  // Callback notification
+    BATCH = 8,             // Several sub-operations in one datagram
+    SNAPSHOT = 9,          // Balances of a range of accounts, in chunks (idempotent)
+    LOGIN = 10,            // Session token for one account (idempotent)
+    DEPOSIT_TOKEN = 11,    // DEPOSIT with a session token (non-idempotent)
+    WITHDRAW_TOKEN = 12,   // WITHDRAW with a session token (non-idempotent)
+    QUERY_BALANCE_TOKEN = 13,  // QUERY_BALANCE with a session token (idempotent)
+    TRANSFER_TOKEN = 14,   // TRANSFER with a session token (non-idempotent)
+    CALLBACK_UPDATE = 100, // Callback notification
+    CALLBACK_BATCH = 101   // Several callback notifications in one datagram
 };
 
 // Currency types
@@ -65,10 +74,40 @@ struct Message {
 
 // Flags
 static constexpr uint16_t FLAG_AT_MOST_ONCE = 0x0001;
+// requestId is session:u32 | seq:u32, seq counting up from 1 per session,
+// and the request's status is seq minus the client's oldest unanswered seq,
+// or SEQ_BEHIND_UNKNOWN when that does not fit; lets server_cpp deduplicate
+// in a per-client window (seq_window.hpp)
+static constexpr uint16_t FLAG_SEQ_ID = 0x0002;
+// Status of a FLAG_SEQ_ID request whose oldest unanswered request is 0xFFFF
+// or more behind it: the server must not raise its floor on it
+static constexpr uint16_t SEQ_BEHIND_UNKNOWN = 0xFFFF;
+// Body in the compact encoding (see compact.hpp): varint integers and
+// money as whole minor units; a reply is compact only if its request asked
+// with this flag, and only when the encoding applies (server_cpp only)
+static constexpr uint16_t FLAG_COMPACT = 0x0004;
+// Body is LZ-compressed (see compact.hpp), after FLAG_COMPACT if both are
+// set; same rules for replies
+static constexpr uint16_t FLAG_LZ = 0x0008;
 
 // Header size in bytes
 static constexpr size_t HEADER_SIZE = 24;
 
+// Largest datagram the clients send or receive
+static constexpr size_t MAX_DATAGRAM = 2048;
+
+// Account numbers: server_cpp node k (--node) hands out FIRST_ACCOUNT +
+// k * NODE_ACCOUNTS onwards, so servers sharing clients never reuse one
+// another's numbers; node 0 numbers like server_java
+static constexpr int32_t FIRST_ACCOUNT = 10001;
+static constexpr int32_t NODE_ACCOUNTS = 100000000;
+static constexpr int MAX_NODES = 21;  // the last range still ends below INT32_MAX
+
+// Node whose range holds an account number, -1 below every range
+inline int nodeOf(int32_t accNo) {
+    return accNo < FIRST_ACCOUNT ? -1 : int((accNo - FIRST_ACCOUNT) / NODE_ACCOUNTS);
+}
+
 // ==================== Encoding helpers (big-endian) ====================
 void putU16(std::vector<uint8_t>& b, uint16_t v);
 void putU32(std::vector<uint8_t>& b, uint32_t v);
@@ -91,9 +130,251 @@ bool getPassword16(const std::vector<uint8_t>& b, size_t& off, std::string& out)
 std::vector<uint8_t> encode(const Message& m);
 bool decode(const std::vector<uint8_t>& raw, Message& out);
 
+// ==================== Fixed-buffer encoding ====================
+
+/**
+ * Big-endian writer over a caller-owned buffer (stack array, pool slot, ...)
+ * Never allocates: a write that does not fit marks the writer as failed
+ * and leaves the buffer untouched from that point on.
+ */
+class Writer {
+public:
+    Writer(uint8_t* buf, size_t cap) : buf_(buf), cap_(cap), pos_(0), ok_(true) {}
+
+    void putU8(uint8_t v);
+    void putU16(uint16_t v);
+    void putU32(uint32_t v);
+    void putU64(uint64_t v);
+    void putI32(int32_t v) { putU32(uint32_t(v)); }
+    void putDouble(double v);
+    void putString(const std::string& s);
+    void putPassword16(const std::string& s);
+    void putBytes(const uint8_t* p, size_t n);
+
+    // Arrays of fields, byte-swapped in one pass (see endian.hpp)
+    void putU32s(const uint32_t* v, size_t n);
+    void putI32s(const int32_t* v, size_t n);
+    void putU64s(const uint64_t* v, size_t n);
+    void putDoubles(const double* v, size_t n);
+
+    /**
+     * Claim the next n bytes for the caller to fill (see schema.hpp)
+     * @return pointer to them, nullptr (and the writer failed) if they do not fit
+     */
+    uint8_t* reserve(size_t n);
+
+    // Mark the writer as failed (a value could not be encoded)
+    void fail() { ok_ = false; }
+
+    bool ok() const { return ok_; }
+    size_t size() const { return pos_; }
+    uint8_t* data() const { return buf_; }
+
+private:
+    uint8_t* buf_;
+    size_t cap_;
+    size_t pos_;
+    bool ok_;
+};
+
+// Write the 24-byte header at p (bodyLen is taken from h)
+void writeHeader(uint8_t* p, const Header& h);
+
+/**
+ * Exact request body size for an operation
+ * @param opCode Operation code
+ * @param nameLen Length of the name field (ignored by MONITOR_REGISTER and the token operations)
+ * @return body size in bytes, 0 for unknown operations
+ */
+size_t requestBodySize(uint16_t opCode, size_t nameLen);
+
+// Request body layouts, written straight into a Writer
+void writeOpenRequest(Writer& w, const std::string& name, const std::string& password,
+                      uint16_t currency, double initialBalance);
+void writeAuthRequest(Writer& w, const std::string& name, int32_t accNo,
+                      const std::string& password);        // CLOSE, QUERY_BALANCE
+void writeAmountRequest(Writer& w, const std::string& name, int32_t accNo,
+                        const std::string& password, uint16_t currency,
+                        double amount);                    // DEPOSIT, WITHDRAW
+void writeTransferRequest(Writer& w, const std::string& name, int32_t fromAccNo,
+                          const std::string& password, int32_t toAccNo,
+                          uint16_t currency, double amount);
+void writeMonitorRequest(Writer& w, uint16_t seconds);
+
+// ==================== MONITOR_REGISTER options ====================
+//
+// Request body: seconds:u16 [options:u16 count:u16 count x accNo:i32]
+// A body of just seconds registers for every account and one
+// CALLBACK_UPDATE per change, as the Java server does. The optional tail
+// restricts the registration to the listed accounts (count 0 = all) and,
+// with MONITOR_BATCH, lets the server coalesce several updates into one
+// CALLBACK_BATCH datagram:
+//   count:u16, then count x { CALLBACK_UPDATE body }
+// Registering again from the same address replaces the registration.
+
+static constexpr uint16_t MONITOR_BATCH = 0x0001;
+
+// Most accounts one registration can name
+static constexpr size_t MONITOR_MAX_FILTER = 256;
+
+// Body size of a MONITOR_REGISTER with options
+size_t monitorRequestSize(size_t accounts);
+
+void writeMonitorRequest(Writer& w, uint16_t seconds, uint16_t options, const int32_t* accounts,
+                         size_t count);
+
+// ==================== BATCH layout ====================
+//
+// Request body: count:u16, then count x { opCode:u16, subId:u16, bodyLen:u16, body }
+// Reply body:   count:u16, then count x { opCode:u16, subId:u16, status:u16, bodyLen:u16, body }
+// Sub-operations run in order and independently; BATCH and MONITOR_REGISTER
+// cannot be nested. The batch as a whole is deduplicated under at-most-once.
+
+static constexpr size_t BATCH_ENTRY_HEADER = 6;
+static constexpr size_t BATCH_REPLY_ENTRY_HEADER = 8;
+
+// Largest BATCH body that fits a 1500-byte Ethernet MTU (IPv4 20 + UDP 8 + header)
+static constexpr size_t BATCH_MTU_BODY = 1500 - 20 - 8 - HEADER_SIZE;
+
+// Prefix one sub-request inside a BATCH body (its body follows)
+void writeBatchEntry(Writer& w, uint16_t opCode, uint16_t subId, uint16_t bodyLen);
+
+// ==================== SNAPSHOT layout ====================
+//
+// Request body: name:str, password:16, from:i32, to:i32, maxChunks:u16
+// Reply:        up to maxChunks Reply datagrams with the request's id, each
+//               chunk:u16, flags:u16, next:i32, count:u16,
+//               then count x { accNo:i32, currency:u16, balance:f64 }
+// Accounts from..to-1 (to 0 = no end) in number order; with a name, only
+// the open accounts of that holder and password (others are skipped, not
+// refused), with an empty name every open account, if the server allows
+// range scans. Chunks are numbered from 0 within one request, and next is
+// the first account number the chunk and those before it did not cover:
+// the resume token to send as from after a lost chunk or to continue
+// past the last one. The last chunk of a reply has SNAPSHOT_LAST, and
+// SNAPSHOT_END too once the range is exhausted. A refused request gets a
+// single reply with an error status and no body.
+// Never retransmitted or deduplicated: a lost chunk is asked for again by
+// its from, so the server keeps no state per snapshot.
+
+static constexpr uint16_t SNAPSHOT_LAST = 0x0001;
+static constexpr uint16_t SNAPSHOT_END = 0x0002;
+
+static constexpr size_t SNAPSHOT_CHUNK_HEADER = 10;
+static constexpr size_t SNAPSHOT_ENTRY = 14;
+
+// Entries per chunk, so that a chunk fits a 1500-byte Ethernet MTU
+static constexpr size_t SNAPSHOT_CHUNK_ENTRIES = (BATCH_MTU_BODY - SNAPSHOT_CHUNK_HEADER) / SNAPSHOT_ENTRY;
+
+// Entries per chunk at most in the compact encoding (FLAG_COMPACT): as many
+// as fit the MTU once packed, and a datagram once unpacked
+static constexpr size_t SNAPSHOT_COMPACT_ENTRIES =
+    (MAX_DATAGRAM - HEADER_SIZE - SNAPSHOT_CHUNK_HEADER) / SNAPSHOT_ENTRY;
+
+// Most chunks one request may ask for
+static constexpr uint16_t SNAPSHOT_MAX_CHUNKS = 64;
+
+void writeSnapshotRequest(Writer& w, const std::string& name, const std::string& password,
+                          int32_t from, int32_t to, uint16_t maxChunks);
+
+// ==================== Session tokens (LOGIN) ====================
+//
+// LOGIN request: name:str, accNo:i32, password:16 (as QUERY_BALANCE)
+// LOGIN reply:   token:u64, seconds:u16
+// The token stands for the name and password of that one account for the
+// given number of seconds, in the requests
+//   DEPOSIT_TOKEN, WITHDRAW_TOKEN: token:u64, accNo:i32, currency:u16, amount:f64
+//   QUERY_BALANCE_TOKEN:           token:u64, accNo:i32
+//   TRANSFER_TOKEN:                token:u64, from:i32, to:i32, currency:u16, amount:f64
+// whose replies are those of the operations they stand for. A LOGIN while
+// the account's token is still valid returns the same token with its
+// lifetime renewed, so several clients of one holder share it. A token
+// that has expired, belongs to another account or was issued before a
+// server restart gets ERR_AUTH: log in again. Tokens live in the memory of
+// the server that issued them (server_cpp only). A token is a bearer
+// secret, unpredictable but sent unencrypted, like the password it stands in
+// for: whoever sees one can act on the account until it expires.
+// Token requests carry no holder name to route by (see ring.hpp), so they
+// are meant for a single server.
+
+// Token variant of an operation (DEPOSIT -> DEPOSIT_TOKEN, ...), 0 if it has none
+uint16_t tokenOpCode(uint16_t opCode);
+
+void writeTokenRequest(Writer& w, uint64_t token, int32_t accNo);  // QUERY_BALANCE_TOKEN
+void writeTokenAmountRequest(Writer& w, uint64_t token, int32_t accNo, uint16_t currency,
+                             double amount);                          // DEPOSIT_TOKEN, WITHDRAW_TOKEN
+void writeTokenTransferRequest(Writer& w, uint64_t token, int32_t fromAccNo, int32_t toAccNo,
+                               uint16_t currency, double amount);
+
+
+/**
+ * Read-only view of a received datagram
+ * The header is parsed in place; body points into the receive buffer and
+ * is only valid as long as that buffer is.
+ */
+struct MessageView {
+    Header h{};
+    const uint8_t* body = nullptr;
+    size_t bodyLen = 0;
+};
+
+// Parse header and locate body without copying; false on short/bad datagram
+bool parse(const uint8_t* data, size_t len, MessageView& out);
+
+// Copy a view into an owning Message
+void copyTo(const MessageView& v, Message& out);
+
+/**
+ * Big-endian cursor over a byte range; string fields are returned as views
+ * into the underlying buffer instead of copies.
+ */
+class Reader {
+public:
+    Reader(const uint8_t* p, size_t n) : p_(p), n_(n), off_(0) {}
+    explicit Reader(const MessageView& m) : p_(m.body), n_(m.bodyLen), off_(0) {}
+
+    bool getU8(uint8_t& out);
+    bool getU16(uint16_t& out);
+    bool getU32(uint32_t& out);
+    bool getU64(uint64_t& out);
+    bool getI32(int32_t& out);
+    bool getDouble(double& out);
+    bool getString(std::string_view& out);
+    bool getPassword16(std::string_view& out);
+    bool getBytes(const uint8_t*& out, size_t n);
+
+    // Arrays of fields into caller storage; false (nothing consumed) if short
+    bool getU32s(uint32_t* out, size_t n);
+    bool getI32s(int32_t* out, size_t n);
+    bool getU64s(uint64_t* out, size_t n);
+    bool getDoubles(double* out, size_t n);
+
+    size_t remaining() const { return n_ - off_; }
+
+private:
+    const uint8_t* p_;
+    size_t n_;
+    size_t off_;
+};
+
+/**
+ * One sub-reply of a BATCH reply; body points into the reply datagram
+ */
+struct BatchReplyEntry {
+    uint16_t opCode = 0;
+    uint16_t subId = 0;
+    uint16_t status = 0;
+    const uint8_t* body = nullptr;
+    size_t bodyLen = 0;
+};
+
+// Read the next sub-reply (after the leading count); false if truncated
+bool readBatchReplyEntry(Reader& r, BatchReplyEntry& out);
+
 // ==================== Utility functions ====================
 std::string currencyToString(uint16_t c);
 std::string statusToString(uint16_t s);
+const char* statusName(uint16_t s);  // short form: "OK", "AUTH", ... ("ERROR" if unknown)
 std::string opCodeToString(uint16_t op);
 
 } // namespace proto
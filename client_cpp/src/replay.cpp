@@ -0,0 +1,593 @@
+#include "compact.hpp"
+#include "endian.hpp"
+#include "net.hpp"
+#include "pipeline.hpp"
+#include "protocol.hpp"
+#include "schema.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Re-drive a captured trace (see trace.hpp) against a server and diff the results
+ *
+ * Usage:
+ *   client.exe --trace run.trace ...        (capture)
+ *   replay.exe --trace run.trace --server 127.0.0.1 --port 9000 --speed 1
+ *
+ * Every distinct request in the trace is submitted again at its original
+ * offset from the first one, divided by --speed ("max": as fast as
+ * --window allows). Retransmissions share the first transmission's
+ * requestId, so each request goes out once and the replay
+ * pipeline retransmits on its own. Each reply's status is compared with
+ * the first reply the trace holds for the same request.
+ *
+ * Account numbers are remapped. An account whose OPEN is in the trace gets
+ * a new number on replay, and requests naming the old number are rewritten
+ * with it; one that comes due before its OPEN is answered waits for it, and
+ * is skipped if that OPEN fails. While a request waits, later requests on
+ * any of its accounts wait behind it, so they still go out in trace order.
+ * Accounts that existed before the capture are used as they are, so replay
+ * against a server holding the same state.
+ * Session tokens are remapped the same way: a token operation uses the
+ * token its LOGIN got on replay, waits for that LOGIN, or is skipped if it
+ * failed; tokens issued before the capture are sent as they are (and will
+ * be refused unless the server still holds them).
+ * BATCH and MONITOR_REGISTER requests are sent verbatim. Bodies captured
+ * in the compact or LZ encoding (see compact.hpp) are unpacked on loading
+ * and replayed wide.
+ *
+ * Arguments:
+ *   --trace    Trace file (required)
+ *   --server   Server IP address (default: 127.0.0.1)
+ *   --port     Server port number (default: 9000)
+ *   --sem      "atmost" or "atleast" (default: as captured)
+ *   --timeout  Per-attempt timeout in milliseconds (default: 500)
+ *   --retry    Number of attempts (default: 5)
+ *   --rto      Retransmission timer: "fixed" or "adaptive" (default: fixed)
+ *   --speed    Time scale: 1 = original timing, N = N times faster, max = no pacing (default: 1)
+ *   --window   Most requests in flight (default: 256)
+ *   --diff     Write each request whose status differs to this file ("-" = stdout)
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr int NO_REPLY = -1;  // timed out (replay) or never answered (trace)
+static constexpr int SKIPPED = -2;   // the OPEN or LOGIN it depends on failed on replay
+static constexpr int PENDING = -3;
+
+struct Item {
+    uint64_t tUs;           // first transmission, from the start of the capture
+    uint64_t requestId;     // as captured
+    uint16_t opCode;
+    const uint8_t* body;    // in the mapped trace, or unpacked by load()
+    uint32_t bodyLen;
+    int original;           // status of the captured reply, NO_REPLY
+    int32_t openedAcc;      // OPEN answered OK in the trace: the number it got, else 0
+    uint64_t issuedToken;   // LOGIN answered OK in the trace: the token it got, else 0
+    int replayed;           // status on replay, NO_REPLY, SKIPPED or PENDING
+    int32_t newAcc;         // OPEN answered OK on replay
+    uint64_t newToken;      // LOGIN answered OK on replay
+    uint32_t latencyUs;
+};
+
+struct OpTotals {
+    uint64_t requests = 0;
+    uint64_t same = 0;
+    uint64_t differ = 0;
+    uint64_t skipped = 0;
+    uint64_t failed = 0;    // no reply on replay
+    std::vector<uint32_t> latUs;
+};
+
+const char* statusText(int s) {
+    if (s == NO_REPLY) return "NO_REPLY";
+    if (s == SKIPPED) return "SKIPPED";
+    return proto::statusName(uint16_t(s));
+}
+
+double percentile(const std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t idx = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)] / 1000.0;
+}
+
+/**
+ * Byte offsets of the account numbers in a request body (0 = none)
+ */
+int accountOffsets(uint16_t opCode, const uint8_t* body, size_t len, size_t out[2]) {
+    if (len < 2) return 0;
+    const size_t acc = 2 + proto::loadBE16(body);  // after the holder's name:str
+    int n = 0;
+    switch ((proto::OpCode)opCode) {
+        // Token variants: after the token:u64, no name or password
+        case proto::OpCode::DEPOSIT_TOKEN:
+        case proto::OpCode::WITHDRAW_TOKEN:
+        case proto::OpCode::QUERY_BALANCE_TOKEN:
+            out[n++] = 8;
+            break;
+        case proto::OpCode::TRANSFER_TOKEN:
+            out[n++] = 8;
+            out[n++] = 12;
+            break;
+        case proto::OpCode::CLOSE:
+        case proto::OpCode::LOGIN:
+        case proto::OpCode::DEPOSIT:
+        case proto::OpCode::WITHDRAW:
+        case proto::OpCode::QUERY_BALANCE:
+            out[n++] = acc;
+            break;
+        case proto::OpCode::TRANSFER:
+            out[n++] = acc;
+            out[n++] = acc + 4 + 16;  // to, after from:i32 and password:16
+            break;
+        default:
+            break;
+    }
+    for (int i = 0; i < n; i++) {
+        if (out[i] + 4 > len) return 0;
+    }
+    return n;
+}
+
+// Whether the body starts with a session token
+bool hasToken(uint16_t opCode, size_t len) {
+    switch ((proto::OpCode)opCode) {
+        case proto::OpCode::DEPOSIT_TOKEN:
+        case proto::OpCode::WITHDRAW_TOKEN:
+        case proto::OpCode::QUERY_BALANCE_TOKEN:
+        case proto::OpCode::TRANSFER_TOKEN:
+            return len >= 8;
+        default:
+            return false;
+    }
+}
+
+class Replayer {
+public:
+    Replayer(Pipeline& pipe, std::vector<Item>& items, double speed, size_t window)
+        : pipe_(pipe), items_(items), speed_(speed), window_(window), done_(0), lateSumUs_(0), lateMaxUs_(0),
+          releasing_(false) {
+        for (size_t i = 0; i < items_.size(); i++) {
+            if (items_[i].openedAcc != 0) openedBy_[items_[i].openedAcc] = i;
+            // A renewal returns the same token: keep the LOGIN that issued it
+            if (items_[i].issuedToken != 0) tokenBy_.emplace(items_[i].issuedToken, i);
+        }
+    }
+
+    void run() {
+        start_ = Clock::now();
+        const uint64_t base = items_.empty() ? 0 : items_[0].tUs;
+        size_t next = 0;
+        while (done_ < items_.size()) {
+            Clock::time_point now = Clock::now();
+            while (next < items_.size() && pipe_.inFlight() < window_) {
+                Clock::time_point due = dueOf(offsetOf(next, base));
+                if (due > now) break;
+                if (speed_ > 0) {
+                    uint64_t late = uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(now - due).count());
+                    lateSumUs_ += late;
+                    lateMaxUs_ = std::max(lateMaxUs_, late);
+                }
+                dispatch(next++);
+            }
+
+            int waitMs = 100;
+            if (next < items_.size() && pipe_.inFlight() < window_) {
+                auto left = std::chrono::duration_cast<std::chrono::microseconds>(dueOf(offsetOf(next, base)) - now).count();
+                waitMs = (int)std::max<long long>(0, std::min<long long>(waitMs, (left + 999) / 1000));
+            }
+            pipe_.poll(waitMs);
+        }
+        elapsed_ = std::chrono::duration<double>(Clock::now() - start_).count();
+    }
+
+    double elapsed() const { return elapsed_; }
+    double lateAvgMs() const { return items_.empty() ? 0 : lateSumUs_ / 1000.0 / items_.size(); }
+    double lateMaxMs() const { return lateMaxUs_ / 1000.0; }
+
+private:
+    Pipeline& pipe_;
+    std::vector<Item>& items_;
+    double speed_;  // 0 = max
+    size_t window_;
+    size_t done_;
+    Clock::time_point start_;
+    double elapsed_ = 0;
+    uint64_t lateSumUs_;
+    uint64_t lateMaxUs_;
+    std::unordered_map<int32_t, size_t> openedBy_;              // captured accNo -> its OPEN
+    std::unordered_map<uint64_t, size_t> tokenBy_;              // captured token -> its LOGIN
+    std::unordered_map<size_t, std::vector<size_t>> waiting_;   // OPEN, LOGIN or held item -> items waiting for it
+    std::unordered_map<int32_t, std::set<size_t>> held_;        // captured accNo -> unfinished items that waited
+    std::vector<size_t> ready_;  // released by finish(), next to dispatch at the back
+    bool releasing_;             // release() is draining ready_
+    std::vector<uint8_t> scratch_;
+
+    // Never negative, even for a trace written out of time order
+    uint64_t offsetOf(size_t i, uint64_t base) const {
+        return items_[i].tUs > base ? items_[i].tUs - base : 0;
+    }
+
+    Clock::time_point dueOf(uint64_t offsetUs) const {
+        if (speed_ <= 0) return start_;
+        return start_ + std::chrono::microseconds(uint64_t(offsetUs / speed_));
+    }
+
+    // Captured account numbers item i names
+    int accountsOf(size_t i, int32_t out[2]) const {
+        const Item& it = items_[i];
+        size_t offs[2];
+        const int n = accountOffsets(it.opCode, it.body, it.bodyLen, offs);
+        for (int k = 0; k < n; k++) out[k] = (int32_t)proto::loadBE32(it.body + offs[k]);
+        return n;
+    }
+
+    // Item i goes out once `on` has finished; until then later items on its accounts stay behind it
+    void wait(size_t on, size_t i) {
+        waiting_[on].push_back(i);
+        int32_t accs[2];
+        const int n = accountsOf(i, accs);
+        for (int k = 0; k < n; k++) held_[accs[k]].insert(i);
+    }
+
+    void finish(size_t i, int status) {
+        items_[i].replayed = status;
+        done_++;
+        int32_t accs[2];
+        const int n = accountsOf(i, accs);
+        for (int k = 0; k < n; k++) {
+            auto h = held_.find(accs[k]);
+            if (h == held_.end()) continue;
+            h->second.erase(i);
+            if (h->second.empty()) held_.erase(h);
+        }
+        auto w = waiting_.find(i);
+        if (w == waiting_.end()) return;
+        std::vector<size_t> deps;
+        deps.swap(w->second);
+        waiting_.erase(w);
+        std::sort(deps.rbegin(), deps.rend());  // trace order from the back
+        ready_.insert(ready_.end(), deps.begin(), deps.end());
+        release();
+    }
+
+    // Dispatch what finish() released, depth first as a recursion would, but
+    // in a loop: a long chain of SKIPPED items would otherwise nest a call per item
+    void release() {
+        if (releasing_) return;
+        releasing_ = true;
+        while (!ready_.empty()) {
+            const size_t d = ready_.back();
+            ready_.pop_back();
+            dispatch(d);
+        }
+        releasing_ = false;
+    }
+
+    void dispatch(size_t i) {
+        Item& it = items_[i];
+        scratch_.assign(it.body, it.body + it.bodyLen);
+
+        size_t offs[2];
+        const int n = accountOffsets(it.opCode, it.body, it.bodyLen, offs);
+        // Behind the latest earlier item that waited on one of the same accounts
+        for (int k = 0; k < n; k++) {
+            auto h = held_.find((int32_t)proto::loadBE32(it.body + offs[k]));
+            if (h == held_.end()) continue;
+            auto e = h->second.lower_bound(i);
+            if (e != h->second.begin()) {
+                wait(*std::prev(e), i);
+                return;
+            }
+        }
+        for (int k = 0; k < n; k++) {
+            auto o = openedBy_.find((int32_t)proto::loadBE32(it.body + offs[k]));
+            if (o == openedBy_.end() || o->second == i) continue;  // opened before the capture
+            const Item& open = items_[o->second];
+            if (open.replayed == PENDING) {
+                wait(o->second, i);
+                return;
+            }
+            if (open.newAcc == 0) {
+                finish(i, SKIPPED);
+                return;
+            }
+            proto::putBE32(scratch_.data() + offs[k], uint32_t(open.newAcc));
+        }
+        if (hasToken(it.opCode, it.bodyLen)) {
+            auto t = tokenBy_.find(proto::loadBE64(it.body));
+            if (t != tokenBy_.end()) {
+                const Item& login = items_[t->second];
+                if (login.replayed == PENDING) {
+                    wait(t->second, i);
+                    return;
+                }
+                if (login.newToken == 0) {
+                    finish(i, SKIPPED);
+                    return;
+                }
+                proto::putBE64(scratch_.data(), login.newToken);
+            }
+        }
+
+        const std::vector<uint8_t>& body = scratch_;
+        auto writeBody = [&body](proto::Writer& w) { w.putBytes(body.data(), body.size()); };
+        Pipeline::CompletionFn done = [this, i](const Pipeline::Completion& c) {
+            Item& item = items_[i];
+            item.latencyUs = (uint32_t)std::min<int64_t>(c.latency.count(), UINT32_MAX);
+            if (!c.ok) {
+                finish(i, NO_REPLY);
+                return;
+            }
+            if (item.opCode == (uint16_t)proto::OpCode::OPEN && c.reply->h.status == (uint16_t)proto::Status::OK) {
+                double bal;
+                int32_t acc;
+                if (proto::schema::OpenReply::read(*c.reply, acc, bal)) item.newAcc = acc;
+            }
+            if (item.opCode == (uint16_t)proto::OpCode::LOGIN && c.reply->h.status == (uint16_t)proto::Status::OK) {
+                uint64_t token;
+                uint16_t seconds;
+                if (proto::schema::LoginReply::read(*c.reply, token, seconds)) item.newToken = token;
+            }
+            finish(i, c.reply->h.status);
+        };
+        // A SNAPSHOT is read to its last chunk, so its other chunks are not taken for strays
+        uint64_t id = it.opCode == (uint16_t)proto::OpCode::SNAPSHOT
+            ? pipe_.submitStreamWith(it.opCode, body.size(), writeBody, [](const proto::MessageView& m) {
+                  uint16_t chunk, flags, count;
+                  int32_t next;
+                  return !proto::schema::SnapshotChunk::read(m, chunk, flags, next, count) ||
+                         (flags & proto::SNAPSHOT_LAST) != 0;
+              }, std::move(done))
+            : pipe_.submitWith(it.opCode, body.size(), writeBody, std::move(done));
+        if (id == 0) finish(i, SKIPPED);
+    }
+};
+
+/**
+ * Turn a body captured in the compact or LZ encoding back into the wide one
+ * @param storage Owns the unpacked body
+ * @return false if it does not unpack
+ */
+bool unpackBody(proto::MessageView& msg, std::deque<std::vector<uint8_t>>& storage) {
+    const uint16_t packed = proto::FLAG_COMPACT | proto::FLAG_LZ;
+    if (!(msg.h.flags & packed) || msg.bodyLen == 0) return true;
+    std::vector<uint8_t> wide(proto::MAX_DATAGRAM);
+    size_t len = 0;
+    const bool reply = msg.h.msgType == (uint8_t)proto::MsgType::Reply;
+    if (!compact::unpack(msg.h.opCode, reply, msg.h.flags, msg.body, msg.bodyLen, wide.data(), wide.size(), len)) {
+        return false;
+    }
+    wide.resize(len);
+    storage.push_back(std::move(wide));
+    msg.h.flags &= uint16_t(~packed);
+    msg.body = storage.back().data();
+    msg.bodyLen = len;
+    msg.h.bodyLen = uint32_t(len);
+    return true;
+}
+
+/**
+ * Distinct requests of a trace in order of first transmission, with the
+ * first reply to each
+ * @param storage Owns the bodies that had to be unpacked
+ */
+void load(trace::Reader& reader, std::vector<Item>& items, std::deque<std::vector<uint8_t>>& storage,
+          uint64_t& replies, uint64_t& callbacks, bool& atMostOnce) {
+    std::unordered_map<uint64_t, size_t> byId;
+    trace::Record rec;
+    replies = callbacks = 0;
+    atMostOnce = false;
+    while (reader.next(rec)) {
+        proto::MessageView msg;
+        if (!proto::parse(rec.data, rec.len, msg)) continue;
+        if (rec.dir == trace::Dir::Callback) {
+            callbacks++;
+            continue;
+        }
+        if (rec.dir == trace::Dir::Sent) {
+            if (byId.count(msg.h.requestId)) continue;  // retransmission
+            if (!unpackBody(msg, storage)) continue;
+            if (items.empty()) atMostOnce = (msg.h.flags & proto::FLAG_AT_MOST_ONCE) != 0;
+            byId.emplace(msg.h.requestId, items.size());
+            items.push_back({rec.tUs, msg.h.requestId, msg.h.opCode, msg.body, (uint32_t)msg.bodyLen,
+                             NO_REPLY, 0, 0, PENDING, 0, 0, 0});
+            continue;
+        }
+        replies++;
+        auto f = byId.find(msg.h.requestId);
+        if (f == byId.end() || items[f->second].original != NO_REPLY) continue;
+        Item& it = items[f->second];
+        it.original = msg.h.status;
+        if (it.opCode == (uint16_t)proto::OpCode::OPEN && msg.h.status == (uint16_t)proto::Status::OK &&
+            unpackBody(msg, storage)) {
+            double bal;
+            int32_t acc;
+            if (proto::schema::OpenReply::read(msg, acc, bal)) it.openedAcc = acc;
+        }
+        if (it.opCode == (uint16_t)proto::OpCode::LOGIN && msg.h.status == (uint16_t)proto::Status::OK &&
+            unpackBody(msg, storage)) {
+            uint16_t seconds;
+            if (!proto::schema::LoginReply::read(msg, it.issuedToken, seconds)) it.issuedToken = 0;
+        }
+    }
+    // Traces written by several workers may hold records out of time order
+    std::stable_sort(items.begin(), items.end(), [](const Item& a, const Item& b) { return a.tUs < b.tUs; });
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string tracePath;
+    std::string server = "127.0.0.1";
+    int port = 9000;
+    std::string sem;
+    int timeout = 500;
+    int retry = 5;
+    RetransmitPolicy::Mode rto = RetransmitPolicy::Mode::Fixed;
+    std::string speedArg = "1";
+    int window = 256;
+    std::string diffPath;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (std::strcmp(argv[i], "--server") == 0 && i + 1 < argc) {
+            server = argv[++i];
+        } else if (std::strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--sem") == 0 && i + 1 < argc) {
+            sem = argv[++i];
+        } else if (std::strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            timeout = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--retry") == 0 && i + 1 < argc) {
+            retry = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--rto") == 0 && i + 1 < argc) {
+            if (!RetransmitPolicy::parseMode(argv[++i], rto)) {
+                std::cerr << "Invalid --rto: " << argv[i] << "\n";
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            speedArg = argv[++i];
+        } else if (std::strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            window = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--diff") == 0 && i + 1 < argc) {
+            diffPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--help") == 0 || std::strcmp(argv[i], "-h") == 0) {
+            std::cout << "Usage: " << argv[0] << " --trace <file> [options]\n";
+            std::cout << "Options:\n";
+            std::cout << "  --trace <file>       Trace captured with --trace (required)\n";
+            std::cout << "  --server <ip>        Server IP address (default: 127.0.0.1)\n";
+            std::cout << "  --port <port>        Server port (default: 9000)\n";
+            std::cout << "  --sem <semantic>     atmost or atleast (default: as captured)\n";
+            std::cout << "  --timeout <ms>       Per-attempt timeout in milliseconds (default: 500)\n";
+            std::cout << "  --retry <count>      Attempts per request (default: 5)\n";
+            std::cout << "  --rto <mode>         fixed or adaptive (default: fixed)\n";
+            std::cout << "  --speed <n|max>      1 = original timing, n = n times faster, max = no pacing (default: 1)\n";
+            std::cout << "  --window <n>         Most requests in flight (default: 256)\n";
+            std::cout << "  --diff <file>        Write requests whose status differs (- = stdout)\n";
+            return 0;
+        }
+    }
+
+    if (tracePath.empty()) {
+        std::cerr << "[replay] --trace is required\n";
+        return 1;
+    }
+    double speed = speedArg == "max" ? 0 : std::atof(speedArg.c_str());
+    if (speedArg != "max" && speed <= 0) {
+        std::cerr << "Invalid --speed: " << speedArg << " (expected a positive number or max)\n";
+        return 1;
+    }
+    if (window < 1) window = 1;
+
+    trace::Reader reader;
+    if (!reader.open(tracePath)) {
+        std::cerr << "[replay] cannot read trace " << tracePath << "\n";
+        return 1;
+    }
+    std::vector<Item> items;
+    std::deque<std::vector<uint8_t>> unpacked;
+    uint64_t replies, callbacks;
+    bool capturedAtMostOnce;
+    load(reader, items, unpacked, replies, callbacks, capturedAtMostOnce);
+    const bool atMostOnce = sem.empty() ? capturedAtMostOnce : (sem == "atmost" || sem == "at-most-once");
+    const double spanSec = items.empty() ? 0 : (items.back().tUs - items.front().tUs) / 1e6;
+    std::cout << "[replay] trace=" << tracePath << " requests=" << items.size() << " replies=" << replies
+              << " callbacks=" << callbacks << " span=" << spanSec << "s\n";
+
+    if (!net::startup()) {
+        std::cerr << "[replay] network startup failed\n";
+        return 1;
+    }
+    sockaddr_in addr;
+    net::Socket sock = net::openUdp();
+    if (!net::resolve(server, port, addr) || !net::isValid(sock)) {
+        std::cerr << "[replay] cannot create socket for " << server << ":" << port << "\n";
+        net::closeSocket(sock);
+        net::cleanup();
+        return 1;
+    }
+
+    int rc = 0;
+    {
+        Pipeline pipe(sock, addr, atMostOnce, RetransmitPolicy(rto, timeout), retry);
+        std::cout << "[replay] server=" << server << ":" << port
+                  << " sem=" << (atMostOnce ? "at-most-once" : "at-least-once")
+                  << " speed=" << (speed > 0 ? speedArg + "x" : "max") << " window=" << window << "\n";
+        Replayer replayer(pipe, items, speed, (size_t)window);
+        replayer.run();
+
+        std::ofstream diffFile;
+        std::ostream* diff = nullptr;
+        if (diffPath == "-") {
+            diff = &std::cout;
+        } else if (!diffPath.empty()) {
+            diffFile.open(diffPath);
+            if (diffFile) diff = &diffFile;
+            else std::cerr << "[replay] cannot create " << diffPath << "\n";
+        }
+
+        std::map<uint16_t, OpTotals> byOp;
+        for (size_t i = 0; i < items.size(); i++) {
+            const Item& it = items[i];
+            OpTotals& t = byOp[it.opCode];
+            t.requests++;
+            if (it.replayed == SKIPPED) {
+                t.skipped++;
+            } else {
+                if (it.replayed == NO_REPLY) t.failed++;
+                else t.latUs.push_back(it.latencyUs);
+                if (it.replayed == it.original) {
+                    t.same++;
+                    continue;
+                }
+                t.differ++;
+            }
+            rc = 1;
+            if (diff) {
+                *diff << i << " " << proto::opCodeToString(it.opCode) << " reqId=" << it.requestId
+                      << " original=" << statusText(it.original) << " replay=" << statusText(it.replayed) << "\n";
+            }
+        }
+
+        std::printf("\n%-19s %9s %9s %9s %9s %9s %10s %10s\n",
+                    "op", "requests", "same", "differ", "skipped", "failed", "p50(ms)", "p99(ms)");
+        uint64_t total = 0, same = 0;
+        for (auto& kv : byOp) {
+            OpTotals& t = kv.second;
+            std::sort(t.latUs.begin(), t.latUs.end());
+            std::printf("%-19s %9llu %9llu %9llu %9llu %9llu %10.3f %10.3f\n",
+                        proto::opCodeToString(kv.first).c_str(), (unsigned long long)t.requests,
+                        (unsigned long long)t.same, (unsigned long long)t.differ,
+                        (unsigned long long)t.skipped, (unsigned long long)t.failed,
+                        percentile(t.latUs, 50), percentile(t.latUs, 99));
+            total += t.requests;
+            same += t.same;
+        }
+        std::printf("\nreplayed %llu requests in %.2fs (%.0f ops/s, captured span %.2fs), %llu with the original status\n",
+                    (unsigned long long)total, replayer.elapsed(),
+                    replayer.elapsed() > 0 ? total / replayer.elapsed() : 0.0, spanSec, (unsigned long long)same);
+        if (speed > 0) {
+            std::printf("timing: sends %.3f ms late on average, %.3f ms at most\n",
+                        replayer.lateAvgMs(), replayer.lateMaxMs());
+        }
+    }
+
+    net::closeSocket(sock);
+    net::cleanup();
+    return rc;
+}
@@ -0,0 +1,77 @@
+#include "ring.hpp"
+#include "endian.hpp"
+#include "protocol.hpp"
+#include <algorithm>
+#include <cstdlib>
+
+HashRing::HashRing(const std::vector<sockaddr_in>& servers) : servers_(servers.size()) {
+    points_.reserve(servers.size() * VNODES);
+    for (uint32_t i = 0; i < servers.size(); i++) {
+        // By address, not by position in the list
+        uint64_t addr = uint64_t(ntohl(servers[i].sin_addr.s_addr)) << 16 | ntohs(servers[i].sin_port);
+        for (int v = 0; v < VNODES; v++) points_.push_back({mix(addr << 8 | uint64_t(v)), i});
+    }
+    std::sort(points_.begin(), points_.end());
+}
+
+uint64_t HashRing::mix(uint64_t x) {
+    // splitmix64 finaliser
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+size_t HashRing::pointOf(uint64_t key) const {
+    const uint64_t h = mix(key);
+    auto it = std::lower_bound(points_.begin(), points_.end(), std::make_pair(h, uint32_t(0)));
+    return it == points_.end() ? 0 : size_t(it - points_.begin());
+}
+
+uint32_t HashRing::owner(uint64_t key) const {
+    if (servers_ <= 1) return 0;
+    return points_[pointOf(key)].second;
+}
+
+bool HashRing::keyOf(uint16_t opCode, const uint8_t* body, size_t len, uint64_t& key) {
+    switch ((proto::OpCode)opCode) {
+        case proto::OpCode::OPEN:
+        case proto::OpCode::CLOSE:
+        case proto::OpCode::DEPOSIT:
+        case proto::OpCode::WITHDRAW:
+        case proto::OpCode::QUERY_BALANCE:
+        case proto::OpCode::LOGIN:
+        case proto::OpCode::TRANSFER:  // the source account's owner
+        case proto::OpCode::SNAPSHOT:  // the holder's accounts, all on its owner
+            break;
+        default:
+            return false;
+    }
+    // Every account request starts with the holder's name:str
+    if (len < 2) return false;
+    const size_t nameLen = proto::loadBE16(body);
+    if (2 + nameLen > len) return false;
+    uint64_t h = 0xCBF29CE484222325ULL;  // FNV-1a
+    for (size_t i = 0; i < nameLen; i++) h = (h ^ body[2 + i]) * 0x100000001B3ULL;
+    key = h;
+    return true;
+}
+
+bool HashRing::parse(const std::string& list, std::vector<sockaddr_in>& out) {
+    out.clear();
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t comma = list.find(',', pos);
+        std::string item = list.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        pos = (comma == std::string::npos) ? list.size() : comma + 1;
+
+        size_t colon = item.rfind(':');
+        if (colon == std::string::npos) return false;
+        int port = std::atoi(item.c_str() + colon + 1);
+        sockaddr_in addr;
+        if (port <= 0 || port > 65535 || !net::resolve(item.substr(0, colon), port, addr)) return false;
+        out.push_back(addr);
+    }
+    return !out.empty();
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "net.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Consistent-hash ring over server endpoints
+ *
+ * Every endpoint is placed at VNODES points, each the hash of its address
+ * and the point number. A key belongs to the endpoint of the first point
+ * at or after the key's own hash. Clients given the same endpoints agree on
+ * every owner whatever the order of their lists, and adding or removing an
+ * endpoint moves only about 1/n of the keys.
+ *
+ * Requests are keyed by the account holder's name, which every account
+ * operation carries: the number is only assigned by the server that
+ * handles OPEN, so a key known before that is needed to keep an account's
+ * OPEN and everything after it on one owner. A TRANSFER goes to the owner
+ * of its source account; every server numbers accounts in a range of its
+ * own (server_cpp --node, see proto::NODE_ACCOUNTS), so a destination that
+ * lives elsewhere is not found there rather than mistaken for a local
+ * account with the same number. The session
+ * token operations (proto::OpCode::DEPOSIT_TOKEN, ...) carry no name and
+ * always go to the first endpoint.
+ */
+class HashRing {
+public:
+    static constexpr int VNODES = 64;
+
+    explicit HashRing(const std::vector<sockaddr_in>& servers);
+
+    size_t size() const { return servers_; }
+
+    // Index, in the constructor's list, of the endpoint owning key
+    uint32_t owner(uint64_t key) const;
+
+    /**
+     * Routing key of an encoded request body
+     * @return false for operations not tied to one account holder (MONITOR_REGISTER, BATCH)
+     *         or that do not name it (the token operations)
+     */
+    static bool keyOf(uint16_t opCode, const uint8_t* body, size_t len, uint64_t& key);
+
+    /**
+     * Parse "ip:port,ip:port,..."
+     * @return false if an entry is malformed or the list is empty
+     */
+    static bool parse(const std::string& list, std::vector<sockaddr_in>& out);
+
+private:
+    std::vector<std::pair<uint64_t, uint32_t>> points_;  // (hash, endpoint), sorted
+    size_t servers_;
+
+    size_t pointOf(uint64_t key) const;  // first point at or after the key
+    static uint64_t mix(uint64_t x);
+};
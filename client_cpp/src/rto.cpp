@@ -0,0 +1,56 @@
+#include "rto.hpp"
+#include <algorithm>
+
+RetransmitPolicy::RetransmitPolicy(Mode mode, int timeoutMs)
+    : mode_(mode), fixed_(Micros((int64_t)std::max(1, timeoutMs) * 1000)),
+      rto_(fixed_), srtt_(0), rttvar_(0), samples_(0),
+      rng_((unsigned)std::chrono::steady_clock::now().time_since_epoch().count()) {
+}
+
+RetransmitPolicy::Micros RetransmitPolicy::timeoutFor(int attempt) {
+    if (mode_ == Mode::Fixed) return fixed_;
+
+    // Exponential backoff, capped before the shift can overflow
+    int shift = std::min(std::max(attempt - 1, 0), 20);
+    int64_t base = std::min<int64_t>(rto_.count() << shift, MAX_RTO_US);
+
+    std::uniform_int_distribution<int> jitter(-25, 25);
+    int64_t t = base + base * jitter(rng_) / 100;
+    return Micros(std::max<int64_t>(t, MIN_RTO_US));
+}
+
+void RetransmitPolicy::onReply(Micros rtt, int attempts) {
+    if (mode_ == Mode::Fixed || attempts != 1) return;
+
+    int64_t r = std::max<int64_t>(rtt.count(), 1);
+    if (samples_ == 0) {
+        srtt_ = Micros(r);
+        rttvar_ = Micros(r / 2);
+    } else {
+        // alpha = 1/8, beta = 1/4
+        int64_t err = srtt_.count() - r;
+        if (err < 0) err = -err;
+        rttvar_ = Micros((3 * rttvar_.count() + err) / 4);
+        srtt_ = Micros((7 * srtt_.count() + r) / 8);
+    }
+    samples_++;
+
+    int64_t rto = srtt_.count() + std::max<int64_t>(1000, 4 * rttvar_.count());
+    rto_ = Micros(std::min(std::max(rto, MIN_RTO_US), MAX_RTO_US));
+}
+
+bool RetransmitPolicy::parseMode(const std::string& s, Mode& out) {
+    if (s == "fixed") {
+        out = Mode::Fixed;
+        return true;
+    }
+    if (s == "adaptive" || s == "rtt") {
+        out = Mode::Adaptive;
+        return true;
+    }
+    return false;
+}
+
+const char* RetransmitPolicy::modeName(Mode m) {
+    return m == Mode::Fixed ? "fixed" : "adaptive";
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * Retransmission timer policy for the request pipeline
+ *
+ * Fixed:    every attempt waits the configured --timeout (original behaviour).
+ * Adaptive: RTO is derived from smoothed RTT samples (SRTT/RTTVAR as in
+ *           RFC 6298, Karn's rule: only first-attempt replies are sampled),
+ *           doubled on every retry of the same request, with +/-25% jitter
+ *           so clients that lost packets together do not resend together.
+ */
+class RetransmitPolicy {
+public:
+    enum class Mode { Fixed, Adaptive };
+
+    using Micros = std::chrono::microseconds;
+
+    /**
+     * Constructor
+     * @param mode Fixed or Adaptive
+     * @param timeoutMs Fixed timeout, or the initial RTO before any sample (adaptive)
+     */
+    RetransmitPolicy(Mode mode, int timeoutMs);
+
+    /**
+     * Timeout to arm after sending the given attempt
+     * @param attempt 1 for the first transmission, 2 for the first retry, ...
+     */
+    Micros timeoutFor(int attempt);
+
+    /**
+     * Feed a matched reply
+     * @param rtt Time from the last transmission to the reply
+     * @param attempts Transmissions the request needed (>1 samples are ambiguous)
+     */
+    void onReply(Micros rtt, int attempts);
+
+    Mode mode() const { return mode_; }
+    Micros rto() const { return rto_; }
+    Micros srtt() const { return srtt_; }
+    Micros rttvar() const { return rttvar_; }
+    uint64_t samples() const { return samples_; }
+
+    // Parse "fixed" / "adaptive"
+    static bool parseMode(const std::string& s, Mode& out);
+    static const char* modeName(Mode m);
+
+    // Lower and upper bound on the adaptive RTO
+    static constexpr int64_t MIN_RTO_US = 2000;
+    static constexpr int64_t MAX_RTO_US = 10000000;
+
+private:
+    Mode mode_;
+    Micros fixed_;
+    Micros rto_;
+    Micros srtt_;
+    Micros rttvar_;
+    uint64_t samples_;
+    std::mt19937 rng_;
+};
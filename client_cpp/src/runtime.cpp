@@ -0,0 +1,243 @@
+#include "runtime.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+
+namespace {
+thread_local int tlsWorker = -1;
+
+// One lock/condvar pair shared by all blocking callWith() callers
+std::mutex callMutex;
+std::condition_variable callCv;
+}
+
+// ==================== CallState ====================
+
+void Runtime::CallState::finish(const Pipeline::Completion& c) {
+    ok_ = c.ok;
+    attempts_ = c.attempts;
+    if (c.reply) proto::copyTo(*c.reply, reply_);
+    {
+        std::lock_guard<std::mutex> lock(callMutex);
+        done_.store(true, std::memory_order_release);
+    }
+    callCv.notify_all();
+}
+
+bool Runtime::CallState::wait(proto::Message& reply, int* attempts) {
+    std::unique_lock<std::mutex> lock(callMutex);
+    callCv.wait(lock, [this] { return done_.load(std::memory_order_acquire); });
+    if (ok_) reply = std::move(reply_);
+    if (attempts) *attempts = attempts_;
+    return ok_;
+}
+
+// ==================== Runtime ====================
+
+Runtime::Runtime(const Config& cfg)
+    : cfg_(cfg), verbose_(false), running_(false), stopping_(false), inFlight_(0), nextWorker_(0) {
+    if (cfg_.workers < 1) cfg_.workers = 1;
+}
+
+Runtime::~Runtime() {
+    stop();
+}
+
+int Runtime::currentWorker() {
+    return tlsWorker;
+}
+
+bool Runtime::start() {
+    if (!net::resolve(cfg_.serverIp, cfg_.serverPort, server_)) {
+        std::cerr << "[client] invalid server ip: " << cfg_.serverIp << "\n";
+        return false;
+    }
+
+    std::vector<sockaddr_in> servers;
+    if (!cfg_.servers.empty() && !HashRing::parse(cfg_.servers, servers)) {
+        std::cerr << "[client] invalid server list: " << cfg_.servers << "\n";
+        return false;
+    }
+    if (servers.size() > 1 && cfg_.batchMax > 1) {
+        std::cerr << "[client] batching is off with several servers\n";
+        cfg_.batchMax = 0;
+    }
+
+    if (!cfg_.trace.empty()) {
+        trace_.reset(new trace::Writer());
+        if (!trace_->open(cfg_.trace)) {
+            std::cerr << "[client] cannot create trace " << cfg_.trace << "\n";
+            trace_.reset();
+            return false;
+        }
+    }
+
+    RetransmitPolicy rto(cfg_.rtoMode, cfg_.timeoutMs);
+    FlowControl::Config flow = cfg_.flow;
+    if (cfg_.workers > 1) {
+        flow.rate /= cfg_.workers;
+        flow.burst /= cfg_.workers;
+        if (flow.window > 0) flow.window = std::max(1, flow.window / cfg_.workers);
+    }
+    for (int i = 0; i < cfg_.workers; i++) {
+        std::unique_ptr<Worker> w(new Worker());
+        w->sock = net::openUdp();
+        if (!net::isValid(w->sock) || !w->waker.open()) {
+            std::cerr << "[client] socket() failed\n";
+            net::closeSocket(w->sock);
+            for (auto& o : workers_) net::closeSocket(o->sock);
+            workers_.clear();
+            return false;
+        }
+        w->pipeline.reset(new Pipeline(w->sock, server_, cfg_.atMostOnce, rto, cfg_.retryCount));
+        if (!servers.empty()) w->pipeline->setServers(servers);
+        if (flow.enabled()) w->pipeline->setFlowControl(flow);
+        if (trace_) w->pipeline->setTrace(trace_.get());
+        w->pipeline->setEncoding(cfg_.compact, cfg_.lz);
+        if (cfg_.impair.enabled()) {
+            Impairment::Config impair = cfg_.impair;
+            if (impair.seed != 0) impair.seed += uint64_t(i);
+            w->pipeline->setImpairment(impair);
+        }
+        w->pipeline->setWakeSocket(w->waker.socket());
+        w->pipeline->setVerbose(verbose_);
+        if (onCallback_) w->pipeline->setCallbackHandler(onCallback_);
+        if (cfg_.batchMax > 1) {
+            w->batcher.reset(new Batcher(*w->pipeline, cfg_.batchMax,
+                                         std::chrono::microseconds(cfg_.batchWindowUs)));
+            w->batcher->setCompact(cfg_.compact);
+        }
+        workers_.push_back(std::move(w));
+    }
+
+    stopping_.store(false);
+    running_.store(true, std::memory_order_release);
+    for (size_t i = 0; i < workers_.size(); i++) {
+        workers_[i]->thread = std::thread(&Runtime::run, this, i);
+    }
+    return true;
+}
+
+void Runtime::stop() {
+    if (!running_.exchange(false)) return;
+    stopping_.store(true);
+    for (auto& w : workers_) {
+        w->waker.wake();
+        w->thread.join();
+    }
+    for (auto& w : workers_) {
+        net::closeSocket(w->sock);
+        w->sock = net::INVALID_SOCK;
+    }
+    if (trace_) trace_->close();
+}
+
+size_t Runtime::pickWorker(int key) {
+    if (key >= 0) return (size_t)key % workers_.size();
+    return nextWorker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+}
+
+void Runtime::wakeIfSleeping(Worker& w) {
+    // Pairs with the store/re-check in run(): either the worker sees the new
+    // entry before sleeping, or this thread sees sleeping == true
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (w.sleeping.load(std::memory_order_relaxed) && w.sleeping.exchange(false)) {
+        w.waker.wake();
+    }
+}
+
+size_t Runtime::drainQueue(Worker& w) {
+    size_t taken = 0;
+    uint64_t discarded = 0;
+    while (w.queue.tryPop([&](Submission& sub) {
+        auto body = [&sub](proto::Writer& wr) { wr.putBytes(sub.body, sub.bodyLen); };
+        bool accepted = false;
+        if (sub.opCode == 0) {
+            // Body did not encode, see submitWith()
+        } else if (sub.onChunk) {
+            accepted = w.pipeline->submitStreamWith(sub.opCode, sub.bodyLen, body, std::move(sub.onChunk),
+                                                    std::move(sub.done)) != 0;
+        } else if (w.batcher) {
+            accepted = w.batcher->submitWith(sub.opCode, sub.bodyLen, body, std::move(sub.done));
+        } else {
+            accepted = w.pipeline->submitWith(sub.opCode, sub.bodyLen, body, std::move(sub.done)) != 0;
+        }
+        if (!accepted) discarded++;
+        sub.done = nullptr;
+        sub.onChunk = nullptr;
+    })) {
+        taken++;
+    }
+    if (discarded) inFlight_.fetch_sub(discarded, std::memory_order_acq_rel);
+    return taken;
+}
+
+void Runtime::run(size_t index) {
+    tlsWorker = (int)index;
+    Worker& w = *workers_[index];
+    auto poll = [&w](int ms) { return w.batcher ? w.batcher->poll(ms) : w.pipeline->poll(ms); };
+
+    while (true) {
+        size_t taken = drainQueue(w);
+        if (stopping_.load(std::memory_order_acquire) && inFlight_.load(std::memory_order_acquire) == 0) {
+            break;
+        }
+
+        int done;
+        if (taken > 0) {
+            // More work may be right behind: flush and collect replies without sleeping
+            done = poll(0);
+        } else {
+            w.sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!w.queue.empty()) {
+                w.sleeping.store(false, std::memory_order_relaxed);
+                continue;
+            }
+            // While stopping, re-check the global count often to exit promptly
+            done = poll(stopping_.load(std::memory_order_relaxed) ? 10 : 1000);
+            w.sleeping.store(false, std::memory_order_relaxed);
+        }
+        if (done > 0) inFlight_.fetch_sub((uint64_t)done, std::memory_order_acq_rel);
+    }
+    tlsWorker = -1;
+}
+
+Pipeline::BatchStats Runtime::batchStats() const {
+    Pipeline::BatchStats sum;
+    for (const auto& w : workers_) {
+        const Pipeline::BatchStats& b = w->pipeline->batchStats();
+        sum.sendCalls += b.sendCalls;
+        sum.sendPackets += b.sendPackets;
+        sum.recvCalls += b.recvCalls;
+        sum.recvPackets += b.recvPackets;
+        sum.sendBytes += b.sendBytes;
+        sum.recvBytes += b.recvBytes;
+        if (b.sendMax > sum.sendMax) sum.sendMax = b.sendMax;
+        if (b.recvMax > sum.recvMax) sum.recvMax = b.recvMax;
+        for (int i = 0; i < 8; i++) {
+            sum.sendHist[i] += b.sendHist[i];
+            sum.recvHist[i] += b.recvHist[i];
+        }
+    }
+    return sum;
+}
+
+Batcher::Stats Runtime::batcherStats() const {
+    Batcher::Stats sum;
+    for (const auto& w : workers_) {
+        if (!w->batcher) continue;
+        const Batcher::Stats& b = w->batcher->stats();
+        sum.batches += b.batches;
+        sum.batchedOps += b.batchedOps;
+        sum.singles += b.singles;
+    }
+    return sum;
+}
+
+metrics::Snapshot Runtime::metrics() const {
+    metrics::Snapshot sum;
+    for (const auto& w : workers_) sum += w->pipeline->metrics().snapshot();
+    return sum;
+}
@@ -0,0 +1,253 @@
+#pragma once
+
+#include "batcher.hpp"
+#include "bounded_queue.hpp"
+#include "net.hpp"
+#include "pipeline.hpp"
+#include "protocol.hpp"
+#include "rto.hpp"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Multi-threaded request runtime
+ *
+ * Runs N worker threads, each owning its own UDP socket (own ephemeral
+ * source port, so server-side RSS / SO_REUSEPORT hashing spreads the load)
+ * and its own Pipeline. Workers share nothing on the hot path:
+ * - Any thread hands a request to a worker through that worker's bounded
+ *   lock-free submission queue; the body is written in place into the
+ *   queue cell, so submitting does not allocate
+ * - A worker drains its queue into its Pipeline, which batches the sends,
+ *   matches replies and retransmits as usual
+ * - Completion callbacks run on the worker that owns the request
+ *
+ * With Config::batchMax > 1 each worker puts a Batcher in front of its
+ * Pipeline, so operations drained together leave as BATCH requests. With
+ * several servers (Config::servers) every Pipeline routes by account and
+ * batching is off: a BATCH would mix accounts of different owners.
+ *
+ * Config::flow limits the runtime as a whole: each worker's Pipeline gets
+ * its share of the rate and of the congestion window, and its own breaker.
+ *
+ * With Config::trace every worker's Pipeline records into one trace file,
+ * flushed and closed by stop().
+ *
+ * Config::impair applies to every worker's Pipeline on its own (a fixed
+ * seed is varied per worker, so workers do not lose the same datagrams).
+ *
+ * A worker blocked waiting for replies is woken with a net::Waker only when
+ * it has announced that it is about to sleep, so a busy runtime sends no
+ * wake-up datagrams at all.
+ */
+class Runtime {
+public:
+    using CompletionFn = Pipeline::CompletionFn;
+    using CallbackFn = Pipeline::CallbackFn;
+    using ChunkFn = Pipeline::ChunkFn;
+
+    // Submission queue depth per worker
+    static constexpr size_t QUEUE_DEPTH = 1024;
+
+    struct Config {
+        std::string serverIp = "127.0.0.1";
+        int serverPort = 9000;
+        bool atMostOnce = false;
+        int timeoutMs = 500;
+        int retryCount = 3;
+        RetransmitPolicy::Mode rtoMode = RetransmitPolicy::Mode::Fixed;
+        int workers = 1;
+        int batchMax = 0;      // > 1: coalesce up to this many operations per BATCH
+        int batchWindowUs = 0; // how long a worker holds an open batch
+        std::string servers;   // "ip:port,..." routed by account (see HashRing); empty = serverIp:serverPort
+        FlowControl::Config flow;  // rate and window for the whole runtime, split over the workers
+        std::string trace;     // capture every datagram to this file (see trace.hpp); empty = off
+        bool compact = false;  // FLAG_COMPACT bodies (see compact.hpp, server_cpp only)
+        bool lz = false;       // FLAG_LZ on large bodies, BATCH in practice (server_cpp only)
+        Impairment::Config impair;  // injected loss and delay, per worker (see impair.hpp)
+    };
+
+    explicit Runtime(const Config& cfg);
+    ~Runtime();
+
+    Runtime(const Runtime&) = delete;
+    Runtime& operator=(const Runtime&) = delete;
+
+    /**
+     * Open the sockets and start the worker threads
+     * @return true on success
+     */
+    bool start();
+
+    /**
+     * Stop after every submitted request has completed, then join the workers
+     */
+    void stop();
+
+    /**
+     * Hand a request to a worker; the body is written in place into the
+     * worker's submission queue (callable taking proto::Writer&)
+     * @param opCode Operation code
+     * @param bodyLen Exact body size (see proto::requestBodySize)
+     * @param writeBody Callable taking proto::Writer&, must write bodyLen bytes
+     * @param done Completion callback, invoked on the worker thread
+     * @param key Routing key (e.g. account number) so requests with equal
+     *            keys stay on one worker; -1 = round-robin
+     * @return false if the body did not fit or the runtime is not running
+     */
+    template <class BodyFn>
+    bool submitWith(uint16_t opCode, size_t bodyLen, BodyFn&& writeBody, CompletionFn done, int key = -1) {
+        return push(opCode, bodyLen, writeBody, std::move(done), nullptr, key);
+    }
+
+    /**
+     * Hand a stream request to a worker (see Pipeline::submitStreamWith());
+     * it bypasses the Batcher
+     * @param onChunk Called on the worker thread with every reply datagram
+     */
+    template <class BodyFn>
+    bool submitStreamWith(uint16_t opCode, size_t bodyLen, BodyFn&& writeBody, ChunkFn onChunk,
+                          CompletionFn done, int key = -1) {
+        return push(opCode, bodyLen, writeBody, std::move(done), std::move(onChunk), key);
+    }
+
+    /**
+     * Submit and block the calling thread until the request completes
+     * (must not be called from a completion callback)
+     * @param reply Output reply message
+     * @param attempts Optional output: datagrams sent
+     * @return true if a matching reply arrived
+     */
+    template <class BodyFn>
+    bool callWith(uint16_t opCode, size_t bodyLen, BodyFn&& writeBody, proto::Message& reply,
+                  int* attempts = nullptr, int key = -1) {
+        CallState st;
+        if (!submitWith(opCode, bodyLen, std::forward<BodyFn>(writeBody),
+                        [&st](const Pipeline::Completion& c) { st.finish(c); }, key)) {
+            return false;
+        }
+        return st.wait(reply, attempts);
+    }
+
+    /**
+     * Handler for non-reply messages, invoked on whichever worker received
+     * the datagram (set before start())
+     */
+    void setCallbackHandler(CallbackFn fn) { onCallback_ = std::move(fn); }
+
+    /**
+     * Print retry/timeout diagnostics to the console (set before start())
+     */
+    void setVerbose(bool v) { verbose_ = v; }
+
+    size_t workerCount() const { return workers_.size(); }
+
+    // Requests submitted and not yet completed, across all workers
+    uint64_t inFlight() const { return inFlight_.load(std::memory_order_acquire); }
+
+    // Index of the worker running the calling thread, -1 on other threads
+    static int currentWorker();
+
+    /**
+     * Batch statistics summed over the workers (meaningful after stop())
+     */
+    Pipeline::BatchStats batchStats() const;
+
+    /**
+     * Batching statistics summed over the workers (meaningful after stop())
+     */
+    Batcher::Stats batcherStats() const;
+
+    /**
+     * Latency histograms and counters summed over the workers; safe to call
+     * while the runtime is running (each field is read atomically)
+     */
+    metrics::Snapshot metrics() const;
+
+    /**
+     * Retransmission policy of one worker (meaningful after stop())
+     */
+    const RetransmitPolicy& rto(size_t worker) const { return workers_[worker]->pipeline->rto(); }
+
+private:
+    static constexpr size_t MAX_BODY = proto::MAX_DATAGRAM - proto::HEADER_SIZE;
+
+    struct Submission {
+        uint16_t opCode;
+        uint16_t bodyLen;
+        CompletionFn done;
+        ChunkFn onChunk;  // stream request
+        uint8_t body[MAX_BODY];
+    };
+
+    struct Worker {
+        Worker() : queue(QUEUE_DEPTH), sock(net::INVALID_SOCK), sleeping(false) {}
+
+        BoundedQueue<Submission> queue;
+        net::Socket sock;
+        net::Waker waker;
+        std::unique_ptr<Pipeline> pipeline;
+        std::unique_ptr<Batcher> batcher;  // only with Config::batchMax > 1
+        std::thread thread;
+        alignas(64) std::atomic<bool> sleeping;
+    };
+
+    /**
+     * Completion rendezvous for callWith()
+     */
+    class CallState {
+    public:
+        void finish(const Pipeline::Completion& c);
+        bool wait(proto::Message& reply, int* attempts);
+
+    private:
+        std::atomic<bool> done_{false};
+        bool ok_ = false;
+        int attempts_ = 0;
+        proto::Message reply_;
+    };
+
+    Config cfg_;
+    sockaddr_in server_;
+    bool verbose_;
+    CallbackFn onCallback_;
+    std::unique_ptr<trace::Writer> trace_;  // shared by the workers' pipelines
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<bool> running_;
+    std::atomic<bool> stopping_;
+    std::atomic<uint64_t> inFlight_;
+    std::atomic<uint32_t> nextWorker_;
+
+    size_t pickWorker(int key);
+
+    template <class BodyFn>
+    bool push(uint16_t opCode, size_t bodyLen, BodyFn& writeBody, CompletionFn done, ChunkFn onChunk, int key) {
+        if (bodyLen > MAX_BODY || !running_.load(std::memory_order_acquire)) return false;
+        Worker& w = *workers_[pickWorker(key)];
+        bool encoded = true;
+        auto fill = [&](Submission& sub) {
+            proto::Writer wr(sub.body, bodyLen);
+            writeBody(wr);
+            encoded = wr.ok() && wr.size() == bodyLen;
+            sub.opCode = encoded ? opCode : 0;  // opCode 0 = discard
+            sub.bodyLen = (uint16_t)bodyLen;
+            sub.done = std::move(done);
+            sub.onChunk = std::move(onChunk);
+        };
+        inFlight_.fetch_add(1, std::memory_order_relaxed);
+        while (!w.queue.tryPush(fill)) {
+            // Queue full: let the worker catch up
+            wakeIfSleeping(w);
+            std::this_thread::yield();
+        }
+        wakeIfSleeping(w);
+        return encoded;
+    }
+
+    void wakeIfSleeping(Worker& w);
+    void run(size_t index);
+    size_t drainQueue(Worker& w);
+};
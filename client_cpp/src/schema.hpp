@@ -0,0 +1,451 @@
+#pragma once
+
+#include "endian.hpp"
+#include "protocol.hpp"
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Compile-time message body layouts
+ *
+ * Each request/reply body is a type, Layout<Field...>, and its encoder and
+ * decoder are generated from that list:
+ * - write() computes the total size, claims it from the Writer with one
+ *   capacity check and stores every field at its offset
+ * - read() checks the fixed part of the body once (MIN_SIZE) and only adds
+ *   one check per variable-length string; fixed fields are loaded without
+ *   further tests, at offsets the compiler folds to constants up to the
+ *   first string
+ * Sizes are checked with static_assert against the layout table in
+ * server_java/src/Protocol.java, so a field added on one side only no
+ * longer compiles.
+ *
+ * Usage:
+ *   schema::AmountRequest::write(w, name, accNo, password, currency, amount);
+ *   double balance;
+ *   if (schema::BalanceReply::read(reply, balance)) ...
+ */
+namespace proto {
+namespace schema {
+
+// ==================== Field types ====================
+
+struct U16 {
+    using Value = uint16_t;
+    static constexpr size_t MIN = 2;
+    static constexpr bool FIXED = true;
+    static size_t size(uint16_t) { return MIN; }
+    static bool fits(uint16_t) { return true; }
+    static void store(uint8_t* p, size_t& off, uint16_t v) {
+        putBE16(p + off, v);
+        off += 2;
+    }
+    static bool load(const uint8_t* p, size_t& off, size_t&, uint16_t& out) {
+        out = loadBE16(p + off);
+        off += 2;
+        return true;
+    }
+};
+
+struct I32 {
+    using Value = int32_t;
+    static constexpr size_t MIN = 4;
+    static constexpr bool FIXED = true;
+    static size_t size(int32_t) { return MIN; }
+    static bool fits(int32_t) { return true; }
+    static void store(uint8_t* p, size_t& off, int32_t v) {
+        putBE32(p + off, uint32_t(v));
+        off += 4;
+    }
+    static bool load(const uint8_t* p, size_t& off, size_t&, int32_t& out) {
+        out = int32_t(loadBE32(p + off));
+        off += 4;
+        return true;
+    }
+};
+
+struct U64 {
+    using Value = uint64_t;
+    static constexpr size_t MIN = 8;
+    static constexpr bool FIXED = true;
+    static size_t size(uint64_t) { return MIN; }
+    static bool fits(uint64_t) { return true; }
+    static void store(uint8_t* p, size_t& off, uint64_t v) {
+        putBE64(p + off, v);
+        off += 8;
+    }
+    static bool load(const uint8_t* p, size_t& off, size_t&, uint64_t& out) {
+        out = loadBE64(p + off);
+        off += 8;
+        return true;
+    }
+};
+
+struct F64 {
+    using Value = double;
+    static constexpr size_t MIN = 8;
+    static constexpr bool FIXED = true;
+    static size_t size(double) { return MIN; }
+    static bool fits(double) { return true; }
+    static void store(uint8_t* p, size_t& off, double v) {
+        uint64_t bits;
+        std::memcpy(&bits, &v, 8);
+        putBE64(p + off, bits);
+        off += 8;
+    }
+    static bool load(const uint8_t* p, size_t& off, size_t&, double& out) {
+        uint64_t bits = loadBE64(p + off);
+        std::memcpy(&out, &bits, 8);
+        off += 8;
+        return true;
+    }
+};
+
+// 16 bytes, zero padded; longer values are truncated like putPassword16
+struct Password16 {
+    using Value = std::string_view;
+    static constexpr size_t MIN = 16;
+    static constexpr bool FIXED = true;
+    static size_t size(std::string_view) { return MIN; }
+    static bool fits(std::string_view) { return true; }
+    static void store(uint8_t* p, size_t& off, std::string_view s) {
+        size_t n = s.size() > 16 ? 16 : s.size();
+        std::memcpy(p + off, s.data(), n);
+        std::memset(p + off + n, 0, 16 - n);
+        off += 16;
+    }
+    static bool load(const uint8_t* p, size_t& off, size_t&, std::string_view& out) {
+        size_t n = 16;
+        while (n > 0 && p[off + n - 1] == 0) n--;
+        out = std::string_view(reinterpret_cast<const char*>(p + off), n);
+        off += 16;
+        return true;
+    }
+};
+
+// len:u16 + bytes; decoded as a view into the body
+struct Str {
+    using Value = std::string_view;
+    static constexpr size_t MIN = 2;
+    static constexpr bool FIXED = false;
+    static size_t size(std::string_view s) { return MIN + s.size(); }
+    static bool fits(std::string_view s) { return s.size() <= 0xFFFF; }
+    static void store(uint8_t* p, size_t& off, std::string_view s) {
+        putBE16(p + off, uint16_t(s.size()));
+        if (!s.empty()) std::memcpy(p + off + 2, s.data(), s.size());
+        off += 2 + s.size();
+    }
+    static bool load(const uint8_t* p, size_t& off, size_t& slack, std::string_view& out) {
+        size_t len = loadBE16(p + off);
+        if (len > slack) return false;
+        slack -= len;
+        out = std::string_view(reinterpret_cast<const char*>(p + off + 2), len);
+        off += 2 + len;
+        return true;
+    }
+};
+
+// ==================== Compact field types (FLAG_COMPACT) ====================
+//
+// Integers are LEB128 varints: 7 bits per byte, low group first, high bit
+// set on every byte but the last; signed ones are zigzag mapped first so
+// small negatives stay short. Each varint counts one byte towards MIN, the
+// rest come out of the slack like string contents.
+
+inline size_t varintSize(uint64_t v) {
+    size_t n = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+inline void putVarint(uint8_t* p, size_t& off, uint64_t v) {
+    while (v >= 0x80) {
+        p[off++] = uint8_t(v) | 0x80;
+        v >>= 7;
+    }
+    p[off++] = uint8_t(v);
+}
+
+// At most maxBytes bytes; false if longer or past the end of the body
+inline bool getVarint(const uint8_t* p, size_t& off, size_t& slack, size_t maxBytes, uint64_t& out) {
+    out = 0;
+    for (size_t i = 0; i < maxBytes; i++) {
+        if (i > 0) {
+            if (slack == 0) return false;
+            slack--;
+        }
+        uint8_t b = p[off++];
+        out |= uint64_t(b & 0x7F) << (7 * i);
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+inline uint64_t zigzag(int64_t v) { return (uint64_t(v) << 1) ^ uint64_t(v >> 63); }
+inline int64_t unzigzag(uint64_t v) { return int64_t(v >> 1) ^ -int64_t(v & 1); }
+
+struct VarU16 {
+    using Value = uint16_t;
+    static constexpr size_t MIN = 1;
+    static constexpr bool FIXED = false;
+    static size_t size(uint16_t v) { return varintSize(v); }
+    static bool fits(uint16_t) { return true; }
+    static void store(uint8_t* p, size_t& off, uint16_t v) { putVarint(p, off, v); }
+    static bool load(const uint8_t* p, size_t& off, size_t& slack, uint16_t& out) {
+        uint64_t v;
+        if (!getVarint(p, off, slack, 3, v) || v > 0xFFFF) return false;
+        out = uint16_t(v);
+        return true;
+    }
+};
+
+struct VarI32 {
+    using Value = int32_t;
+    static constexpr size_t MIN = 1;
+    static constexpr bool FIXED = false;
+    static size_t size(int32_t v) { return varintSize(zigzag(v)); }
+    static bool fits(int32_t) { return true; }
+    static void store(uint8_t* p, size_t& off, int32_t v) { putVarint(p, off, zigzag(v)); }
+    static bool load(const uint8_t* p, size_t& off, size_t& slack, int32_t& out) {
+        uint64_t v;
+        if (!getVarint(p, off, slack, 5, v) || v > 0xFFFFFFFFull) return false;
+        out = int32_t(unzigzag(v));
+        return true;
+    }
+};
+
+// Amount as a zigzag varint of minor units (MONEY_SCALE per unit); only
+// for values a whole number of minor units reproduces exactly, so
+// decoding yields the very double that was encoded
+struct Money {
+    using Value = double;
+    static constexpr size_t MIN = 1;
+    static constexpr bool FIXED = false;
+    static constexpr double MONEY_SCALE = 100.0;
+    static constexpr double MAX_UNITS = 9007199254740992.0;  // 2^53: every integer exact
+    static int64_t units(double v) { return int64_t(std::llround(v * MONEY_SCALE)); }
+    static size_t size(double v) { return varintSize(zigzag(units(v))); }
+    static bool fits(double v) {
+        if (!(std::fabs(v * MONEY_SCALE) < MAX_UNITS)) return false;  // also NaN and infinities
+        return double(units(v)) / MONEY_SCALE == v;
+    }
+    static void store(uint8_t* p, size_t& off, double v) { putVarint(p, off, zigzag(units(v))); }
+    static bool load(const uint8_t* p, size_t& off, size_t& slack, double& out) {
+        uint64_t v;
+        if (!getVarint(p, off, slack, 10, v)) return false;
+        out = double(unzigzag(v)) / MONEY_SCALE;
+        return true;
+    }
+};
+
+// len:varint + bytes (names and passwords alike); decoded as a view into the body
+struct VarStr {
+    using Value = std::string_view;
+    static constexpr size_t MIN = 1;
+    static constexpr bool FIXED = false;
+    static size_t size(std::string_view s) { return varintSize(s.size()) + s.size(); }
+    static bool fits(std::string_view s) { return s.size() <= 0xFFFF; }
+    static void store(uint8_t* p, size_t& off, std::string_view s) {
+        putVarint(p, off, s.size());
+        if (!s.empty()) std::memcpy(p + off, s.data(), s.size());
+        off += s.size();
+    }
+    static bool load(const uint8_t* p, size_t& off, size_t& slack, std::string_view& out) {
+        uint64_t len;
+        if (!getVarint(p, off, slack, 3, len) || len > slack) return false;
+        slack -= len;
+        out = std::string_view(reinterpret_cast<const char*>(p + off), len);
+        off += len;
+        return true;
+    }
+};
+
+// ==================== Layout ====================
+
+template <class... F>
+struct Layout {
+    static constexpr size_t FIELDS = sizeof...(F);
+    // Body size with every string empty
+    static constexpr size_t MIN_SIZE = (F::MIN + ... + 0);
+    static constexpr bool FIXED = (F::FIXED && ... && true);
+
+    // Exact size of a layout without strings
+    static constexpr size_t fixedSize() {
+        static_assert(FIXED, "layout has variable-length fields");
+        return MIN_SIZE;
+    }
+
+    /**
+     * Encoded size for the given values
+     */
+    template <class... A>
+    static size_t size(const A&... v) {
+        static_assert(sizeof...(A) == FIELDS, "one value per field");
+        return (F::size(v) + ... + 0);
+    }
+
+    /**
+     * Append one body to the writer (fails the writer if it does not fit)
+     */
+    template <class... A>
+    static void write(Writer& w, const A&... v) {
+        static_assert(sizeof...(A) == FIELDS, "one value per field");
+        if (!(F::fits(v) && ... && true)) {
+            w.fail();
+            return;
+        }
+        uint8_t* p = w.reserve(size(v...));
+        if (!p) return;
+        size_t off = 0;
+        (F::store(p, off, v), ...);
+    }
+
+    /**
+     * Decode a body; strings are views into it (trailing bytes are ignored)
+     * @return false if the body is too short
+     */
+    static bool read(const uint8_t* p, size_t n, typename F::Value&... out) {
+        if (n < MIN_SIZE) return false;
+        size_t off = 0;
+        size_t slack = n - MIN_SIZE;  // bytes left for string contents
+        return (F::load(p, off, slack, out) && ... && true);
+    }
+
+    /**
+     * Decode a body that starts at p + off and is followed by others (BATCH
+     * entries), then move off past it
+     * @return false if it runs past n
+     */
+    static bool readAt(const uint8_t* p, size_t n, size_t& off, typename F::Value&... out) {
+        if (off > n || n - off < MIN_SIZE) return false;
+        size_t at = 0;
+        size_t slack = n - off - MIN_SIZE;
+        if (!(F::load(p + off, at, slack, out) && ... && true)) return false;
+        off += at;
+        return true;
+    }
+
+    static bool read(const MessageView& m, typename F::Value&... out) {
+        return read(m.body, m.bodyLen, out...);
+    }
+
+    static bool read(const std::vector<uint8_t>& body, typename F::Value&... out) {
+        return read(body.data(), body.size(), out...);
+    }
+};
+
+// ==================== Bodies ====================
+
+// Requests
+using OpenRequest = Layout<Str, Password16, U16, F64>;                  // name, password, currency, initialBalance
+using AuthRequest = Layout<Str, I32, Password16>;                       // CLOSE, QUERY_BALANCE, LOGIN: name, accNo, password
+using AmountRequest = Layout<Str, I32, Password16, U16, F64>;           // DEPOSIT, WITHDRAW: ..., currency, amount
+using TransferRequest = Layout<Str, I32, Password16, I32, U16, F64>;    // name, from, password, to, currency, amount
+using MonitorRequest = Layout<U16>;                                     // seconds
+using MonitorOptions = Layout<U16, U16>;                                // options, count; count x accNo:i32 follow
+using SnapshotRequest = Layout<Str, Password16, I32, I32, U16>;         // name, password, from, to, maxChunks
+using TokenRequest = Layout<U64, I32>;                                  // QUERY_BALANCE_TOKEN: token, accNo
+using TokenAmountRequest = Layout<U64, I32, U16, F64>;                  // DEPOSIT/WITHDRAW_TOKEN: ..., currency, amount
+using TokenTransferRequest = Layout<U64, I32, I32, U16, F64>;           // token, from, to, currency, amount
+
+// Replies (status OK)
+using OpenReply = Layout<I32, F64>;         // accNo, balance
+using TextReply = Layout<Str>;              // CLOSE, MONITOR_REGISTER: message
+using BalanceReply = Layout<F64>;           // DEPOSIT, WITHDRAW: new balance
+using QueryReply = Layout<U16, F64>;        // currency, balance
+using TransferReply = Layout<F64, F64>;     // from balance, to balance
+using SnapshotChunk = Layout<U16, U16, I32, U16>;  // chunk, flags, next, count; count x SnapshotEntry follow
+using SnapshotEntry = Layout<I32, U16, F64>;       // accNo, currency, balance
+using LoginReply = Layout<U64, U16>;        // token, seconds
+
+// Server push and BATCH framing
+using CallbackUpdate = Layout<U16, I32, U16, F64, Str>;  // updateType, accNo, currency, balance, info
+using BatchEntryHeader = Layout<U16, U16, U16>;          // opCode, subId, bodyLen
+using BatchReplyEntryHeader = Layout<U16, U16, U16, U16>; // opCode, subId, status, bodyLen
+
+// Compact counterparts (FLAG_COMPACT), field for field; compact.cpp converts
+using CompactOpenRequest = Layout<VarStr, VarStr, VarU16, Money>;
+using CompactAuthRequest = Layout<VarStr, VarI32, VarStr>;
+using CompactAmountRequest = Layout<VarStr, VarI32, VarStr, VarU16, Money>;
+using CompactTransferRequest = Layout<VarStr, VarI32, VarStr, VarI32, VarU16, Money>;
+using CompactSnapshotRequest = Layout<VarStr, VarStr, VarI32, VarI32, VarU16>;
+using CompactTokenRequest = Layout<U64, VarI32>;  // tokens are random: kept whole
+using CompactTokenAmountRequest = Layout<U64, VarI32, VarU16, Money>;
+using CompactTokenTransferRequest = Layout<U64, VarI32, VarI32, VarU16, Money>;
+using CompactOpenReply = Layout<VarI32, Money>;
+using CompactTextReply = Layout<VarStr>;
+using CompactBalanceReply = Layout<Money>;
+using CompactQueryReply = Layout<VarU16, Money>;
+using CompactTransferReply = Layout<Money, Money>;
+using CompactSnapshotChunk = Layout<VarU16, VarU16, VarI32, VarU16>;
+using CompactSnapshotEntry = Layout<VarI32, VarU16, Money>;       // accNo as the step from the previous entry's
+using CompactLoginReply = Layout<U64, VarU16>;
+using CompactBatchEntryHeader = Layout<VarU16, VarU16, VarU16>;
+using CompactBatchReplyEntryHeader = Layout<VarU16, VarU16, VarU16, VarU16>;
+using BatchCount = Layout<U16>;
+using CompactBatchCount = Layout<VarU16>;
+
+// Fixed parts as listed in server_java/src/Protocol.java ("Body layouts")
+static_assert(OpenRequest::MIN_SIZE == 28, "OPEN request");
+static_assert(AuthRequest::MIN_SIZE == 22, "CLOSE / QUERY_BALANCE request");
+static_assert(AmountRequest::MIN_SIZE == 32, "DEPOSIT / WITHDRAW request");
+static_assert(TransferRequest::MIN_SIZE == 36, "TRANSFER request");
+static_assert(MonitorRequest::fixedSize() == 2, "MONITOR_REGISTER request");
+static_assert(MonitorOptions::fixedSize() == 4, "MONITOR_REGISTER options");
+static_assert(OpenReply::fixedSize() == 12, "OPEN reply");
+static_assert(TextReply::MIN_SIZE == 2, "CLOSE / MONITOR_REGISTER reply");
+static_assert(BalanceReply::fixedSize() == 8, "DEPOSIT / WITHDRAW reply");
+static_assert(QueryReply::fixedSize() == 10, "QUERY_BALANCE reply");
+static_assert(TransferReply::fixedSize() == 16, "TRANSFER reply");
+static_assert(CallbackUpdate::MIN_SIZE == 18, "CALLBACK_UPDATE body");
+static_assert(BatchEntryHeader::fixedSize() == BATCH_ENTRY_HEADER, "BATCH entry");
+static_assert(BatchReplyEntryHeader::fixedSize() == BATCH_REPLY_ENTRY_HEADER, "BATCH reply entry");
+static_assert(SnapshotRequest::MIN_SIZE == 28, "SNAPSHOT request");
+static_assert(SnapshotChunk::fixedSize() == SNAPSHOT_CHUNK_HEADER, "SNAPSHOT chunk");
+static_assert(SnapshotEntry::fixedSize() == SNAPSHOT_ENTRY, "SNAPSHOT entry");
+static_assert(LoginReply::fixedSize() == 10, "LOGIN reply");
+static_assert(TokenRequest::fixedSize() == 12, "QUERY_BALANCE_TOKEN request");
+static_assert(TokenAmountRequest::fixedSize() == 22, "DEPOSIT_TOKEN / WITHDRAW_TOKEN request");
+static_assert(TokenTransferRequest::fixedSize() == 26, "TRANSFER_TOKEN request");
+
+/**
+ * Layout by opcode: Request<op>::type / Reply<op>::type
+ */
+template <OpCode Op> struct Request;
+template <> struct Request<OpCode::OPEN> { using type = OpenRequest; };
+template <> struct Request<OpCode::CLOSE> { using type = AuthRequest; };
+template <> struct Request<OpCode::DEPOSIT> { using type = AmountRequest; };
+template <> struct Request<OpCode::WITHDRAW> { using type = AmountRequest; };
+template <> struct Request<OpCode::MONITOR_REGISTER> { using type = MonitorRequest; };
+template <> struct Request<OpCode::QUERY_BALANCE> { using type = AuthRequest; };
+template <> struct Request<OpCode::TRANSFER> { using type = TransferRequest; };
+template <> struct Request<OpCode::SNAPSHOT> { using type = SnapshotRequest; };
+template <> struct Request<OpCode::LOGIN> { using type = AuthRequest; };
+template <> struct Request<OpCode::DEPOSIT_TOKEN> { using type = TokenAmountRequest; };
+template <> struct Request<OpCode::WITHDRAW_TOKEN> { using type = TokenAmountRequest; };
+template <> struct Request<OpCode::QUERY_BALANCE_TOKEN> { using type = TokenRequest; };
+template <> struct Request<OpCode::TRANSFER_TOKEN> { using type = TokenTransferRequest; };
+
+template <OpCode Op> struct Reply;
+template <> struct Reply<OpCode::OPEN> { using type = OpenReply; };
+template <> struct Reply<OpCode::CLOSE> { using type = TextReply; };
+template <> struct Reply<OpCode::DEPOSIT> { using type = BalanceReply; };
+template <> struct Reply<OpCode::WITHDRAW> { using type = BalanceReply; };
+template <> struct Reply<OpCode::MONITOR_REGISTER> { using type = TextReply; };
+template <> struct Reply<OpCode::QUERY_BALANCE> { using type = QueryReply; };
+template <> struct Reply<OpCode::TRANSFER> { using type = TransferReply; };
+template <> struct Reply<OpCode::SNAPSHOT> { using type = SnapshotChunk; };
+template <> struct Reply<OpCode::LOGIN> { using type = LoginReply; };
+template <> struct Reply<OpCode::DEPOSIT_TOKEN> { using type = BalanceReply; };
+template <> struct Reply<OpCode::WITHDRAW_TOKEN> { using type = BalanceReply; };
+template <> struct Reply<OpCode::QUERY_BALANCE_TOKEN> { using type = QueryReply; };
+template <> struct Reply<OpCode::TRANSFER_TOKEN> { using type = TransferReply; };
+
+} // namespace schema
+} // namespace proto
@@ -0,0 +1,484 @@
+#include "script.hpp"
+#include "schema.hpp"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <sstream>
+
+namespace {
+
+// Read-ahead beyond the in-flight window, so blocked accounts do not stall others
+constexpr size_t MIN_LOOKAHEAD = 256;
+
+bool parseOpName(std::string s, uint16_t& op) {
+    for (char& c : s) c = (char)std::tolower((unsigned char)c);
+    if (s == "open") op = uint16_t(proto::OpCode::OPEN);
+    else if (s == "close") op = uint16_t(proto::OpCode::CLOSE);
+    else if (s == "deposit") op = uint16_t(proto::OpCode::DEPOSIT);
+    else if (s == "withdraw") op = uint16_t(proto::OpCode::WITHDRAW);
+    else if (s == "query") op = uint16_t(proto::OpCode::QUERY_BALANCE);
+    else if (s == "transfer") op = uint16_t(proto::OpCode::TRANSFER);
+    else return false;
+    return true;
+}
+
+bool parseCurrency(const std::string& s, uint16_t& cur) {
+    if (s == "CNY" || s == "cny" || s == "0") cur = uint16_t(proto::Currency::CNY);
+    else if (s == "SGD" || s == "sgd" || s == "1") cur = uint16_t(proto::Currency::SGD);
+    else return false;
+    return true;
+}
+
+bool parseNumber(const std::string& s, double& out) {
+    char* end = nullptr;
+    out = std::strtod(s.c_str(), &end);
+    return !s.empty() && *end == '\0';
+}
+
+std::string money(double v) {
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%.2f", v);
+    return buf;
+}
+
+} // namespace
+
+ScriptRunner::ScriptRunner(Runtime& rt, std::istream& in, std::ostream& out, int concurrency,
+                           TokenCache* tokens)
+    : rt_(rt), in_(in), out_(out), concurrency_(concurrency < 1 ? 1 : concurrency), tokens_(tokens),
+      binary_(false), eof_(false), lineNo_(0), nextId_(1), opens_(0), inFlight_(0) {}
+
+ScriptRunner::Summary ScriptRunner::run() {
+    auto started = std::chrono::steady_clock::now();
+
+    // Format detection: binary traces start with "BKOP", anything else is text
+    char magic[4] = {0, 0, 0, 0};
+    in_.read(magic, sizeof(magic));
+    if (in_.gcount() == 4 && std::memcmp(magic, "BKOP", 4) == 0) {
+        binary_ = true;
+    } else {
+        prefix_.assign(magic, (size_t)in_.gcount());
+        in_.clear();
+    }
+
+    const size_t lookahead = std::max(MIN_LOOKAHEAD, (size_t)concurrency_ * 4);
+    std::vector<Result> done;
+
+    while (!eof_ || !ops_.empty()) {
+        while (!eof_ && ops_.size() < lookahead) {
+            if (!readOne()) eof_ = true;
+        }
+
+        while (inFlight_ < concurrency_ && !ready_.empty()) {
+            uint64_t id = ready_.front();
+            ready_.pop_front();
+            dispatch(id);
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (results_.empty() && inFlight_ > 0) {
+                // Nothing to do until a reply lands: make the output visible meanwhile
+                lock.unlock();
+                out_.flush();
+                lock.lock();
+                cv_.wait(lock, [this] { return !results_.empty(); });
+            }
+            done.swap(results_);
+        }
+        for (const Result& r : done) finish(r);
+        done.clear();
+    }
+
+    out_.flush();
+    sum_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return sum_;
+}
+
+bool ScriptRunner::readOne() {
+    Op op;
+    if (binary_) {
+        if (!readRecord(op)) return false;
+    } else {
+        std::string line;
+        if (!prefix_.empty()) {
+            size_t nl = prefix_.find('\n');
+            if (nl != std::string::npos) {
+                line = prefix_.substr(0, nl);
+                prefix_.erase(0, nl + 1);
+            } else {
+                std::string rest;
+                std::getline(in_, rest);
+                line = prefix_ + rest;
+                prefix_.clear();
+            }
+        } else if (!std::getline(in_, line)) {
+            return false;
+        }
+        lineNo_++;
+        op.lineNo = lineNo_;
+
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        if (line.find_first_not_of(" \t\r") == std::string::npos) return true;
+
+        std::string err;
+        if (!parseLine(line, op, err)) {
+            emit(op, "PARSE_ERROR", err);
+            sum_.ops++;
+            sum_.failed++;
+            return true;
+        }
+    }
+    addOp(std::move(op));
+    return true;
+}
+
+bool ScriptRunner::parseLine(const std::string& line, Op& op, std::string& err) {
+    std::istringstream ss(line);
+    std::vector<std::string> t;
+    std::string tok;
+    while (ss >> tok) t.push_back(tok);
+
+    if (!parseOpName(t[0], op.opCode)) {
+        err = "unknown operation '" + t[0] + "'";
+        return false;
+    }
+    // Every "open" line claims its $k, even a malformed one, so numbering follows the file
+    if (op.opCode == uint16_t(proto::OpCode::OPEN)) {
+        op.openIndex = ++opens_;
+        opened_.push_back(0);
+    }
+
+    auto acc = [&](const std::string& s, AccRef& out) {
+        if (!s.empty() && s[0] == '$') {
+            out.ref = std::atoi(s.c_str() + 1);
+            if (out.ref < 1 || out.ref > opens_) {
+                err = "no open line for " + s;
+                return false;
+            }
+            return true;
+        }
+        double v;
+        if (!parseNumber(s, v) || v <= 0 || v != (double)(int32_t)v) {
+            err = "bad account '" + s + "'";
+            return false;
+        }
+        out.value = (int32_t)v;
+        return true;
+    };
+    auto cur = [&](const std::string& s) {
+        if (parseCurrency(s, op.currency)) return true;
+        err = "bad currency '" + s + "'";
+        return false;
+    };
+    auto amount = [&](const std::string& s) {
+        if (parseNumber(s, op.amount)) return true;
+        err = "bad amount '" + s + "'";
+        return false;
+    };
+    auto arity = [&](size_t n) {
+        if (t.size() == n + 1) return true;
+        err = "expected " + std::to_string(n) + " arguments";
+        return false;
+    };
+
+    switch (op.opCode) {
+        case uint16_t(proto::OpCode::OPEN):
+            if (!arity(4) || !cur(t[3]) || !amount(t[4])) return false;
+            op.name = t[1];
+            op.password = t[2];
+            break;
+        case uint16_t(proto::OpCode::CLOSE):
+        case uint16_t(proto::OpCode::QUERY_BALANCE):
+            if (!arity(3) || !acc(t[2], op.acc)) return false;
+            op.name = t[1];
+            op.password = t[3];
+            break;
+        case uint16_t(proto::OpCode::DEPOSIT):
+        case uint16_t(proto::OpCode::WITHDRAW):
+            if (!arity(5) || !acc(t[2], op.acc) || !cur(t[4]) || !amount(t[5])) return false;
+            op.name = t[1];
+            op.password = t[3];
+            break;
+        case uint16_t(proto::OpCode::TRANSFER):
+            if (!arity(6) || !acc(t[2], op.acc) || !acc(t[4], op.to) || !cur(t[5]) ||
+                !amount(t[6])) {
+                return false;
+            }
+            op.name = t[1];
+            op.password = t[3];
+            break;
+    }
+    if (op.name.size() > 0xFFFF) {
+        err = "name too long";
+        return false;
+    }
+
+    // Ordering keys: literal accounts by number, $k (and the OPEN producing it) by -k
+    auto key = [](const AccRef& a) { return a.ref ? -(int64_t)a.ref : (int64_t)a.value; };
+    if (op.opCode == uint16_t(proto::OpCode::OPEN)) {
+        op.keys.push_back(-(int64_t)op.openIndex);
+    } else {
+        op.keys.push_back(key(op.acc));
+        if (op.opCode == uint16_t(proto::OpCode::TRANSFER) && key(op.to) != key(op.acc)) {
+            op.keys.push_back(key(op.to));
+        }
+    }
+    return true;
+}
+
+bool ScriptRunner::readRecord(Op& op) {
+    uint8_t hdr[4];
+    if (!in_.read(reinterpret_cast<char*>(hdr), sizeof(hdr))) return false;
+    op.opCode = uint16_t((hdr[0] << 8) | hdr[1]);
+    size_t len = size_t((hdr[2] << 8) | hdr[3]);
+    op.raw.resize(len);
+    if (len && !in_.read(reinterpret_cast<char*>(op.raw.data()), (std::streamsize)len)) return false;
+    lineNo_++;
+    op.lineNo = lineNo_;
+
+    if (op.opCode == uint16_t(proto::OpCode::OPEN)) {
+        op.openIndex = ++opens_;
+        opened_.push_back(0);
+        op.keys.push_back(-(int64_t)op.openIndex);
+        return true;
+    }
+
+    // Pull the account numbers out of the body for ordering and result lines
+    // (every account operation starts with the AuthRequest fields)
+    std::string_view name, password;
+    if (proto::schema::AuthRequest::read(op.raw, name, op.acc.value, password)) {
+        op.keys.push_back(op.acc.value);
+    }
+    uint16_t cur;
+    double amount;
+    if (op.opCode == uint16_t(proto::OpCode::TRANSFER) &&
+        proto::schema::TransferRequest::read(op.raw, name, op.acc.value, password, op.to.value, cur, amount) &&
+        op.to.value != op.acc.value) {
+        op.keys.push_back(op.to.value);
+    }
+    return true;
+}
+
+void ScriptRunner::addOp(Op&& op) {
+    uint64_t id = nextId_++;
+    for (int64_t k : op.keys) queues_[k].push_back(id);
+    ops_.emplace(id, std::move(op));
+    release(id);
+}
+
+void ScriptRunner::release(uint64_t id) {
+    Op& op = ops_.at(id);
+    if (op.released) return;
+    for (int64_t k : op.keys) {
+        if (queues_[k].front() != id) return;
+    }
+    op.released = true;
+    ready_.push_back(id);
+}
+
+bool ScriptRunner::resolve(AccRef& a) const {
+    if (!a.ref) return true;
+    a.value = opened_[a.ref - 1];
+    return a.value != 0;
+}
+
+void ScriptRunner::dispatch(uint64_t id) {
+    Op& op = ops_.at(id);
+    inFlight_++;
+
+    // The OPEN this operation refers to has completed (key order), but may have failed
+    if (!resolve(op.acc) || (op.opCode == uint16_t(proto::OpCode::TRANSFER) && !resolve(op.to))) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        results_.push_back({id, false, 0, 0, "SKIPPED referenced OPEN failed"});
+        return;
+    }
+
+    const uint16_t opCode = op.opCode;
+    const int32_t acc = op.acc.value;
+    const int32_t to = op.to.value;
+    const uint16_t currency = op.currency;
+
+    // Session token: log in ahead of the first operation on the account,
+    // name and password if that did not give one
+    uint64_t token = 0;
+    const uint16_t tokenOp = binary_ || !tokens_ ? 0 : proto::tokenOpCode(opCode);
+    if (tokenOp && op.tokenStage != TOKEN_PLAIN && tokens_->supported()) {
+        if (tokens_->lookup(acc, op.name, op.password, token)) {
+            op.tokenStage = TOKEN_SENT;
+        } else if (op.tokenStage == TOKEN_NONE && submitLogin(id, op)) {
+            op.tokenStage = TOKEN_LOGIN;
+            return;
+        }
+    }
+    const bool withToken = op.tokenStage == TOKEN_SENT;
+
+    // Results are keyed by the operation as written, whichever variant went out
+    auto done = [this, id, opCode, acc, to, currency, withToken](const Pipeline::Completion& c) {
+        Result r{id, c.ok, 0, 0, std::string()};
+        if (withToken && c.ok && c.reply->h.status == uint16_t(proto::Status::ERR_AUTH)) {
+            tokens_->erase(acc);
+            r.again = true;
+        } else if (!c.ok) {
+            r.text = c.shed ? std::string("SHED circuit open")
+                            : "TIMEOUT attempts=" + std::to_string(c.attempts);
+        } else {
+            r.status = c.reply->h.status;
+            r.text = proto::statusName(r.status);
+            const proto::MessageView& body = *c.reply;
+            if (r.status == uint16_t(proto::Status::OK)) {
+                double bal = 0, toBal = 0;
+                uint16_t cur = currency;
+                int32_t newAcc = 0;
+                switch (opCode) {
+                    case uint16_t(proto::OpCode::OPEN):
+                        if (proto::schema::OpenReply::read(body, newAcc, bal)) {
+                            r.openedAcc = newAcc;
+                            r.text += " acc=" + std::to_string(newAcc) + " currency=" +
+                                      proto::currencyToString(cur) + " balance=" + money(bal);
+                        }
+                        break;
+                    case uint16_t(proto::OpCode::CLOSE):
+                        r.text += " acc=" + std::to_string(acc);
+                        break;
+                    case uint16_t(proto::OpCode::DEPOSIT):
+                    case uint16_t(proto::OpCode::WITHDRAW):
+                        if (proto::schema::BalanceReply::read(body, bal)) {
+                            r.text += " acc=" + std::to_string(acc) + " balance=" + money(bal);
+                        }
+                        break;
+                    case uint16_t(proto::OpCode::QUERY_BALANCE):
+                        if (proto::schema::QueryReply::read(body, cur, bal)) {
+                            r.text += " acc=" + std::to_string(acc) + " currency=" +
+                                      proto::currencyToString(cur) + " balance=" + money(bal);
+                        }
+                        break;
+                    case uint16_t(proto::OpCode::TRANSFER):
+                        if (proto::schema::TransferReply::read(body, bal, toBal)) {
+                            r.text += " from=" + std::to_string(acc) + " to=" + std::to_string(to) +
+                                      " fromBalance=" + money(bal) + " toBalance=" + money(toBal);
+                        }
+                        break;
+                }
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        results_.push_back(std::move(r));
+        cv_.notify_one();
+    };
+
+    bool submitted;
+    if (binary_) {
+        const std::vector<uint8_t>& raw = op.raw;
+        submitted = rt_.submitWith(opCode, raw.size(),
+                                   [&raw](proto::Writer& w) { w.putBytes(raw.data(), raw.size()); },
+                                   done, acc ? acc : -1);
+    } else if (withToken) {
+        submitted = rt_.submitWith(tokenOp, proto::requestBodySize(tokenOp, 0), [&op, acc, to, token](proto::Writer& w) {
+            switch (op.opCode) {
+                case uint16_t(proto::OpCode::QUERY_BALANCE):
+                    proto::writeTokenRequest(w, token, acc);
+                    break;
+                case uint16_t(proto::OpCode::DEPOSIT):
+                case uint16_t(proto::OpCode::WITHDRAW):
+                    proto::writeTokenAmountRequest(w, token, acc, op.currency, op.amount);
+                    break;
+                case uint16_t(proto::OpCode::TRANSFER):
+                    proto::writeTokenTransferRequest(w, token, acc, to, op.currency, op.amount);
+                    break;
+            }
+        }, done, acc);
+    } else {
+        const size_t len = proto::requestBodySize(opCode, op.name.size());
+        submitted = rt_.submitWith(opCode, len, [&op, acc, to](proto::Writer& w) {
+            switch (op.opCode) {
+                case uint16_t(proto::OpCode::OPEN):
+                    proto::writeOpenRequest(w, op.name, op.password, op.currency, op.amount);
+                    break;
+                case uint16_t(proto::OpCode::CLOSE):
+                case uint16_t(proto::OpCode::QUERY_BALANCE):
+                    proto::writeAuthRequest(w, op.name, acc, op.password);
+                    break;
+                case uint16_t(proto::OpCode::DEPOSIT):
+                case uint16_t(proto::OpCode::WITHDRAW):
+                    proto::writeAmountRequest(w, op.name, acc, op.password, op.currency, op.amount);
+                    break;
+                case uint16_t(proto::OpCode::TRANSFER):
+                    proto::writeTransferRequest(w, op.name, acc, op.password, to, op.currency, op.amount);
+                    break;
+            }
+        }, done, acc ? acc : -1);
+    }
+
+    // Rejected submissions (body too large or not encodable) never complete
+    if (!submitted) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        results_.push_back({id, false, 0, 0, "SKIPPED request could not be encoded"});
+    }
+}
+
+bool ScriptRunner::submitLogin(uint64_t id, const Op& op) {
+    const uint16_t opCode = uint16_t(proto::OpCode::LOGIN);
+    const int32_t acc = op.acc.value;
+    const auto sent = TokenCache::Clock::now();
+    // The completion runs on a worker thread, after op may have been dispatched again
+    auto done = [this, id, acc, name = op.name, password = op.password, sent](const Pipeline::Completion& c) {
+        uint64_t token;
+        if (c.ok) {
+            tokens_->login(acc, name, password, c.reply->h.status, c.reply->body, c.reply->bodyLen, sent, token);
+        }
+        Result r{id, true, 0, 0, std::string()};
+        r.again = true;
+        std::lock_guard<std::mutex> lock(mutex_);
+        results_.push_back(std::move(r));
+        cv_.notify_one();
+    };
+    return rt_.submitWith(opCode, proto::requestBodySize(opCode, op.name.size()), [&op, acc](proto::Writer& w) {
+        proto::writeAuthRequest(w, op.name, acc, op.password);
+    }, done, acc);
+}
+
+void ScriptRunner::finish(const Result& r) {
+    auto it = ops_.find(r.id);
+    Op& op = it->second;
+    inFlight_--;
+
+    // Still the head of its queues: straight back to the front of ready_
+    if (r.again) {
+        if (op.tokenStage == TOKEN_SENT) op.tokenStage = TOKEN_PLAIN;
+        ready_.push_front(r.id);
+        return;
+    }
+
+    if (op.openIndex && r.openedAcc) opened_[op.openIndex - 1] = r.openedAcc;
+
+    sum_.ops++;
+    if (r.ok && r.status == uint16_t(proto::Status::OK)) sum_.ok++;
+    else if (r.ok) sum_.rejected++;
+    else sum_.failed++;
+    emit(op, nullptr, r.text);
+
+    // Release the next operation on every account this one held
+    for (int64_t k : op.keys) {
+        auto q = queues_.find(k);
+        q->second.pop_front();
+        if (q->second.empty()) {
+            queues_.erase(q);
+        } else {
+            release(q->second.front());
+        }
+    }
+    ops_.erase(it);
+}
+
+void ScriptRunner::emit(const Op& op, const char* status, const std::string& text) {
+    out_ << op.lineNo << ' '
+         << (op.opCode ? proto::opCodeToString(op.opCode) : std::string("?")) << ' ';
+    if (status) out_ << status << ' ';
+    out_ << text << '\n';
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "runtime.hpp"
+#include "token_cache.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Non-interactive batch mode: replays an operation file through the Runtime
+ *
+ * Text format, one operation per line ('#' starts a comment):
+ *   open     <name> <password> <CNY|SGD> <initialBalance>
+ *   close    <name> <acc> <password>
+ *   deposit  <name> <acc> <password> <CNY|SGD> <amount>
+ *   withdraw <name> <acc> <password> <CNY|SGD> <amount>
+ *   query    <name> <acc> <password>
+ *   transfer <name> <fromAcc> <password> <toAcc> <CNY|SGD> <amount>
+ * <acc> is an account number or $k, the account created by the k-th
+ * "open" line of the script (1-based).
+ *
+ * Binary format: the 4 bytes "BKOP", then records of
+ *   opCode:u16 bodyLen:u16 body   (big-endian, body as sent on the wire)
+ *
+ * Operations are pipelined up to `concurrency` at a time. Operations that
+ * touch the same account run in file order (a $k reference also waits for
+ * its OPEN), everything else overlaps freely. One result line per operation
+ * is streamed to the output as it completes:
+ *   <lineNo> <OP> <STATUS> [key=value ...]
+ * STATUS is a protocol status name, TIMEOUT, SKIPPED (an OPEN it refers to
+ * failed) or PARSE_ERROR.
+ *
+ * With a TokenCache, text-mode deposits, withdrawals, queries and transfers
+ * go out as their session-token variants: the first one on an account sends
+ * a LOGIN ahead of it, and if that fails or the token is refused the
+ * operation is sent with name and password instead. Result lines are the
+ * same either way. Binary records are sent exactly as read.
+ */
+class ScriptRunner {
+public:
+    struct Summary {
+        uint64_t ops = 0;
+        uint64_t ok = 0;
+        uint64_t rejected = 0;  // server returned an error status
+        uint64_t failed = 0;    // timeout, skipped or parse error
+        double seconds = 0;
+    };
+
+    /**
+     * Constructor
+     * @param rt Started runtime the operations are submitted to
+     * @param in Operation stream (text or binary, detected from the first bytes)
+     * @param out Result stream
+     * @param concurrency Largest number of operations in flight
+     * @param tokens Session tokens to use (nullptr = name and password only)
+     */
+    ScriptRunner(Runtime& rt, std::istream& in, std::ostream& out, int concurrency,
+                 TokenCache* tokens = nullptr);
+
+    /**
+     * Run the whole stream
+     * @return summary of the run
+     */
+    Summary run();
+
+private:
+    // Account operand: a literal account number or a $k reference
+    struct AccRef {
+        int32_t value = 0;
+        int ref = 0;  // k of $k, 0 for a literal
+    };
+
+    // How far an operation got with a session token
+    enum : uint8_t {
+        TOKEN_NONE,   // not tried yet
+        TOKEN_LOGIN,  // LOGIN sent for it
+        TOKEN_SENT,   // sent with the token
+        TOKEN_PLAIN,  // token refused: name and password from now on
+    };
+
+    struct Op {
+        uint64_t lineNo = 0;
+        uint16_t opCode = 0;
+        std::string name;
+        std::string password;
+        AccRef acc;
+        AccRef to;
+        uint16_t currency = 0;
+        double amount = 0;
+        int openIndex = 0;              // OPEN: its k
+        std::vector<uint8_t> raw;       // binary records: body as read
+        std::vector<int64_t> keys;      // ordering keys (accounts touched)
+        bool released = false;          // head of all its key queues, moved to ready_
+        uint8_t tokenStage = TOKEN_NONE;  // text mode with a TokenCache
+    };
+
+
+    struct Result {
+        uint64_t id;
+        bool ok;
+        uint16_t status;
+        int32_t openedAcc;  // OPEN OK: the new account number
+        std::string text;
+        bool again = false;  // LOGIN done or token refused: dispatch the operation again
+    };
+
+    Runtime& rt_;
+    std::istream& in_;
+    std::ostream& out_;
+    int concurrency_;
+    TokenCache* tokens_;
+    bool binary_;
+    bool eof_;
+    std::string prefix_;  // text bytes consumed by format detection
+    uint64_t lineNo_;
+    uint64_t nextId_;
+    int opens_;
+
+    std::unordered_map<uint64_t, Op> ops_;                  // read, not yet finished
+    std::unordered_map<int64_t, std::deque<uint64_t>> queues_;  // per-key FIFO of op ids
+    std::deque<uint64_t> ready_;                            // released, not yet sent
+    std::vector<int32_t> opened_;                           // k-1 -> account, 0 = failed/pending
+    int inFlight_;
+    Summary sum_;
+
+    std::mutex mutex_;               // guards results_ (filled on worker threads)
+    std::condition_variable cv_;
+    std::vector<Result> results_;
+
+    bool readOne();
+    bool parseLine(const std::string& line, Op& op, std::string& err);
+    bool readRecord(Op& op);
+    void addOp(Op&& op);
+    void release(uint64_t id);
+    void dispatch(uint64_t id);
+    bool submitLogin(uint64_t id, const Op& op);
+    void finish(const Result& r);
+    bool resolve(AccRef& a) const;
+    void emit(const Op& op, const char* status, const std::string& text);
+};
@@ -0,0 +1,181 @@
+#include "coro.hpp"
+#include "net.hpp"
+#include "protocol.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * Many logical bank sessions as coroutines on one thread (see coro.hpp)
+ *
+ * Usage:
+ *   sessions.exe --server 127.0.0.1 --port 9000 --sessions 5000 --duration 10
+ *
+ * Every session opens its own account, then alternates DEPOSIT 1.00 and
+ * QUERY_BALANCE until the duration is up, checking each balance against
+ * the deposits it made, and closes the account. All sessions share one
+ * socket and one EventLoop.
+ *
+ * Arguments:
+ *   --server    Server IP address (default: 127.0.0.1)
+ *   --port      Server port number (default: 9000)
+ *   --sem       Invocation semantics: "atmost" or "atleast" (default: atmost)
+ *   --timeout   Per-attempt timeout in milliseconds (default: 500)
+ *   --retry     Number of attempts (default: 5)
+ *   --rto       Retransmission timer: "fixed" or "adaptive" (default: fixed)
+ *   --sessions  Concurrent logical sessions (default: 1000)
+ *   --duration  Seconds each session keeps going (default: 10)
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Totals {
+    Clock::time_point end;
+    uint64_t ok = 0;
+    uint64_t rejected = 0;
+    uint64_t failed = 0;      // no reply after all attempts
+    uint64_t mismatched = 0;  // balance differs from the session's own count
+    uint64_t unopened = 0;    // sessions whose OPEN failed
+    std::vector<uint32_t> latUs;
+};
+
+void record(Totals& t, const coro::Result& r) {
+    if (!r.delivered) {
+        t.failed++;
+        return;
+    }
+    if (r.ok()) {
+        t.ok++;
+    } else {
+        t.rejected++;
+    }
+    t.latUs.push_back((uint32_t)std::min<int64_t>(r.latency.count(), UINT32_MAX));
+}
+
+coro::Task<void> session(coro::Bank& bank, Totals& t, int id) {
+    const uint16_t cny = (uint16_t)proto::Currency::CNY;
+    const std::string name = "co-" + std::to_string(id);
+    const std::string password = "pw" + std::to_string(id % 1000);
+
+    coro::OpenResult opened = co_await bank.open(name, password, cny, 1000.0);
+    record(t, opened);
+    if (!opened.ok()) {
+        t.unopened++;
+        co_return;
+    }
+
+    double expected = opened.balance;
+    bool known = true;  // a lost deposit leaves the balance unknown
+    while (Clock::now() < t.end) {
+        coro::AmountResult dep = co_await bank.deposit(name, opened.accNo, password, cny, 1.0);
+        record(t, dep);
+        if (dep.ok()) {
+            expected += 1.0;
+        } else if (!dep.delivered) {
+            known = false;
+        }
+
+        coro::QueryResult q = co_await bank.queryBalance(name, opened.accNo, password);
+        record(t, q);
+        if (q.ok() && known && q.balance != expected) t.mismatched++;
+    }
+
+    record(t, co_await bank.close(name, opened.accNo, password));
+}
+
+double percentile(const std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t idx = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)] / 1000.0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    coro::EventLoop::Config cfg;
+    cfg.atMostOnce = true;
+    cfg.retryCount = 5;
+    std::string sem = "atmost";
+    int sessions = 1000;
+    int durationSec = 10;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--server") == 0 && i + 1 < argc) {
+            cfg.serverIp = argv[++i];
+        } else if (std::strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            cfg.serverPort = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--sem") == 0 && i + 1 < argc) {
+            sem = argv[++i];
+        } else if (std::strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            cfg.timeoutMs = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--retry") == 0 && i + 1 < argc) {
+            cfg.retryCount = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--rto") == 0 && i + 1 < argc) {
+            if (!RetransmitPolicy::parseMode(argv[++i], cfg.rtoMode)) {
+                std::cerr << "Invalid --rto: " << argv[i] << "\n";
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--sessions") == 0 && i + 1 < argc) {
+            sessions = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+            durationSec = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--help") == 0 || std::strcmp(argv[i], "-h") == 0) {
+            std::cout << "Usage: " << argv[0] << " [options]\n";
+            std::cout << "Options:\n";
+            std::cout << "  --server <ip>        Server IP address (default: 127.0.0.1)\n";
+            std::cout << "  --port <port>        Server port (default: 9000)\n";
+            std::cout << "  --sem <semantic>     atmost or atleast (default: atmost)\n";
+            std::cout << "  --timeout <ms>       Per-attempt timeout in milliseconds (default: 500)\n";
+            std::cout << "  --retry <count>      Attempts per request (default: 5)\n";
+            std::cout << "  --rto <mode>         fixed or adaptive (default: fixed)\n";
+            std::cout << "  --sessions <n>       Concurrent logical sessions (default: 1000)\n";
+            std::cout << "  --duration <s>       Seconds each session keeps going (default: 10)\n";
+            return 0;
+        }
+    }
+    cfg.atMostOnce = (sem == "atmost" || sem == "at-most-once");
+    if (sessions < 1) sessions = 1;
+
+    if (!net::startup()) {
+        std::cerr << "[sessions] network startup failed\n";
+        return 1;
+    }
+    int rc = 0;
+    {
+        coro::EventLoop loop(cfg);
+        if (!loop.open()) {
+            net::cleanup();
+            return 1;
+        }
+        // Replies for thousands of sessions can arrive in one burst
+        net::setBufferSizes(loop.socket(), 4 << 20);
+        coro::Bank bank(loop);
+
+        Totals t;
+        auto start = Clock::now();
+        t.end = start + std::chrono::seconds(durationSec);
+        for (int i = 0; i < sessions; i++) loop.spawn(session(bank, t, i));
+        size_t frames = coro::liveFrameBytes();
+        loop.run();
+        double secs = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::sort(t.latUs.begin(), t.latUs.end());
+        uint64_t done = t.ok + t.rejected;
+        std::printf("sessions=%d on one thread, %zu bytes of coroutine frames (%.0f per session)\n",
+                    sessions, frames, double(frames) / sessions);
+        std::printf("ok=%llu rejected=%llu failed=%llu unopened=%llu mismatched=%llu\n",
+                    (unsigned long long)t.ok, (unsigned long long)t.rejected, (unsigned long long)t.failed,
+                    (unsigned long long)t.unopened, (unsigned long long)t.mismatched);
+        std::printf("total: %llu replies in %.2fs = %.0f ops/s  p50=%.3fms p99=%.3fms\n",
+                    (unsigned long long)done, secs, done / secs, percentile(t.latUs, 50), percentile(t.latUs, 99));
+        rc = t.mismatched > 0 ? 1 : 0;
+    }
+    net::cleanup();
+    return rc;
+}
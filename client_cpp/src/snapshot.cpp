@@ -0,0 +1,122 @@
+#include "snapshot.hpp"
+#include "schema.hpp"
+
+SnapshotReader::SnapshotReader(Runtime& rt, const Options& opt, EntryFn onEntry)
+    : rt_(rt), opt_(opt), onEntry_(std::move(onEntry)) {
+    if (opt_.maxChunks == 0 || opt_.maxChunks > proto::SNAPSHOT_MAX_CHUNKS) opt_.maxChunks = proto::SNAPSHOT_MAX_CHUNKS;
+    if (opt_.attempts < 1) opt_.attempts = 1;
+}
+
+SnapshotReader::Result SnapshotReader::run() {
+    res_ = Result();
+    int32_t from = opt_.from;
+    int stalled = 0;
+    while (true) {
+        if (!request(from)) return res_;  // runtime not running
+        res_.requests++;
+        const Pass& p = pass_;
+
+        if (p.status != (uint16_t)proto::Status::OK || p.bad) {
+            res_.status = p.bad ? (uint16_t)proto::Status::ERR_BAD_REQUEST : p.status;
+            res_.next = from;
+            return res_;
+        }
+        if (p.last && p.end) {
+            res_.ok = true;
+            res_.next = p.next;
+            return res_;
+        }
+        if (p.expect == 0) {
+            // Nothing in order: asked again from the same token
+            if (++stalled >= opt_.attempts) {
+                res_.next = from;
+                return res_;
+            }
+        } else {
+            stalled = 0;
+            from = p.next;
+        }
+        if (!p.last) res_.resumes++;
+    }
+}
+
+bool SnapshotReader::request(int32_t from) {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        pass_ = Pass();
+        pass_.next = from;
+    }
+    const uint16_t op = (uint16_t)proto::OpCode::SNAPSHOT;
+    bool submitted = rt_.submitStreamWith(op, proto::requestBodySize(op, opt_.name.size()),
+        [this, from](proto::Writer& w) {
+            proto::writeSnapshotRequest(w, opt_.name, opt_.password, from, opt_.to, opt_.maxChunks);
+        },
+        [this](const proto::MessageView& m) { return onChunk(m); },
+        [this](const Pipeline::Completion&) {
+            {
+                std::lock_guard<std::mutex> lock(mu_);
+                pass_.finished = true;
+            }
+            cv_.notify_all();
+        });
+    if (!submitted) return false;
+
+    std::unique_lock<std::mutex> lock(mu_);
+    cv_.wait(lock, [this] { return pass_.finished; });
+    return true;
+}
+
+bool SnapshotReader::onChunk(const proto::MessageView& m) {
+    namespace schema = proto::schema;
+    std::lock_guard<std::mutex> lock(mu_);
+    Pass& p = pass_;
+    p.status = m.h.status;
+    if (m.h.status != (uint16_t)proto::Status::OK) return true;
+
+    uint16_t chunk, flags, count;
+    int32_t next;
+    if (!schema::SnapshotChunk::read(m.body, m.bodyLen, chunk, flags, next, count) ||
+        m.bodyLen != proto::SNAPSHOT_CHUNK_HEADER + size_t(count) * proto::SNAPSHOT_ENTRY) {
+        p.bad = true;
+        return true;
+    }
+    res_.chunks++;
+    if (flags & proto::SNAPSHOT_LAST) p.sawLast = true;
+
+    if (chunk < p.expect || p.early.count(chunk)) {
+        res_.duplicates++;
+    } else if (chunk > p.expect) {
+        p.early.emplace(chunk, std::vector<uint8_t>(m.body, m.body + m.bodyLen));
+    } else {
+        deliver(m.body, m.bodyLen);
+        // Chunks that were waiting for this one
+        for (auto it = p.early.begin(); it != p.early.end() && it->first == p.expect; it = p.early.erase(it)) {
+            deliver(it->second.data(), it->second.size());
+        }
+    }
+    // The server sends a reply's chunks back to back: once the last one is
+    // in, a missing one is lost rather than late
+    return p.last || p.sawLast;
+}
+
+void SnapshotReader::deliver(const uint8_t* body, size_t len) {
+    namespace schema = proto::schema;
+    Pass& p = pass_;
+    uint16_t chunk = 0, flags = 0, count = 0;
+    int32_t next = 0;
+    schema::SnapshotChunk::read(body, len, chunk, flags, next, count);  // checked by onChunk()
+
+    const uint8_t* e = body + proto::SNAPSHOT_CHUNK_HEADER;
+    for (uint16_t i = 0; i < count; i++, e += proto::SNAPSHOT_ENTRY) {
+        Entry entry;
+        schema::SnapshotEntry::read(e, proto::SNAPSHOT_ENTRY, entry.accNo, entry.currency, entry.balance);
+        onEntry_(entry);
+    }
+    res_.entries += count;
+    p.next = next;
+    p.expect++;
+    if (flags & proto::SNAPSHOT_LAST) {
+        p.last = true;
+        p.end = (flags & proto::SNAPSHOT_END) != 0;
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "protocol.hpp"
+#include "runtime.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Streaming reader for SNAPSHOT (see protocol.hpp for the wire layout)
+ *
+ * Asks for one reply of up to Options::maxChunks chunks at a time and
+ * hands every entry to the caller as soon as its chunk is next in order,
+ * so a snapshot of any size costs at most one reply's worth of memory:
+ * only chunks that overtook a missing one are held back.
+ *
+ * A reply is over at its SNAPSHOT_LAST chunk, or once the stream stalls
+ * for a retransmission timeout. Every chunk carries the resume token of
+ * the accounts before it, so the next request starts from the last chunk
+ * delivered in order: after a complete reply that is where the server
+ * stopped, after a lost chunk it is the gap, and nothing is delivered
+ * twice. A request that gets no chunk at all is retransmitted by the
+ * Pipeline as usual, then counts against Options::attempts.
+ */
+class SnapshotReader {
+public:
+    struct Entry {
+        int32_t accNo;
+        uint16_t currency;
+        double balance;
+    };
+
+    // Called on a Runtime worker thread, in account order, while run() blocks
+    using EntryFn = std::function<void(const Entry&)>;
+
+    struct Options {
+        std::string name;       // holder; empty = every account (server --allow-scan)
+        std::string password;
+        int32_t from = 0;       // first account number, 0 = the first there is
+        int32_t to = 0;         // end of the range, exclusive; 0 = no end
+        uint16_t maxChunks = proto::SNAPSHOT_MAX_CHUNKS;  // per request
+        int attempts = 3;       // requests in a row without progress before giving up
+    };
+
+    struct Result {
+        bool ok = false;           // the whole range was read
+        uint16_t status = 0;       // server status when refused (proto::Status)
+        uint64_t entries = 0;
+        uint64_t chunks = 0;       // chunk datagrams received
+        uint64_t duplicates = 0;   // of those, already delivered or buffered
+        int requests = 0;
+        int resumes = 0;           // requests that restarted after a lost chunk
+        int32_t next = 0;          // resume token where reading stopped
+    };
+
+    SnapshotReader(Runtime& rt, const Options& opt, EntryFn onEntry);
+
+    /**
+     * Read the range to its end (must not be called from a completion
+     * callback or another Runtime worker)
+     */
+    Result run();
+
+private:
+    // State of one request, written by the worker while run() waits
+    struct Pass {
+        int32_t next = 0;          // resume token after the chunks delivered so far
+        uint16_t expect = 0;       // next chunk index to deliver
+        bool last = false;         // the SNAPSHOT_LAST chunk was delivered
+        bool end = false;          // ... with SNAPSHOT_END
+        bool sawLast = false;      // the SNAPSHOT_LAST chunk arrived (maybe early)
+        uint16_t status = 0;
+        bool bad = false;          // malformed chunk
+        bool finished = false;
+        std::map<uint16_t, std::vector<uint8_t>> early;  // chunk bodies that overtook a lost one
+    };
+
+    Runtime& rt_;
+    Options opt_;
+    EntryFn onEntry_;
+    Result res_;
+    Pass pass_;
+    std::mutex mu_;
+    std::condition_variable cv_;
+
+    // Handle one reply datagram; true if the request is over
+    bool onChunk(const proto::MessageView& m);
+
+    // Hand out the entries of the next chunk in order
+    void deliver(const uint8_t* body, size_t len);
+
+    // Send one request from the given token and wait for it to finish
+    bool request(int32_t from);
+};
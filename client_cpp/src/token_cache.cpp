@@ -0,0 +1,76 @@
+#include "token_cache.hpp"
+#include "protocol.hpp"
+#include "schema.hpp"
+#include <algorithm>
+
+TokenCache::TokenCache(std::chrono::milliseconds margin) : margin_(margin), supported_(true) {}
+
+uint64_t TokenCache::hashCredentials(const std::string& name, const std::string& password) {
+    // FNV-1a over "name\0password", as BalanceCache does
+    uint64_t h = 0xcbf29ce484222325ULL;
+    auto mix = [&h](unsigned char c) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    };
+    for (unsigned char c : name) mix(c);
+    mix(0);
+    for (unsigned char c : password) mix(c);
+    return h;
+}
+
+bool TokenCache::lookup(int32_t accNo, const std::string& name, const std::string& password, uint64_t& token) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(accNo);
+    if (it == entries_.end() || it->second.credentials != hashCredentials(name, password)) {
+        stats_.misses++;
+        return false;
+    }
+    if (Clock::now() >= it->second.usableUntil) {
+        entries_.erase(it);
+        stats_.misses++;
+        return false;
+    }
+    token = it->second.token;
+    stats_.hits++;
+    return true;
+}
+
+bool TokenCache::login(int32_t accNo, const std::string& name, const std::string& password, uint16_t status,
+                       const uint8_t* body, size_t len, Clock::time_point sent, uint64_t& token) {
+    uint16_t seconds;
+    if (status != (uint16_t)proto::Status::OK || !proto::schema::LoginReply::read(body, len, token, seconds)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry& e = entries_[accNo];
+    e.credentials = hashCredentials(name, password);
+    e.token = token;
+    // Short lifetimes keep at least half of it usable
+    const std::chrono::milliseconds life = std::chrono::seconds(seconds);
+    e.usableUntil = sent + life - std::min(margin_, life / 2);
+    stats_.logins++;
+    return true;
+}
+
+void TokenCache::erase(int32_t accNo) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.erase(accNo)) stats_.dropped++;
+}
+
+size_t TokenCache::probeSize() {
+    return proto::requestBodySize((uint16_t)proto::OpCode::LOGIN, 0);
+}
+
+void TokenCache::writeProbe(proto::Writer& w) {
+    proto::writeAuthRequest(w, std::string(), 0, std::string());
+}
+
+void TokenCache::probed(uint16_t status) {
+    if (status == (uint16_t)proto::Status::ERR_BAD_REQUEST) supported_.store(false, std::memory_order_relaxed);
+}
+
+TokenCache::Stats TokenCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
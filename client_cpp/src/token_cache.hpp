@@ -0,0 +1,101 @@
+#pragma once
+
+#include "protocol.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Client-side session tokens (proto::OpCode::LOGIN), one per account
+ *
+ * Each entry is the token the server issued for an account and, as in
+ * BalanceCache, a hash of the name/password pair that logged in; a lookup
+ * with other credentials misses, so a token never stands in for a caller
+ * the server would have refused.
+ *
+ * A token is used until `margin` (at most half the lifetime) before the
+ * lifetime the server granted, counted from when the LOGIN was sent, so a
+ * request does not set out just as its token runs out. One the server
+ * refuses anyway (ERR_AUTH: expired, or the server restarted) is dropped by
+ * the caller with erase(), which then logs in again or falls back to name
+ * and password.
+ *
+ * A cache serves one server, the only one a token is valid on. A LOGIN
+ * refused as a bad request falls back to name and password for that call
+ * only. Whether the server has session tokens at all (server_java and
+ * server_cpp with --token-ttl 0 do not) is told by a probe LOGIN that no
+ * server with tokens refuses for its arguments: callers send it once
+ * before the first LOGIN and hand the reply to probed(), which turns the
+ * cache off for this server if the opcode was rejected.
+ *
+ * Thread-safe: completions of different workers log in concurrently.
+ */
+class TokenCache {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t logins = 0;   // tokens issued or renewed
+        uint64_t dropped = 0;  // tokens dropped with erase()
+    };
+
+    /**
+     * @param margin Stop using a token this long before it expires
+     */
+    explicit TokenCache(std::chrono::milliseconds margin = std::chrono::seconds(5));
+
+    /**
+     * Token for the given credentials
+     * @return true on a hit that has not reached its margin
+     */
+    bool lookup(int32_t accNo, const std::string& name, const std::string& password, uint64_t& token);
+
+    /**
+     * Take in the reply to a LOGIN for these credentials
+     * @param sent When the LOGIN was submitted (the lifetime counts from there)
+     * @param body Reply body (status OK: token, seconds)
+     * @param token Output: the token, if one was issued
+     * @return true if the token was issued and cached
+     */
+    bool login(int32_t accNo, const std::string& name, const std::string& password, uint16_t status,
+               const uint8_t* body, size_t len, Clock::time_point sent, uint64_t& token);
+
+    // Drop an account's token (refused by the server, account closed)
+    void erase(int32_t accNo);
+
+    /**
+     * Body of the probe LOGIN: no name, account 0, no password, which a
+     * server with tokens answers NOT_FOUND like any unknown account
+     */
+    static size_t probeSize();
+    static void writeProbe(proto::Writer& w);
+
+    // Take in the status of the probe LOGIN (a bad request: no tokens here)
+    void probed(uint16_t status);
+
+    // False once the probe LOGIN has been rejected
+    bool supported() const { return supported_.load(std::memory_order_relaxed); }
+
+    Stats stats() const;
+
+private:
+    struct Entry {
+        uint64_t credentials;  // hash of name + password
+        uint64_t token;
+        Clock::time_point usableUntil;
+    };
+
+    mutable std::mutex mutex_;
+    std::chrono::milliseconds margin_;
+    std::unordered_map<int32_t, Entry> entries_;
+    std::atomic<bool> supported_;
+    Stats stats_;
+
+    static uint64_t hashCredentials(const std::string& name, const std::string& password);
+};
@@ -0,0 +1,138 @@
+#include "trace.hpp"
+#include "endian.hpp"
+#include <cstring>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace trace {
+
+static size_t padded(size_t len) { return (len + 7) & ~size_t(7); }
+
+// ==================== Writer ====================
+
+Writer::Writer() : file_(nullptr), records_(0) {}
+
+Writer::~Writer() { close(); }
+
+bool Writer::open(const std::string& path) {
+    close();
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) return false;
+    start_ = Clock::now();
+    buf_.reserve(2 * BUFFER);
+
+    uint8_t h[FILE_HEADER] = {};
+    proto::putBE32(h, MAGIC);
+    proto::putBE16(h + 4, VERSION);
+    auto unixUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    proto::putBE64(h + 8, uint64_t(unixUs));
+    return std::fwrite(h, 1, sizeof(h), file_) == sizeof(h);
+}
+
+void Writer::record(Dir dir, const uint8_t* data, size_t len) {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (!file_) return;
+    // Under the lock, so records from several workers land in time order
+    const uint64_t tUs = uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start_).count());
+
+    const size_t at = buf_.size();
+    buf_.resize(at + RECORD_HEADER + padded(len), 0);
+    uint8_t* p = buf_.data() + at;
+    proto::putBE64(p, tUs);
+    proto::putBE32(p + 8, uint32_t(len));
+    p[12] = uint8_t(dir);
+    std::memcpy(p + RECORD_HEADER, data, len);
+    records_++;
+    if (buf_.size() >= BUFFER) flushLocked();
+}
+
+void Writer::flushLocked() {
+    if (file_ && !buf_.empty()) {
+        std::fwrite(buf_.data(), 1, buf_.size(), file_);
+        std::fflush(file_);
+    }
+    buf_.clear();
+}
+
+void Writer::flush() {
+    std::lock_guard<std::mutex> lock(mu_);
+    flushLocked();
+}
+
+void Writer::close() {
+    std::lock_guard<std::mutex> lock(mu_);
+    flushLocked();
+    if (file_) std::fclose(file_);
+    file_ = nullptr;
+}
+
+// ==================== Reader ====================
+
+Reader::Reader() : base_(nullptr), size_(0), pos_(FILE_HEADER), startUnixUs_(0), mapped_(false) {}
+
+Reader::~Reader() { unmap(); }
+
+void Reader::unmap() {
+#ifndef _WIN32
+    if (mapped_) munmap(const_cast<uint8_t*>(base_), size_);
+#endif
+    mapped_ = false;
+    copy_.clear();
+    base_ = nullptr;
+    size_ = 0;
+}
+
+bool Reader::open(const std::string& path) {
+    unmap();
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            base_ = static_cast<const uint8_t*>(p);
+            size_ = size_t(st.st_size);
+            mapped_ = true;
+        }
+    }
+    ::close(fd);
+#endif
+    if (!mapped_) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return false;
+        copy_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        base_ = copy_.data();
+        size_ = copy_.size();
+    }
+
+    if (size_ < FILE_HEADER || proto::loadBE32(base_) != MAGIC || proto::loadBE16(base_ + 4) != VERSION) {
+        unmap();
+        return false;
+    }
+    startUnixUs_ = proto::loadBE64(base_ + 8);
+    pos_ = FILE_HEADER;
+    return true;
+}
+
+bool Reader::next(Record& r) {
+    if (pos_ + RECORD_HEADER > size_) return false;
+    const uint8_t* p = base_ + pos_;
+    const uint32_t len = proto::loadBE32(p + 8);
+    if (pos_ + RECORD_HEADER + len > size_) return false;
+    r.tUs = proto::loadBE64(p);
+    r.dir = Dir(p[12]);
+    r.data = p + RECORD_HEADER;
+    r.len = len;
+    pos_ += RECORD_HEADER + padded(len);
+    return true;
+}
+
+} // namespace trace
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Binary trace of the datagrams a client exchanged with its servers
+ *
+ * File layout (all integers big-endian, like the wire protocol):
+ *   header   magic:u32 "BKTR", version:u16, reserved:u16, startUnixUs:u64
+ *   record*  tUs:u64, len:u32, dir:u8, reserved:u8[3], datagram[len],
+ *            zero padding to a multiple of 8 bytes
+ *
+ * tUs counts steady-clock microseconds from the start of the capture and
+ * never decreases along the file (it is read under the writer's lock); the
+ * datagram is the encoded message exactly as sent or received, so the
+ * proto::Header fields and the body come back with proto::parse(). Records
+ * are 8-byte aligned and self-delimiting, so a mapped file is read in
+ * place, and a tail cut short by a crash is simply where reading stops.
+ *
+ * Retransmissions are recorded like any other send: they share the
+ * requestId of the first transmission.
+ */
+namespace trace {
+
+static constexpr uint32_t MAGIC = 0x424B5452;  // "BKTR"
+static constexpr uint16_t VERSION = 1;
+static constexpr size_t FILE_HEADER = 16;
+static constexpr size_t RECORD_HEADER = 16;
+
+enum class Dir : uint8_t {
+    Sent = 0,      // request datagram handed to the kernel
+    Reply = 1,     // reply received
+    Callback = 2,  // any other message received (CALLBACK_UPDATE, ...)
+};
+
+/**
+ * Append-only trace file shared by every Pipeline of a process
+ *
+ * Records are staged in a buffer under a mutex and written out in
+ * BUFFER-sized chunks, so capturing costs a copy per datagram and a
+ * write call per chunk.
+ */
+class Writer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t BUFFER = 1 << 16;
+
+    Writer();
+    ~Writer();
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    /**
+     * Create (truncate) the trace file and write its header
+     * @return false if the file cannot be created
+     */
+    bool open(const std::string& path);
+
+    // Append one datagram; thread-safe
+    void record(Dir dir, const uint8_t* data, size_t len);
+
+    // Write out staged records (also done when the buffer fills and on close())
+    void flush();
+    void close();
+
+    uint64_t records() const { return records_; }
+
+private:
+    std::mutex mu_;
+    FILE* file_;
+    Clock::time_point start_;
+    std::vector<uint8_t> buf_;
+    uint64_t records_;
+
+    void flushLocked();
+};
+
+/**
+ * One record as read back; data points into the mapped file
+ */
+struct Record {
+    uint64_t tUs;
+    Dir dir;
+    const uint8_t* data;
+    uint32_t len;
+};
+
+/**
+ * Read-only view of a trace file (mmap, or read into memory on Windows)
+ */
+class Reader {
+public:
+    Reader();
+    ~Reader();
+
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    /**
+     * Map the file and check its header
+     * @return false if it cannot be read or is not a trace
+     */
+    bool open(const std::string& path);
+
+    /**
+     * Next record in file order
+     * @return false at the end (or at a truncated record)
+     */
+    bool next(Record& r);
+
+    // Back to the first record
+    void rewind() { pos_ = FILE_HEADER; }
+
+    uint64_t startUnixUs() const { return startUnixUs_; }
+    size_t size() const { return size_; }
+
+private:
+    const uint8_t* base_;
+    size_t size_;
+    size_t pos_;
+    uint64_t startUnixUs_;
+    std::vector<uint8_t> copy_;  // fallback when the file is not mapped
+    bool mapped_;
+
+    void unmap();
+};
+
+} // namespace trace
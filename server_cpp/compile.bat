@@ -0,0 +1,97 @@
+@echo off
+REM Compile script for C++ Banking Server
+REM Usage: compile.bat
+REM Requires: MinGW-w64 or MSVC with cl.exe in PATH
+
+echo ========================================
+echo   Compiling C++ Banking Server
+echo ========================================
+echo.
+
+if not exist "out" mkdir out
+
+REM Protocol and socket layer are shared with the C++ client
+set PROTO=..\client_cpp\src
+set SOURCES=src\account_store.cpp src\dedup_cache.cpp src\monitor_hub.cpp src\seq_window.cpp src\wal.cpp src\persistence.cpp src\server.cpp src\main.cpp %PROTO%\protocol.cpp %PROTO%\endian.cpp %PROTO%\net.cpp %PROTO%\compact.cpp %PROTO%\lz.cpp
+REM The benchmark embeds the server and drives it through the client runtime
+set BENCH=src\account_store.cpp src\dedup_cache.cpp src\monitor_hub.cpp src\seq_window.cpp src\wal.cpp src\persistence.cpp src\server.cpp src\bench_e2e.cpp %PROTO%\protocol.cpp %PROTO%\endian.cpp %PROTO%\net.cpp %PROTO%\compact.cpp %PROTO%\lz.cpp %PROTO%\metrics.cpp %PROTO%\rto.cpp %PROTO%\ring.cpp %PROTO%\flow.cpp %PROTO%\impair.cpp %PROTO%\trace.cpp %PROTO%\pipeline.cpp %PROTO%\batcher.cpp %PROTO%\runtime.cpp
+
+REM Try g++ first (MinGW)
+echo Checking for g++ compiler...
+g++ --version >nul 2>&1
+if %errorlevel% equ 0 (
+    echo Found g++ compiler
+    echo Compiling with g++...
+    g++ -std=c++17 -O2 -pthread -I%PROTO% -o out\server.exe %SOURCES% -lws2_32 -lbcrypt
+    if errorlevel 1 goto failed
+    g++ -std=c++17 -O2 -pthread -I%PROTO% -o out\bench_e2e.exe %BENCH% -lws2_32 -lbcrypt -lpsapi
+    if errorlevel 1 goto failed
+    goto success
+)
+
+REM Try cl.exe (MSVC)
+echo Checking for cl.exe compiler...
+cl >nul 2>&1
+if %errorlevel% equ 0 (
+    echo Found cl.exe compiler
+    echo Compiling with cl.exe...
+    cl /EHsc /O2 /std:c++17 /I%PROTO% /Fe:out\server.exe %SOURCES% ws2_32.lib bcrypt.lib
+    if errorlevel 1 goto failed
+    cl /EHsc /O2 /std:c++17 /I%PROTO% /Fe:out\bench_e2e.exe %BENCH% ws2_32.lib bcrypt.lib psapi.lib
+    if errorlevel 1 goto failed
+    goto success
+)
+
+echo.
+echo ERROR: No suitable compiler found!
+echo.
+echo Please install one of the following:
+echo   1. MinGW-w64 - Add the bin directory to your PATH
+echo   2. Visual Studio - Run this from a Developer Command Prompt
+echo.
+exit /b 1
+
+:failed
+echo.
+echo ERROR: Compilation failed!
+echo Please check the error messages above.
+exit /b 1
+
+:success
+echo.
+echo ========================================
+echo   Compilation successful!
+echo ========================================
+echo.
+echo Executables created: out\server.exe, out\bench_e2e.exe
+echo.
+echo To run the server:
+echo   run.bat --port 9000 --threads 8
+echo.
+echo Options:
+echo   --port ^<port^>      Server port (default: 9000)
+echo   --lossReq ^<prob^>   Request loss probability 0.0-1.0 (default: 0.0)
+echo   --lossRep ^<prob^>   Reply loss probability 0.0-1.0 (default: 0.0)
+echo   --threads ^<n^>      Worker threads (default: one per hardware thread)
+echo   --shards ^<n^>       Account store shards (default: 64)
+echo   --verbose          Log every request
+echo   --stats ^<s^>        Print request rate every s seconds
+echo   --shared-socket    Workers share one socket instead of one each
+echo   --pin              Pin worker i to CPU i
+echo   --batch ^<n^>        Datagrams per receive call (default: 32, max 64)
+echo   --dedup-mb ^<mb^>    Reply cache memory in MB (default: 64)
+echo   --dedup-ttl ^<s^>    Reply cache entry lifetime in seconds (default: 60)
+echo   --window-mb ^<mb^>   Sequenced-client window memory in MB (default: 16)
+echo   --data ^<dir^>       Keep accounts in a write-ahead log and snapshots
+echo   --snapshot ^<s^>     Snapshot interval in seconds (default: 60, 0 = never)
+echo   --no-fsync         Write the log without fsync
+echo   --callback-linger ^<us^> Callback coalescing window (default: 1000, 0 = off)
+echo   --allow-scan       SNAPSHOT without a name lists every account
+echo   --token-ttl ^<s^>    LOGIN session token lifetime (default: 300, 0 = no LOGIN)
+echo.
+echo To run the end-to-end benchmark against a baseline:
+echo   out\bench_e2e.exe --suite e2e,impair --duration 5 --baseline baseline.tsv --out results.tsv
+echo.
+echo To soak the server under mixed load, monitors and client churn:
+echo   out\bench_e2e.exe --suite soak --soak 600 --sample 10 --soak-out soak.tsv
+echo.
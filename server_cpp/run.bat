@@ -0,0 +1,18 @@
+@echo off
+REM Run script for C++ Banking Server
+REM Usage: run.bat [options]
+REM Options: --port <port> --lossReq <prob> --lossRep <prob> --threads <n>
+
+if not exist "out\server.exe" (
+    echo ERROR: Executable not found!
+    echo Please compile first by running: compile.bat
+    echo.
+    exit /b 1
+)
+
+echo ========================================
+echo   Starting C++ Banking Server
+echo ========================================
+echo.
+
+out\server.exe %*
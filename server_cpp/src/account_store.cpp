@@ -0,0 +1,297 @@
+#include "account_store.hpp"
+#include <cstring>
+
+AccountStore::AccountStore(size_t shards, int node)
+    : chunks_(new std::atomic<Chunk*>[MAX_CHUNKS]), first_(proto::FIRST_ACCOUNT + node * proto::NODE_ACCOUNTS),
+      nextAccountNo_(first_), log_(nullptr) {
+    size_t n = 1;
+    while (n < shards) n <<= 1;
+    stripes_.reset(new Stripe[n]);
+    mask_ = n - 1;
+    for (size_t i = 0; i < MAX_CHUNKS; i++) chunks_[i].store(nullptr, std::memory_order_relaxed);
+}
+
+AccountStore::~AccountStore() {
+    for (size_t i = 0; i < MAX_CHUNKS; i++) delete chunks_[i].load(std::memory_order_relaxed);
+}
+
+size_t AccountStore::accountCount() const {
+    return size_t(nextAccountNo_.load(std::memory_order_relaxed) - first_);
+}
+
+bool AccountStore::locate(int32_t accNo, Chunk*& chunk, size_t& index) const {
+    if (accNo < first_ || accNo >= nextAccountNo_.load(std::memory_order_acquire)) return false;
+    index = size_t(accNo - first_);
+    chunk = chunks_[index >> CHUNK_BITS].load(std::memory_order_acquire);
+    return chunk != nullptr;
+}
+
+AccountStore::Chunk* AccountStore::chunkFor(size_t index) {
+    std::atomic<Chunk*>& slot = chunks_[index >> CHUNK_BITS];
+    Chunk* c = slot.load(std::memory_order_acquire);
+    if (c) return c;
+    std::lock_guard<std::mutex> lock(growMutex_);
+    c = slot.load(std::memory_order_relaxed);
+    if (!c) {
+        c = new Chunk();  // value-initialised: every state UNUSED
+        slot.store(c, std::memory_order_release);
+    }
+    return c;
+}
+
+AccountStore::Status AccountStore::check(const Chunk& c, size_t k, const Auth& who) {
+    if (c.state[k] != OPEN) return Status::ERR_NOT_FOUND;
+    if (who.session) {
+        // Expiry compared as a difference, so the clock may wrap
+        if (who.session->token == 0 || c.token[k] != who.session->token ||
+            int32_t(c.tokenExpires[k] - who.session->now) <= 0) {
+            return Status::ERR_AUTH;
+        }
+        return Status::OK;
+    }
+    if (c.name[k] != who.name || std::string_view(c.password[k], c.passwordLen[k]) != who.password) {
+        return Status::ERR_AUTH;
+    }
+    return Status::OK;
+}
+
+AccountStore::Status AccountStore::open(std::string_view name, std::string_view password,
+                                        uint16_t currency, double initialBalance, int32_t& accNo) {
+    if (password.empty() || password.size() > 16) return Status::ERR_PASSWORD_FORMAT;
+    if (initialBalance < 0) return Status::ERR_BAD_REQUEST;
+    if (!wal::openFits(name, password)) return Status::ERR_BAD_REQUEST;  // could not be logged
+
+    // Take a number only while one is left, so a full table stays full
+    // instead of burning a number on every OPEN it rejects
+    accNo = nextAccountNo_.load(std::memory_order_relaxed);
+    do {
+        if (size_t(accNo - first_) >= CAPACITY) return Status::ERR_BAD_REQUEST;  // table full
+    } while (!nextAccountNo_.compare_exchange_weak(accNo, accNo + 1, std::memory_order_relaxed));
+    size_t index = size_t(accNo - first_);
+    Chunk* c = chunkFor(index);
+    size_t k = index & (CHUNK - 1);
+
+    std::lock_guard<std::mutex> lock(stripes_[stripeOf(index)].mutex);
+    c->name[k].assign(name.data(), name.size());
+    std::memcpy(c->password[k], password.data(), password.size());
+    c->passwordLen[k] = uint8_t(password.size());
+    c->currency[k] = currency;
+    c->balance[k] = initialBalance;
+    c->state[k] = OPEN;
+    if (log_) log_->logOpen(accNo, name, password, currency, initialBalance);
+    return Status::OK;
+}
+
+AccountStore::Status AccountStore::close(std::string_view name, int32_t accNo, std::string_view password,
+                                         uint16_t& currency, double& balance) {
+    Chunk* c;
+    size_t index;
+    if (!locate(accNo, c, index)) return Status::ERR_NOT_FOUND;
+    size_t k = index & (CHUNK - 1);
+    std::lock_guard<std::mutex> lock(stripes_[stripeOf(index)].mutex);
+    Status st = check(*c, k, Auth{name, password, nullptr});
+    if (st != Status::OK) return st;
+    c->state[k] = CLOSED;
+    c->token[k] = 0;
+    currency = c->currency[k];
+    balance = c->balance[k];
+    if (log_) log_->logClose(accNo);
+    return Status::OK;
+}
+
+AccountStore::Status AccountStore::deposit(std::string_view name, int32_t accNo, std::string_view password,
+                                           uint16_t currency, double amount, double& newBalance) {
+    return deposit(Auth{name, password, nullptr}, accNo, currency, amount, newBalance);
+}
+
+AccountStore::Status AccountStore::deposit(const Session& s, int32_t accNo, uint16_t currency, double amount,
+                                           double& newBalance) {
+    return deposit(Auth{{}, {}, &s}, accNo, currency, amount, newBalance);
+}
+
+AccountStore::Status AccountStore::deposit(const Auth& who, int32_t accNo, uint16_t currency, double amount,
+                                           double& newBalance) {
+    Chunk* c;
+    size_t index;
+    if (!locate(accNo, c, index)) return Status::ERR_NOT_FOUND;
+    size_t k = index & (CHUNK - 1);
+    std::lock_guard<std::mutex> lock(stripes_[stripeOf(index)].mutex);
+    Status st = check(*c, k, who);
+    if (st != Status::OK) return st;
+    if (c->currency[k] != currency) return Status::ERR_CURRENCY;
+    if (amount <= 0) return Status::ERR_BAD_REQUEST;
+    c->balance[k] += amount;
+    newBalance = c->balance[k];
+    if (log_) log_->logBalance(wal::RecordType::Deposit, accNo, newBalance);
+    return Status::OK;
+}
+
+AccountStore::Status AccountStore::withdraw(std::string_view name, int32_t accNo, std::string_view password,
+                                            uint16_t currency, double amount, double& newBalance) {
+    return withdraw(Auth{name, password, nullptr}, accNo, currency, amount, newBalance);
+}
+
+AccountStore::Status AccountStore::withdraw(const Session& s, int32_t accNo, uint16_t currency, double amount,
+                                            double& newBalance) {
+    return withdraw(Auth{{}, {}, &s}, accNo, currency, amount, newBalance);
+}
+
+AccountStore::Status AccountStore::withdraw(const Auth& who, int32_t accNo, uint16_t currency, double amount,
+                                            double& newBalance) {
+    Chunk* c;
+    size_t index;
+    if (!locate(accNo, c, index)) return Status::ERR_NOT_FOUND;
+    size_t k = index & (CHUNK - 1);
+    std::lock_guard<std::mutex> lock(stripes_[stripeOf(index)].mutex);
+    Status st = check(*c, k, who);
+    if (st != Status::OK) return st;
+    if (c->currency[k] != currency) return Status::ERR_CURRENCY;
+    if (amount <= 0) return Status::ERR_BAD_REQUEST;
+    if (c->balance[k] < amount) return Status::ERR_INSUFFICIENT_FUNDS;
+    c->balance[k] -= amount;
+    newBalance = c->balance[k];
+    if (log_) log_->logBalance(wal::RecordType::Withdraw, accNo, newBalance);
+    return Status::OK;
+}
+
+AccountStore::Status AccountStore::query(std::string_view name, int32_t accNo, std::string_view password,
+                                         uint16_t& currency, double& balance) {
+    return query(Auth{name, password, nullptr}, accNo, currency, balance);
+}
+
+AccountStore::Status AccountStore::query(const Session& s, int32_t accNo, uint16_t& currency, double& balance) {
+    return query(Auth{{}, {}, &s}, accNo, currency, balance);
+}
+
+AccountStore::Status AccountStore::query(const Auth& who, int32_t accNo, uint16_t& currency, double& balance) {
+    Chunk* c;
+    size_t index;
+    if (!locate(accNo, c, index)) return Status::ERR_NOT_FOUND;
+    size_t k = index & (CHUNK - 1);
+    std::lock_guard<std::mutex> lock(stripes_[stripeOf(index)].mutex);
+    Status st = check(*c, k, who);
+    if (st != Status::OK) return st;
+    currency = c->currency[k];
+    balance = c->balance[k];
+    return Status::OK;
+}
+
+AccountStore::Status AccountStore::transfer(std::string_view name, int32_t fromAccNo, std::string_view password,
+                                            int32_t toAccNo, uint16_t currency, double amount,
+                                            double& fromBalance, double& toBalance) {
+    return transfer(Auth{name, password, nullptr}, fromAccNo, toAccNo, currency, amount, fromBalance, toBalance);
+}
+
+AccountStore::Status AccountStore::transfer(const Session& s, int32_t fromAccNo, int32_t toAccNo, uint16_t currency,
+                                            double amount, double& fromBalance, double& toBalance) {
+    return transfer(Auth{{}, {}, &s}, fromAccNo, toAccNo, currency, amount, fromBalance, toBalance);
+}
+
+AccountStore::Status AccountStore::transfer(const Auth& who, int32_t fromAccNo, int32_t toAccNo, uint16_t currency,
+                                            double amount, double& fromBalance, double& toBalance) {
+    if (fromAccNo == toAccNo) return Status::ERR_BAD_REQUEST;
+
+    Chunk* src;
+    Chunk* dst;
+    size_t fromIndex, toIndex;
+    if (!locate(fromAccNo, src, fromIndex) || !locate(toAccNo, dst, toIndex)) return Status::ERR_NOT_FOUND;
+    size_t f = fromIndex & (CHUNK - 1);
+    size_t t = toIndex & (CHUNK - 1);
+
+    // Lower stripe index first: a fixed global order rules out deadlock
+    size_t fromStripe = stripeOf(fromIndex);
+    size_t toStripe = stripeOf(toIndex);
+    size_t first = fromStripe < toStripe ? fromStripe : toStripe;
+    size_t second = fromStripe < toStripe ? toStripe : fromStripe;
+    std::unique_lock<std::mutex> lockFirst(stripes_[first].mutex);
+    std::unique_lock<std::mutex> lockSecond;
+    if (second != first) lockSecond = std::unique_lock<std::mutex>(stripes_[second].mutex);
+
+    if (src->state[f] != OPEN || dst->state[t] != OPEN) return Status::ERR_NOT_FOUND;
+    Status st = check(*src, f, who);
+    if (st != Status::OK) return st;
+    if (src->currency[f] != currency || dst->currency[t] != currency) return Status::ERR_CURRENCY;
+    if (amount <= 0) return Status::ERR_BAD_REQUEST;
+    if (src->balance[f] < amount) return Status::ERR_INSUFFICIENT_FUNDS;
+
+    src->balance[f] -= amount;
+    dst->balance[t] += amount;
+    fromBalance = src->balance[f];
+    toBalance = dst->balance[t];
+    if (log_) log_->logTransfer(fromAccNo, fromBalance, toAccNo, toBalance);
+    return Status::OK;
+}
+
+// ==================== Session tokens ====================
+
+AccountStore::Status AccountStore::login(std::string_view name, int32_t accNo, std::string_view password,
+                                         uint64_t fresh, uint32_t now, uint32_t ttl, uint64_t& token) {
+    Chunk* c;
+    size_t index;
+    if (!locate(accNo, c, index)) return Status::ERR_NOT_FOUND;
+    size_t k = index & (CHUNK - 1);
+    std::lock_guard<std::mutex> lock(stripes_[stripeOf(index)].mutex);
+    Status st = check(*c, k, Auth{name, password, nullptr});
+    if (st != Status::OK) return st;
+    if (c->token[k] == 0 || int32_t(c->tokenExpires[k] - now) <= 0) c->token[k] = fresh;
+    c->tokenExpires[k] = now + ttl;
+    token = c->token[k];
+    return Status::OK;
+}
+
+// ==================== Recovery ====================
+
+void AccountStore::reserve(size_t accounts) {
+    for (size_t index = 0; index < std::min(accounts, CAPACITY); index += CHUNK) {
+        chunkFor(index);
+    }
+}
+
+bool AccountStore::restore(int32_t accNo, std::string_view name, std::string_view password,
+                           uint16_t currency, double balance, bool closed) {
+    if (accNo < first_ || size_t(accNo - first_) >= CAPACITY) return false;
+    if (password.size() > 16) return true;  // never written by open()
+    size_t index = size_t(accNo - first_);
+    Chunk* c = chunkFor(index);
+    size_t k = index & (CHUNK - 1);
+    {
+        std::lock_guard<std::mutex> lock(stripes_[stripeOf(index)].mutex);
+        c->name[k].assign(name.data(), name.size());
+        std::memcpy(c->password[k], password.data(), password.size());
+        c->passwordLen[k] = uint8_t(password.size());
+        c->currency[k] = currency;
+        c->balance[k] = balance;
+        c->state[k] = closed ? CLOSED : OPEN;
+    }
+    restoreNextAccountNo(accNo + 1);
+    return true;
+}
+
+void AccountStore::restoreNextAccountNo(int32_t next) {
+    if (next < first_ || size_t(next - first_) > CAPACITY) return;  // another node's range
+    int32_t cur = nextAccountNo_.load(std::memory_order_relaxed);
+    while (next > cur && !nextAccountNo_.compare_exchange_weak(cur, next)) {
+    }
+}
+
+bool AccountStore::restoreBalance(int32_t accNo, double balance) {
+    Chunk* c;
+    size_t index;
+    if (!locate(accNo, c, index)) return false;
+    size_t k = index & (CHUNK - 1);
+    std::lock_guard<std::mutex> lock(stripes_[stripeOf(index)].mutex);
+    if (c->state[k] == UNUSED) return false;
+    c->balance[k] = balance;
+    return true;
+}
+
+bool AccountStore::restoreClosed(int32_t accNo) {
+    Chunk* c;
+    size_t index;
+    if (!locate(accNo, c, index)) return false;
+    size_t k = index & (CHUNK - 1);
+    std::lock_guard<std::mutex> lock(stripes_[stripeOf(index)].mutex);
+    if (c->state[k] == UNUSED) return false;
+    c->state[k] = CLOSED;
+    return true;
+}
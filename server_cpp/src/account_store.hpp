@@ -0,0 +1,265 @@
+#pragma once
+
+#include "protocol.hpp"
+#include "wal.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+/**
+ * Account table laid out as dense arrays indexed by account number
+ *
+ * Account numbers are handed out sequentially from the first number of
+ * the server's node (proto::FIRST_ACCOUNT + node * proto::NODE_ACCOUNTS),
+ * so account n lives at index n - firstAccount() and a lookup is a bounds
+ * check and an array access, with no hashing and no pointer per account.
+ * Storage grows in chunks of CHUNK accounts that never move once
+ * allocated. Inside a chunk every field has its own array:
+ * - hot (balance, currency, state) in separate cache-aligned arrays, so an
+ *   operation touches one line of each and a scan over balances, as in an
+ *   audit or a snapshot, streams through memory
+ * - cold (name, password) in arrays of their own, read only to
+ *   authenticate
+ * - the session token of each account (LOGIN) and its expiry, next to
+ *   each other: an operation with a token compares one integer instead
+ *   of a name and a password
+ *
+ * Locks are striped over groups of LINE consecutive accounts, the number
+ * of balances in one cache line, so two threads updating neighbouring
+ * accounts either share a lock or do not share a line. TRANSFER locks the
+ * two stripes in ascending index, so two opposite transfers can never
+ * wait on each other; accounts on one stripe take that lock once.
+ *
+ * Validation order and status codes follow server_java/src/Bank.java
+ * exactly.
+ *
+ * With a wal::Log attached every applied change is appended to it under
+ * the same stripe lock(s), so the log order of an account matches the
+ * order its changes took effect. Session tokens are not logged: after a
+ * restart every account has none until its holder logs in again.
+ */
+class AccountStore {
+public:
+    using Status = proto::Status;
+
+    static constexpr int CHUNK_BITS = 12;
+    static constexpr size_t CHUNK = size_t(1) << CHUNK_BITS;  // accounts per chunk
+    static constexpr size_t CAPACITY = proto::NODE_ACCOUNTS;  // accounts, one node's range
+    static constexpr size_t MAX_CHUNKS = (CAPACITY + CHUNK - 1) >> CHUNK_BITS;
+    static constexpr size_t LINE = 64 / sizeof(double);       // accounts per lock stripe unit
+
+    // Session token standing in for an account's name and password (LOGIN)
+    struct Session {
+        uint64_t token;
+        uint32_t now;  // current time in seconds, on the clock given to login()
+    };
+
+    // One account as seen by forEach()
+    struct AccountView {
+        int32_t accNo;
+        std::string_view name;
+        std::string_view password;
+        uint16_t currency;
+        double balance;
+        bool closed;
+    };
+
+    /**
+     * @param shards Number of lock stripes, rounded up to a power of two
+     * @param node Account number range, 0..proto::MAX_NODES-1
+     */
+    explicit AccountStore(size_t shards = 64, int node = 0);
+    ~AccountStore();
+
+    AccountStore(const AccountStore&) = delete;
+    AccountStore& operator=(const AccountStore&) = delete;
+
+    /**
+     * Open an account
+     * @param accNo Output: new account number
+     */
+    Status open(std::string_view name, std::string_view password, uint16_t currency,
+                double initialBalance, int32_t& accNo);
+
+    /**
+     * Close an account
+     * @param currency Output: currency of the closed account
+     * @param balance Output: balance at closing
+     */
+    Status close(std::string_view name, int32_t accNo, std::string_view password,
+                 uint16_t& currency, double& balance);
+
+    Status deposit(std::string_view name, int32_t accNo, std::string_view password,
+                   uint16_t currency, double amount, double& newBalance);
+
+    Status withdraw(std::string_view name, int32_t accNo, std::string_view password,
+                    uint16_t currency, double amount, double& newBalance);
+
+    Status query(std::string_view name, int32_t accNo, std::string_view password,
+                 uint16_t& currency, double& balance);
+
+    Status transfer(std::string_view name, int32_t fromAccNo, std::string_view password,
+                    int32_t toAccNo, uint16_t currency, double amount,
+                    double& fromBalance, double& toBalance);
+
+    // ==================== Session tokens ====================
+
+    /**
+     * Authenticate once for a session token (LOGIN)
+     * @param fresh Token to issue if the account has no valid one (random, nonzero)
+     * @param now Current time in seconds, any epoch as long as every call uses the same
+     * @param ttl Lifetime from now in seconds; a token still valid is kept and renewed
+     * @param token Output: the account's token
+     */
+    Status login(std::string_view name, int32_t accNo, std::string_view password, uint64_t fresh,
+                 uint32_t now, uint32_t ttl, uint64_t& token);
+
+    // The operations above with a token of the account instead of name and password
+    Status deposit(const Session& s, int32_t accNo, uint16_t currency, double amount, double& newBalance);
+    Status withdraw(const Session& s, int32_t accNo, uint16_t currency, double amount, double& newBalance);
+    Status query(const Session& s, int32_t accNo, uint16_t& currency, double& balance);
+    Status transfer(const Session& s, int32_t fromAccNo, int32_t toAccNo, uint16_t currency, double amount,
+                    double& fromBalance, double& toBalance);
+
+    size_t shardCount() const { return mask_ + 1; }
+    int32_t firstAccount() const { return first_; }
+
+    // Accounts opened so far (including closed ones)
+    size_t accountCount() const;
+
+    // ==================== Persistence ====================
+
+    // Log every applied change from now on (nullptr = memory only)
+    void setLog(wal::Log* log) { log_ = log; }
+
+    // Recovery from a snapshot and the log, before serving
+    void reserve(size_t accounts);
+    // false if accNo is outside this node's range (the data of another node)
+    bool restore(int32_t accNo, std::string_view name, std::string_view password, uint16_t currency,
+                 double balance, bool closed);
+    bool restoreBalance(int32_t accNo, double balance);
+    bool restoreClosed(int32_t accNo);
+    void restoreNextAccountNo(int32_t next);  // raises only, within this node's range
+
+    // Number the next OPEN will get; never below anything restored
+    int32_t nextAccountNo() const { return nextAccountNo_.load(std::memory_order_relaxed); }
+
+    /**
+     * Call f(const AccountView&) for every account in number order, holding
+     * one stripe lock per LINE accounts (see Persistence::snapshot)
+     */
+    template <class F>
+    void forEach(F&& f) {
+        const size_t n = accountCount();
+        for (size_t base = 0; base < n; base += LINE) {
+            Chunk* c = chunks_[base >> CHUNK_BITS].load(std::memory_order_acquire);
+            if (!c) continue;
+            std::lock_guard<std::mutex> lock(stripes_[stripeOf(base)].mutex);
+            for (size_t i = base; i < std::min(base + LINE, n); i++) {
+                size_t k = i & (CHUNK - 1);
+                if (c->state[k] == UNUSED) continue;
+                f(AccountView{int32_t(i) + first_, c->name[k],
+                              std::string_view(c->password[k], c->passwordLen[k]), c->currency[k],
+                              c->balance[k], c->state[k] == CLOSED});
+            }
+        }
+    }
+
+    /**
+     * Call f(const AccountView&) for the accounts from..to-1 in number
+     * order, like forEach(), until f returns false (SNAPSHOT)
+     * @param to End of the range, exclusive; 0 = every account opened so far
+     * @param next Output: first account number not visited (the one f
+     *             declined, or the end of the range)
+     * @return true if the range was exhausted
+     */
+    template <class F>
+    bool scan(int32_t from, int32_t to, F&& f, int32_t& next) {
+        const size_t n = accountCount();
+        size_t end = n;
+        if (to != 0) end = to > first_ ? std::min(n, size_t(to - first_)) : 0;
+        size_t i = from > first_ ? size_t(from - first_) : 0;
+        while (i < end) {
+            const size_t lineEnd = std::min((i / LINE + 1) * LINE, end);
+            Chunk* c = chunks_[i >> CHUNK_BITS].load(std::memory_order_acquire);
+            if (!c) {
+                i = lineEnd;
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(stripes_[stripeOf(i)].mutex);
+            for (; i < lineEnd; i++) {
+                size_t k = i & (CHUNK - 1);
+                if (c->state[k] == UNUSED) continue;
+                if (!f(AccountView{int32_t(i) + first_, c->name[k],
+                                   std::string_view(c->password[k], c->passwordLen[k]), c->currency[k],
+                                   c->balance[k], c->state[k] == CLOSED})) {
+                    next = int32_t(i) + first_;
+                    return false;
+                }
+            }
+        }
+        next = int32_t(std::max(i, end)) + first_;
+        return true;
+    }
+
+private:
+    enum State : uint8_t { UNUSED = 0, OPEN = 1, CLOSED = 2 };
+
+    struct Chunk {
+        // Hot
+        alignas(64) double balance[CHUNK];
+        alignas(64) uint16_t currency[CHUNK];
+        alignas(64) uint8_t state[CHUNK];
+        // Cold
+        alignas(64) char password[CHUNK][16];
+        uint8_t passwordLen[CHUNK];
+        std::string name[CHUNK];
+        // Sessions: token 0 = none
+        alignas(64) uint64_t token[CHUNK];
+        uint32_t tokenExpires[CHUNK];
+    };
+
+    // Who acts on an account: its name and password, or a session
+    struct Auth {
+        std::string_view name;
+        std::string_view password;
+        const Session* session;  // nullptr = name and password
+    };
+
+    // One cache line per lock so neighbouring stripes do not false-share
+    struct alignas(64) Stripe {
+        std::mutex mutex;
+    };
+
+    std::unique_ptr<Stripe[]> stripes_;
+    size_t mask_;
+    std::unique_ptr<std::atomic<Chunk*>[]> chunks_;
+    std::mutex growMutex_;
+    const int32_t first_;
+    std::atomic<int32_t> nextAccountNo_;
+    wal::Log* log_;
+
+    size_t stripeOf(size_t index) const { return (index / LINE) & mask_; }
+
+    /**
+     * Array position of an account number that has been handed out
+     * @return false if it never was (its storage may not exist)
+     */
+    bool locate(int32_t accNo, Chunk*& chunk, size_t& index) const;
+
+    // Chunk holding index, allocated on first use
+    Chunk* chunkFor(size_t index);
+
+    // Open, authenticated account at a locked position, or the status to return
+    static Status check(const Chunk& c, size_t k, const Auth& who);
+
+    Status deposit(const Auth& who, int32_t accNo, uint16_t currency, double amount, double& newBalance);
+    Status withdraw(const Auth& who, int32_t accNo, uint16_t currency, double amount, double& newBalance);
+    Status query(const Auth& who, int32_t accNo, uint16_t& currency, double& balance);
+    Status transfer(const Auth& who, int32_t fromAccNo, int32_t toAccNo, uint16_t currency, double amount,
+                    double& fromBalance, double& toBalance);
+};
@@ -0,0 +1,868 @@
+#include "log.hpp"
+#include "net.hpp"
+#include "protocol.hpp"
+#include "runtime.hpp"
+#include "schema.hpp"
+#include "server.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#endif
+
+/**
+ * End-to-end benchmark and soak harness
+ *
+ * Runs a Server in this process on a loopback port and drives it through
+ * the client Runtime, over real UDP sockets, one scenario at a time (a
+ * fresh Runtime each, so their metrics do not mix). Accounts are opened
+ * and logged in once, before the first scenario.
+ *
+ * Usage:
+ *   bench_e2e.exe --suite e2e,impair --duration 5 --out results.tsv
+ *   bench_e2e.exe --baseline baseline.tsv --max-slowdown 15 --max-p99 30
+ *   bench_e2e.exe --suite soak --soak 600 --sample 10 --soak-out soak.tsv
+ *
+ * Suites:
+ *   e2e     One closed-loop run per operation (OPEN, DEPOSIT, WITHDRAW,
+ *           QUERY_BALANCE, TRANSFER, LOGIN and the token variants), then
+ *           mixed workloads: plain, batched, compact and with tokens
+ *   impair  A mixed workload through the client transport's Impairment
+ *           (loss both ways, delay, jitter; see impair.hpp), once under
+ *           at-least-once and once under at-most-once. "reexecuted" counts
+ *           requests the server ran more often than they were answered:
+ *           the lost replies at-least-once repeats
+ *   soak    A mixed workload for --soak seconds while monitors re-register
+ *           and short-lived clients come and go, sampling the process's
+ *           resident memory, the reply cache, the sequenced-client windows
+ *           and the monitor table every --sample seconds
+ *
+ * Results are one tab-separated line per scenario under a header line,
+ * the same format as a baseline, so a results file can be kept as the next
+ * baseline. With --baseline every scenario found in it is compared and the
+ * run fails (exit code 1) if its throughput fell by more than
+ * --max-slowdown percent or its p99 rose by more than --max-p99 percent.
+ * The soak also fails if resident memory grew by more than --max-growth MB
+ * from its first sample to its last.
+ *
+ * Arguments:
+ *   --suite        Comma-separated suites: e2e, impair, soak (default: e2e,impair)
+ *   --filter       Only scenarios whose name contains this text
+ *   --duration     Seconds per e2e/impair scenario (default: 5)
+ *   --concurrency  Requests kept in flight (default: 64)
+ *   --threads      Client worker threads (default: 1)
+ *   --server-threads  Server worker threads (default: 4)
+ *   --port         Loopback port for the in-process server (default: 9300)
+ *   --accounts     Accounts opened before the first scenario (default: 1000)
+ *   --loss         Impair suite: loss probability each way (default: 0.05)
+ *   --delay        Impair suite: added delay in ms (default: 1)
+ *   --jitter       Impair suite: delay spread in ms (default: 0.5)
+ *   --timeout      Impair suite: per-attempt timeout in ms (default: 20)
+ *   --soak         Soak duration in seconds (default: 60)
+ *   --sample       Soak sampling interval in seconds (default: 5)
+ *   --monitors     Soak: monitor registrations kept alive (default: 8)
+ *   --out          Write the results to this file ("-" = stdout)
+ *   --soak-out     Write the soak samples to this file (tab-separated)
+ *   --baseline     Compare with this results file
+ *   --max-slowdown Allowed throughput loss against the baseline, percent (default: 15)
+ *   --max-p99      Allowed p99 increase against the baseline, percent (default: 30)
+ *   --max-growth   Allowed soak memory growth in MB (default: 64)
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Account {
+    std::string name;
+    std::string password;
+    int32_t accNo = 0;
+    uint64_t token = 0;
+};
+
+struct Options {
+    std::vector<std::string> suites{"e2e", "impair"};
+    std::string filter;
+    int durationSec = 5;
+    int concurrency = 64;
+    int threads = 1;
+    int serverThreads = 4;
+    int port = 9300;
+    int accounts = 1000;
+    double loss = 0.05;
+    int delayUs = 1000;
+    int jitterUs = 500;
+    int timeoutMs = 20;
+    int soakSec = 60;
+    int sampleSec = 5;
+    int monitors = 8;
+    std::string out;
+    std::string soakOut;
+    std::string baseline;
+    double maxSlowdown = 15;
+    double maxP99 = 30;
+    double maxGrowthMb = 64;
+};
+
+/**
+ * One workload: operation ratios and the client settings to run them with
+ */
+struct Scenario {
+    std::string name;
+    std::vector<std::pair<uint16_t, int>> mix;  // opCode, weight
+    bool atMostOnce = true;
+    int batch = 0;
+    bool compact = false;
+    bool tokens = false;  // use the token variants of the account operations
+    Impairment::Config impair;
+    int timeoutMs = 500;
+};
+
+/**
+ * One line of the results file
+ */
+struct Result {
+    std::string name;
+    double opsPerSec = 0;
+    double p50Ms = 0;
+    double p99Ms = 0;
+    uint64_t ok = 0;
+    uint64_t rejected = 0;
+    uint64_t failed = 0;
+    uint64_t retransmits = 0;
+    int64_t reexecuted = 0;  // server executions beyond one per answered request
+    double rssMb = 0;
+};
+
+// Columns of the results file, in order
+const char* const COLUMNS[] = {"scenario", "ops_per_sec", "p50_ms", "p99_ms", "ok", "rejected",
+                               "failed", "retransmits", "reexecuted", "rss_mb"};
+
+// Resident set size of this process, 0 where unknown
+uint64_t residentBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return pmc.WorkingSetSize;
+    return 0;
+#elif defined(__linux__)
+    std::ifstream f("/proc/self/statm");
+    uint64_t size = 0, resident = 0;
+    if (!(f >> size >> resident)) return 0;
+    return resident * uint64_t(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+}
+
+double mb(uint64_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+// Latency of every operation but BATCH itself (its sub-operations are counted one by one)
+metrics::Histogram::Snapshot operationLatency(const metrics::Snapshot& m) {
+    metrics::Histogram::Snapshot all;
+    for (int i = 0; i < metrics::OP_SLOTS; i++) {
+        if (i != (int)proto::OpCode::BATCH) all += m.latency[i];
+    }
+    return all;
+}
+
+// Samples recorded between two snapshots of the same histogram
+metrics::Histogram::Snapshot since(const metrics::Histogram::Snapshot& now, const metrics::Histogram::Snapshot& then) {
+    metrics::Histogram::Snapshot d;
+    d.count = now.count - then.count;
+    d.sum = now.sum - then.sum;
+    d.max = now.max;
+    for (size_t i = 0; i < d.buckets.size(); i++) d.buckets[i] = now.buckets[i] - then.buckets[i];
+    return d;
+}
+
+bool parseMix(const std::string& spec, std::vector<std::pair<uint16_t, int>>& out) {
+    static const std::map<std::string, proto::OpCode> names = {
+        {"open", proto::OpCode::OPEN},
+        {"deposit", proto::OpCode::DEPOSIT},
+        {"withdraw", proto::OpCode::WITHDRAW},
+        {"transfer", proto::OpCode::TRANSFER},
+        {"query", proto::OpCode::QUERY_BALANCE},
+        {"login", proto::OpCode::LOGIN},
+    };
+    out.clear();
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) return false;
+        auto it = names.find(item.substr(0, eq));
+        int w = std::atoi(item.c_str() + eq + 1);
+        if (it == names.end() || w < 0) return false;
+        if (w > 0) out.push_back({(uint16_t)it->second, w});
+    }
+    return !out.empty();
+}
+
+Scenario makeScenario(const std::string& name, const std::string& mix) {
+    Scenario s;
+    s.name = name;
+    parseMix(mix, s.mix);
+    return s;
+}
+
+/**
+ * Per-worker generator state (completions of different workers never
+ * share it), plus one for the main thread
+ */
+struct alignas(64) ThreadState {
+    std::mt19937_64 rng;
+    uint64_t opened = 0;
+    uint64_t ok = 0;
+    uint64_t rejected = 0;
+    uint64_t failed = 0;
+};
+
+class Bench {
+public:
+    Bench(const Options& opt, Server& server) : opt_(opt), server_(server) {}
+
+    // Open and log in the accounts the scenarios work on
+    bool setup();
+
+    // Closed loop for `seconds`
+    Result run(const Scenario& sc, int seconds);
+
+    // The soak suite, samples written to `samples` if open
+    Result soak(const Scenario& sc, std::ostream* samples, bool& grewTooMuch);
+
+private:
+    const Options& opt_;
+    Server& server_;
+    std::vector<Account> accounts_;  // read-only once a scenario runs
+    std::vector<ThreadState> threads_;
+    std::atomic<bool> measuring_{false};
+
+    Runtime::Config runtimeConfig(const Scenario& sc) const;
+    ThreadState& state();
+    uint16_t pickOp(const Scenario& sc, ThreadState& t) const;
+    void submitOp(Runtime& rt, const Scenario& sc, uint16_t op, Runtime::CompletionFn done);
+    void submitOne(Runtime& rt, const Scenario& sc);
+    Result collect(const std::string& name, Runtime& rt, double seconds, const Server::Stats& before);
+    void churn(const Scenario& sc, int requests);
+    static void drain(Runtime& rt);
+};
+
+Runtime::Config Bench::runtimeConfig(const Scenario& sc) const {
+    Runtime::Config cfg;
+    cfg.serverIp = "127.0.0.1";
+    cfg.serverPort = opt_.port;
+    cfg.atMostOnce = sc.atMostOnce;
+    cfg.timeoutMs = sc.timeoutMs;
+    cfg.retryCount = 10;
+    cfg.workers = opt_.threads;
+    cfg.batchMax = sc.batch;
+    cfg.compact = sc.compact;
+    cfg.impair = sc.impair;
+    return cfg;
+}
+
+ThreadState& Bench::state() {
+    int w = Runtime::currentWorker();
+    return threads_[w < 0 ? threads_.size() - 1 : (size_t)w];
+}
+
+void Bench::drain(Runtime& rt) {
+    while (rt.inFlight() > 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+bool Bench::setup() {
+    Scenario sc;
+    Runtime rt(runtimeConfig(sc));
+    if (!rt.start()) return false;
+
+    // OPEN, then LOGIN, 64 at a time
+    accounts_.resize(opt_.accounts);
+    std::atomic<int> failures(0);
+    for (size_t i = 0; i < accounts_.size(); i++) {
+        while (rt.inFlight() >= 64) std::this_thread::sleep_for(std::chrono::microseconds(100));
+        Account& a = accounts_[i];
+        a.name = "be-" + std::to_string(i);
+        a.password = "pw" + std::to_string(i % 1000);
+        const uint16_t op = (uint16_t)proto::OpCode::OPEN;
+        rt.submitWith(op, proto::requestBodySize(op, a.name.size()), [&](proto::Writer& w) {
+            proto::writeOpenRequest(w, a.name, a.password, (uint16_t)proto::Currency::CNY, 1000000.0);
+        }, [&a, &failures](const Pipeline::Completion& c) {
+            double bal;
+            if (!c.ok || !proto::schema::OpenReply::read(*c.reply, a.accNo, bal)) failures++;
+        });
+    }
+    drain(rt);
+    for (Account& a : accounts_) {
+        while (rt.inFlight() >= 64) std::this_thread::sleep_for(std::chrono::microseconds(100));
+        const uint16_t op = (uint16_t)proto::OpCode::LOGIN;
+        rt.submitWith(op, proto::requestBodySize(op, a.name.size()), [&](proto::Writer& w) {
+            proto::writeAuthRequest(w, a.name, a.accNo, a.password);
+        }, [&a, &failures](const Pipeline::Completion& c) {
+            uint16_t seconds;
+            if (!c.ok || !proto::schema::LoginReply::read(*c.reply, a.token, seconds)) failures++;
+        });
+    }
+    drain(rt);
+    rt.stop();
+
+    if (failures > 0) {
+        std::cerr << "[bench] setup failed: " << failures.load() << " of " << 2 * accounts_.size()
+                  << " OPEN/LOGIN requests\n";
+        return false;
+    }
+    std::cout << "[bench] opened and logged in " << accounts_.size() << " accounts\n";
+    return true;
+}
+
+uint16_t Bench::pickOp(const Scenario& sc, ThreadState& t) const {
+    int total = 0;
+    for (const auto& m : sc.mix) total += m.second;
+    int r = int(t.rng() % (uint64_t)total);
+    for (const auto& m : sc.mix) {
+        if (r < m.second) return m.first;
+        r -= m.second;
+    }
+    return sc.mix.back().first;
+}
+
+void Bench::submitOp(Runtime& rt, const Scenario& sc, uint16_t op, Runtime::CompletionFn done) {
+    const uint16_t cny = (uint16_t)proto::Currency::CNY;
+    ThreadState& t = state();
+    const Account& a = accounts_[t.rng() % accounts_.size()];
+    // Follow-up requests stay on the worker that completed the previous one
+    const int key = Runtime::currentWorker();
+    const uint16_t tok = sc.tokens ? proto::tokenOpCode(op) : 0;
+    switch ((proto::OpCode)op) {
+        case proto::OpCode::OPEN: {
+            int owner = key < 0 ? (int)(threads_.size() - 1) : key;
+            std::string name = "be-open-" + std::to_string(owner) + "-" + std::to_string(t.opened++);
+            rt.submitWith(op, proto::requestBodySize(op, name.size()), [&](proto::Writer& w) {
+                proto::writeOpenRequest(w, name, "bench", cny, 1000.0);
+            }, std::move(done), key);
+            break;
+        }
+        case proto::OpCode::LOGIN:
+            rt.submitWith(op, proto::requestBodySize(op, a.name.size()), [&](proto::Writer& w) {
+                proto::writeAuthRequest(w, a.name, a.accNo, a.password);
+            }, std::move(done), key);
+            break;
+        case proto::OpCode::DEPOSIT:
+        case proto::OpCode::WITHDRAW:
+            if (tok) {
+                rt.submitWith(tok, proto::requestBodySize(tok, 0), [&](proto::Writer& w) {
+                    proto::writeTokenAmountRequest(w, a.token, a.accNo, cny, 1.0);
+                }, std::move(done), key);
+            } else {
+                rt.submitWith(op, proto::requestBodySize(op, a.name.size()), [&](proto::Writer& w) {
+                    proto::writeAmountRequest(w, a.name, a.accNo, a.password, cny, 1.0);
+                }, std::move(done), key);
+            }
+            break;
+        case proto::OpCode::QUERY_BALANCE:
+            if (tok) {
+                rt.submitWith(tok, proto::requestBodySize(tok, 0), [&](proto::Writer& w) {
+                    proto::writeTokenRequest(w, a.token, a.accNo);
+                }, std::move(done), key);
+            } else {
+                rt.submitWith(op, proto::requestBodySize(op, a.name.size()), [&](proto::Writer& w) {
+                    proto::writeAuthRequest(w, a.name, a.accNo, a.password);
+                }, std::move(done), key);
+            }
+            break;
+        case proto::OpCode::TRANSFER: {
+            const Account* to = &accounts_[t.rng() % accounts_.size()];
+            while (to->accNo == a.accNo) to = &accounts_[t.rng() % accounts_.size()];
+            if (tok) {
+                rt.submitWith(tok, proto::requestBodySize(tok, 0), [&](proto::Writer& w) {
+                    proto::writeTokenTransferRequest(w, a.token, a.accNo, to->accNo, cny, 1.0);
+                }, std::move(done), key);
+            } else {
+                rt.submitWith(op, proto::requestBodySize(op, a.name.size()), [&](proto::Writer& w) {
+                    proto::writeTransferRequest(w, a.name, a.accNo, a.password, to->accNo, cny, 1.0);
+                }, std::move(done), key);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void Bench::submitOne(Runtime& rt, const Scenario& sc) {
+    submitOp(rt, sc, pickOp(sc, state()), [this, &rt, &sc](const Pipeline::Completion& c) {
+        ThreadState& t = state();
+        if (!c.ok) {
+            t.failed++;
+        } else if (c.reply->h.status == (uint16_t)proto::Status::OK) {
+            t.ok++;
+        } else {
+            t.rejected++;
+        }
+        // Closed loop: replace the finished request
+        if (measuring_.load(std::memory_order_relaxed)) submitOne(rt, sc);
+    });
+}
+
+Result Bench::collect(const std::string& name, Runtime& rt, double seconds, const Server::Stats& before) {
+    Result r;
+    r.name = name;
+    for (const ThreadState& t : threads_) {
+        r.ok += t.ok;
+        r.rejected += t.rejected;
+        r.failed += t.failed;
+    }
+    const metrics::Snapshot m = rt.metrics();
+    const metrics::Histogram::Snapshot lat = operationLatency(m);
+    r.opsPerSec = seconds > 0 ? (r.ok + r.rejected) / seconds : 0;
+    r.p50Ms = lat.quantile(0.50) / 1000.0;
+    r.p99Ms = lat.quantile(0.99) / 1000.0;
+    r.retransmits = m.counters[metrics::RETRANSMITS];
+
+    // A BATCH runs as one request on the server, so only unbatched scenarios compare
+    const Server::Stats after = server_.stats();
+    r.reexecuted = int64_t(after.requests - before.requests) - int64_t(r.ok + r.rejected);
+    r.rssMb = mb(residentBytes());
+    return r;
+}
+
+Result Bench::run(const Scenario& sc, int seconds) {
+    threads_.assign(opt_.threads + 1, ThreadState());
+    for (size_t i = 0; i < threads_.size(); i++) threads_[i].rng.seed(12345 + i);
+
+    Runtime rt(runtimeConfig(sc));
+    Result r;
+    r.name = sc.name;
+    if (!rt.start()) {
+        std::cerr << "[bench] " << sc.name << ": cannot create client sockets\n";
+        return r;
+    }
+    const Server::Stats before = server_.stats();
+    measuring_.store(true);
+    auto start = Clock::now();
+    for (int i = 0; i < opt_.concurrency; i++) submitOne(rt, sc);
+    std::this_thread::sleep_until(start + std::chrono::seconds(seconds));
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    measuring_.store(false);
+    drain(rt);
+    rt.stop();
+    r = collect(sc.name, rt, elapsed, before);
+    if (sc.batch > 1) r.reexecuted = 0;
+    return r;
+}
+
+void Bench::churn(const Scenario& sc, int requests) {
+    // A new socket is a new client to the server: a window, reply cache entries
+    Scenario one = sc;
+    Runtime::Config cfg = runtimeConfig(one);
+    cfg.workers = 1;
+    Runtime rt(cfg);
+    if (!rt.start()) return;
+    for (int i = 0; i < requests; i++) {
+        while (rt.inFlight() >= 16) std::this_thread::sleep_for(std::chrono::microseconds(100));
+        submitOp(rt, sc, (uint16_t)proto::OpCode::DEPOSIT, [](const Pipeline::Completion&) {});
+    }
+    drain(rt);
+    rt.stop();
+}
+
+Result Bench::soak(const Scenario& sc, std::ostream* samples, bool& grewTooMuch) {
+    threads_.assign(opt_.threads + 1, ThreadState());
+    for (size_t i = 0; i < threads_.size(); i++) threads_[i].rng.seed(54321 + i);
+    grewTooMuch = false;
+
+    Runtime rt(runtimeConfig(sc));
+    // Monitors: one socket each, all accounts, updates coalesced
+    Runtime::Config mcfg = runtimeConfig(sc);
+    mcfg.workers = std::max(1, opt_.monitors);
+    Runtime mon(mcfg);
+    std::atomic<uint64_t> callbacks(0);
+    mon.setCallbackHandler([&callbacks](const proto::MessageView&) { callbacks.fetch_add(1, std::memory_order_relaxed); });
+    Result r;
+    r.name = sc.name;
+    if (!rt.start() || (opt_.monitors > 0 && !mon.start())) {
+        std::cerr << "[bench] " << sc.name << ": cannot create client sockets\n";
+        return r;
+    }
+    auto registerMonitors = [&]() {
+        const uint16_t op = (uint16_t)proto::OpCode::MONITOR_REGISTER;
+        const uint16_t seconds = (uint16_t)std::min(65535, opt_.sampleSec * 2 + 1);
+        for (int i = 0; i < opt_.monitors; i++) {
+            mon.submitWith(op, proto::monitorRequestSize(0), [&](proto::Writer& w) {
+                proto::writeMonitorRequest(w, seconds, proto::MONITOR_BATCH, nullptr, 0);
+            }, [](const Pipeline::Completion&) {}, i);
+        }
+    };
+
+    std::printf("\n%8s %10s %9s %9s %10s %10s %9s %9s %11s\n", "t(s)", "ops/s", "p99(ms)", "rss(MB)",
+                "dedup", "windows", "monitors", "accounts", "callbacks");
+    if (samples) {
+        *samples << "t_s\tops_per_sec\tp99_ms\trss_mb\tdedup_entries\twindows\tmonitors\taccounts\tcallbacks\n";
+    }
+
+    const Server::Stats before = server_.stats();
+    measuring_.store(true);
+    const auto start = Clock::now();
+    auto next = start;
+    uint64_t lastDone = 0;
+    metrics::Histogram::Snapshot lastLat;
+    double firstRss = -1, lastRss = 0;
+    for (int i = 0; i < opt_.concurrency; i++) submitOne(rt, sc);
+
+    while (true) {
+        if (opt_.monitors > 0) registerMonitors();
+        churn(sc, 100);
+        next += std::chrono::seconds(opt_.sampleSec);
+        std::this_thread::sleep_until(std::min(next, start + std::chrono::seconds(opt_.soakSec)));
+        const auto now = Clock::now();
+        const double t = std::chrono::duration<double>(now - start).count();
+
+        uint64_t done = 0;
+        for (const ThreadState& s : threads_) done += s.ok + s.rejected;
+        const metrics::Histogram::Snapshot lat = operationLatency(rt.metrics());
+        const metrics::Histogram::Snapshot interval = since(lat, lastLat);
+        const double rss = mb(residentBytes());
+        if (firstRss < 0) firstRss = rss;
+        lastRss = rss;
+        const MonitorHub::Stats ms = server_.monitors().stats();
+        const double ops = (done - lastDone) / double(opt_.sampleSec);
+        std::printf("%8.0f %10.0f %9.3f %9.1f %10zu %10zu %9zu %9zu %11llu\n", t, ops,
+                    interval.quantile(0.99) / 1000.0, rss, server_.dedup().size(), server_.window().clients(),
+                    ms.monitors, server_.store().accountCount(), (unsigned long long)callbacks.load());
+        std::fflush(stdout);
+        if (samples) {
+            char line[256];
+            std::snprintf(line, sizeof(line), "%.1f\t%.0f\t%.3f\t%.1f\t%zu\t%zu\t%zu\t%zu\t%llu\n", t, ops,
+                          interval.quantile(0.99) / 1000.0, rss, server_.dedup().size(), server_.window().clients(),
+                          ms.monitors, server_.store().accountCount(), (unsigned long long)callbacks.load());
+            *samples << line;
+        }
+        lastDone = done;
+        lastLat = lat;
+        if (now >= start + std::chrono::seconds(opt_.soakSec)) break;
+    }
+
+    const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    measuring_.store(false);
+    drain(rt);
+    rt.stop();
+    if (opt_.monitors > 0) mon.stop();
+    r = collect(sc.name, rt, elapsed, before);
+    r.reexecuted = 0;  // the churn clients' requests run on the same server
+
+    const double growth = lastRss - firstRss;
+    std::printf("soak: resident memory %.1f MB -> %.1f MB (%+.1f MB, limit %.0f MB)\n", firstRss, lastRss, growth,
+                opt_.maxGrowthMb);
+    grewTooMuch = growth > opt_.maxGrowthMb;
+    return r;
+}
+
+// ==================== Results and baselines ====================
+
+void writeResults(std::ostream& os, const std::vector<Result>& results) {
+    os << "# bench_e2e results\n";
+    for (size_t i = 0; i < sizeof(COLUMNS) / sizeof(COLUMNS[0]); i++) os << (i ? "\t" : "") << COLUMNS[i];
+    os << '\n';
+    char line[512];
+    for (const Result& r : results) {
+        std::snprintf(line, sizeof(line), "%s\t%.0f\t%.3f\t%.3f\t%llu\t%llu\t%llu\t%llu\t%lld\t%.1f\n",
+                      r.name.c_str(), r.opsPerSec, r.p50Ms, r.p99Ms, (unsigned long long)r.ok,
+                      (unsigned long long)r.rejected, (unsigned long long)r.failed,
+                      (unsigned long long)r.retransmits, (long long)r.reexecuted, r.rssMb);
+        os << line;
+    }
+}
+
+/**
+ * Read a results file: scenario -> (ops/s, p99); columns are found by the header
+ * @return false if the file cannot be read or has no header
+ */
+bool readBaseline(const std::string& path, std::map<std::string, std::pair<double, double>>& out) {
+    std::ifstream f(path);
+    if (!f) return false;
+    std::string line;
+    int opsCol = -1, p99Col = -1;
+    while (std::getline(f, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::vector<std::string> cells;
+        std::stringstream ss(line);
+        std::string cell;
+        while (std::getline(ss, cell, '\t')) cells.push_back(cell);
+        if (opsCol < 0) {
+            for (size_t i = 0; i < cells.size(); i++) {
+                if (cells[i] == "ops_per_sec") opsCol = (int)i;
+                if (cells[i] == "p99_ms") p99Col = (int)i;
+            }
+            if (cells.empty() || cells[0] != "scenario" || opsCol < 0 || p99Col < 0) return false;
+            continue;
+        }
+        if ((int)cells.size() <= std::max(opsCol, p99Col)) continue;
+        out[cells[0]] = {std::atof(cells[opsCol].c_str()), std::atof(cells[p99Col].c_str())};
+    }
+    return opsCol >= 0;
+}
+
+/**
+ * Print each scenario against its baseline
+ * @return number of regressions
+ */
+int compare(const std::vector<Result>& results, const std::map<std::string, std::pair<double, double>>& base,
+            const Options& opt) {
+    std::printf("\nagainst the baseline (throughput -%.0f%%, p99 +%.0f%% allowed):\n", opt.maxSlowdown, opt.maxP99);
+    std::printf("%-20s %10s %10s %8s %9s %9s %8s  %s\n", "scenario", "ops/s", "base", "change", "p99(ms)", "base",
+                "change", "verdict");
+    int regressions = 0;
+    for (const Result& r : results) {
+        auto it = base.find(r.name);
+        if (it == base.end()) {
+            std::printf("%-20s %10.0f %10s %8s %9.3f %9s %8s  new\n", r.name.c_str(), r.opsPerSec, "-", "-", r.p99Ms,
+                        "-", "-");
+            continue;
+        }
+        const double baseOps = it->second.first, baseP99 = it->second.second;
+        const double opsChange = baseOps > 0 ? (r.opsPerSec - baseOps) / baseOps * 100 : 0;
+        const double p99Change = baseP99 > 0 ? (r.p99Ms - baseP99) / baseP99 * 100 : 0;
+        std::string verdict;
+        if (-opsChange > opt.maxSlowdown) verdict += "SLOWER ";
+        if (p99Change > opt.maxP99) verdict += "P99 ";
+        if (verdict.empty()) {
+            verdict = "ok";
+        } else {
+            verdict += "REGRESSION";
+            regressions++;
+        }
+        std::printf("%-20s %10.0f %10.0f %+7.1f%% %9.3f %9.3f %+7.1f%%  %s\n", r.name.c_str(), r.opsPerSec, baseOps,
+                    opsChange, r.p99Ms, baseP99, p99Change, verdict.c_str());
+    }
+    return regressions;
+}
+
+void printResult(const Result& r) {
+    std::printf("%-20s %10.0f %9.3f %9.3f %10llu %9llu %8llu %9llu %10lld\n", r.name.c_str(), r.opsPerSec, r.p50Ms,
+                r.p99Ms, (unsigned long long)r.ok, (unsigned long long)r.rejected, (unsigned long long)r.failed,
+                (unsigned long long)r.retransmits, (long long)r.reexecuted);
+    std::fflush(stdout);
+}
+
+bool wanted(const Options& opt, const std::string& suite, const std::string& name) {
+    if (std::find(opt.suites.begin(), opt.suites.end(), suite) == opt.suites.end()) return false;
+    return opt.filter.empty() || name.find(opt.filter) != std::string::npos;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options opt;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--suite") == 0 && i + 1 < argc) {
+            opt.suites.clear();
+            std::stringstream ss(argv[++i]);
+            std::string s;
+            while (std::getline(ss, s, ',')) opt.suites.push_back(s);
+        } else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            opt.filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+            opt.durationSec = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--concurrency") == 0 && i + 1 < argc) {
+            opt.concurrency = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            opt.threads = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--server-threads") == 0 && i + 1 < argc) {
+            opt.serverThreads = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            opt.port = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--accounts") == 0 && i + 1 < argc) {
+            opt.accounts = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--loss") == 0 && i + 1 < argc) {
+            opt.loss = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--delay") == 0 && i + 1 < argc) {
+            opt.delayUs = (int)(std::atof(argv[++i]) * 1000);
+        } else if (std::strcmp(argv[i], "--jitter") == 0 && i + 1 < argc) {
+            opt.jitterUs = (int)(std::atof(argv[++i]) * 1000);
+        } else if (std::strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            opt.timeoutMs = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--soak") == 0 && i + 1 < argc) {
+            opt.soakSec = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--sample") == 0 && i + 1 < argc) {
+            opt.sampleSec = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--monitors") == 0 && i + 1 < argc) {
+            opt.monitors = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            opt.out = argv[++i];
+        } else if (std::strcmp(argv[i], "--soak-out") == 0 && i + 1 < argc) {
+            opt.soakOut = argv[++i];
+        } else if (std::strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            opt.baseline = argv[++i];
+        } else if (std::strcmp(argv[i], "--max-slowdown") == 0 && i + 1 < argc) {
+            opt.maxSlowdown = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--max-p99") == 0 && i + 1 < argc) {
+            opt.maxP99 = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--max-growth") == 0 && i + 1 < argc) {
+            opt.maxGrowthMb = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--help") == 0 || std::strcmp(argv[i], "-h") == 0) {
+            std::cout << "Usage: " << argv[0] << " [options]\n";
+            std::cout << "Options:\n";
+            std::cout << "  --suite <list>       e2e, impair, soak (default: e2e,impair)\n";
+            std::cout << "  --filter <text>      Only scenarios whose name contains text\n";
+            std::cout << "  --duration <s>       Seconds per e2e/impair scenario (default: 5)\n";
+            std::cout << "  --concurrency <n>    Requests in flight (default: 64)\n";
+            std::cout << "  --threads <n>        Client worker threads (default: 1)\n";
+            std::cout << "  --server-threads <n> Server worker threads (default: 4)\n";
+            std::cout << "  --port <port>        Loopback port of the in-process server (default: 9300)\n";
+            std::cout << "  --accounts <n>       Accounts opened before the first scenario (default: 1000)\n";
+            std::cout << "  --loss <p>           Impair: loss probability each way (default: 0.05)\n";
+            std::cout << "  --delay <ms>         Impair: added delay (default: 1)\n";
+            std::cout << "  --jitter <ms>        Impair: delay spread (default: 0.5)\n";
+            std::cout << "  --timeout <ms>       Impair: per-attempt timeout (default: 20)\n";
+            std::cout << "  --soak <s>           Soak duration (default: 60)\n";
+            std::cout << "  --sample <s>         Soak sampling interval (default: 5)\n";
+            std::cout << "  --monitors <n>       Soak: live monitor registrations (default: 8)\n";
+            std::cout << "  --out <file>         Write the results (- = stdout)\n";
+            std::cout << "  --soak-out <file>    Write the soak samples\n";
+            std::cout << "  --baseline <file>    Compare with an earlier results file\n";
+            std::cout << "  --max-slowdown <pct> Allowed throughput loss (default: 15)\n";
+            std::cout << "  --max-p99 <pct>      Allowed p99 increase (default: 30)\n";
+            std::cout << "  --max-growth <mb>    Allowed soak memory growth (default: 64)\n";
+            return 0;
+        }
+    }
+    if (opt.accounts < 2) opt.accounts = 2;
+    if (opt.concurrency < 1) opt.concurrency = 1;
+    if (opt.threads < 1) opt.threads = 1;
+    if (opt.durationSec < 1) opt.durationSec = 1;
+    if (opt.sampleSec < 1) opt.sampleSec = 1;
+    if (opt.soakSec < opt.sampleSec) opt.soakSec = opt.sampleSec;
+
+    // Read the baseline first: a bad path should not cost a whole run
+    std::map<std::string, std::pair<double, double>> base;
+    if (!opt.baseline.empty() && !readBaseline(opt.baseline, base)) {
+        std::cerr << "[bench] cannot read baseline " << opt.baseline << "\n";
+        return 1;
+    }
+
+    // Scenarios, by suite
+    std::vector<std::pair<std::string, Scenario>> plan;
+    const char* const singles[][2] = {
+        {"e2e-open", "open=1"},         {"e2e-deposit", "deposit=1"}, {"e2e-withdraw", "withdraw=1"},
+        {"e2e-query", "query=1"},       {"e2e-transfer", "transfer=1"}, {"e2e-login", "login=1"},
+    };
+    for (const auto& s : singles) plan.push_back({"e2e", makeScenario(s[0], s[1])});
+    const char* const tokenSingles[][2] = {
+        {"e2e-deposit-token", "deposit=1"}, {"e2e-query-token", "query=1"}, {"e2e-transfer-token", "transfer=1"},
+    };
+    for (const auto& s : tokenSingles) {
+        Scenario sc = makeScenario(s[0], s[1]);
+        sc.tokens = true;
+        plan.push_back({"e2e", sc});
+    }
+    const std::string mix = "deposit=4,query=4,withdraw=1,transfer=1";
+    plan.push_back({"e2e", makeScenario("e2e-mix", mix)});
+    {
+        Scenario sc = makeScenario("e2e-mix-batch16", mix);
+        sc.batch = 16;
+        plan.push_back({"e2e", sc});
+        sc = makeScenario("e2e-mix-compact", mix);
+        sc.compact = true;
+        plan.push_back({"e2e", sc});
+        sc = makeScenario("e2e-mix-tokens", mix);
+        sc.tokens = true;
+        plan.push_back({"e2e", sc});
+    }
+    for (bool atMostOnce : {false, true}) {
+        Scenario sc = makeScenario(atMostOnce ? "impair-atmost" : "impair-atleast", "deposit=1,withdraw=1,transfer=1,query=1");
+        sc.atMostOnce = atMostOnce;
+        sc.timeoutMs = opt.timeoutMs;
+        sc.impair.dropSend = opt.loss;
+        sc.impair.dropRecv = opt.loss;
+        sc.impair.delayUs = opt.delayUs;
+        sc.impair.jitterUs = opt.jitterUs;
+        sc.impair.seed = 777;
+        plan.push_back({"impair", sc});
+    }
+    plan.push_back({"soak", makeScenario("soak-mix", mix)});
+
+    logging::tag() = "bench";
+    if (!net::startup()) {
+        std::cerr << "[bench] network startup failed\n";
+        return 1;
+    }
+
+    int rc = 0;
+    {
+        Server::Config scfg;
+        scfg.port = opt.port;
+        scfg.threads = opt.serverThreads;
+        scfg.tokenTtl = 65535;
+        Server server(scfg);
+        if (!server.start()) {
+            std::cerr << "[bench] cannot start the server on UDP port " << opt.port << "\n";
+            net::cleanup();
+            return 1;
+        }
+        std::cout << "[bench] server on 127.0.0.1:" << opt.port << " threads=" << server.threadCount()
+                  << ", client threads=" << opt.threads << " concurrency=" << opt.concurrency
+                  << " duration=" << opt.durationSec << "s\n";
+
+        Bench bench(opt, server);
+        std::vector<Result> results;
+        if (!bench.setup()) {
+            rc = 1;
+        } else {
+            std::ofstream soakFile;
+            if (!opt.soakOut.empty()) soakFile.open(opt.soakOut);
+
+            std::printf("\n%-20s %10s %9s %9s %10s %9s %8s %9s %10s\n", "scenario", "ops/s", "p50(ms)", "p99(ms)",
+                        "ok", "rejected", "failed", "retrans", "reexecuted");
+            for (const auto& p : plan) {
+                const Scenario& sc = p.second;
+                if (!wanted(opt, p.first, sc.name)) continue;
+                if (p.first == "soak") {
+                    bool grew = false;
+                    Result r = bench.soak(sc, soakFile.is_open() ? &soakFile : nullptr, grew);
+                    if (grew) rc = 1;
+                    printResult(r);
+                    results.push_back(r);
+                } else {
+                    results.push_back(bench.run(sc, opt.durationSec));
+                    printResult(results.back());
+                }
+                if (results.back().failed > 0 && !sc.impair.enabled()) {
+                    std::cerr << "[bench] " << sc.name << ": " << results.back().failed << " requests failed\n";
+                    rc = 1;
+                }
+            }
+        }
+        server.stop();
+
+        if (!opt.out.empty()) {
+            if (opt.out == "-") {
+                writeResults(std::cout, results);
+            } else {
+                std::ofstream f(opt.out);
+                if (f) writeResults(f, results);
+                else std::cerr << "[bench] cannot create " << opt.out << "\n";
+            }
+        }
+        if (!base.empty() && compare(results, base, opt) > 0) rc = 1;
+    }
+
+    net::cleanup();
+    return rc;
+}
@@ -0,0 +1,331 @@
+#include "dedup_cache.hpp"
+#include <algorithm>
+#include <cstring>
+
+DedupCache::DedupCache(const Config& cfg) : epoch_(Clock::now()) {
+    size_t n = 1;
+    while (n < cfg.stripes) n <<= 1;
+    stripes_.reset(new Stripe[n]);
+    mask_ = n - 1;
+
+    // Largest index (a power of two) that fits the stripe's share of the
+    // budget at a load between 1/4 and 1/2; the rest of the share is slots
+    const size_t budget = cfg.memoryBytes / n;
+    size_t width = 64;
+    while ((width << 1) * (sizeof(uint32_t) + sizeof(Slot) / 4) <= budget && width < (size_t(1) << 30)) {
+        width <<= 1;
+    }
+    size_t fit = budget > width * sizeof(uint32_t) ? (budget - width * sizeof(uint32_t)) / sizeof(Slot) : 0;
+    const uint32_t slots = uint32_t(std::max(width / 4, std::min(width / 2, fit)));
+
+    int ttl = cfg.ttlSeconds > 0 ? cfg.ttlSeconds : DEFAULT_TTL_SECONDS;
+    ttlTicks_ = uint32_t(int64_t(ttl) * 1000 / TICK_MS);
+    capacity_ = n * slots;
+    bytes_ = n * (sizeof(Stripe) + width * sizeof(uint32_t) + slots * sizeof(Slot));
+
+    for (size_t i = 0; i < n; i++) {
+        Stripe& s = stripes_[i];
+        s.slots.reset(new Slot[slots]);
+        s.index.reset(new uint32_t[width]);
+        s.indexMask = uint32_t(width - 1);
+        std::fill(s.index.get(), s.index.get() + width, NIL);
+        std::fill(std::begin(s.head), std::end(s.head), NIL);
+        std::fill(std::begin(s.tail), std::end(s.tail), NIL);
+        for (uint32_t k = slots; k-- > 0;) release(s, k);
+    }
+}
+
+DedupCache::Key DedupCache::keyOf(const sockaddr_in& from, uint64_t requestId) {
+    uint64_t addr = uint64_t(ntohl(from.sin_addr.s_addr)) << 16 | ntohs(from.sin_port);
+    return Key{addr, requestId};
+}
+
+uint32_t DedupCache::tickOf(Clock::time_point t) const {
+    return uint32_t(std::chrono::duration_cast<std::chrono::milliseconds>(t - epoch_).count() / TICK_MS);
+}
+
+DedupCache::Lookup DedupCache::begin(const Key& key, uint8_t* reply, size_t& len) {
+    const uint64_t hash = hashOf(key);
+    const uint32_t expires = tickOf(Clock::now()) + ttlTicks_;
+    Stripe& s = stripeOf(hash);
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    uint32_t pos = find(s, key, hash);
+    if (pos != NIL) {
+        const Slot& e = s.slots[s.index[pos]];
+        if (e.state != Done) return Lookup::InProgress;
+        size_t copied = std::min<size_t>(e.len, SLOT_DATA);
+        std::memcpy(reply, e.data, copied);
+        for (uint32_t x = e.more; x != NIL; x = s.slots[x].next) {
+            size_t n = std::min<size_t>(e.len - copied, SLOT_DATA);
+            std::memcpy(reply + copied, s.slots[x].data, n);
+            copied += n;
+        }
+        len = copied;
+        return Lookup::Done;
+    }
+
+    // Claimed; an abandoned claim still expires eventually. With no slot
+    // to spare the request runs unclaimed and finish() tries again
+    if (!reserve(s, 1, NIL)) return Lookup::New;
+    uint32_t slot = allocate(s);
+    Slot& e = s.slots[slot];
+    e.key = key;
+    e.state = Claimed;
+    e.len = 0;
+    e.more = NIL;
+    e.expires = expires;
+    link(s, slot);
+    insert(s, slot, hash);
+    s.entries++;
+    return Lookup::New;
+}
+
+void DedupCache::finish(const Key& key, const uint8_t* reply, size_t len) {
+    if (len > 0xFFFF) return;
+    const uint64_t hash = hashOf(key);
+    const uint32_t expires = tickOf(Clock::now()) + ttlTicks_;
+    const uint32_t extra = len > SLOT_DATA ? uint32_t((len - 1) / SLOT_DATA) : 0;
+    Stripe& s = stripeOf(hash);
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    uint32_t slot;
+    uint32_t pos = find(s, key, hash);
+    if (pos != NIL) {
+        slot = s.index[pos];
+        releaseChain(s, s.slots[slot].more);
+        s.slots[slot].more = NIL;
+        unlink(s, slot);
+    } else {
+        // Claim was evicted (or never made) while the request ran
+        if (!reserve(s, 1, NIL)) return;
+        slot = allocate(s);
+        s.slots[slot].key = key;
+        s.slots[slot].more = NIL;
+        insert(s, slot, hash);
+        s.entries++;
+    }
+    Slot& e = s.slots[slot];
+    e.state = Claimed;
+    e.expires = expires;
+    link(s, slot);
+    if (!reserve(s, extra, slot)) {
+        drop(s, slot);  // longer than the whole stripe can hold
+        return;
+    }
+
+    size_t copied = std::min(len, SLOT_DATA);
+    std::memcpy(e.data, reply, copied);
+    uint32_t last = NIL;
+    while (copied < len) {
+        uint32_t x = allocate(s);
+        Slot& ext = s.slots[x];
+        size_t n = std::min(len - copied, SLOT_DATA);
+        std::memcpy(ext.data, reply + copied, n);
+        ext.state = Extension;
+        ext.next = NIL;
+        if (last == NIL) {
+            e.more = x;
+        } else {
+            s.slots[last].next = x;
+        }
+        last = x;
+        copied += n;
+    }
+    e.len = uint16_t(len);
+    e.state = Done;
+}
+
+void DedupCache::expire(Clock::time_point now) {
+    const uint32_t target = tickOf(now);
+    for (size_t i = 0; i <= mask_; i++) {
+        Stripe& s = stripes_[i];
+        std::lock_guard<std::mutex> lock(s.mutex);
+        advance(s, target);
+    }
+}
+
+size_t DedupCache::size() const {
+    size_t n = 0;
+    for (size_t i = 0; i <= mask_; i++) {
+        std::lock_guard<std::mutex> lock(stripes_[i].mutex);
+        n += stripes_[i].entries;
+    }
+    return n;
+}
+
+uint64_t DedupCache::evictions() const {
+    uint64_t n = 0;
+    for (size_t i = 0; i <= mask_; i++) {
+        std::lock_guard<std::mutex> lock(stripes_[i].mutex);
+        n += stripes_[i].evictions;
+    }
+    return n;
+}
+
+// ==================== Index ====================
+
+uint32_t DedupCache::find(const Stripe& s, const Key& key, uint64_t hash) {
+    for (uint32_t i = uint32_t(hash) & s.indexMask;; i = (i + 1) & s.indexMask) {
+        uint32_t x = s.index[i];
+        if (x == NIL) return NIL;
+        if (s.slots[x].key == key) return i;
+    }
+}
+
+void DedupCache::insert(Stripe& s, uint32_t slot, uint64_t hash) {
+    uint32_t i = uint32_t(hash) & s.indexMask;
+    while (s.index[i] != NIL) i = (i + 1) & s.indexMask;
+    s.index[i] = slot;
+}
+
+void DedupCache::erase(Stripe& s, uint32_t pos) {
+    // Backward-shift deletion: pull later entries of the probe run into
+    // the hole unless that would move them before their home position
+    uint32_t hole = pos;
+    for (uint32_t j = (pos + 1) & s.indexMask;; j = (j + 1) & s.indexMask) {
+        uint32_t x = s.index[j];
+        if (x == NIL) break;
+        uint32_t home = uint32_t(hashOf(s.slots[x].key)) & s.indexMask;
+        bool stays = hole <= j ? (hole < home && home <= j) : (hole < home || home <= j);
+        if (!stays) {
+            s.index[hole] = x;
+            hole = j;
+        }
+    }
+    s.index[hole] = NIL;
+}
+
+// ==================== Slot pool ====================
+
+bool DedupCache::reserve(Stripe& s, uint32_t n, uint32_t keep) {
+    while (s.freeCount < n) {
+        uint32_t victim = oldest(s);
+        if (victim == NIL || victim == keep) return false;
+        drop(s, victim);
+        s.evictions++;
+    }
+    return true;
+}
+
+uint32_t DedupCache::allocate(Stripe& s) {
+    uint32_t slot = s.freeHead;
+    s.freeHead = s.slots[slot].next;
+    s.freeCount--;
+    return slot;
+}
+
+void DedupCache::release(Stripe& s, uint32_t slot) {
+    s.slots[slot].state = Free;
+    s.slots[slot].next = s.freeHead;
+    s.freeHead = slot;
+    s.freeCount++;
+}
+
+void DedupCache::releaseChain(Stripe& s, uint32_t slot) {
+    while (slot != NIL) {
+        uint32_t next = s.slots[slot].next;
+        release(s, slot);
+        slot = next;
+    }
+}
+
+void DedupCache::drop(Stripe& s, uint32_t slot) {
+    Slot& e = s.slots[slot];
+    erase(s, find(s, e.key, hashOf(e.key)));
+    unlink(s, slot);
+    releaseChain(s, e.more);
+    release(s, slot);
+    s.entries--;
+}
+
+// ==================== Timing wheel ====================
+//
+// Level l bucket i holds entries whose expiry tick, shifted right by
+// 6 * l, is i modulo 64, and which are less than 64 such units ahead of
+// the current tick. Every 64 ticks the next level-1 bucket is cascaded
+// into level 0 (every 4096 ticks, a level-2 bucket into levels 1 and 0),
+// so each entry is moved at most twice before it is dropped.
+
+void DedupCache::link(Stripe& s, uint32_t slot) {
+    Slot& e = s.slots[slot];
+    const uint32_t now = s.now;
+    if (int32_t(e.expires - now) < 0) e.expires = now;
+
+    uint32_t b;
+    if (e.expires - now < WHEEL_SIZE) {
+        b = e.expires & WHEEL_MASK;
+    } else if ((e.expires >> WHEEL_BITS) - (now >> WHEEL_BITS) < WHEEL_SIZE) {
+        b = WHEEL_SIZE + ((e.expires >> WHEEL_BITS) & WHEEL_MASK);
+    } else {
+        // Beyond the horizon: expire early rather than wrap around
+        if ((e.expires >> 2 * WHEEL_BITS) - (now >> 2 * WHEEL_BITS) >= WHEEL_SIZE) {
+            e.expires = ((now >> 2 * WHEEL_BITS) + WHEEL_MASK) << 2 * WHEEL_BITS;
+        }
+        b = 2 * WHEEL_SIZE + ((e.expires >> 2 * WHEEL_BITS) & WHEEL_MASK);
+    }
+
+    e.bucket = uint16_t(b);
+    e.next = NIL;
+    e.prev = s.tail[b];
+    if (e.prev == NIL) {
+        s.head[b] = slot;
+    } else {
+        s.slots[e.prev].next = slot;
+    }
+    s.tail[b] = slot;
+}
+
+void DedupCache::unlink(Stripe& s, uint32_t slot) {
+    Slot& e = s.slots[slot];
+    if (e.prev == NIL) {
+        s.head[e.bucket] = e.next;
+    } else {
+        s.slots[e.prev].next = e.next;
+    }
+    if (e.next == NIL) {
+        s.tail[e.bucket] = e.prev;
+    } else {
+        s.slots[e.next].prev = e.prev;
+    }
+}
+
+void DedupCache::cascade(Stripe& s, uint32_t bucket) {
+    uint32_t x = s.head[bucket];
+    s.head[bucket] = s.tail[bucket] = NIL;
+    while (x != NIL) {
+        uint32_t next = s.slots[x].next;
+        link(s, x);
+        x = next;
+    }
+}
+
+void DedupCache::advance(Stripe& s, uint32_t target) {
+    while (int32_t(target - s.now) > 0) {
+        if (s.entries == 0) {
+            s.now = target;  // nothing to expire
+            return;
+        }
+        uint32_t t = ++s.now;
+        if ((t & WHEEL_MASK) == 0) {
+            if (((t >> WHEEL_BITS) & WHEEL_MASK) == 0) {
+                cascade(s, 2 * WHEEL_SIZE + ((t >> 2 * WHEEL_BITS) & WHEEL_MASK));
+            }
+            cascade(s, WHEEL_SIZE + ((t >> WHEEL_BITS) & WHEEL_MASK));
+        }
+        uint32_t b = t & WHEEL_MASK;
+        while (s.head[b] != NIL) drop(s, s.head[b]);
+    }
+}
+
+uint32_t DedupCache::oldest(const Stripe& s) {
+    // Nearest bucket first on each level; a bounded scan whatever the size
+    for (int level = 0; level < LEVELS; level++) {
+        uint32_t base = s.now >> (level * WHEEL_BITS);
+        for (uint32_t i = level == 0 ? 0 : 1; i <= WHEEL_SIZE; i++) {
+            uint32_t b = level * WHEEL_SIZE + ((base + i) & WHEEL_MASK);
+            if (s.head[b] != NIL) return s.head[b];
+        }
+    }
+    return NIL;
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "net.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+/**
+ * Reply cache for at-most-once requests, keyed by client address and
+ * requestId
+ *
+ * Striped like the account store so workers handling different clients
+ * do not share a lock. A request is claimed before it runs, so a
+ * retransmission that arrives while the original is still executing is
+ * dropped rather than executed a second time (the client retries and then
+ * gets the cached reply). Entries expire TTL seconds after the reply was
+ * stored (60 s, as in server_java/src/Server.java).
+ *
+ * All memory is allocated up front from a byte budget, so the footprint is
+ * flat however long the server runs:
+ * - Each stripe owns a fixed pool of 128-byte slots and an open-addressing
+ *   index (linear probing, load <= 0.5) over them. A reply is stored in
+ *   its entry's slot, spilling into extension slots if it is longer
+ * - Expiry goes through a hierarchical timing wheel per stripe, so the
+ *   housekeeper only touches entries that are due
+ * - When the pool is full the entries closest to expiry are evicted;
+ *   finding them is a bounded scan of the wheel buckets. An evicted
+ *   request is executed again if it is retransmitted
+ */
+class DedupCache {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr int DEFAULT_TTL_SECONDS = 60;
+    static constexpr size_t DEFAULT_MEMORY_BYTES = size_t(64) << 20;
+
+    // Client address and requestId packed into 128 bits
+    struct Key {
+        uint64_t hi;  // ip << 16 | port
+        uint64_t lo;  // requestId
+
+        bool operator==(const Key& o) const { return hi == o.hi && lo == o.lo; }
+    };
+
+    enum class Lookup {
+        New,         // claimed: run the request, then call finish()
+        Done,        // reply copied out: send it again
+        InProgress   // original still executing: drop this copy
+    };
+
+    struct Config {
+        size_t stripes = 64;                        // rounded up to a power of two
+        size_t memoryBytes = DEFAULT_MEMORY_BYTES;  // slots + index, all stripes
+        int ttlSeconds = DEFAULT_TTL_SECONDS;
+    };
+
+    explicit DedupCache(const Config& cfg);
+
+    static Key keyOf(const sockaddr_in& from, uint64_t requestId);
+
+    /**
+     * Claim a request or fetch its stored reply
+     * @param reply Output: the cached reply datagram (Lookup::Done only),
+     *              at least proto::MAX_DATAGRAM bytes
+     * @param len Output: reply size (Lookup::Done only)
+     */
+    Lookup begin(const Key& key, uint8_t* reply, size_t& len);
+
+    // Store the reply of a claimed request
+    void finish(const Key& key, const uint8_t* reply, size_t len);
+
+    // Advance the timing wheels to now, dropping entries whose time is up
+    void expire(Clock::time_point now);
+
+    size_t size() const;
+    size_t capacity() const { return capacity_; }  // slots, all stripes
+    size_t memoryBytes() const { return bytes_; }  // allocated
+    uint64_t evictions() const;                    // entries dropped before their TTL
+
+private:
+    static constexpr uint32_t NIL = 0xFFFFFFFFu;
+    static constexpr int TICK_MS = 250;
+    static constexpr int WHEEL_BITS = 6;
+    static constexpr uint32_t WHEEL_SIZE = 1u << WHEEL_BITS;
+    static constexpr uint32_t WHEEL_MASK = WHEEL_SIZE - 1;
+    static constexpr int LEVELS = 3;  // 64^3 ticks = 18 h horizon
+
+    enum State : uint8_t { Free, Claimed, Done, Extension };
+
+    struct Slot {
+        Key key;
+        uint32_t prev;     // wheel bucket list
+        uint32_t next;     // wheel bucket list, free list, or extension chain
+        uint32_t more;     // first extension slot of the reply
+        uint32_t expires;  // wheel tick
+        uint16_t len;      // reply bytes, all slots
+        uint16_t bucket;   // level * WHEEL_SIZE + index
+        State state;
+        uint8_t data[88];
+    };
+    static_assert(sizeof(Slot) == 128, "two cache lines per four slots");
+    static constexpr size_t SLOT_DATA = sizeof(Slot::data);
+
+    struct alignas(64) Stripe {
+        mutable std::mutex mutex;
+        std::unique_ptr<Slot[]> slots;
+        std::unique_ptr<uint32_t[]> index;  // slot numbers, NIL = empty
+        uint32_t indexMask = 0;
+        uint32_t freeHead = NIL;
+        uint32_t freeCount = 0;
+        uint32_t entries = 0;
+        uint32_t now = 0;  // current wheel tick
+        uint32_t head[LEVELS * WHEEL_SIZE];  // wheel buckets, oldest first
+        uint32_t tail[LEVELS * WHEEL_SIZE];
+        uint64_t evictions = 0;
+    };
+
+    std::unique_ptr<Stripe[]> stripes_;
+    size_t mask_;
+    size_t capacity_;
+    size_t bytes_;
+    uint32_t ttlTicks_;
+    Clock::time_point epoch_;
+
+    static uint64_t hashOf(const Key& k) {
+        uint64_t h = k.lo * 0x9E3779B97F4A7C15ULL ^ (k.hi + 0x632BE59BD9B4E019ULL) * 0xC2B2AE3D27D4EB4FULL;
+        return h ^ (h >> 31);
+    }
+    Stripe& stripeOf(uint64_t hash) { return stripes_[(hash >> 40) & mask_]; }
+    uint32_t tickOf(Clock::time_point t) const;
+
+    // Index
+    static uint32_t find(const Stripe& s, const Key& key, uint64_t hash);  // position or NIL
+    static void insert(Stripe& s, uint32_t slot, uint64_t hash);
+    static void erase(Stripe& s, uint32_t pos);
+
+    // Slot pool
+    static bool reserve(Stripe& s, uint32_t n, uint32_t keep);  // evict until n slots are free
+    static uint32_t allocate(Stripe& s);
+    static void release(Stripe& s, uint32_t slot);
+    static void releaseChain(Stripe& s, uint32_t slot);
+    static void drop(Stripe& s, uint32_t slot);
+
+    // Timing wheel
+    static void link(Stripe& s, uint32_t slot);
+    static void unlink(Stripe& s, uint32_t slot);
+    static void cascade(Stripe& s, uint32_t bucket);
+    static void advance(Stripe& s, uint32_t target);
+    static uint32_t oldest(const Stripe& s);
+};
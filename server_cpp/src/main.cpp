@@ -0,0 +1,191 @@
+#include "log.hpp"
+#include "net.hpp"
+#include "server.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+/**
+ * Native banking server
+ *
+ * Usage:
+ *   server.exe --port 9000 --lossReq 0.0 --lossRep 0.0 --threads 8
+ *
+ * Arguments:
+ *   --port      Server port (default: 9000)
+ *   --lossReq   Request loss probability 0.0-1.0 (default: 0.0)
+ *   --lossRep   Reply loss probability 0.0-1.0 (default: 0.0)
+ *   --threads   Worker threads (default: 0 = one per hardware thread)
+ *   --shards    Account store shards (default: 64)
+ *   --node      Account number range 0-20 (default: 0, numbers from
+ *               10001); give every server a client routes to its own
+ *   --verbose   Log every request, as the Java server does
+ *   --stats     Print request rate every N seconds (default: 0 = off)
+ *   --shared-socket  All workers drain one socket instead of one
+ *               SO_REUSEPORT socket each
+ *   --pin       Pin worker i to CPU i
+ *   --batch     Datagrams per receive call (default: 32, max 64)
+ *   --dedup-mb  Memory for the at-most-once reply cache in MB (default: 64)
+ *   --dedup-ttl Reply cache entry lifetime in seconds (default: 60)
+ *   --window-mb Memory for per-client windows of sequenced request IDs in
+ *               MB (default: 16)
+ *   --data      Directory for the write-ahead log and snapshots (default:
+ *               none, accounts are lost on exit)
+ *   --snapshot  Snapshot interval in seconds (default: 60, 0 = never)
+ *   --no-fsync  Write the log without fsync (survives a crash of the
+ *               process, not of the machine)
+ *   --callback-linger  Microseconds the notifier waits to coalesce
+ *               callbacks (default: 1000, 0 = send at once)
+ *   --allow-scan  Let SNAPSHOT without a name list every open account
+ *               (default: only the accounts of the given holder)
+ *   --token-ttl Lifetime of LOGIN session tokens in seconds (default: 300,
+ *               0 = LOGIN refused, max 65535)
+ */
+int main(int argc, char* argv[]) {
+    Server::Config cfg;
+    int statsInterval = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            cfg.port = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--lossReq") == 0 && i + 1 < argc) {
+            cfg.lossReq = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--lossRep") == 0 && i + 1 < argc) {
+            cfg.lossRep = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            cfg.threads = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            cfg.shards = (size_t)std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--node") == 0 && i + 1 < argc) {
+            cfg.node = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--verbose") == 0) {
+            cfg.verbose = true;
+        } else if (std::strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            statsInterval = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--shared-socket") == 0) {
+            cfg.reusePort = false;
+        } else if (std::strcmp(argv[i], "--pin") == 0) {
+            cfg.pin = true;
+        } else if (std::strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            cfg.recvBatch = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--dedup-mb") == 0 && i + 1 < argc) {
+            cfg.dedupBytes = size_t(std::atoi(argv[++i])) << 20;
+        } else if (std::strcmp(argv[i], "--dedup-ttl") == 0 && i + 1 < argc) {
+            cfg.dedupTtl = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--window-mb") == 0 && i + 1 < argc) {
+            cfg.windowBytes = size_t(std::atoi(argv[++i])) << 20;
+        } else if (std::strcmp(argv[i], "--data") == 0 && i + 1 < argc) {
+            cfg.dataDir = argv[++i];
+        } else if (std::strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+            cfg.snapshotSeconds = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--no-fsync") == 0) {
+            cfg.fsync = false;
+        } else if (std::strcmp(argv[i], "--callback-linger") == 0 && i + 1 < argc) {
+            cfg.callbackLingerMicros = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--allow-scan") == 0) {
+            cfg.allowScan = true;
+        } else if (std::strcmp(argv[i], "--token-ttl") == 0 && i + 1 < argc) {
+            cfg.tokenTtl = std::atoi(argv[++i]);
+        } else {
+            std::cout << "Usage: " << argv[0] << " [options]\n";
+            std::cout << "Options:\n";
+            std::cout << "  --port <port>     Server port (default: 9000)\n";
+            std::cout << "  --lossReq <prob>  Request loss probability 0.0-1.0 (default: 0.0)\n";
+            std::cout << "  --lossRep <prob>  Reply loss probability 0.0-1.0 (default: 0.0)\n";
+            std::cout << "  --threads <n>     Worker threads (default: 0 = one per hardware thread)\n";
+            std::cout << "  --shards <n>      Account store shards (default: 64)\n";
+            std::cout << "  --node <k>        Account number range 0-20, one per server (default: 0)\n";
+            std::cout << "  --verbose         Log every request\n";
+            std::cout << "  --stats <s>       Print request rate every s seconds (default: 0 = off)\n";
+            std::cout << "  --shared-socket   Workers share one socket (default: one SO_REUSEPORT socket each)\n";
+            std::cout << "  --pin             Pin worker i to CPU i\n";
+            std::cout << "  --batch <n>       Datagrams per receive call (default: 32, max 64)\n";
+            std::cout << "  --dedup-mb <mb>   Reply cache memory in MB (default: 64)\n";
+            std::cout << "  --dedup-ttl <s>   Reply cache entry lifetime in seconds (default: 60)\n";
+            std::cout << "  --window-mb <mb>  Sequenced-client window memory in MB (default: 16)\n";
+            std::cout << "  --data <dir>      Keep accounts in a write-ahead log and snapshots (default: memory only)\n";
+            std::cout << "  --snapshot <s>    Snapshot interval in seconds (default: 60, 0 = never)\n";
+            std::cout << "  --no-fsync        Write the log without fsync\n";
+            std::cout << "  --callback-linger <us> Callback coalescing window (default: 1000, 0 = off)\n";
+            std::cout << "  --allow-scan      SNAPSHOT without a name lists every account\n";
+            std::cout << "  --token-ttl <s>   LOGIN session token lifetime (default: 300, 0 = no LOGIN)\n";
+            return 0;
+        }
+    }
+
+    if (cfg.node < 0 || cfg.node >= proto::MAX_NODES) {
+        std::cerr << "--node must be 0-" << proto::MAX_NODES - 1 << "\n";
+        return 1;
+    }
+
+    logging::tag() = "server";
+    if (!net::startup()) {
+        std::cerr << "Failed to initialize networking\n";
+        return 1;
+    }
+
+    Server server(cfg);
+    if (!server.start()) {
+        std::cerr << "Failed to start server on UDP port " << cfg.port << "\n";
+        net::cleanup();
+        return 1;
+    }
+    std::cout << "[server] UDP listening on port " << cfg.port << " lossReq=" << cfg.lossReq
+              << " lossRep=" << cfg.lossRep << " threads=" << server.threadCount()
+              << " shards=" << server.store().shardCount() << " node=" << cfg.node
+              << " sockets=" << (server.perWorkerSockets() ? "per-worker" : "shared")
+              << " dedup=" << server.dedup().capacity() << " slots/"
+              << (server.dedup().memoryBytes() >> 20) << "MB"
+              << " windows=" << server.window().capacity() << "/" << (server.window().memoryBytes() >> 20) << "MB"
+              << std::endl;
+    if (!cfg.dataDir.empty()) {
+        const Persistence::Recovery& r = server.recovery();
+        std::cout << "[server] recovered " << server.store().accountCount() << " accounts from " << cfg.dataDir
+                  << " (snapshot: " << (r.fromSnapshot ? std::to_string(r.snapshotAccounts) : std::string("none"))
+                  << ", log: " << r.records << " records in " << r.segments << " segments"
+                  << (r.torn ? ", torn tail ignored" : "") << ") in " << r.millis << " ms" << std::endl;
+    }
+
+    // Serve until killed, like the Java server
+    Server::Stats last;
+    auto lastTime = std::chrono::steady_clock::now();
+    for (;;) {
+        std::this_thread::sleep_for(std::chrono::seconds(statsInterval > 0 ? statsInterval : 3600));
+        if (statsInterval <= 0) continue;
+        Server::Stats now = server.stats();
+        auto t = std::chrono::steady_clock::now();
+        double secs = std::chrono::duration<double>(t - lastTime).count();
+        char line[256];
+        std::snprintf(line, sizeof(line),
+                      "[server] %.0f req/s  total=%llu dup=%llu dropped=%llu bad=%llu callbacks=%llu accounts=%zu cached=%zu evicted=%llu",
+                      (now.requests - last.requests) / secs, (unsigned long long)now.requests,
+                      (unsigned long long)now.duplicates, (unsigned long long)now.dropped,
+                      (unsigned long long)now.bad, (unsigned long long)now.callbacks,
+                      server.store().accountCount(), server.dedup().size(),
+                      (unsigned long long)server.dedup().evictions());
+        // How evenly the kernel spreads clients over the workers
+        std::string spread;
+        for (size_t i = 0; i < now.perWorker.size(); i++) {
+            uint64_t prev = i < last.perWorker.size() ? last.perWorker[i] : 0;
+            spread += (i ? " " : "") + std::to_string(now.perWorker[i] - prev);
+        }
+        std::cerr << line << "  workers=[" << spread << "]";
+        std::cerr << "  windows=" << server.window().clients() << " stale=" << server.window().stale()
+                  << " spilled=" << server.window().spilled();
+        MonitorHub::Stats ms = server.monitors().stats();
+        if (ms.monitors > 0 || ms.dropped > 0) {
+            std::cerr << "  monitors=" << ms.monitors << " updates=" << ms.updates << " lost=" << ms.dropped;
+        }
+        if (Persistence* p = server.persistence()) {
+            wal::Log::Stats ws = p->log().stats();
+            std::cerr << "  wal=" << ws.records << " records/" << ws.syncs << " commits";
+        }
+        std::cerr << "\n";
+        last = now;
+        lastTime = t;
+    }
+}
@@ -0,0 +1,246 @@
+#include "monitor_hub.hpp"
+#include "endian.hpp"
+#include "log.hpp"
+#include "schema.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+std::string addrString(const sockaddr_in& a) {
+    char ip[INET_ADDRSTRLEN] = "?";
+    inet_ntop(AF_INET, &a.sin_addr, ip, sizeof(ip));
+    return std::string(ip) + ":" + std::to_string(ntohs(a.sin_port));
+}
+
+void eraseKey(std::vector<uint64_t>& v, uint64_t key) {
+    auto it = std::find(v.begin(), v.end(), key);
+    if (it == v.end()) return;
+    *it = v.back();
+    v.pop_back();
+}
+
+} // namespace
+
+MonitorHub::MonitorHub(const Config& cfg)
+    : cfg_(cfg), sock_(net::INVALID_SOCK), stopping_(false), live_(0),
+      arena_(size_t(net::MAX_BATCH) * proto::MAX_DATAGRAM), packetCount_(0), updates_(0), datagrams_(0),
+      dropped_(0) {}
+
+MonitorHub::~MonitorHub() {
+    stop();
+}
+
+uint64_t MonitorHub::keyOf(const sockaddr_in& addr) {
+    return uint64_t(ntohl(addr.sin_addr.s_addr)) << 16 | ntohs(addr.sin_port);
+}
+
+void MonitorHub::start(net::Socket sock) {
+    sock_ = sock;
+    stopping_ = false;
+    thread_ = std::thread(&MonitorHub::run, this);
+}
+
+void MonitorHub::stop() {
+    if (!thread_.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+}
+
+// ==================== Registration ====================
+
+void MonitorHub::subscribe(const sockaddr_in& addr, int seconds, uint16_t options,
+                           std::vector<int32_t> accounts) {
+    std::sort(accounts.begin(), accounts.end());
+    accounts.erase(std::unique(accounts.begin(), accounts.end()), accounts.end());
+
+    const uint64_t key = keyOf(addr);
+    std::lock_guard<std::mutex> lock(indexMutex_);
+    auto it = subs_.find(key);
+    if (it != subs_.end()) unindex(key, it->second);
+
+    Subscriber& s = subs_[key];
+    s.addr = addr;
+    s.until = Clock::now() + std::chrono::seconds(seconds);
+    s.batch = (options & proto::MONITOR_BATCH) != 0;
+    s.accounts = std::move(accounts);
+    if (s.accounts.empty()) {
+        everyone_.push_back(key);
+    } else {
+        for (int32_t acc : s.accounts) byAccount_[acc].push_back(key);
+    }
+    // A replaced registration leaves its old deadline behind; expire()
+    // tells them apart by the time
+    deadlines_.push(Deadline{s.until, key});
+    live_.store(subs_.size(), std::memory_order_release);
+}
+
+void MonitorHub::unindex(uint64_t key, const Subscriber& s) {
+    if (s.accounts.empty()) {
+        eraseKey(everyone_, key);
+        return;
+    }
+    for (int32_t acc : s.accounts) {
+        auto it = byAccount_.find(acc);
+        if (it == byAccount_.end()) continue;
+        eraseKey(it->second, key);
+        if (it->second.empty()) byAccount_.erase(it);
+    }
+}
+
+void MonitorHub::expire(Clock::time_point now) {
+    while (!deadlines_.empty() && deadlines_.top().first <= now) {
+        Deadline d = deadlines_.top();
+        deadlines_.pop();
+        auto it = subs_.find(d.second);
+        if (it == subs_.end() || it->second.until != d.first) continue;  // replaced since
+        BANK_LOG(logging::Info, cfg_.verbose, "MONITOR expired: " << addrString(it->second.addr));
+        unindex(d.second, it->second);
+        subs_.erase(it);
+    }
+    live_.store(subs_.size(), std::memory_order_release);
+}
+
+// ==================== Publishing ====================
+
+void MonitorHub::publish(uint16_t updateType, int32_t accNo, uint16_t currency, double balance,
+                         std::string info) {
+    updates_.fetch_add(1, std::memory_order_relaxed);
+    bool first;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        if (queue_.size() >= cfg_.queueLimit) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        queue_.push_back(Update{updateType, accNo, currency, balance, std::move(info)});
+        first = queue_.size() == 1;
+    }
+    // Later updates of the round are picked up without a wake-up
+    if (first) wake_.notify_one();
+}
+
+MonitorHub::Stats MonitorHub::stats() const {
+    Stats s;
+    s.updates = updates_.load(std::memory_order_relaxed);
+    s.datagrams = datagrams_.load(std::memory_order_relaxed);
+    s.dropped = dropped_.load(std::memory_order_relaxed);
+    s.monitors = live_.load(std::memory_order_relaxed);
+    return s;
+}
+
+// ==================== Notifier ====================
+
+void MonitorHub::run() {
+    std::vector<Update> round;
+    std::unique_lock<std::mutex> lock(queueMutex_);
+    while (true) {
+        // Wake at least once a second to expire registrations
+        wake_.wait_for(lock, std::chrono::seconds(1), [this] { return stopping_ || !queue_.empty(); });
+        if (!queue_.empty() && !stopping_ && cfg_.lingerMicros > 0) {
+            lock.unlock();
+            std::this_thread::sleep_for(std::chrono::microseconds(cfg_.lingerMicros));
+            lock.lock();
+        }
+        round.swap(queue_);
+        const bool last = stopping_;
+        lock.unlock();
+
+        deliver(round);
+        round.clear();
+
+        lock.lock();
+        if (last && queue_.empty()) break;
+    }
+}
+
+void MonitorHub::deliver(const std::vector<Update>& round) {
+    std::lock_guard<std::mutex> lock(indexMutex_);
+    const auto now = Clock::now();
+    expire(now);
+    if (subs_.empty()) return;
+
+    uint8_t body[proto::MAX_DATAGRAM - proto::HEADER_SIZE];
+    for (const Update& u : round) {
+        proto::Writer w(body, sizeof(body));
+        proto::schema::CallbackUpdate::write(w, u.updateType, u.accNo, u.currency, u.balance, u.info);
+        if (!w.ok()) continue;
+
+        auto visit = [&](uint64_t key) { append(subs_.find(key)->second, body, w.size()); };
+        for (uint64_t key : everyone_) visit(key);
+        auto it = byAccount_.find(u.accNo);
+        if (it != byAccount_.end()) {
+            for (uint64_t key : it->second) visit(key);
+        }
+    }
+
+    for (Subscriber* s : touched_) flushPending(*s);
+    touched_.clear();
+    sendPackets();
+}
+
+void MonitorHub::append(Subscriber& s, const uint8_t* body, size_t len) {
+    if (!s.batch) {
+        emit(s.addr, uint16_t(proto::OpCode::CALLBACK_UPDATE), body, len, 1);
+        return;
+    }
+    // pending = count:u16 followed by the update bodies
+    if (s.pendingCount > 0 && s.pending.size() + len > proto::BATCH_MTU_BODY) flushPending(s);
+    if (s.pendingCount == 0) {
+        touched_.push_back(&s);  // listed again after a flush; flushing twice is harmless
+        s.pending.assign(2, 0);
+    }
+    s.pending.insert(s.pending.end(), body, body + len);
+    s.pendingCount++;
+}
+
+void MonitorHub::flushPending(Subscriber& s) {
+    if (s.pendingCount == 1) {
+        // A lone update goes out in the plain format
+        emit(s.addr, uint16_t(proto::OpCode::CALLBACK_UPDATE), s.pending.data() + 2, s.pending.size() - 2, 1);
+    } else if (s.pendingCount > 1) {
+        proto::putBE16(s.pending.data(), s.pendingCount);
+        emit(s.addr, uint16_t(proto::OpCode::CALLBACK_BATCH), s.pending.data(), s.pending.size(), s.pendingCount);
+    }
+    s.pendingCount = 0;
+}
+
+void MonitorHub::emit(const sockaddr_in& addr, uint16_t opCode, const uint8_t* body, size_t len,
+                      uint16_t updates) {
+    uint8_t* p = arena_.data() + size_t(packetCount_) * proto::MAX_DATAGRAM;
+    proto::Header h{};
+    h.magic = proto::MAGIC;
+    h.version = proto::VERSION;
+    h.msgType = (uint8_t)proto::MsgType::Callback;
+    h.opCode = opCode;
+    h.status = uint16_t(proto::Status::OK);
+    h.bodyLen = uint32_t(len);
+    proto::writeHeader(p, h);
+    std::memcpy(p + proto::HEADER_SIZE, body, len);
+
+    packets_[packetCount_].data = p;
+    packets_[packetCount_].len = proto::HEADER_SIZE + len;
+    packets_[packetCount_].addr = addr;
+    BANK_LOG(logging::Info, cfg_.verbose, "CALLBACK sent to " << addrString(addr) << ": "
+             << proto::opCodeToString(opCode) << " updates=" << updates);
+    if (++packetCount_ == net::MAX_BATCH) sendPackets();
+}
+
+void MonitorHub::sendPackets() {
+    for (int sent = 0; sent < packetCount_;) {
+        int r = net::sendBatch(sock_, packets_ + sent, packetCount_ - sent);
+        if (r < 0) {
+            sent++;  // hard error on this datagram: skip it
+        } else if (r == 0) {
+            std::this_thread::yield();  // send buffer full
+        } else {
+            sent += r;
+        }
+    }
+    datagrams_.fetch_add(uint64_t(packetCount_), std::memory_order_relaxed);
+    packetCount_ = 0;
+}
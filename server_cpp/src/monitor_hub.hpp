@@ -0,0 +1,144 @@
+#pragma once
+
+#include "net.hpp"
+#include "protocol.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Monitor registrations and asynchronous callback delivery
+ *
+ * Workers only queue an update (one short lock, no sends); a notifier
+ * thread fans the queue out to the subscribers, so the cost of a DEPOSIT
+ * does not grow with the number of monitors:
+ * - Subscriptions are indexed by account: an update visits the monitors
+ *   watching every account plus those that listed its account, never the
+ *   whole registration table
+ * - Expiry is a min-heap on the registration deadline, so lapsed monitors
+ *   are dropped as they come due without scanning the others
+ * - The notifier waits Config::lingerMicros after the first update of a
+ *   round, then delivers everything queued meanwhile. Monitors registered
+ *   with proto::MONITOR_BATCH get their updates of a round coalesced into
+ *   CALLBACK_BATCH datagrams of at most one MTU; others get one
+ *   CALLBACK_UPDATE per update, as from server_java. All datagrams of a
+ *   round leave in sendBatch calls
+ *
+ * Callbacks are best effort, as before: an update that finds the queue
+ * full (Config::queueLimit) is dropped and counted.
+ */
+class MonitorHub {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Config {
+        int lingerMicros = 1000;    // coalescing window, 0 = deliver at once
+        size_t queueLimit = 65536;  // updates waiting for the notifier
+        bool verbose = false;       // one line per callback datagram
+    };
+
+    struct Stats {
+        uint64_t updates = 0;    // published
+        uint64_t datagrams = 0;  // callback datagrams sent
+        uint64_t dropped = 0;    // updates lost to a full queue
+        size_t monitors = 0;     // live registrations
+    };
+
+    explicit MonitorHub(const Config& cfg);
+    ~MonitorHub();
+
+    MonitorHub(const MonitorHub&) = delete;
+    MonitorHub& operator=(const MonitorHub&) = delete;
+
+    // Start the notifier; callbacks are sent from sock (bound to the server port)
+    void start(net::Socket sock);
+
+    // Deliver what is queued and join the notifier
+    void stop();
+
+    /**
+     * Register a monitor, replacing an earlier registration from the same address
+     * @param options proto::MONITOR_BATCH or 0
+     * @param accounts Accounts to watch, empty = all
+     */
+    void subscribe(const sockaddr_in& addr, int seconds, uint16_t options, std::vector<int32_t> accounts);
+
+    // Cheap check before building an update: false while nobody is registered
+    bool active() const { return live_.load(std::memory_order_acquire) != 0; }
+
+    // Queue one applied change for the monitors watching accNo
+    void publish(uint16_t updateType, int32_t accNo, uint16_t currency, double balance, std::string info);
+
+    Stats stats() const;
+
+private:
+    struct Update {
+        uint16_t updateType;
+        int32_t accNo;
+        uint16_t currency;
+        double balance;
+        std::string info;
+    };
+
+    struct Subscriber {
+        sockaddr_in addr;
+        Clock::time_point until;
+        bool batch;
+        std::vector<int32_t> accounts;  // sorted, empty = all
+        // CALLBACK_BATCH body being filled during a round
+        std::vector<uint8_t> pending;
+        uint16_t pendingCount = 0;
+    };
+
+    using Deadline = std::pair<Clock::time_point, uint64_t>;  // until, subscriber key
+
+    Config cfg_;
+    net::Socket sock_;
+    std::thread thread_;
+
+    // Update queue (workers -> notifier)
+    std::mutex queueMutex_;
+    std::condition_variable wake_;
+    std::vector<Update> queue_;
+    bool stopping_;
+
+    // Subscription index, guarded by indexMutex_
+    std::mutex indexMutex_;
+    std::unordered_map<uint64_t, Subscriber> subs_;
+    std::vector<uint64_t> everyone_;                                // watching all accounts
+    std::unordered_map<int32_t, std::vector<uint64_t>> byAccount_;  // watching listed accounts
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> deadlines_;
+    std::atomic<size_t> live_;
+
+    // Notifier state: datagrams of the current round
+    std::vector<uint8_t> arena_;
+    net::Packet packets_[net::MAX_BATCH];
+    int packetCount_;
+    std::vector<Subscriber*> touched_;  // batch subscribers with a pending body
+
+    std::atomic<uint64_t> updates_;
+    std::atomic<uint64_t> datagrams_;
+    std::atomic<uint64_t> dropped_;
+
+    static uint64_t keyOf(const sockaddr_in& addr);
+
+    void run();
+    void deliver(const std::vector<Update>& round);
+    void expire(Clock::time_point now);  // indexMutex_ held
+    void unindex(uint64_t key, const Subscriber& s);
+
+    // Append one update body for s, flushing its batch first if it would not fit
+    void append(Subscriber& s, const uint8_t* body, size_t len);
+    void flushPending(Subscriber& s);
+
+    // Queue a datagram (header + body) to addr, sending when the batch is full
+    void emit(const sockaddr_in& addr, uint16_t opCode, const uint8_t* body, size_t len, uint16_t updates);
+    void sendPackets();
+};
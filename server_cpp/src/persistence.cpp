@@ -0,0 +1,389 @@
+#include "persistence.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char SNAPSHOT_MAGIC[4] = {'B', 'S', 'N', 'P'};
+
+// Read-only view of a whole file
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { unmap(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool map(const std::string& path) {
+#ifdef _WIN32
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0) return false;
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping_) return false;
+        data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        size_ = size_t(size.QuadPart);
+        return data_ != nullptr;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void* p = ::mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return false;
+        ::madvise(p, size_t(st.st_size), MADV_SEQUENTIAL);
+        ::madvise(p, size_t(st.st_size), MADV_WILLNEED);
+        data_ = static_cast<const uint8_t*>(p);
+        size_ = size_t(st.st_size);
+        return true;
+#endif
+    }
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#endif
+
+    void unmap() {
+#ifdef _WIN32
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+#else
+        if (data_) ::munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+        data_ = nullptr;
+    }
+};
+
+// Snapshot numbers present in dir, newest first
+std::vector<uint32_t> listSnapshots(const std::string& dir) {
+    std::vector<uint32_t> out;
+    std::error_code ec;
+    for (const auto& e : fs::directory_iterator(dir, ec)) {
+        unsigned n;
+        char tail;
+        std::string name = e.path().filename().string();
+        if (std::sscanf(name.c_str(), "snapshot-%8u.bi%c", &n, &tail) == 2 && tail == 'n' &&
+            name.size() == std::strlen("snapshot-00000000.bin")) {
+            out.push_back(n);
+        }
+    }
+    std::sort(out.rbegin(), out.rend());
+    return out;
+}
+
+} // namespace
+
+Persistence::Persistence(const Config& cfg, AccountStore& store)
+    : cfg_(cfg), store_(store), log_(wal::Log::Config{cfg.dir, cfg.segmentBytes, cfg.fsync}),
+      stopping_(false), snapshotRecords_(0), foreign_(0) {}
+
+Persistence::~Persistence() {
+    stop();
+}
+
+std::string Persistence::snapshotPath(const std::string& dir, uint32_t segment) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "snapshot-%08u.bin", segment);
+    return (fs::path(dir) / name).string();
+}
+
+// ==================== Recovery ====================
+
+bool Persistence::recover(Recovery& out) {
+    auto t0 = std::chrono::steady_clock::now();
+    std::error_code ec;
+    fs::create_directories(cfg_.dir, ec);
+    if (!fs::is_directory(cfg_.dir, ec)) {
+        BANK_LOG(logging::Error, true, "persistence: cannot create data directory " << cfg_.dir);
+        return false;
+    }
+
+    // Newest snapshot that passes its checks; an unreadable one falls back
+    // to the one before it (its segments are only deleted after a newer
+    // snapshot is safely on disk)
+    uint32_t from = 0;
+    for (uint32_t n : listSnapshots(cfg_.dir)) {
+        uint32_t walSegment;
+        uint64_t accounts;
+        if (loadSnapshot(snapshotPath(cfg_.dir, n), walSegment, accounts)) {
+            from = walSegment;
+            out.fromSnapshot = true;
+            out.snapshotAccounts = accounts;
+            break;
+        }
+        BANK_LOG(logging::Warn, true, "persistence: ignoring damaged " << snapshotPath(cfg_.dir, n));
+    }
+
+    uint32_t last = from;
+    for (uint32_t seg : wal::Log::listSegments(cfg_.dir)) {
+        last = std::max(last, seg);
+        if (seg < from) continue;
+        bool torn;
+        std::string path = wal::Log::segmentPath(cfg_.dir, seg);
+        long long n = wal::Log::replay(
+            path, [this](wal::RecordType t, const uint8_t* p, size_t len) { apply(t, p, len); }, torn);
+        if (n < 0) {
+            BANK_LOG(logging::Warn, true, "persistence: skipping unreadable " << path);
+            continue;
+        }
+        out.records += uint64_t(n);
+        out.segments++;
+        out.torn = out.torn || torn;
+    }
+
+    // Serving them would hand out their numbers again and lose their changes
+    if (foreign_.load() > 0) {
+        BANK_LOG(logging::Error, true, "persistence: " << foreign_.load() << " accounts in " << cfg_.dir
+                 << " are outside the numbers of this node (first " << store_.firstAccount()
+                 << "); start with the --node they were written by");
+        return false;
+    }
+
+    // Leftovers of a snapshot that was being written
+    for (const auto& e : fs::directory_iterator(cfg_.dir, ec)) {
+        if (e.path().extension() == ".tmp") fs::remove(e.path(), ec);
+    }
+
+    if (!log_.open(last + 1)) {
+        BANK_LOG(logging::Error, true, "persistence: cannot create "
+                 << wal::Log::segmentPath(cfg_.dir, last + 1));
+        return false;
+    }
+    store_.setLog(&log_);
+    // A replayed log is compacted by the first snapshot
+    if (out.records > 0) snapshotRecords_ = ~uint64_t(0);
+    out.millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    return true;
+}
+
+bool Persistence::loadSnapshot(const std::string& path, uint32_t& walSegment, uint64_t& accounts) {
+    MappedFile file;
+    if (!file.map(path) || file.size() < sizeof(snapshot::Header)) return false;
+
+    snapshot::Header h;
+    std::memcpy(&h, file.data(), sizeof(h));
+    if (std::memcmp(h.magic, SNAPSHOT_MAGIC, 4) != 0 || h.version != snapshot::VERSION ||
+        h.byteOrder != snapshot::ORDER_MARK) {
+        return false;
+    }
+    const size_t body = file.size() - sizeof(h);
+    if (h.accounts > body / sizeof(snapshot::Account) ||
+        h.accounts * sizeof(snapshot::Account) + h.namesBytes != body) {
+        return false;
+    }
+    const uint8_t* p = file.data() + sizeof(h);
+    if (wal::crc32(p, body) != h.crc) return false;
+
+    const auto* a = reinterpret_cast<const snapshot::Account*>(p);
+    const char* names = reinterpret_cast<const char*>(p + h.accounts * sizeof(snapshot::Account));
+    for (uint64_t i = 0; i < h.accounts; i++) {
+        const snapshot::Account& e = a[i];
+        if (e.nameOffset > h.namesBytes || e.nameLen > h.namesBytes - e.nameOffset || e.passwordLen > 16) {
+            return false;
+        }
+    }
+
+    // Slices of the array go to different threads; restore() takes the
+    // stripe locks, and the array is in account-number order, so slices
+    // only meet at their edges
+    store_.reserve(size_t(h.accounts));
+    auto load = [&](uint64_t begin, uint64_t end) {
+        for (uint64_t i = begin; i < end; i++) {
+            const snapshot::Account& e = a[i];
+            if (!store_.restore(e.accNo, std::string_view(names + e.nameOffset, e.nameLen),
+                                std::string_view(e.password, e.passwordLen), e.currency, e.balance,
+                                e.closed != 0)) {
+                foreign_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    };
+    unsigned threads = std::min(std::max(std::thread::hardware_concurrency(), 1u), 8u);
+    if (h.accounts < 100000) threads = 1;
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++) {
+        pool.emplace_back(load, h.accounts * t / threads, h.accounts * (t + 1) / threads);
+    }
+    load(0, h.accounts / threads);
+    for (auto& t : pool) t.join();
+    store_.restoreNextAccountNo(h.nextAccountNo);
+    walSegment = h.walSegment;
+    accounts = h.accounts;
+    return true;
+}
+
+void Persistence::apply(wal::RecordType type, const uint8_t* p, size_t n) {
+    int32_t accNo, toAccNo;
+    uint16_t currency;
+    double balance, toBalance;
+    std::string_view name, password;
+
+    switch (type) {
+        case wal::RecordType::Open:
+            if (wal::OpenRecord::read(p, n, accNo, name, password, currency, balance) &&
+                !store_.restore(accNo, name, password, currency, balance, false)) {
+                foreign_.fetch_add(1, std::memory_order_relaxed);
+            }
+            break;
+        case wal::RecordType::Close:
+            if (wal::CloseRecord::read(p, n, accNo)) store_.restoreClosed(accNo);
+            break;
+        case wal::RecordType::Deposit:
+        case wal::RecordType::Withdraw:
+            if (wal::BalanceRecord::read(p, n, accNo, balance)) store_.restoreBalance(accNo, balance);
+            break;
+        case wal::RecordType::Transfer:
+            if (wal::TransferRecord::read(p, n, accNo, balance, toAccNo, toBalance)) {
+                store_.restoreBalance(accNo, balance);
+                store_.restoreBalance(toAccNo, toBalance);
+            }
+            break;
+    }
+}
+
+// ==================== Snapshots ====================
+
+bool Persistence::snapshot() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t records = log_.stats().records;
+    if (records == snapshotRecords_) return true;
+    // rotate() no longer starts a segment, so the snapshot could not say which records it holds
+    if (log_.failed()) return false;
+
+    // Everything applied before this point is in segments below `segment`
+    const uint32_t segment = log_.rotate();
+
+    std::vector<snapshot::Account> accounts;
+    std::vector<char> names;
+    accounts.reserve(store_.accountCount());
+    store_.forEach([&](const AccountStore::AccountView& a) {
+        snapshot::Account e{};
+        e.accNo = a.accNo;
+        e.currency = a.currency;
+        e.closed = a.closed ? 1 : 0;
+        e.passwordLen = uint8_t(std::min<size_t>(a.password.size(), 16));
+        std::memcpy(e.password, a.password.data(), e.passwordLen);
+        e.nameOffset = uint32_t(names.size());
+        e.nameLen = uint32_t(a.name.size());
+        e.balance = a.balance;
+        names.insert(names.end(), a.name.begin(), a.name.end());
+        accounts.push_back(e);
+    });
+
+    snapshot::Header h{};
+    std::memcpy(h.magic, SNAPSHOT_MAGIC, 4);
+    h.version = snapshot::VERSION;
+    h.byteOrder = snapshot::ORDER_MARK;
+    h.walSegment = segment;
+    h.accounts = accounts.size();
+    h.namesBytes = names.size();
+    h.nextAccountNo = store_.nextAccountNo();
+    const auto* body = reinterpret_cast<const uint8_t*>(accounts.data());
+    const size_t bodyBytes = accounts.size() * sizeof(snapshot::Account);
+    h.crc = wal::crc32(reinterpret_cast<const uint8_t*>(names.data()), names.size(), wal::crc32(body, bodyBytes));
+
+    const std::string path = snapshotPath(cfg_.dir, segment);
+    const std::string tmp = path + ".tmp";
+    wal::File f = wal::createFile(tmp);
+    bool ok = f != wal::INVALID_FILE && wal::writeAll(f, reinterpret_cast<const uint8_t*>(&h), sizeof(h)) &&
+              wal::writeAll(f, body, bodyBytes) &&
+              wal::writeAll(f, reinterpret_cast<const uint8_t*>(names.data()), names.size()) &&
+              (!cfg_.fsync || wal::syncFile(f));
+    wal::closeFile(f);
+    std::error_code ec;
+    if (ok) {
+        fs::rename(tmp, path, ec);
+        ok = !ec && (!cfg_.fsync || wal::syncDir(cfg_.dir));
+    }
+    if (!ok) {
+        fs::remove(tmp, ec);
+        BANK_LOG(logging::Error, true, "persistence: cannot write " << path);
+        return false;
+    }
+
+    snapshotRecords_ = records;
+    removeCovered(segment);
+    return true;
+}
+
+void Persistence::removeCovered(uint32_t segment) {
+    // Keep the previous snapshot and its segments as well, in case the new
+    // one turns out unreadable
+    std::vector<uint32_t> snapshots = listSnapshots(cfg_.dir);
+    auto prev = std::find_if(snapshots.begin(), snapshots.end(), [&](uint32_t n) { return n < segment; });
+    if (prev == snapshots.end()) return;
+    const uint32_t keep = *prev;
+
+    std::error_code ec;
+    for (uint32_t n : snapshots) {
+        if (n < keep) fs::remove(snapshotPath(cfg_.dir, n), ec);
+    }
+    for (uint32_t seg : wal::Log::listSegments(cfg_.dir)) {
+        if (seg < keep) fs::remove(wal::Log::segmentPath(cfg_.dir, seg), ec);
+    }
+}
+
+void Persistence::start() {
+    if (cfg_.snapshotSeconds <= 0 || thread_.joinable()) return;
+    stopping_ = false;
+    thread_ = std::thread([this] { run(); });
+}
+
+void Persistence::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) thread_.join();
+    log_.sync();
+}
+
+void Persistence::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        wake_.wait_for(lock, std::chrono::seconds(cfg_.snapshotSeconds));
+        if (stopping_) break;
+        lock.unlock();
+        auto t0 = std::chrono::steady_clock::now();
+        if (snapshot()) {
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0);
+            BANK_LOG(logging::Info, true, "snapshot of " << store_.accountCount() << " accounts written in "
+                     << ms.count() << " ms");
+        }
+        lock.lock();
+    }
+}
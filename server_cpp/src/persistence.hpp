@@ -0,0 +1,127 @@
+#pragma once
+
+#include "account_store.hpp"
+#include "wal.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * Durable account state: write-ahead log plus periodic snapshots
+ *
+ * The data directory holds log segments (see wal.hpp) and snapshots,
+ * dir/snapshot-NNNNNNNN.bin, where NNNNNNNN is the first log segment that
+ * is not contained in the snapshot. Taking a snapshot:
+ * 1. rotate the log, so every change applied so far is in earlier segments
+ * 2. copy the accounts in number order, a lock stripe at a time (changes made
+ *    meanwhile may or may not be included; they are in the new segment)
+ * 3. write the file under a temporary name, fsync and rename it
+ * 4. delete what the previous snapshot covers (older snapshots and their
+ *    segments), keeping one generation to fall back on
+ * Recovery loads the newest valid snapshot and replays the segments from
+ * its number on. Because log records carry resulting balances, changes
+ * that were already copied into the snapshot replay to the same values.
+ *
+ * Snapshots are laid out for mapping straight into memory: a 64-byte
+ * header, a packed array of 40-byte accounts and a name area, in host
+ * byte order (the header records which). Loading reads the mapped array
+ * in place, with no parsing.
+ */
+namespace snapshot {
+
+constexpr uint32_t VERSION = 1;
+constexpr uint32_t ORDER_MARK = 0x01020304;
+
+struct Header {
+    char magic[4];          // "BSNP"
+    uint32_t version;
+    uint32_t byteOrder;     // ORDER_MARK as stored by the writing host
+    uint32_t walSegment;    // replay the log from this segment on
+    uint64_t accounts;
+    uint64_t namesBytes;
+    int32_t nextAccountNo;
+    uint32_t crc;           // crc32 of the account array and the name area
+    uint8_t reserved[24];
+};
+
+struct Account {
+    int32_t accNo;
+    uint16_t currency;
+    uint8_t closed;
+    uint8_t passwordLen;
+    uint32_t nameOffset;    // into the name area
+    uint32_t nameLen;
+    double balance;
+    char password[16];
+};
+
+static_assert(sizeof(Header) == 64, "snapshot header layout");
+static_assert(sizeof(Account) == 40, "snapshot account layout");
+
+} // namespace snapshot
+
+class Persistence {
+public:
+    struct Config {
+        std::string dir;
+        int snapshotSeconds = 60;  // 0 = only on demand
+        size_t segmentBytes = size_t(64) << 20;
+        bool fsync = true;
+    };
+
+    struct Recovery {
+        bool fromSnapshot = false;
+        uint64_t snapshotAccounts = 0;
+        uint64_t records = 0;     // log records replayed
+        int segments = 0;         // log segments read
+        bool torn = false;        // a segment ended in a partial record
+        double millis = 0;
+    };
+
+    Persistence(const Config& cfg, AccountStore& store);
+    ~Persistence();
+
+    Persistence(const Persistence&) = delete;
+    Persistence& operator=(const Persistence&) = delete;
+
+    /**
+     * Rebuild the store from the data directory, start a new log segment
+     * and attach the log to the store
+     * @return false if the directory or the new segment cannot be created,
+     *         or the data holds accounts outside the store's node range
+     */
+    bool recover(Recovery& out);
+
+    // Take snapshots every Config::snapshotSeconds in the background
+    void start();
+
+    // Stop the snapshot thread and flush the log
+    void stop();
+
+    // Write a snapshot now (skipped if nothing changed since the last one)
+    bool snapshot();
+
+    wal::Log& log() { return log_; }
+
+    static std::string snapshotPath(const std::string& dir, uint32_t segment);
+
+private:
+    Config cfg_;
+    AccountStore& store_;
+    wal::Log log_;
+
+    std::thread thread_;
+    std::mutex mutex_;  // serialises snapshots; guards stopping_
+    std::condition_variable wake_;
+    bool stopping_;
+    uint64_t snapshotRecords_;  // log records as of the last snapshot
+    std::atomic<uint64_t> foreign_;  // accounts recovery found outside the store's range
+
+    bool loadSnapshot(const std::string& path, uint32_t& walSegment, uint64_t& accounts);
+    void apply(wal::RecordType type, const uint8_t* p, size_t n);
+    void removeCovered(uint32_t segment);  // after snapshot `segment` is on disk
+    void run();
+};
@@ -0,0 +1,232 @@
+#include "seq_window.hpp"
+#include <algorithm>
+#include <cstring>
+
+SeqWindow::SeqWindow(const Config& cfg, DedupCache& spill) : epoch_(Clock::now()), spill_(spill) {
+    size_t n = 1;
+    while (n < cfg.stripes) n <<= 1;
+    stripes_.reset(new Stripe[n]);
+    mask_ = n - 1;
+
+    const uint32_t perStripe = uint32_t(std::max<size_t>(1, cfg.memoryBytes / n / sizeof(Window)));
+    ttlSeconds_ = uint32_t(cfg.ttlSeconds > 0 ? cfg.ttlSeconds : 60);
+    capacity_ = n * perStripe;
+    bytes_ = n * (sizeof(Stripe) + perStripe * sizeof(Window));
+
+    for (size_t i = 0; i < n; i++) {
+        Stripe& s = stripes_[i];
+        s.windows.reset(new Window[perStripe]);
+        s.count = perStripe;
+        s.free.reserve(perStripe);
+        for (uint32_t k = perStripe; k-- > 0;) {
+            s.windows[k].live = false;
+            s.free.push_back(k);
+        }
+        s.index.reserve(perStripe);
+    }
+}
+
+SeqWindow::Key SeqWindow::keyOf(const sockaddr_in& from, uint64_t requestId) {
+    uint64_t addr = uint64_t(ntohl(from.sin_addr.s_addr)) << 16 | ntohs(from.sin_port);
+    return Key{addr, uint32_t(requestId >> 32)};
+}
+
+uint32_t SeqWindow::secondsOf(Clock::time_point t) const {
+    return uint32_t(std::chrono::duration_cast<std::chrono::seconds>(t - epoch_).count());
+}
+
+// ==================== Windows ====================
+
+SeqWindow::Window& SeqWindow::acquire(Stripe& s, const Key& key, uint32_t now, bool& created) {
+    auto it = s.index.find(key);
+    created = it == s.index.end();
+    if (!created) return s.windows[it->second];
+
+    uint32_t w;
+    if (!s.free.empty()) {
+        w = s.free.back();
+        s.free.pop_back();
+    } else {
+        // Pool full: the least recently used window goes, keeping the
+        // replies its client may still ask for
+        w = 0;
+        for (uint32_t i = 1; i < s.count; i++) {
+            if (s.windows[i].lastUsed < s.windows[w].lastUsed) w = i;
+        }
+        for (const Entry& e : s.windows[w].entries) keep(s, s.windows[w], e);
+        s.index.erase(s.windows[w].key);
+        s.evictions++;
+    }
+
+    Window& win = s.windows[w];
+    win.key = key;
+    win.base = 0;
+    win.top = 0;
+    win.floor = 0;
+    win.lastUsed = now;
+    win.live = true;
+    std::fill(std::begin(win.seen), std::end(win.seen), 0);
+    for (Entry& e : win.entries) {
+        e.seq = 0;
+        e.state = Empty;
+    }
+    s.index.emplace(key, w);
+    return win;
+}
+
+void SeqWindow::release(Stripe& s, uint32_t w) {
+    s.index.erase(s.windows[w].key);
+    s.windows[w].live = false;
+    s.free.push_back(w);
+}
+
+void SeqWindow::keep(Stripe& s, const Window& w, const Entry& e) {
+    if (e.state != Done || e.seq < w.floor) return;
+    spill_.finish(spillKey(w.key, e.seq), e.data, e.len);
+    s.spilled++;
+}
+
+void SeqWindow::advance(Window& w, uint32_t seq) {
+    if (seq - w.top >= SPAN) {
+        std::fill(std::begin(w.seen), std::end(w.seen), 0);
+    } else {
+        for (uint32_t s = w.top + 1; s != seq + 1; s++) w.seen[(s % SPAN) / 64] &= ~(uint64_t(1) << (s % 64));
+    }
+    w.top = seq;
+}
+
+// ==================== Lookup ====================
+
+SeqWindow::Lookup SeqWindow::begin(const sockaddr_in& from, uint64_t requestId, uint16_t behind,
+                                   uint8_t* reply, size_t& len) {
+    const Key key = keyOf(from, requestId);
+    const uint32_t seq = uint32_t(requestId);
+    const uint32_t now = secondsOf(Clock::now());
+    Stripe& s = stripeOf(key);
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    if (seq == 0) return spill_.begin(spillKey(key, seq), reply, len);  // not one clients hand out
+
+    bool created;
+    Window& w = acquire(s, key, now, created);
+    w.lastUsed = now;
+    // Copies of a request can carry different floors; the highest is the latest.
+    // An unknown distance says nothing about the oldest, so the floor stays
+    if (behind != proto::SEQ_BEHIND_UNKNOWN) {
+        const uint32_t floor = seq > behind ? seq - behind : 1;
+        if (floor > w.floor) w.floor = floor;
+    }
+    if (seq < w.floor) {
+        s.stale++;  // a later request said it was answered: this copy is a late one
+        return Lookup::InProgress;
+    }
+
+    if (created) {
+        // An evicted window may have left this very request behind
+        w.base = seq + 1;
+        w.top = seq;
+        s.spilled++;
+        return spill_.begin(spillKey(key, seq), reply, len);
+    }
+    if (seq > w.top) {
+        advance(w, seq);
+    } else if (seq < w.base || w.top - seq >= SPAN) {
+        // Outside the bitmap: only the DedupCache can tell
+        s.spilled++;
+        return spill_.begin(spillKey(key, seq), reply, len);
+    } else if (seen(w, seq)) {
+        const Entry& e = w.entries[seq % KEPT];
+        if (e.seq == seq && e.state == Claimed) return Lookup::InProgress;
+        if (e.seq == seq && e.state == Done) {
+            std::memcpy(reply, e.data, e.len);
+            len = e.len;
+            return Lookup::Done;
+        }
+        // Seen, reply not in the ring: spilled, or still running after its
+        // entry was taken. Never run it twice
+        s.spilled++;
+        Lookup found = spill_.begin(spillKey(key, seq), reply, len);
+        return found == Lookup::New ? Lookup::InProgress : found;
+    }
+
+    mark(w, seq);
+    Entry& e = w.entries[seq % KEPT];
+    if (e.state != Empty && e.seq > seq) {
+        // A late request does not displace the reply of a newer one
+        s.spilled++;
+        return spill_.begin(spillKey(key, seq), reply, len);
+    }
+    keep(s, w, e);
+    e.seq = seq;
+    e.state = Claimed;
+    e.len = 0;
+    return Lookup::New;
+}
+
+void SeqWindow::finish(const sockaddr_in& from, uint64_t requestId, const uint8_t* reply, size_t len) {
+    const Key key = keyOf(from, requestId);
+    const uint32_t seq = uint32_t(requestId);
+    Stripe& s = stripeOf(key);
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    auto it = s.index.find(key);
+    Entry* e = it == s.index.end() ? nullptr : &s.windows[it->second].entries[seq % KEPT];
+    if (e && e->seq == seq && e->state == Claimed && len <= INLINE) {
+        std::memcpy(e->data, reply, len);
+        e->len = uint16_t(len);
+        e->state = Done;
+        return;
+    }
+    // Claimed in the DedupCache, entry taken by a newer request, window
+    // evicted while the request ran, or too long for the ring
+    if (e && e->seq == seq && e->state == Claimed) e->state = Spilled;
+    spill_.finish(spillKey(key, seq), reply, len);
+    s.spilled++;
+}
+
+void SeqWindow::expire(Clock::time_point now) {
+    const uint32_t t = secondsOf(now);
+    for (size_t i = 0; i <= mask_; i++) {
+        Stripe& s = stripes_[i];
+        std::lock_guard<std::mutex> lock(s.mutex);
+        for (uint32_t w = 0; w < s.count; w++) {
+            if (s.windows[w].live && t - s.windows[w].lastUsed > ttlSeconds_) release(s, w);
+        }
+    }
+}
+
+size_t SeqWindow::clients() const {
+    size_t n = 0;
+    for (size_t i = 0; i <= mask_; i++) {
+        std::lock_guard<std::mutex> lock(stripes_[i].mutex);
+        n += stripes_[i].index.size();
+    }
+    return n;
+}
+
+uint64_t SeqWindow::evictions() const {
+    uint64_t n = 0;
+    for (size_t i = 0; i <= mask_; i++) {
+        std::lock_guard<std::mutex> lock(stripes_[i].mutex);
+        n += stripes_[i].evictions;
+    }
+    return n;
+}
+
+uint64_t SeqWindow::stale() const {
+    uint64_t n = 0;
+    for (size_t i = 0; i <= mask_; i++) {
+        std::lock_guard<std::mutex> lock(stripes_[i].mutex);
+        n += stripes_[i].stale;
+    }
+    return n;
+}
+
+uint64_t SeqWindow::spilled() const {
+    uint64_t n = 0;
+    for (size_t i = 0; i <= mask_; i++) {
+        std::lock_guard<std::mutex> lock(stripes_[i].mutex);
+        n += stripes_[i].spilled;
+    }
+    return n;
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "dedup_cache.hpp"
+#include "net.hpp"
+#include "protocol.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Reply window for sequenced at-most-once requests (proto::FLAG_SEQ_ID)
+ *
+ * A sequenced requestId is session:u32 | seq:u32, where the client draws
+ * the session once per socket and counts seq up from 1; the header status
+ * of such a request says how far behind seq its oldest unanswered request
+ * is, or proto::SEQ_BEHIND_UNKNOWN if that is too far to say, which leaves
+ * the floor where it is. Instead of one hash entry per request the server keeps one window per
+ * client (address + session):
+ * - a floor: everything below it is answered on the client, so a late copy
+ *   of such a request is dropped and its reply need not be kept
+ * - a bitmap over the last SPAN sequence numbers says whether a request was
+ *   seen, so a duplicate is a bit test
+ * - the replies of the last KEPT requests sit in a ring indexed by
+ *   seq % KEPT, inline when they fit INLINE bytes
+ * Replies the ring cannot hold while the client may still ask for them (a
+ * long BATCH reply, one pushed out of the ring at or above the floor, the
+ * ring of an evicted window) go to the DedupCache, which also decides for
+ * requests the window cannot vouch for (older than the bitmap, or the one
+ * that creates a window). While a client's unanswered requests fit in the
+ * ring the DedupCache is not touched.
+ *
+ * Windows come from a pool sized by a byte budget; when it is full the
+ * least recently used window of the stripe is evicted, and windows idle for
+ * the TTL are released by expire().
+ */
+class SeqWindow {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Lookup = DedupCache::Lookup;
+
+    static constexpr uint32_t SPAN = 1024;  // sequence numbers tracked per client
+    static constexpr uint32_t KEPT = 128;   // replies kept per client
+    static constexpr size_t INLINE = 88;    // reply bytes stored in the window
+    static constexpr size_t DEFAULT_MEMORY_BYTES = size_t(16) << 20;
+
+    struct Config {
+        size_t stripes = 64;                        // rounded up to a power of two
+        size_t memoryBytes = DEFAULT_MEMORY_BYTES;  // all windows
+        int ttlSeconds = 60;                        // idle time before a window is released
+    };
+
+    /**
+     * @param spill Cache for what the windows cannot hold; must outlive this
+     */
+    SeqWindow(const Config& cfg, DedupCache& spill);
+
+    /**
+     * Claim a request or fetch its stored reply, as DedupCache::begin
+     * @param behind Header status: seq minus the client's oldest unanswered seq
+     *               (proto::SEQ_BEHIND_UNKNOWN: do not raise the floor)
+     * @param reply Output: the cached reply datagram (Lookup::Done only),
+     *              at least proto::MAX_DATAGRAM bytes
+     * @param len Output: reply size (Lookup::Done only)
+     */
+    Lookup begin(const sockaddr_in& from, uint64_t requestId, uint16_t behind, uint8_t* reply, size_t& len);
+
+    // Store the reply of a claimed request
+    void finish(const sockaddr_in& from, uint64_t requestId, const uint8_t* reply, size_t len);
+
+    // Release windows idle for longer than the TTL
+    void expire(Clock::time_point now);
+
+    size_t clients() const;                          // live windows
+    size_t capacity() const { return capacity_; }    // windows, all stripes
+    size_t memoryBytes() const { return bytes_; }    // allocated
+    uint64_t evictions() const;                      // windows dropped before their TTL
+    uint64_t stale() const;                          // late copies dropped below the floor
+    uint64_t spilled() const;                        // lookups and replies passed to the DedupCache
+
+private:
+    enum State : uint8_t { Empty, Claimed, Done, Spilled };
+
+    struct Entry {
+        uint32_t seq;
+        State state;
+        uint8_t reserved;
+        uint16_t len;
+        uint8_t data[INLINE];
+    };
+    static_assert(sizeof(Entry) == 96, "entry layout");
+
+    struct Key {
+        uint64_t addr;     // ip << 16 | port
+        uint32_t session;
+
+        bool operator==(const Key& o) const { return addr == o.addr && session == o.session; }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& k) const {
+            uint64_t h = (k.addr ^ uint64_t(k.session) << 32) * 0x9E3779B97F4A7C15ULL;
+            return size_t(h ^ (h >> 29));
+        }
+    };
+
+    struct Window {
+        Key key;
+        uint32_t base;      // lowest seq the bitmap speaks for
+        uint32_t top;       // highest seq seen
+        uint32_t floor;     // lowest seq the client may still send
+        uint32_t lastUsed;  // seconds since epoch_
+        bool live;
+        uint64_t seen[SPAN / 64];  // bit seq % SPAN, for seq in (top - SPAN, top]
+        Entry entries[KEPT];       // entry seq % KEPT
+    };
+
+    struct alignas(64) Stripe {
+        mutable std::mutex mutex;
+        std::unique_ptr<Window[]> windows;
+        uint32_t count = 0;
+        std::vector<uint32_t> free;
+        std::unordered_map<Key, uint32_t, KeyHash> index;
+        uint64_t evictions = 0;
+        uint64_t stale = 0;
+        uint64_t spilled = 0;
+    };
+
+    std::unique_ptr<Stripe[]> stripes_;
+    size_t mask_;
+    size_t capacity_;
+    size_t bytes_;
+    uint32_t ttlSeconds_;
+    Clock::time_point epoch_;
+    DedupCache& spill_;
+
+    static Key keyOf(const sockaddr_in& from, uint64_t requestId);
+    static DedupCache::Key spillKey(const Key& k, uint32_t seq) {
+        return DedupCache::Key{k.addr, uint64_t(k.session) << 32 | seq};
+    }
+    Stripe& stripeOf(const Key& k) { return stripes_[(KeyHash()(k) >> 40) & mask_]; }
+    uint32_t secondsOf(Clock::time_point t) const;
+
+    /**
+     * Window of key, allocated (evicting the least recently used) if absent
+     * @param created Output: true if it was allocated by this call
+     */
+    Window& acquire(Stripe& s, const Key& key, uint32_t now, bool& created);
+    static void release(Stripe& s, uint32_t w);
+
+    // Hand an entry's reply to the DedupCache if the client may still ask for it
+    void keep(Stripe& s, const Window& w, const Entry& e);
+
+    static bool seen(const Window& w, uint32_t seq) { return (w.seen[(seq % SPAN) / 64] >> (seq % 64)) & 1; }
+    static void mark(Window& w, uint32_t seq) { w.seen[(seq % SPAN) / 64] |= uint64_t(1) << (seq % 64); }
+    static void advance(Window& w, uint32_t seq);  // make seq the new top
+};
@@ -0,0 +1,849 @@
+#include "server.hpp"
+#include "compact.hpp"
+#include "log.hpp"
+#include "schema.hpp"
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <bcrypt.h>
+#elif defined(__linux__)
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/random.h>
+#endif
+
+namespace {
+
+std::string addrString(const sockaddr_in& a) {
+    char ip[INET_ADDRSTRLEN] = "?";
+    inet_ntop(AF_INET, &a.sin_addr, ip, sizeof(ip));
+    return std::string(ip) + ":" + std::to_string(ntohs(a.sin_port));
+}
+
+// Shortest round-trip form with a ".0" for whole numbers, as Java prints doubles
+std::string num(double v) {
+    char buf[32];
+    auto r = std::to_chars(buf, buf + sizeof(buf), v);
+    std::string s(buf, r.ptr);
+    if (s.find_first_of(".en") == std::string::npos) s += ".0";
+    return s;
+}
+
+std::string str(std::string_view v) {
+    return std::string(v.data(), v.size());
+}
+
+// Bind the calling thread to one CPU; false where unsupported
+bool pinCurrentThread(int cpu) {
+#ifdef _WIN32
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << (cpu % 64)) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+// CLOSE's reply message
+constexpr std::string_view CLOSED = "account closed";
+
+// A BATCH sub-reply is built in a buffer of this size, so no entry's body is longer
+constexpr size_t BATCH_SUB_REPLY_MAX = 64;
+
+// Longest body an OK reply to opCode can carry inside a BATCH; 0 where it can only fail
+size_t batchSubReplyMax(uint16_t opCode) {
+    namespace schema = proto::schema;
+    switch (opCode) {
+        case uint16_t(proto::OpCode::OPEN):
+            return schema::OpenReply::fixedSize();
+        case uint16_t(proto::OpCode::DEPOSIT):
+        case uint16_t(proto::OpCode::WITHDRAW):
+        case uint16_t(proto::OpCode::DEPOSIT_TOKEN):
+        case uint16_t(proto::OpCode::WITHDRAW_TOKEN):
+            return schema::BalanceReply::fixedSize();
+        case uint16_t(proto::OpCode::QUERY_BALANCE):
+        case uint16_t(proto::OpCode::QUERY_BALANCE_TOKEN):
+            return schema::QueryReply::fixedSize();
+        case uint16_t(proto::OpCode::TRANSFER):
+        case uint16_t(proto::OpCode::TRANSFER_TOKEN):
+            return schema::TransferReply::fixedSize();
+        case uint16_t(proto::OpCode::LOGIN):
+            return schema::LoginReply::fixedSize();
+        case uint16_t(proto::OpCode::CLOSE):
+            return proto::schema::TextReply::MIN_SIZE + CLOSED.size();
+        default:
+            return 0;
+    }
+}
+
+// Fill buf from the operating system's CSPRNG; false if it is unavailable
+bool secureRandom(void* buf, size_t len) {
+#ifdef _WIN32
+    return BCryptGenRandom(nullptr, static_cast<PUCHAR>(buf), ULONG(len), BCRYPT_USE_SYSTEM_PREFERRED_RNG) == 0;
+#elif defined(__linux__)
+    auto* p = static_cast<uint8_t*>(buf);
+    while (len > 0) {
+        ssize_t n = getrandom(p, len, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        len -= size_t(n);
+    }
+    return true;
+#else
+    // Backed by /dev/urandom or arc4random on the remaining targets
+    try {
+        std::random_device rd;
+        auto* p = static_cast<uint8_t*>(buf);
+        for (size_t i = 0; i < len; i += 4) {
+            uint32_t v = rd();
+            std::memcpy(p + i, &v, std::min<size_t>(4, len - i));
+        }
+        return true;
+    } catch (...) {
+        return false;
+    }
+#endif
+}
+
+} // namespace
+
+Server::Server(const Config& cfg)
+    : cfg_(cfg), sock_(net::INVALID_SOCK), perWorkerSockets_(false), store_(cfg.shards, cfg.node),
+      dedup_(DedupCache::Config{cfg.shards, cfg.dedupBytes, cfg.dedupTtl}),
+      window_(SeqWindow::Config{cfg.shards, cfg.windowBytes, cfg.dedupTtl}, dedup_), running_(false),
+      monitors_(MonitorHub::Config{cfg.callbackLingerMicros, 65536, cfg.verbose}), epoch_(Clock::now()) {
+    if (cfg_.recvBatch < 1) cfg_.recvBatch = 1;
+    if (cfg_.recvBatch > net::MAX_BATCH) cfg_.recvBatch = net::MAX_BATCH;
+    cfg_.tokenTtl = std::max(0, std::min(cfg_.tokenTtl, 0xFFFF));  // sent as a u16
+}
+
+Server::~Server() {
+    stop();
+}
+
+bool Server::start() {
+    if (!cfg_.dataDir.empty()) {
+        persist_ = std::make_unique<Persistence>(
+            Persistence::Config{cfg_.dataDir, cfg_.snapshotSeconds, size_t(64) << 20, cfg_.fsync}, store_);
+        if (!persist_->recover(recovery_)) {
+            persist_.reset();
+            return false;
+        }
+    }
+
+    int n = cfg_.threads > 0 ? cfg_.threads : (int)std::thread::hardware_concurrency();
+    if (n < 1) n = 1;
+    std::random_device seed;
+    for (int i = 0; i < n; i++) {
+        auto w = std::make_unique<Worker>();
+        w->rng.seed(((uint64_t)seed() << 32) ^ seed());
+        w->inBuf.resize(size_t(cfg_.recvBatch) * proto::MAX_DATAGRAM);
+        w->outBuf.resize(size_t(cfg_.recvBatch) * proto::MAX_DATAGRAM);
+        w->unpacked.resize(proto::MAX_DATAGRAM);
+        w->packed.resize(proto::MAX_DATAGRAM);
+        if (persist_) w->heldBuf.reserve(size_t(cfg_.recvBatch) * proto::MAX_DATAGRAM);
+        workers_.push_back(std::move(w));
+    }
+    if (!openSockets(n)) {
+        workers_.clear();
+        return false;
+    }
+    if (persist_) persist_->start();
+    monitors_.start(perWorkerSockets_ ? workers_[0]->sock : sock_);
+
+    running_.store(true, std::memory_order_release);
+    for (int i = 0; i < n; i++) {
+        Worker* w = workers_[i].get();
+        w->thread = std::thread([this, w, i] { run(*w, i); });
+    }
+    return true;
+}
+
+bool Server::openSockets(int workers) {
+    const int bufBytes = 4 * 1024 * 1024;
+
+    // One SO_REUSEPORT socket per worker; all or nothing
+    if (cfg_.reusePort && workers > 1 && net::hasReusePort()) {
+        bool ok = true;
+        for (auto& w : workers_) {
+            w->sock = net::openBoundUdp(cfg_.port, true);
+            if (!net::isValid(w->sock) || !net::setNonBlocking(w->sock)) {
+                ok = false;
+                break;
+            }
+            net::setBufferSizes(w->sock, bufBytes);
+        }
+        if (ok) {
+            perWorkerSockets_ = true;
+            return true;
+        }
+        for (auto& w : workers_) {
+            net::closeSocket(w->sock);
+            w->sock = net::INVALID_SOCK;
+        }
+        BANK_LOG(logging::Warn, true, "SO_REUSEPORT sockets unavailable, workers share one socket");
+    }
+
+    sock_ = net::openBoundUdp(cfg_.port);
+    if (!net::isValid(sock_) || !net::setNonBlocking(sock_)) {
+        net::closeSocket(sock_);
+        sock_ = net::INVALID_SOCK;
+        return false;
+    }
+    net::setBufferSizes(sock_, bufBytes);
+    for (auto& w : workers_) w->sock = sock_;
+    return true;
+}
+
+void Server::stop() {
+    running_.store(false, std::memory_order_release);
+    for (auto& w : workers_) {
+        if (w->thread.joinable()) w->thread.join();
+    }
+    monitors_.stop();  // sends from a worker socket
+    for (auto& w : workers_) {
+        if (perWorkerSockets_) net::closeSocket(w->sock);
+        w->sock = net::INVALID_SOCK;
+    }
+    net::closeSocket(sock_);
+    sock_ = net::INVALID_SOCK;
+    if (persist_) persist_->stop();
+}
+
+Server::Stats Server::stats() const {
+    Stats s;
+    for (const auto& w : workers_) {
+        s.requests += w->requests.load(std::memory_order_relaxed);
+        s.duplicates += w->duplicates.load(std::memory_order_relaxed);
+        s.dropped += w->dropped.load(std::memory_order_relaxed);
+        s.bad += w->bad.load(std::memory_order_relaxed);
+        s.perWorker.push_back(w->requests.load(std::memory_order_relaxed));
+    }
+    s.callbacks = monitors_.stats().datagrams;
+    return s;
+}
+
+bool Server::lose(Worker& w, double p) {
+    if (p <= 0) return false;
+    return std::uniform_real_distribution<double>(0.0, 1.0)(w.rng) < p;
+}
+
+uint32_t Server::sessionTime() const {
+    return uint32_t(std::chrono::duration_cast<std::chrono::seconds>(Clock::now() - epoch_).count());
+}
+
+uint16_t Server::packReply(Worker& w, const proto::MessageView& req, uint8_t* body, size_t& len) {
+    if (!(req.h.flags & (proto::FLAG_COMPACT | proto::FLAG_LZ)) || len == 0) return 0;
+    size_t packed = 0;
+    uint16_t applied = compact::pack(req.h.opCode, true, req.h.flags, body, len, w.packed.data(),
+                                     w.packed.size(), packed);
+    if (applied) {
+        std::memcpy(body, w.packed.data(), packed);
+        len = packed;
+    }
+    return applied;
+}
+
+// ==================== Worker loop ====================
+
+void Server::run(Worker& w, int index) {
+    if (cfg_.pin) {
+        unsigned cpus = std::thread::hardware_concurrency();
+        int cpu = cpus ? int(index % cpus) : index;
+        if (!pinCurrentThread(cpu)) {
+            BANK_LOG(logging::Warn, true, "worker " << index << ": could not pin to CPU " << cpu);
+        }
+    }
+
+    const int batch = cfg_.recvBatch;
+    const bool housekeeper = index == 0;
+    net::Packet in[net::MAX_BATCH];
+    net::Packet out[net::MAX_BATCH];
+    auto nextCleanup = Clock::now() + std::chrono::seconds(1);
+
+    while (running_.load(std::memory_order_acquire)) {
+        int ready = net::waitReadable(w.sock, 100);
+
+        // One worker expires reply-cache entries, once a second
+        if (housekeeper) {
+            auto now = Clock::now();
+            if (now >= nextCleanup) {
+                dedup_.expire(now);
+                window_.expire(now);
+                nextCleanup = now + std::chrono::seconds(1);
+            }
+        }
+        if (ready <= 0) continue;
+
+        // Drain the socket before sleeping again; on a shared socket
+        // another worker may have emptied it first
+        int got;
+        do {
+            for (int i = 0; i < batch; i++) {
+                in[i].data = w.inBuf.data() + i * proto::MAX_DATAGRAM;
+                in[i].len = proto::MAX_DATAGRAM;
+            }
+            got = net::recvBatch(w.sock, in, batch);
+            if (got <= 0) break;
+            serveBatch(w, in, out, got);
+        } while (got == batch && running_.load(std::memory_order_relaxed));
+    }
+}
+
+void Server::serveBatch(Worker& w, net::Packet* in, net::Packet* out, int got) {
+    int replies = 0;
+    for (int i = 0; i < got; i++) {
+        uint8_t* buf = w.outBuf.data() + replies * proto::MAX_DATAGRAM;
+        size_t len = handle(w, in[i].data, in[i].len, in[i].addr, buf);
+        if (len == 0) continue;
+        out[replies].data = buf;
+        out[replies].len = len;
+        out[replies].addr = in[i].addr;
+        replies++;
+    }
+
+    // Group commit: this batch's changes are durable before any reply leaves
+    commit(w);
+    sendAll(w, out, replies);
+}
+
+void Server::commit(Worker& w) {
+    if (!persist_) return;
+    if (w.dirty) {
+        if (!persist_->log().sync()) {
+            // The replies are built and the changes applied in memory: the only way not
+            // to acknowledge them is to stop here; a restart recovers what reached the disk
+            BANK_LOG(logging::Error, true, "wal: log failed, stopping before unlogged changes are acknowledged");
+            std::abort();
+        }
+        w.dirty = false;
+    }
+    // Until now a retransmission of these requests found them InProgress and was dropped
+    for (const Held& r : w.held) {
+        if (r.sequenced) {
+            window_.finish(r.from, r.requestId, w.heldBuf.data() + r.offset, r.len);
+        } else {
+            dedup_.finish(r.key, w.heldBuf.data() + r.offset, r.len);
+        }
+    }
+    w.held.clear();
+    w.heldBuf.clear();
+    // Monitors hear of a change no earlier than its client does
+    for (Update& u : w.updates) monitors_.publish(u.type, u.accNo, u.currency, u.balance, std::move(u.info));
+    w.updates.clear();
+}
+
+void Server::publish(Worker& w, uint16_t type, int32_t accNo, uint16_t currency, double balance, std::string info) {
+    if (persist_) {
+        w.updates.push_back(Update{type, accNo, currency, balance, std::move(info)});
+    } else {
+        monitors_.publish(type, accNo, currency, balance, std::move(info));
+    }
+}
+
+void Server::cacheReply(Worker& w, bool sequenced, const sockaddr_in& from, uint64_t requestId,
+                        const DedupCache::Key& key, const uint8_t* reply, size_t len) {
+    if (persist_) {
+        // Copied: the reply buffer is reused if the reply is lost
+        w.held.push_back(Held{sequenced, from, requestId, key, w.heldBuf.size(), len});
+        w.heldBuf.insert(w.heldBuf.end(), reply, reply + len);
+    } else if (sequenced) {
+        window_.finish(from, requestId, reply, len);
+    } else {
+        dedup_.finish(key, reply, len);
+    }
+}
+
+void Server::sendAll(Worker& w, net::Packet* pkts, int n) {
+    for (int sent = 0; sent < n;) {
+        int r = net::sendBatch(w.sock, pkts + sent, n - sent);
+        if (r < 0) {
+            sent++;  // hard error on this datagram: skip it
+        } else if (r == 0) {
+            std::this_thread::yield();  // send buffer full
+        } else {
+            sent += r;
+        }
+    }
+}
+
+// ==================== Request handling ====================
+
+size_t Server::handle(Worker& w, const uint8_t* data, size_t len, const sockaddr_in& from, uint8_t* out) {
+    // Simulate request loss
+    if (lose(w, cfg_.lossReq)) {
+        w.dropped.fetch_add(1, std::memory_order_relaxed);
+        BANK_LOG(logging::Info, cfg_.verbose, "DROP request from " << addrString(from) << " (simulated)");
+        return 0;
+    }
+
+    proto::MessageView req;
+    if (!proto::parse(data, len, req) || req.h.version != proto::VERSION ||
+        req.h.msgType != (uint8_t)proto::MsgType::Request) {
+        w.bad.fetch_add(1, std::memory_order_relaxed);
+        BANK_LOG(logging::Info, cfg_.verbose, "Bad request from " << addrString(from));
+        return 0;
+    }
+
+    // Unpacked before anything looks at the body; one that does not unpack
+    // is left empty, so the operation refuses it as a bad request
+    if (req.h.flags & (proto::FLAG_COMPACT | proto::FLAG_LZ)) {
+        size_t wide = 0;
+        if (!compact::unpack(req.h.opCode, false, req.h.flags, req.body, req.bodyLen, w.unpacked.data(),
+                             w.unpacked.size(), wide)) {
+            wide = 0;
+        }
+        req.body = w.unpacked.data();
+        req.bodyLen = wide;
+    }
+
+    // Read-only and answered in several datagrams: never cached
+    if (req.h.opCode == uint16_t(proto::OpCode::SNAPSHOT)) {
+        w.requests.fetch_add(1, std::memory_order_relaxed);
+        handleSnapshot(w, req, from);
+        return 0;
+    }
+
+    bool atMostOnce = (req.h.flags & proto::FLAG_AT_MOST_ONCE) != 0;
+    bool sequenced = atMostOnce && (req.h.flags & proto::FLAG_SEQ_ID) != 0;
+    DedupCache::Key key{};
+    if (atMostOnce) {
+        key = DedupCache::keyOf(from, req.h.requestId);
+        size_t cachedLen = 0;
+        // A sequenced client's window first; it uses the DedupCache for what it cannot hold
+        DedupCache::Lookup found = sequenced
+                                       ? window_.begin(from, req.h.requestId, req.h.status, out, cachedLen)
+                                       : dedup_.begin(key, out, cachedLen);
+        switch (found) {
+            case DedupCache::Lookup::New:
+                break;
+            case DedupCache::Lookup::Done:
+                w.duplicates.fetch_add(1, std::memory_order_relaxed);
+                BANK_LOG(logging::Info, cfg_.verbose, "DUP reqId=" << req.h.requestId << " from "
+                         << addrString(from) << " => replay cached reply");
+                if (lose(w, cfg_.lossRep)) {
+                    w.dropped.fetch_add(1, std::memory_order_relaxed);
+                    BANK_LOG(logging::Info, cfg_.verbose, "DROP reply (simulated)");
+                    return 0;
+                }
+                return cachedLen;
+            case DedupCache::Lookup::InProgress:
+                w.duplicates.fetch_add(1, std::memory_order_relaxed);
+                return 0;
+        }
+    }
+
+    BANK_LOG(logging::Info, cfg_.verbose, "recv op=" << proto::opCodeToString(req.h.opCode)
+             << " reqId=" << req.h.requestId << " from " << addrString(from) << " flags=" << req.h.flags
+             << " (" << (atMostOnce ? "at-most-once" : "at-least-once") << ")");
+    w.requests.fetch_add(1, std::memory_order_relaxed);
+
+    proto::Writer body(out + proto::HEADER_SIZE, proto::MAX_DATAGRAM - proto::HEADER_SIZE);
+    proto::Status st = req.h.opCode == uint16_t(proto::OpCode::BATCH)
+                           ? handleBatch(w, req.body, req.bodyLen, body, from)
+                           : dispatch(w, req.h.opCode, req.body, req.bodyLen, body, from);
+    // A reply that does not fit a datagram is reported as a bad request. Single replies are a
+    // few fields and a batch is sized before any entry runs, so nothing that took effect gets here
+    if (st == proto::Status::OK && !body.ok()) st = proto::Status::ERR_BAD_REQUEST;
+    size_t bodyLen = body.size();
+    const uint16_t encoded = st == proto::Status::OK ? packReply(w, req, body.data(), bodyLen) : 0;
+
+    proto::Header h{};
+    h.magic = proto::MAGIC;
+    h.version = proto::VERSION;
+    h.msgType = (uint8_t)proto::MsgType::Reply;
+    h.opCode = req.h.opCode;
+    h.flags = uint16_t(req.h.flags & ~(proto::FLAG_COMPACT | proto::FLAG_LZ)) | encoded;
+    h.status = (uint16_t)st;
+    h.requestId = req.h.requestId;
+    h.bodyLen = st == proto::Status::OK ? (uint32_t)bodyLen : 0;
+    proto::writeHeader(out, h);
+    size_t replyLen = proto::HEADER_SIZE + h.bodyLen;
+
+    if (atMostOnce) cacheReply(w, sequenced, from, req.h.requestId, key, out, replyLen);
+
+    // Simulate reply loss
+    if (lose(w, cfg_.lossRep)) {
+        w.dropped.fetch_add(1, std::memory_order_relaxed);
+        BANK_LOG(logging::Info, cfg_.verbose, "DROP reply to " << addrString(from) << " (simulated)");
+        return 0;
+    }
+    return replyLen;
+}
+
+proto::Status Server::dispatch(Worker& w, uint16_t opCode, const uint8_t* p, size_t n,
+                               proto::Writer& rep, const sockaddr_in& from) {
+    namespace schema = proto::schema;
+    using proto::Status;
+
+    std::string_view name, password;
+    int32_t accNo = 0, toAccNo = 0;
+    uint16_t currency = 0;
+    double amount = 0, balance = 0, toBalance = 0;
+    Status st;
+
+    switch (opCode) {
+        case uint16_t(proto::OpCode::OPEN):
+            if (!schema::OpenRequest::read(p, n, name, password, currency, amount)) return Status::ERR_BAD_REQUEST;
+            st = store_.open(name, password, currency, amount, accNo);
+            if (st != Status::OK) return st;
+            w.dirty = true;
+            schema::OpenReply::write(rep, accNo, amount);
+            BANK_LOG(logging::Info, cfg_.verbose, "OPEN: accountNo=" << accNo << " name=" << name
+                     << " currency=" << proto::currencyToString(currency) << " balance=" << num(amount));
+            if (monitors_.active()) publish(w, opCode, accNo, currency, amount, "OPEN by " + str(name));
+            return Status::OK;
+
+        case uint16_t(proto::OpCode::CLOSE):
+            if (!schema::AuthRequest::read(p, n, name, accNo, password)) return Status::ERR_BAD_REQUEST;
+            st = store_.close(name, accNo, password, currency, balance);
+            if (st != Status::OK) return st;
+            w.dirty = true;
+            schema::TextReply::write(rep, CLOSED);
+            BANK_LOG(logging::Info, cfg_.verbose, "CLOSE: accountNo=" << accNo << " name=" << name);
+            if (monitors_.active()) publish(w, opCode, accNo, currency, balance, "CLOSE by " + str(name));
+            return Status::OK;
+
+        case uint16_t(proto::OpCode::DEPOSIT):
+        case uint16_t(proto::OpCode::WITHDRAW): {
+            if (!schema::AmountRequest::read(p, n, name, accNo, password, currency, amount)) {
+                return Status::ERR_BAD_REQUEST;
+            }
+            bool deposit = opCode == uint16_t(proto::OpCode::DEPOSIT);
+            st = deposit ? store_.deposit(name, accNo, password, currency, amount, balance)
+                         : store_.withdraw(name, accNo, password, currency, amount, balance);
+            if (st != Status::OK) return st;
+            w.dirty = true;
+            schema::BalanceReply::write(rep, balance);
+            const char* label = deposit ? "DEPOSIT" : "WITHDRAW";
+            BANK_LOG(logging::Info, cfg_.verbose, label << ": accountNo=" << accNo << " amount=" << num(amount)
+                     << " newBalance=" << num(balance));
+            if (monitors_.active()) {
+                publish(w, opCode, accNo, currency, balance,
+                        std::string(label) + " " + num(amount) + " by " + str(name));
+            }
+            return Status::OK;
+        }
+
+        case uint16_t(proto::OpCode::QUERY_BALANCE):
+            if (!schema::AuthRequest::read(p, n, name, accNo, password)) return Status::ERR_BAD_REQUEST;
+            st = store_.query(name, accNo, password, currency, balance);
+            if (st != Status::OK) return st;
+            schema::QueryReply::write(rep, currency, balance);
+            BANK_LOG(logging::Info, cfg_.verbose, "QUERY_BALANCE: accountNo=" << accNo << " currency="
+                     << proto::currencyToString(currency) << " balance=" << num(balance));
+            return Status::OK;
+
+        case uint16_t(proto::OpCode::TRANSFER):
+            if (!schema::TransferRequest::read(p, n, name, accNo, password, toAccNo, currency, amount)) {
+                return Status::ERR_BAD_REQUEST;
+            }
+            st = store_.transfer(name, accNo, password, toAccNo, currency, amount, balance, toBalance);
+            if (st != Status::OK) return st;
+            w.dirty = true;
+            schema::TransferReply::write(rep, balance, toBalance);
+            BANK_LOG(logging::Info, cfg_.verbose, "TRANSFER: from=" << accNo << " to=" << toAccNo
+                     << " amount=" << num(amount) << " fromNewBal=" << num(balance)
+                     << " toNewBal=" << num(toBalance));
+            if (monitors_.active()) {
+                publish(w, opCode, accNo, currency, balance,
+                        "TRANSFER out " + num(amount) + " to " + std::to_string(toAccNo) + " by " + str(name));
+                publish(w, opCode, toAccNo, currency, toBalance,
+                        "TRANSFER in " + num(amount) + " from " + std::to_string(accNo));
+            }
+            return Status::OK;
+
+        case uint16_t(proto::OpCode::LOGIN): {
+            if (!schema::AuthRequest::read(p, n, name, accNo, password)) return Status::ERR_BAD_REQUEST;
+            if (cfg_.tokenTtl == 0) return Status::ERR_BAD_REQUEST;
+            // A bearer credential: unpredictable, never from the loss-simulation generator
+            uint64_t fresh = 0, token;
+            do {
+                if (!secureRandom(&fresh, sizeof(fresh))) {
+                    BANK_LOG(logging::Error, true, "LOGIN: no system random source, refusing to issue a token");
+                    return Status::ERR_BAD_REQUEST;
+                }
+            } while (fresh == 0);  // 0 = no token
+            st = store_.login(name, accNo, password, fresh, sessionTime(), uint32_t(cfg_.tokenTtl), token);
+            if (st != Status::OK) return st;
+            schema::LoginReply::write(rep, token, uint16_t(cfg_.tokenTtl));
+            BANK_LOG(logging::Info, cfg_.verbose, "LOGIN: accountNo=" << accNo << " name=" << name
+                     << " for " << cfg_.tokenTtl << "s");
+            return Status::OK;
+        }
+
+        // Token variants: the same operations, and the same callbacks, without name and password
+        case uint16_t(proto::OpCode::DEPOSIT_TOKEN):
+        case uint16_t(proto::OpCode::WITHDRAW_TOKEN): {
+            uint64_t token;
+            if (!schema::TokenAmountRequest::read(p, n, token, accNo, currency, amount)) {
+                return Status::ERR_BAD_REQUEST;
+            }
+            const AccountStore::Session s{token, sessionTime()};
+            bool deposit = opCode == uint16_t(proto::OpCode::DEPOSIT_TOKEN);
+            st = deposit ? store_.deposit(s, accNo, currency, amount, balance)
+                         : store_.withdraw(s, accNo, currency, amount, balance);
+            if (st != Status::OK) return st;
+            w.dirty = true;
+            schema::BalanceReply::write(rep, balance);
+            const char* label = deposit ? "DEPOSIT" : "WITHDRAW";
+            BANK_LOG(logging::Info, cfg_.verbose, label << "_TOKEN: accountNo=" << accNo << " amount=" << num(amount)
+                     << " newBalance=" << num(balance));
+            if (monitors_.active()) {
+                publish(w, uint16_t(deposit ? proto::OpCode::DEPOSIT : proto::OpCode::WITHDRAW), accNo,
+                        currency, balance, std::string(label) + " " + num(amount) + " by token");
+            }
+            return Status::OK;
+        }
+
+        case uint16_t(proto::OpCode::QUERY_BALANCE_TOKEN): {
+            uint64_t token;
+            if (!schema::TokenRequest::read(p, n, token, accNo)) return Status::ERR_BAD_REQUEST;
+            st = store_.query(AccountStore::Session{token, sessionTime()}, accNo, currency, balance);
+            if (st != Status::OK) return st;
+            schema::QueryReply::write(rep, currency, balance);
+            BANK_LOG(logging::Info, cfg_.verbose, "QUERY_BALANCE_TOKEN: accountNo=" << accNo << " currency="
+                     << proto::currencyToString(currency) << " balance=" << num(balance));
+            return Status::OK;
+        }
+
+        case uint16_t(proto::OpCode::TRANSFER_TOKEN): {
+            uint64_t token;
+            if (!schema::TokenTransferRequest::read(p, n, token, accNo, toAccNo, currency, amount)) {
+                return Status::ERR_BAD_REQUEST;
+            }
+            st = store_.transfer(AccountStore::Session{token, sessionTime()}, accNo, toAccNo, currency, amount,
+                                 balance, toBalance);
+            if (st != Status::OK) return st;
+            w.dirty = true;
+            schema::TransferReply::write(rep, balance, toBalance);
+            BANK_LOG(logging::Info, cfg_.verbose, "TRANSFER_TOKEN: from=" << accNo << " to=" << toAccNo
+                     << " amount=" << num(amount) << " fromNewBal=" << num(balance)
+                     << " toNewBal=" << num(toBalance));
+            if (monitors_.active()) {
+                const uint16_t op = uint16_t(proto::OpCode::TRANSFER);
+                publish(w, op, accNo, currency, balance,
+                        "TRANSFER out " + num(amount) + " to " + std::to_string(toAccNo) + " by token");
+                publish(w, op, toAccNo, currency, toBalance,
+                        "TRANSFER in " + num(amount) + " from " + std::to_string(accNo));
+            }
+            return Status::OK;
+        }
+
+        case uint16_t(proto::OpCode::MONITOR_REGISTER):
+            return handleMonitor(p, n, rep, from);
+
+        default:
+            return Status::ERR_BAD_REQUEST;
+    }
+}
+
+proto::Status Server::handleBatch(Worker& w, const uint8_t* p, size_t n, proto::Writer& rep,
+                                  const sockaddr_in& from) {
+    namespace schema = proto::schema;
+
+    proto::Reader r(p, n);
+    uint16_t count;
+    if (!r.getU16(count)) return proto::Status::ERR_BAD_REQUEST;
+
+    // A malformed entry list, or one whose replies might not fit a datagram, fails the whole
+    // batch; both are found before the first entry runs, since none can be undone after
+    size_t replyMax = schema::BatchCount::fixedSize();
+    proto::Reader scan = r;
+    for (uint16_t i = 0; i < count; i++) {
+        const uint8_t* hdr;
+        const uint8_t* sub;
+        uint16_t subOp, subId, subLen;
+        if (!scan.getBytes(hdr, proto::BATCH_ENTRY_HEADER) ||
+            !schema::BatchEntryHeader::read(hdr, proto::BATCH_ENTRY_HEADER, subOp, subId, subLen) ||
+            !scan.getBytes(sub, subLen)) {
+            return proto::Status::ERR_BAD_REQUEST;
+        }
+        replyMax += proto::BATCH_REPLY_ENTRY_HEADER + batchSubReplyMax(subOp);
+    }
+    if (replyMax > proto::MAX_DATAGRAM - proto::HEADER_SIZE) return proto::Status::ERR_BAD_REQUEST;
+    rep.putU16(count);
+
+    for (uint16_t i = 0; i < count; i++) {
+        const uint8_t* hdr;
+        const uint8_t* sub;
+        uint16_t subOp, subId, subLen;
+        r.getBytes(hdr, proto::BATCH_ENTRY_HEADER);  // checked above
+        schema::BatchEntryHeader::read(hdr, proto::BATCH_ENTRY_HEADER, subOp, subId, subLen);
+        r.getBytes(sub, subLen);
+
+        // Sub-replies are at most a few fields; build each one on the stack
+        // so its length is known before the entry header is written
+        uint8_t subBuf[BATCH_SUB_REPLY_MAX];
+        proto::Writer subRep(subBuf, sizeof(subBuf));
+        proto::Status st = proto::Status::ERR_BAD_REQUEST;
+        if (subOp != uint16_t(proto::OpCode::BATCH) && subOp != uint16_t(proto::OpCode::MONITOR_REGISTER)) {
+            st = dispatch(w, subOp, sub, subLen, subRep, from);
+        }
+        uint16_t bodyLen = st == proto::Status::OK ? (uint16_t)subRep.size() : 0;
+        schema::BatchReplyEntryHeader::write(rep, subOp, subId, uint16_t(st), bodyLen);
+        rep.putBytes(subBuf, bodyLen);
+    }
+
+    BANK_LOG(logging::Info, cfg_.verbose, "BATCH: " << count << " operations");
+    return proto::Status::OK;
+}
+
+void Server::handleSnapshot(Worker& w, const proto::MessageView& req, const sockaddr_in& from) {
+    namespace schema = proto::schema;
+
+    std::string_view name, password;
+    int32_t start = 0, to = 0;
+    uint16_t maxChunks = 0;
+    proto::Status st = proto::Status::OK;
+    if (!schema::SnapshotRequest::read(req.body, req.bodyLen, name, password, start, to, maxChunks) ||
+        maxChunks == 0) {
+        st = proto::Status::ERR_BAD_REQUEST;
+    } else if (name.empty() && !cfg_.allowScan) {
+        st = proto::Status::ERR_AUTH;
+    }
+    maxChunks = std::min(maxChunks, proto::SNAPSHOT_MAX_CHUNKS);
+
+    // Balances changed earlier in this batch are durable before any leaves
+    commit(w);
+
+    if (w.snapBuf.empty()) w.snapBuf.resize(size_t(proto::SNAPSHOT_MAX_CHUNKS) * proto::MAX_DATAGRAM);
+    net::Packet out[proto::SNAPSHOT_MAX_CHUNKS];
+    int chunks = 0;
+    size_t count = 0;
+    uint8_t* chunkHeader = nullptr;
+    proto::Writer body(nullptr, 0);
+
+    // Compact chunks are cut by their packed size, while every balance in
+    // them has a compact form; a chunk with one that has not goes out wide
+    const bool compact = (req.h.flags & proto::FLAG_COMPACT) != 0;
+    size_t packed = 0;
+    bool wide = false;
+    int32_t prev = 0;
+
+    auto begin = [&] {
+        uint8_t* buf = w.snapBuf.data() + size_t(chunks) * proto::MAX_DATAGRAM;
+        body = proto::Writer(buf + proto::HEADER_SIZE, proto::MAX_DATAGRAM - proto::HEADER_SIZE);
+        chunkHeader = body.reserve(proto::SNAPSHOT_CHUNK_HEADER);
+        count = 0;
+        packed = proto::SNAPSHOT_CHUNK_HEADER;  // at least the compact header
+        wide = false;
+        prev = 0;
+    };
+    auto step = [&](const AccountStore::AccountView& a) { return int32_t(uint32_t(a.accNo) - uint32_t(prev)); };
+    auto full = [&](const AccountStore::AccountView& a) {
+        if (!compact || wide || !schema::Money::fits(a.balance)) return count >= proto::SNAPSHOT_CHUNK_ENTRIES;
+        return count == proto::SNAPSHOT_COMPACT_ENTRIES ||
+               packed + schema::CompactSnapshotEntry::size(step(a), a.currency, a.balance) > proto::BATCH_MTU_BODY;
+    };
+    auto finish = [&](uint16_t flags, int32_t next) {
+        proto::Writer ch(chunkHeader, proto::SNAPSHOT_CHUNK_HEADER);
+        schema::SnapshotChunk::write(ch, uint16_t(chunks), flags, next, uint16_t(count));
+        size_t bodyLen = body.size();
+        const uint16_t encoded = st == proto::Status::OK ? packReply(w, req, body.data(), bodyLen) : 0;
+
+        proto::Header h{};
+        h.magic = proto::MAGIC;
+        h.version = proto::VERSION;
+        h.msgType = (uint8_t)proto::MsgType::Reply;
+        h.opCode = req.h.opCode;
+        h.flags = uint16_t(req.h.flags & ~(proto::FLAG_COMPACT | proto::FLAG_LZ)) | encoded;
+        h.status = (uint16_t)st;
+        h.requestId = req.h.requestId;
+        h.bodyLen = st == proto::Status::OK ? (uint32_t)bodyLen : 0;
+        uint8_t* buf = body.data() - proto::HEADER_SIZE;
+        proto::writeHeader(buf, h);
+        out[chunks].data = buf;
+        out[chunks].len = proto::HEADER_SIZE + h.bodyLen;
+        out[chunks].addr = from;
+        chunks++;
+    };
+
+    begin();
+    int32_t next = start;
+    bool end = false;
+    if (st == proto::Status::OK) {
+        // Chunks are cut before the entry that does not fit, which becomes
+        // the resume token of everything before it
+        end = store_.scan(start, to, [&](const AccountStore::AccountView& a) {
+            if (a.closed) return true;
+            if (!name.empty() && (a.name != name || a.password != password)) return true;
+            if (full(a)) {
+                if (chunks + 1 == maxChunks) return false;
+                finish(0, a.accNo);
+                begin();
+            }
+            schema::SnapshotEntry::write(body, a.accNo, a.currency, a.balance);
+            count++;
+            if (compact && !wide) {
+                if (schema::Money::fits(a.balance)) {
+                    packed += schema::CompactSnapshotEntry::size(step(a), a.currency, a.balance);
+                } else {
+                    wide = true;
+                }
+            }
+            prev = a.accNo;
+            return true;
+        }, next);
+    }
+    finish(proto::SNAPSHOT_LAST | (end ? proto::SNAPSHOT_END : 0), next);
+
+    BANK_LOG(logging::Info, cfg_.verbose, "SNAPSHOT: reqId=" << req.h.requestId << " from " << addrString(from)
+             << " name=" << (name.empty() ? std::string("*") : str(name)) << " range=" << start << ".."
+             << (to ? std::to_string(to) : std::string("end")) << " => " << proto::statusToString(uint16_t(st))
+             << ", " << chunks << " chunk(s), next=" << next << (end ? " (end)" : ""));
+
+    // Simulate reply loss, chunk by chunk
+    int kept = 0;
+    for (int i = 0; i < chunks; i++) {
+        if (lose(w, cfg_.lossRep)) {
+            w.dropped.fetch_add(1, std::memory_order_relaxed);
+            BANK_LOG(logging::Info, cfg_.verbose, "DROP snapshot chunk " << i << " (simulated)");
+            continue;
+        }
+        out[kept++] = out[i];
+    }
+    sendAll(w, out, kept);
+}
+
+proto::Status Server::handleMonitor(const uint8_t* p, size_t n, proto::Writer& rep, const sockaddr_in& from) {
+    uint16_t raw;
+    if (!proto::schema::MonitorRequest::read(p, n, raw)) return proto::Status::ERR_BAD_REQUEST;
+    int seconds = (int16_t)raw;  // signed on the wire, as Java reads it
+    if (seconds <= 0) return proto::Status::ERR_BAD_REQUEST;
+
+    // Optional tail: options, account filter (see protocol.hpp)
+    uint16_t options = 0;
+    std::vector<int32_t> accounts;
+    const size_t fixed = proto::schema::MonitorRequest::fixedSize();
+    if (n > fixed) {
+        proto::Reader r(p + fixed, n - fixed);
+        uint16_t count;
+        if (!r.getU16(options) || !r.getU16(count) || count > proto::MONITOR_MAX_FILTER) {
+            return proto::Status::ERR_BAD_REQUEST;
+        }
+        accounts.resize(count);
+        if (!r.getI32s(accounts.data(), count)) return proto::Status::ERR_BAD_REQUEST;
+    }
+
+    const size_t watched = accounts.size();
+    monitors_.subscribe(from, seconds, options, std::move(accounts));
+    std::string msg = "monitor registered for " + std::to_string(seconds) + "s";
+    if (watched > 0) msg += " on " + std::to_string(watched) + " account(s)";
+    proto::schema::TextReply::write(rep, msg);
+    BANK_LOG(logging::Info, cfg_.verbose, "MONITOR_REGISTER: " << addrString(from) << " for " << seconds << "s"
+             << " accounts=" << (watched ? std::to_string(watched) : std::string("all"))
+             << ((options & proto::MONITOR_BATCH) ? " batched" : ""));
+    return proto::Status::OK;
+}
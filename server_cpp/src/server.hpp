@@ -0,0 +1,229 @@
+#pragma once
+
+#include "account_store.hpp"
+#include "dedup_cache.hpp"
+#include "monitor_hub.hpp"
+#include "net.hpp"
+#include "persistence.hpp"
+#include "seq_window.hpp"
+#include "protocol.hpp"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Multi-threaded UDP bank server (native counterpart of server_java)
+ *
+ * Same wire format, operations, status codes, at-most-once reply cache,
+ * loss simulation and monitor callbacks as server_java/src/Server.java,
+ * but requests are executed by N worker threads, each run to completion:
+ * recvBatch -> decode -> dedup check -> execute -> encode -> sendBatch,
+ * with no hand-off between threads.
+ * - With SO_REUSEPORT (Linux) every worker owns a socket bound to the
+ *   port and the kernel hashes each client to one of them, so workers
+ *   never wake for each other's datagrams and a client's retransmissions
+ *   reach the worker that cached its reply. Elsewhere, or with
+ *   Config::reusePort off, the workers drain one shared socket
+ * - Workers can be pinned to one CPU each (Config::pin) to keep their
+ *   buffers and the socket's softirq work on one core
+ * - Account state lives in an AccountStore sharded by accountNo, and the
+ *   reply cache is striped the same way, so workers only meet on a lock
+ *   when they touch the same shard
+ * - Each server numbers accounts in the range of its node
+ *   (Config::node), so servers sharing clients never hand out the same
+ *   number and a TRANSFER to an account of another server is refused
+ *   with ERR_NOT_FOUND rather than crediting a namesake here
+ * - Sequenced request IDs (proto::FLAG_SEQ_ID) are deduplicated in a
+ *   per-client SeqWindow rather than one reply-cache entry per request
+ * - Callbacks are queued by the worker that applied the update and sent
+ *   by a notifier thread (see monitor_hub.hpp); with no monitor
+ *   registered that costs one atomic load
+ * - With a data directory (Config::dataDir) changes are logged and a
+ *   worker group-commits the log once per received batch, before sending
+ *   that batch's replies (see persistence.hpp); if the log cannot be
+ *   written the server aborts rather than acknowledge what is not on disk.
+ *   The batch's replies enter the reply cache and its callbacks are
+ *   published only after that commit, so neither a retransmission answered
+ *   by another worker nor a monitor sees a change a crash could roll back
+ * - SNAPSHOT is answered straight from the store, in up to
+ *   proto::SNAPSHOT_MAX_CHUNKS datagrams sent with one sendBatch, and
+ *   bypasses the reply cache: a lost chunk is asked for again by its
+ *   resume token, so nothing is kept per snapshot
+ * - Requests in the compact or LZ encoding (proto::FLAG_COMPACT,
+ *   proto::FLAG_LZ) are unpacked before dispatch, and their replies
+ *   packed the same way where that makes them smaller (see compact.hpp);
+ *   the reply cache holds them as sent
+ * - LOGIN issues a session token per account, drawn from the operating
+ *   system's CSPRNG and kept in the AccountStore next to the account; the
+ *   token operations then authenticate with one comparison
+ */
+class Server {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Config {
+        int port = 9000;
+        double lossReq = 0.0;   // probability of dropping an incoming request
+        double lossRep = 0.0;   // probability of dropping an outgoing reply
+        int threads = 0;        // 0 = one per hardware thread
+        size_t shards = 64;     // account store shards
+        int node = 0;           // account number range (see proto::NODE_ACCOUNTS); distinct per server of a --servers list
+        bool verbose = false;   // one line per request, like the Java server
+        bool reusePort = true;  // one SO_REUSEPORT socket per worker where supported
+        bool pin = false;       // pin worker i to CPU i (mod CPU count)
+        int recvBatch = 32;     // datagrams per recvBatch call (1..net::MAX_BATCH)
+        size_t dedupBytes = DedupCache::DEFAULT_MEMORY_BYTES;  // reply cache budget
+        int dedupTtl = DedupCache::DEFAULT_TTL_SECONDS;        // reply cache entry lifetime
+        size_t windowBytes = SeqWindow::DEFAULT_MEMORY_BYTES;  // sequenced-client windows budget
+        std::string dataDir;        // empty = accounts live in memory only
+        int snapshotSeconds = 60;   // snapshot interval with a data directory
+        bool fsync = true;          // fsync each group commit
+        int callbackLingerMicros = 1000;  // callback coalescing window
+        bool allowScan = false;     // SNAPSHOT without a name lists every account
+        int tokenTtl = 300;         // LOGIN token lifetime in seconds (0 = LOGIN refused, max 65535)
+    };
+
+    // Totals over all workers
+    struct Stats {
+        uint64_t requests = 0;    // executed
+        uint64_t duplicates = 0;  // answered from the reply cache
+        uint64_t dropped = 0;     // simulated request or reply loss
+        uint64_t bad = 0;         // undecodable datagrams
+        uint64_t callbacks = 0;   // callback datagrams sent
+        std::vector<uint64_t> perWorker;  // executed, by worker
+    };
+
+    explicit Server(const Config& cfg);
+    ~Server();
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    /**
+     * Recover the accounts (with a data directory), bind the port and start
+     * the workers (falls back to one shared socket if per-worker sockets
+     * cannot be opened)
+     * @return false if recovery failed or the port could not be bound
+     */
+    bool start();
+
+    // Stop and join the workers
+    void stop();
+
+    Stats stats() const;
+    size_t threadCount() const { return workers_.size(); }
+
+    // True if every worker has its own SO_REUSEPORT socket
+    bool perWorkerSockets() const { return perWorkerSockets_; }
+    const AccountStore& store() const { return store_; }
+    const DedupCache& dedup() const { return dedup_; }
+    const SeqWindow& window() const { return window_; }
+    const MonitorHub& monitors() const { return monitors_; }
+    const Persistence::Recovery& recovery() const { return recovery_; }
+    Persistence* persistence() { return persist_.get(); }  // nullptr without a data directory
+
+private:
+    // A callback held back until the group commit
+    struct Update {
+        uint16_t type;
+        int32_t accNo;
+        uint16_t currency;
+        double balance;
+        std::string info;
+    };
+
+    // An at-most-once reply held back from the reply cache until the group commit
+    struct Held {
+        bool sequenced;
+        sockaddr_in from;
+        uint64_t requestId;
+        DedupCache::Key key;
+        size_t offset;  // in Worker::heldBuf
+        size_t len;
+    };
+
+    struct Worker {
+        std::thread thread;
+        net::Socket sock = net::INVALID_SOCK;  // own socket, or the shared one
+        std::mt19937_64 rng;  // simulated loss only; session tokens come from the OS CSPRNG
+        std::vector<uint8_t> inBuf;
+        std::vector<uint8_t> outBuf;
+        std::vector<uint8_t> snapBuf;  // SNAPSHOT chunks, allocated on first use
+        std::vector<uint8_t> unpacked;  // wide body of a packed request
+        std::vector<uint8_t> packed;    // reply body being packed
+        bool dirty = false;  // changed accounts since the last group commit
+        std::vector<Update> updates;  // callbacks of those changes, published by commit()
+        std::vector<Held> held;       // replies of this batch, cached by commit()
+        std::vector<uint8_t> heldBuf;
+        alignas(64) std::atomic<uint64_t> requests{0};
+        std::atomic<uint64_t> duplicates{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<uint64_t> bad{0};
+    };
+
+    Config cfg_;
+    net::Socket sock_;  // shared socket (not used with per-worker sockets)
+    bool perWorkerSockets_;
+    AccountStore store_;
+    DedupCache dedup_;
+    SeqWindow window_;
+    std::unique_ptr<Persistence> persist_;
+    Persistence::Recovery recovery_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<bool> running_;
+    MonitorHub monitors_;
+    Clock::time_point epoch_;  // session token clock starts here
+
+    bool openSockets(int workers);
+    void run(Worker& w, int index);
+
+    // Handle a received batch and send its replies with one sendBatch
+    void serveBatch(Worker& w, net::Packet* in, net::Packet* out, int got);
+    bool lose(Worker& w, double p);
+
+    // Seconds since the server was created: the clock of session tokens
+    uint32_t sessionTime() const;
+
+    /**
+     * Pack an OK reply body in place in the encodings its request asked for
+     * @param len Body size, updated
+     * @return the flags applied (see compact::pack)
+     */
+    uint16_t packReply(Worker& w, const proto::MessageView& req, uint8_t* body, size_t& len);
+
+    // Send n datagrams, retrying while the socket buffer is full
+    void sendAll(Worker& w, net::Packet* pkts, int n);
+
+    // Make the worker's changes durable before their replies leave, then cache those replies
+    // and publish their callbacks; aborts if the log has failed
+    void commit(Worker& w);
+
+    // Store an at-most-once reply, after the group commit when changes are logged
+    void cacheReply(Worker& w, bool sequenced, const sockaddr_in& from, uint64_t requestId,
+                    const DedupCache::Key& key, const uint8_t* reply, size_t len);
+
+    // Publish a callback, after the group commit when changes are logged
+    void publish(Worker& w, uint16_t type, int32_t accNo, uint16_t currency, double balance, std::string info);
+
+    /**
+     * Handle one datagram
+     * @param out Reply buffer (MAX_DATAGRAM bytes)
+     * @return reply size, 0 = nothing to send
+     */
+    size_t handle(Worker& w, const uint8_t* data, size_t len, const sockaddr_in& from, uint8_t* out);
+
+    // Run one operation, appending its reply body; the body is discarded unless OK
+    proto::Status dispatch(Worker& w, uint16_t opCode, const uint8_t* p, size_t n,
+                           proto::Writer& rep, const sockaddr_in& from);
+    proto::Status handleBatch(Worker& w, const uint8_t* p, size_t n, proto::Writer& rep,
+                              const sockaddr_in& from);
+
+    // Answer a SNAPSHOT with its chunks (sent here, not by serveBatch)
+    void handleSnapshot(Worker& w, const proto::MessageView& req, const sockaddr_in& from);
+    proto::Status handleMonitor(const uint8_t* p, size_t n, proto::Writer& rep, const sockaddr_in& from);
+};
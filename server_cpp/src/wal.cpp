@@ -0,0 +1,325 @@
+#include "wal.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace wal {
+
+namespace {
+
+constexpr uint8_t SEGMENT_MAGIC[4] = {'B', 'W', 'A', 'L'};
+constexpr uint16_t SEGMENT_VERSION = 1;
+constexpr size_t SEGMENT_HEADER = 8;  // magic, version:u16, reserved:u16
+
+// Slicing-by-8: t[k][b] is the CRC of byte b followed by k zero bytes,
+// so eight input bytes are folded in with eight independent lookups
+struct CrcTable {
+    uint32_t t[8][256];
+    CrcTable() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int k = 1; k < 8; k++) t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+        }
+    }
+};
+
+} // namespace
+
+// ==================== Files ====================
+
+File createFile(const std::string& path) {
+#ifdef _WIN32
+    return _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    return ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+#endif
+}
+
+void closeFile(File f) {
+    if (f == INVALID_FILE) return;
+#ifdef _WIN32
+    _close(f);
+#else
+    ::close(f);
+#endif
+}
+
+bool writeAll(File f, const uint8_t* p, size_t n) {
+    while (n > 0) {
+#ifdef _WIN32
+        int chunk = n > (1u << 30) ? (1 << 30) : int(n);
+        int r = _write(f, p, unsigned(chunk));
+#else
+        ssize_t r = ::write(f, p, n);
+        if (r < 0 && errno == EINTR) continue;
+#endif
+        if (r <= 0) return false;
+        p += r;
+        n -= size_t(r);
+    }
+    return true;
+}
+
+bool syncFile(File f) {
+#ifdef _WIN32
+    return _commit(f) == 0;
+#elif defined(__APPLE__)
+    return ::fsync(f) == 0;
+#else
+    return ::fdatasync(f) == 0;
+#endif
+}
+
+bool syncDir(const std::string& dir) {
+#ifdef _WIN32
+    (void)dir;
+    return true;
+#else
+    int fd = ::open(dir.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+uint32_t crc32(const uint8_t* p, size_t n, uint32_t crc) {
+    static const CrcTable table;
+    const auto& t = table.t;
+    crc = ~crc;
+    for (; n >= 8; p += 8, n -= 8) {
+        uint32_t lo = crc ^ (uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24);
+        uint32_t hi = uint32_t(p[4]) | uint32_t(p[5]) << 8 | uint32_t(p[6]) << 16 | uint32_t(p[7]) << 24;
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+    }
+    for (; n > 0; p++, n--) crc = t[0][(crc ^ *p) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// ==================== Log ====================
+
+Log::Log(const Config& cfg)
+    : cfg_(cfg), appended_(0), durable_(0), records_(0), syncs_(0), current_(0), flushing_(false),
+      file_(INVALID_FILE), segment_(0), segmentSize_(0), failed_(false) {}
+
+Log::~Log() {
+    close();
+}
+
+std::string Log::segmentPath(const std::string& dir, uint32_t segment) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "wal-%08u.log", segment);
+    return (std::filesystem::path(dir) / name).string();
+}
+
+std::vector<uint32_t> Log::listSegments(const std::string& dir) {
+    std::vector<uint32_t> out;
+    std::error_code ec;
+    for (const auto& e : std::filesystem::directory_iterator(dir, ec)) {
+        unsigned n;
+        char tail;
+        std::string name = e.path().filename().string();
+        if (std::sscanf(name.c_str(), "wal-%8u.lo%c", &n, &tail) == 2 && tail == 'g' &&
+            name.size() == std::strlen("wal-00000000.log")) {
+            out.push_back(n);
+        }
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+bool Log::openSegment(uint32_t segment) {
+    File f = createFile(segmentPath(cfg_.dir, segment));
+    if (f == INVALID_FILE) return false;
+    uint8_t header[SEGMENT_HEADER] = {};
+    std::memcpy(header, SEGMENT_MAGIC, 4);
+    proto::putBE16(header + 4, SEGMENT_VERSION);
+    // The header and the directory entry are synced once, so later group
+    // commits only have to sync data
+    if (!writeAll(f, header, sizeof(header)) || (cfg_.fsync && (!syncFile(f) || !syncDir(cfg_.dir)))) {
+        closeFile(f);
+        return false;
+    }
+    closeFile(file_);
+    file_ = f;
+    segment_ = segment;
+    segmentSize_ = SEGMENT_HEADER;
+    return true;
+}
+
+bool Log::open(uint32_t segment) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!openSegment(segment)) return false;
+    current_ = segment_;
+    return true;
+}
+
+void Log::close() {
+    sync();
+    std::lock_guard<std::mutex> lock(mutex_);
+    closeFile(file_);
+    file_ = INVALID_FILE;
+}
+
+template <class L, class... A>
+void Log::append(RecordType type, const A&... v) {
+    uint8_t buf[RECORD_HEADER + MAX_RECORD];
+    proto::Writer w(buf + RECORD_HEADER, MAX_RECORD);
+    w.putU8(uint8_t(type));
+    L::write(w, v...);
+    if (!w.ok()) {
+        // Leaving an applied change out would lose it on recovery
+        BANK_LOG(logging::Error, true, "wal: record of type " << int(type)
+                 << " too large, changes are no longer durable");
+        std::lock_guard<std::mutex> lock(mutex_);
+        failed_ = true;
+        return;
+    }
+    size_t len = w.size();
+    proto::putBE32(buf, uint32_t(len));
+    proto::putBE32(buf + 4, crc32(buf + RECORD_HEADER, len));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.insert(pending_.end(), buf, buf + RECORD_HEADER + len);
+    appended_ += RECORD_HEADER + len;
+    records_++;
+}
+
+void Log::logOpen(int32_t accNo, std::string_view name, std::string_view password, uint16_t currency,
+                  double balance) {
+    append<OpenRecord>(RecordType::Open, accNo, name, password, currency, balance);
+}
+
+void Log::logClose(int32_t accNo) {
+    append<CloseRecord>(RecordType::Close, accNo);
+}
+
+void Log::logBalance(RecordType type, int32_t accNo, double balance) {
+    append<BalanceRecord>(type, accNo, balance);
+}
+
+void Log::logTransfer(int32_t fromAccNo, double fromBalance, int32_t toAccNo, double toBalance) {
+    append<TransferRecord>(RecordType::Transfer, fromAccNo, fromBalance, toAccNo, toBalance);
+}
+
+void Log::flush(std::unique_lock<std::mutex>& lock, uint32_t nextSegment) {
+    flushing_ = true;
+    std::vector<uint8_t> batch;
+    batch.swap(spare_);
+    batch.swap(pending_);  // pending_ continues in the spare buffer
+    uint64_t upto = appended_;
+    const bool wasFailed = failed_;  // append() may set it while we write
+    lock.unlock();
+
+    // Never behind a failed write: recovery stops at the first torn record
+    bool ok = file_ != INVALID_FILE && !wasFailed;
+    if (ok && !batch.empty()) {
+        ok = writeAll(file_, batch.data(), batch.size()) && (!cfg_.fsync || syncFile(file_));
+        segmentSize_ += batch.size();
+    }
+    if (ok && nextSegment == 0 && segmentSize_ >= cfg_.segmentBytes) nextSegment = segment_ + 1;
+    if (ok && nextSegment != 0) ok = openSegment(nextSegment);
+    if (!ok && !wasFailed) {
+        BANK_LOG(logging::Error, true, "wal: cannot write " << segmentPath(cfg_.dir, segment_)
+                 << ", changes are no longer durable");
+    }
+    batch.clear();
+
+    lock.lock();
+    failed_ = failed_ || !ok;
+    spare_.swap(batch);
+    current_ = segment_;
+    if (ok) durable_ = upto;
+    syncs_++;
+    flushing_ = false;
+    flushed_.notify_all();
+}
+
+bool Log::sync() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    const uint64_t target = appended_;
+    while (durable_ < target && !failed_) {
+        if (flushing_) {
+            flushed_.wait(lock);  // a flush in progress may not include our records
+        } else {
+            flush(lock, 0);
+        }
+    }
+    return !failed_;
+}
+
+bool Log::failed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return failed_;
+}
+
+uint32_t Log::rotate() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (flushing_) flushed_.wait(lock);
+    flush(lock, current_ + 1);
+    return current_;
+}
+
+Log::Stats Log::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats s;
+    s.records = records_;
+    s.bytes = appended_;
+    s.syncs = syncs_;
+    s.segment = current_;
+    return s;
+}
+
+long long Log::replay(const std::string& path,
+                      const std::function<void(RecordType, const uint8_t*, size_t)>& apply, bool& torn) {
+    torn = false;
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) return -1;
+    std::vector<uint8_t> data;
+    uint8_t chunk[1 << 16];
+    size_t got;
+    while ((got = std::fread(chunk, 1, sizeof(chunk), f)) > 0) data.insert(data.end(), chunk, chunk + got);
+    std::fclose(f);
+
+    if (data.size() < SEGMENT_HEADER || std::memcmp(data.data(), SEGMENT_MAGIC, 4) != 0 ||
+        proto::loadBE16(data.data() + 4) != SEGMENT_VERSION) {
+        return -1;
+    }
+
+    long long count = 0;
+    size_t off = SEGMENT_HEADER;
+    while (off < data.size()) {
+        if (data.size() - off < RECORD_HEADER) {
+            torn = true;
+            break;
+        }
+        uint32_t len = proto::loadBE32(data.data() + off);
+        uint32_t crc = proto::loadBE32(data.data() + off + 4);
+        const uint8_t* rec = data.data() + off + RECORD_HEADER;
+        if (len == 0 || len > data.size() - off - RECORD_HEADER || crc32(rec, len) != crc) {
+            torn = true;
+            break;
+        }
+        apply(RecordType(rec[0]), rec + 1, len - 1);
+        count++;
+        off += RECORD_HEADER + len;
+    }
+    return count;
+}
+
+} // namespace wal
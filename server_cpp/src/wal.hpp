@@ -0,0 +1,193 @@
+#pragma once
+
+#include "schema.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Write-ahead log of applied account changes
+ *
+ * The AccountStore appends one record per successful OPEN, CLOSE,
+ * DEPOSIT, WITHDRAW or TRANSFER while it still holds the account's shard
+ * lock, so the log order of any one account is the order its changes were
+ * applied in. Records carry resulting balances rather than amounts, which
+ * makes replaying a record that a snapshot already contains harmless.
+ *
+ * Group commit: append() only copies the record into a memory buffer.
+ * A worker calls sync() once per received batch, before sending replies;
+ * the first caller writes and fsyncs everything buffered by all workers
+ * while later callers wait for that flush, so one fsync covers many
+ * requests and no reply is sent for a change that is not on disk.
+ *
+ * A record that does not fit MAX_RECORD is never dropped silently: it
+ * fails the log like a write error would, so the change is not
+ * acknowledged. AccountStore::open checks openFits() first, which makes
+ * this unreachable for well-formed input.
+ *
+ * A failed write or fsync fails the log for good: nothing more is written
+ * (a record behind a torn one would be lost on recovery anyway) and every
+ * sync() from then on returns false.
+ *
+ * On disk the log is a numbered series of segments, dir/wal-NNNNNNNN.log,
+ * each an 8-byte header followed by records:
+ *   len:u32  crc:u32  type:u8  body (a schema layout, big-endian)
+ * len counts type and body, crc covers them. A new segment is started
+ * when the current one passes Config::segmentBytes or on rotate(); a
+ * server never appends to a segment it did not create.
+ */
+namespace wal {
+
+// Record types share the opcode numbers of the operations they log
+enum class RecordType : uint8_t {
+    Open = 1,
+    Close = 2,
+    Deposit = 3,
+    Withdraw = 4,
+    Transfer = 7
+};
+
+using proto::schema::F64;
+using proto::schema::I32;
+using proto::schema::Layout;
+using proto::schema::Str;
+using proto::schema::U16;
+
+using OpenRecord = Layout<I32, Str, Str, U16, F64>;  // accNo, name, password, currency, balance
+using CloseRecord = Layout<I32>;                     // accNo
+using BalanceRecord = Layout<I32, F64>;              // DEPOSIT, WITHDRAW: accNo, new balance
+using TransferRecord = Layout<I32, F64, I32, F64>;   // from, from balance, to, to balance
+
+constexpr size_t RECORD_HEADER = 8;
+// Type byte and the largest OPEN a request datagram can carry
+constexpr size_t MAX_RECORD = 1 + OpenRecord::MIN_SIZE + proto::MAX_DATAGRAM;
+
+// An OPEN of this name and password can be logged (AccountStore::open refuses the rest)
+inline bool openFits(std::string_view name, std::string_view password) {
+    return name.size() <= 0xFFFF && password.size() <= 0xFFFF &&
+           1 + OpenRecord::size(int32_t(0), name, password, uint16_t(0), 0.0) <= MAX_RECORD;
+}
+
+// ==================== Files ====================
+// Thin layer over the C runtime, shared with the snapshot writer
+
+using File = int;
+constexpr File INVALID_FILE = -1;
+
+File createFile(const std::string& path);  // truncates
+void closeFile(File f);
+bool writeAll(File f, const uint8_t* p, size_t n);
+bool syncFile(File f);
+bool syncDir(const std::string& dir);      // make a rename or create durable (no-op on Windows)
+
+uint32_t crc32(const uint8_t* p, size_t n, uint32_t crc = 0);
+
+// ==================== Log ====================
+
+class Log {
+public:
+    struct Config {
+        std::string dir;
+        size_t segmentBytes = size_t(64) << 20;
+        bool fsync = true;  // false: write() only, durable against a process crash but not power loss
+    };
+
+    struct Stats {
+        uint64_t records = 0;
+        uint64_t bytes = 0;
+        uint64_t syncs = 0;   // group commits
+        uint32_t segment = 0; // current segment number
+    };
+
+    explicit Log(const Config& cfg);
+    ~Log();
+
+    Log(const Log&) = delete;
+    Log& operator=(const Log&) = delete;
+
+    /**
+     * Start appending to a new segment
+     * @param segment Its number; must be above every existing one
+     */
+    bool open(uint32_t segment);
+
+    // Flush what is buffered and close the segment
+    void close();
+
+    void logOpen(int32_t accNo, std::string_view name, std::string_view password, uint16_t currency,
+                 double balance);
+    void logClose(int32_t accNo);
+    void logBalance(RecordType type, int32_t accNo, double balance);
+    void logTransfer(int32_t fromAccNo, double fromBalance, int32_t toAccNo, double toBalance);
+
+    /**
+     * Block until every record appended so far is durable
+     * @return false if the log has failed; the records may not be on disk
+     */
+    bool sync();
+
+    // A write or fsync failed; nothing is written any more
+    bool failed() const;
+
+    /**
+     * Flush and continue in a new segment; records appended after this
+     * returns land in the new segment
+     * @return the new segment number
+     */
+    uint32_t rotate();
+
+    Stats stats() const;
+
+    static std::string segmentPath(const std::string& dir, uint32_t segment);
+
+    // Segment numbers present in dir, ascending
+    static std::vector<uint32_t> listSegments(const std::string& dir);
+
+    /**
+     * Read one segment, calling apply(type, body, len) for every intact
+     * record
+     * @param torn Output: true if the segment ends in a partial or corrupt
+     *             record (the tail of a crash); reading stops there
+     * @return records read, or -1 if the file is missing or not a segment
+     */
+    static long long replay(const std::string& path,
+                            const std::function<void(RecordType, const uint8_t*, size_t)>& apply,
+                            bool& torn);
+
+private:
+    Config cfg_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable flushed_;
+    std::vector<uint8_t> pending_;  // appended, not yet written
+    std::vector<uint8_t> spare_;    // the other half of the double buffer
+    uint64_t appended_;             // bytes appended since open
+    uint64_t durable_;              // bytes written (and synced)
+    uint64_t records_;
+    uint64_t syncs_;
+    uint32_t current_;              // segment_, as of the last flush
+    bool flushing_;
+
+    // Owned by whichever thread has flushing_ set
+    File file_;
+    uint32_t segment_;
+    size_t segmentSize_;
+    bool failed_;  // set under mutex_, once
+
+    template <class L, class... A>
+    void append(RecordType type, const A&... v);
+
+    /**
+     * Write out pending_ as the flushing thread
+     * @param nextSegment Continue in a new segment afterwards (0 = only if full)
+     */
+    void flush(std::unique_lock<std::mutex>& lock, uint32_t nextSegment);
+    bool openSegment(uint32_t segment);
+};
+
+} // namespace wal
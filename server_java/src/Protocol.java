@@ -28,10 +28,13 @@ public class Protocol {
     public static final short OP_MONITOR_REGISTER = 5;  // Monitor register
     public static final short OP_QUERY_BALANCE = 6;     // Query balance (idempotent)
     public static final short OP_TRANSFER = 7;          // Transfer (non-idempotent)
+    public static final short OP_BATCH = 8;             // Several sub-operations in one datagram
     public static final short OP_CALLBACK_UPDATE = 100; // Callback notification
+    public static final short OP_CALLBACK_BATCH = 101;  // Several callback notifications (native server)
 
     // Flags
     public static final short FLAG_AT_MOST_ONCE = 0x0001;
+    public static final short FLAG_SEQ_ID = 0x0002;  // sequenced requestId (used by server_cpp only)
 
     // Status codes
     public static final short STATUS_OK = 0;
@@ -49,6 +52,38 @@ public class Protocol {
     // Header size in bytes
     public static final int HEADER_SIZE = 24;
 
+    /*
+     * Body layouts (str = len:2 + UTF-8 bytes, pw = 16 bytes zero padded)
+     *                       fields                                       fixed bytes
+     *   OPEN request        name:str pw currency:2 initialBalance:8      28 + name
+     *   CLOSE, QUERY_BALANCE name:str accNo:4 pw                         22 + name
+     *   DEPOSIT, WITHDRAW   name:str accNo:4 pw currency:2 amount:8      32 + name
+     *   TRANSFER request    name:str from:4 pw to:4 currency:2 amount:8  36 + name
+     *   MONITOR_REGISTER    seconds:2                                    2
+     *     optional tail     options:2 count:2 count x accNo:4            4 + 4 x count
+     *   OPEN reply          accNo:4 balance:8                            12
+     *   CLOSE/MONITOR reply message:str                                  2 + message
+     *   DEPOSIT/WITHDRAW    balance:8                                    8
+     *   QUERY_BALANCE reply currency:2 balance:8                         10
+     *   TRANSFER reply      fromBalance:8 toBalance:8                    16
+     *   CALLBACK_UPDATE     updateType:2 accNo:4 currency:2 balance:8 info:str  18 + info
+     *   CALLBACK_BATCH      count:2, then count x { CALLBACK_UPDATE body }
+     * This server reads only seconds; the MONITOR_REGISTER tail (account
+     * filter, batched delivery) and CALLBACK_BATCH are served by server_cpp.
+     * client_cpp/src/schema.hpp declares the same layouts and checks these
+     * sizes at compile time.
+     */
+
+    /*
+     * BATCH body layout
+     *   request: count:2, then count x { opCode:2 + subId:2 + bodyLen:2 + body }
+     *   reply:   count:2, then count x { opCode:2 + subId:2 + status:2 + bodyLen:2 + body }
+     * Sub-operations run in order and independently; BATCH and MONITOR_REGISTER
+     * cannot be nested. The batch as a whole is deduplicated under at-most-once.
+     */
+    public static final int BATCH_ENTRY_HEADER = 6;
+    public static final int BATCH_REPLY_ENTRY_HEADER = 8;
+
     /**
      * Message structure for request/reply/callback
      */
@@ -189,7 +224,9 @@ public class Protocol {
             case OP_MONITOR_REGISTER: return "MONITOR_REGISTER";
             case OP_QUERY_BALANCE: return "QUERY_BALANCE";
             case OP_TRANSFER: return "TRANSFER";
+            case OP_BATCH: return "BATCH";
             case OP_CALLBACK_UPDATE: return "CALLBACK_UPDATE";
+            case OP_CALLBACK_BATCH: return "CALLBACK_BATCH";
             default: return "UNKNOWN_OP(" + op + ")";
         }
     }
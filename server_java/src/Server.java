@@ -157,33 +157,14 @@ public class Server {
 
         try {
             ByteBuffer bb = ByteBuffer.wrap(req.body).order(ByteOrder.BIG_ENDIAN);
-            ByteBuffer repBody = ByteBuffer.allocate(1024).order(ByteOrder.BIG_ENDIAN);
-
-            switch (req.opCode) {
-                case Protocol.OP_OPEN:
-                    handleOpen(bb, repBody, rep);
-                    break;
-                case Protocol.OP_CLOSE:
-                    handleClose(bb, repBody, rep);
-                    break;
-                case Protocol.OP_DEPOSIT:
-                    handleDeposit(bb, repBody, rep);
-                    break;
-                case Protocol.OP_WITHDRAW:
-                    handleWithdraw(bb, repBody, rep);
-                    break;
-                case Protocol.OP_QUERY_BALANCE:
-                    handleQueryBalance(bb, repBody, rep);
-                    break;
-                case Protocol.OP_TRANSFER:
-                    handleTransfer(bb, repBody, rep);
-                    break;
-                case Protocol.OP_MONITOR_REGISTER:
-                    handleMonitorRegister(bb, repBody, rep, clientAddr, clientPort);
-                    break;
-                default:
-                    rep.status = Protocol.STATUS_ERR_BAD_REQUEST;
-                    break;
+            // A batch reply entry is at most 2 bytes longer than its request entry
+            int repCap = req.opCode == Protocol.OP_BATCH ? Math.max(1024, req.body.length * 2) : 1024;
+            ByteBuffer repBody = ByteBuffer.allocate(repCap).order(ByteOrder.BIG_ENDIAN);
+
+            if (req.opCode == Protocol.OP_BATCH) {
+                handleBatch(bb, repBody, rep, clientAddr, clientPort);
+            } else {
+                dispatch(req.opCode, bb, repBody, rep, clientAddr, clientPort);
             }
 
             // Copy body to reply
@@ -198,6 +179,104 @@ public class Server {
         return rep;
     }
 
+    /**
+     * Run a single (non-batch) operation; handlers set rep.status on failure
+     */
+    private void dispatch(short opCode, ByteBuffer bb, ByteBuffer repBody, Protocol.Message rep,
+                          InetAddress clientAddr, int clientPort) {
+        switch (opCode) {
+            case Protocol.OP_OPEN:
+                handleOpen(bb, repBody, rep);
+                break;
+            case Protocol.OP_CLOSE:
+                handleClose(bb, repBody, rep);
+                break;
+            case Protocol.OP_DEPOSIT:
+                handleDeposit(bb, repBody, rep);
+                break;
+            case Protocol.OP_WITHDRAW:
+                handleWithdraw(bb, repBody, rep);
+                break;
+            case Protocol.OP_QUERY_BALANCE:
+                handleQueryBalance(bb, repBody, rep);
+                break;
+            case Protocol.OP_TRANSFER:
+                handleTransfer(bb, repBody, rep);
+                break;
+            case Protocol.OP_MONITOR_REGISTER:
+                handleMonitorRegister(bb, repBody, rep, clientAddr, clientPort);
+                break;
+            default:
+                rep.status = Protocol.STATUS_ERR_BAD_REQUEST;
+                break;
+        }
+    }
+
+    /**
+     * Run every sub-operation of a BATCH request and collect their replies.
+     * Each entry gets its own status; a malformed entry list fails the whole
+     * batch, and is detected before any entry runs.
+     */
+    private void handleBatch(ByteBuffer bb, ByteBuffer repBody, Protocol.Message rep,
+                             InetAddress clientAddr, int clientPort) {
+        int count = Short.toUnsignedInt(bb.getShort());
+        checkBatchFraming(bb.duplicate(), count);
+        repBody.putShort((short) count);
+
+        for (int i = 0; i < count; i++) {
+            short subOp = bb.getShort();
+            short subId = bb.getShort();
+            int subLen = Short.toUnsignedInt(bb.getShort());
+            if (subLen > bb.remaining()) {
+                throw new IllegalArgumentException("batch entry " + i + " truncated");
+            }
+            ByteBuffer subReq = bb.slice().order(ByteOrder.BIG_ENDIAN);
+            subReq.limit(subLen);
+            bb.position(bb.position() + subLen);
+
+            Protocol.Message subRep = new Protocol.Message();
+            subRep.status = Protocol.STATUS_OK;
+            ByteBuffer subBody = ByteBuffer.allocate(1024).order(ByteOrder.BIG_ENDIAN);
+
+            if (subOp == Protocol.OP_BATCH || subOp == Protocol.OP_MONITOR_REGISTER) {
+                subRep.status = Protocol.STATUS_ERR_BAD_REQUEST;
+            } else {
+                try {
+                    dispatch(subOp, subReq, subBody, subRep, clientAddr, clientPort);
+                } catch (Exception e) {
+                    subRep.status = Protocol.STATUS_ERR_BAD_REQUEST;
+                    subBody.clear();
+                }
+            }
+
+            repBody.putShort(subOp);
+            repBody.putShort(subId);
+            repBody.putShort(subRep.status);
+            repBody.putShort((short) subBody.position());
+            repBody.put(subBody.array(), 0, subBody.position());
+        }
+
+        System.out.println("[server] BATCH: " + count + " operations");
+    }
+
+    /**
+     * Walk the entry headers of a BATCH without running anything
+     * @throws IllegalArgumentException if an entry header or body runs past the request
+     */
+    private static void checkBatchFraming(ByteBuffer bb, int count) {
+        for (int i = 0; i < count; i++) {
+            if (bb.remaining() < 6) {
+                throw new IllegalArgumentException("batch entry " + i + " truncated");
+            }
+            bb.position(bb.position() + 4);  // subOp, subId
+            int subLen = Short.toUnsignedInt(bb.getShort());
+            if (subLen > bb.remaining()) {
+                throw new IllegalArgumentException("batch entry " + i + " truncated");
+            }
+            bb.position(bb.position() + subLen);
+        }
+    }
+
     // ==================== Operation handlers ====================
 
     private void handleOpen(ByteBuffer bb, ByteBuffer repBody, Protocol.Message rep) {